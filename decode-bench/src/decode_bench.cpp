@@ -0,0 +1,333 @@
+// Headless decode-throughput benchmark.
+// Drives init_ffmpeg()/get_next_frame()/cleanup_ffmpeg() from decode_video.cpp as fast as
+// possible (no GL, no wall-clock pacing) and reports throughput and per-frame latency as JSON.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "decode_video.h"
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+}
+
+struct BenchResult {
+    std::string file;
+    int width = 0;
+    int height = 0;
+    long long frames = 0;
+    double seconds = 0.0;
+    double decoded_bytes = 0.0;
+    std::vector<double> latencies_ms; // One entry per decoded frame
+};
+
+struct SyntheticClip {
+    int width;
+    int height;
+    int frames;
+    int fps;
+};
+
+static double percentile(std::vector<double>& sorted_values, double p) {
+    if (sorted_values.empty()) {
+        return 0.0;
+    }
+    // Nearest-rank percentile on an already sorted vector
+    size_t rank = (size_t)(p / 100.0 * (sorted_values.size() - 1) + 0.5);
+    return sorted_values[std::min(rank, sorted_values.size() - 1)];
+}
+
+// Decodes a whole file with no pacing, timing every get_next_frame() call.
+static int bench_file(const char* path, int max_frames, BenchResult* result) {
+    AVFrame* frame = nullptr;
+    double frame_delay = 0.0;
+    double pts = 0.0;
+
+    result->file = path;
+    int ret = init_ffmpeg(path, &result->width, &result->height, &frame_delay, &frame);
+    if (ret < 0) {
+        av_frame_free(&frame);
+        cleanup_ffmpeg();
+        return ret;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    while (max_frames <= 0 || result->frames < max_frames) {
+        auto before = std::chrono::steady_clock::now();
+        ret = get_next_frame(&frame, &pts);
+        auto after = std::chrono::steady_clock::now();
+        if (ret < 0) {
+            break;
+        }
+
+        result->latencies_ms.push_back(std::chrono::duration<double, std::milli>(after - before).count());
+        result->decoded_bytes += av_image_get_buffer_size((AVPixelFormat)frame->format, frame->width, frame->height, 1);
+        result->frames++;
+    }
+    result->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    av_frame_free(&frame);
+    cleanup_ffmpeg();
+    return (ret < 0 && ret != AVERROR_EOF) ? ret : 0;
+}
+
+// Renders a libavfilter test source (testsrc2) and encodes it into a local file, so the
+// benchmark has deterministic input on machines that have no sample media.
+static int generate_synthetic_clip(const SyntheticClip& clip, const char* encoder_name, const char* out_path) {
+    AVFilterGraph* graph = nullptr;
+    AVFilterContext* src_ctx = nullptr;
+    AVFilterContext* sink_ctx = nullptr;
+    AVFormatContext* out_ctx = nullptr;
+    AVCodecContext* enc_ctx = nullptr;
+    AVStream* stream = nullptr;
+    AVFrame* frame = av_frame_alloc();
+    AVPacket* pkt = av_packet_alloc();
+    char args[256];
+    int ret;
+
+    const AVCodec* encoder = avcodec_find_encoder_by_name(encoder_name);
+    if (!encoder) {
+        fprintf(stderr, "Encoder not found: %s\n", encoder_name);
+        ret = AVERROR_ENCODER_NOT_FOUND;
+        goto end;
+    }
+
+    // 1. Filter graph: testsrc2 -> buffersink (yuv420p)
+    graph = avfilter_graph_alloc();
+    snprintf(args, sizeof(args), "size=%dx%d:rate=%d:duration=%f",
+        clip.width, clip.height, clip.fps, (double)clip.frames / clip.fps);
+    ret = avfilter_graph_create_filter(&src_ctx, avfilter_get_by_name("testsrc2"), "src", args, nullptr, graph);
+    if (ret < 0) goto end;
+    ret = avfilter_graph_create_filter(&sink_ctx, avfilter_get_by_name("buffersink"), "sink", nullptr, nullptr, graph);
+    if (ret < 0) goto end;
+    {
+        AVFilterContext* fmt_ctx = nullptr;
+        ret = avfilter_graph_create_filter(&fmt_ctx, avfilter_get_by_name("format"), "fmt", "pix_fmts=yuv420p", nullptr, graph);
+        if (ret < 0) goto end;
+        if ((ret = avfilter_link(src_ctx, 0, fmt_ctx, 0)) < 0) goto end;
+        if ((ret = avfilter_link(fmt_ctx, 0, sink_ctx, 0)) < 0) goto end;
+    }
+    ret = avfilter_graph_config(graph, nullptr);
+    if (ret < 0) goto end;
+
+    // 2. Encoder + muxer
+    ret = avformat_alloc_output_context2(&out_ctx, nullptr, nullptr, out_path);
+    if (ret < 0) goto end;
+
+    enc_ctx = avcodec_alloc_context3(encoder);
+    enc_ctx->width = clip.width;
+    enc_ctx->height = clip.height;
+    enc_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc_ctx->time_base = av_make_q(1, clip.fps);
+    enc_ctx->framerate = av_make_q(clip.fps, 1);
+    enc_ctx->gop_size = clip.fps * 2;
+    enc_ctx->max_b_frames = 2;
+    enc_ctx->bit_rate = (int64_t)clip.width * clip.height * clip.fps / 8;
+    if (out_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+        enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    ret = avcodec_open2(enc_ctx, encoder, nullptr);
+    if (ret < 0) goto end;
+
+    stream = avformat_new_stream(out_ctx, nullptr);
+    stream->time_base = enc_ctx->time_base;
+    avcodec_parameters_from_context(stream->codecpar, enc_ctx);
+
+    if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&out_ctx->pb, out_path, AVIO_FLAG_WRITE);
+        if (ret < 0) goto end;
+    }
+    ret = avformat_write_header(out_ctx, nullptr);
+    if (ret < 0) goto end;
+
+    // 3. Pull frames from the graph, encode, mux; a null frame flushes the encoder
+    while (true) {
+        ret = av_buffersink_get_frame(sink_ctx, frame);
+        bool flushing = (ret == AVERROR_EOF);
+        if (ret < 0 && !flushing) goto end;
+
+        ret = avcodec_send_frame(enc_ctx, flushing ? nullptr : frame);
+        av_frame_unref(frame);
+        if (ret < 0) goto end;
+
+        while ((ret = avcodec_receive_packet(enc_ctx, pkt)) == 0) {
+            av_packet_rescale_ts(pkt, enc_ctx->time_base, stream->time_base);
+            pkt->stream_index = stream->index;
+            ret = av_interleaved_write_frame(out_ctx, pkt);
+            if (ret < 0) goto end;
+        }
+        if (ret == AVERROR_EOF) break;
+        if (ret != AVERROR(EAGAIN)) goto end;
+    }
+    ret = av_write_trailer(out_ctx);
+
+end:
+    if (ret < 0) {
+        fprintf(stderr, "Failed to generate synthetic clip %s\n", out_path);
+        print_ffmpeerr(ret);
+    }
+    if (out_ctx && !(out_ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&out_ctx->pb);
+    }
+    avformat_free_context(out_ctx);
+    avcodec_free_context(&enc_ctx);
+    avfilter_graph_free(&graph);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    return ret < 0 ? ret : 0;
+}
+
+static void write_json(FILE* out, const std::vector<BenchResult>& results, const DecoderOptions& options) {
+    fprintf(out, "{\n  \"requested_decoder_threads\": %d,\n  \"results\": [\n", options.thread_count);
+    for (size_t i = 0; i < results.size(); i++) {
+        BenchResult r = results[i];
+        std::sort(r.latencies_ms.begin(), r.latencies_ms.end());
+        double fps = r.seconds > 0.0 ? r.frames / r.seconds : 0.0;
+        double mbps = r.seconds > 0.0 ? r.decoded_bytes / (1024.0 * 1024.0) / r.seconds : 0.0;
+
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"file\": \"");
+        // Escape the path (Windows backslashes, quotes) so the output stays valid JSON
+        for (const char* c = r.file.c_str(); *c; c++) {
+            if (*c == '\\' || *c == '"') fputc('\\', out);
+            fputc(*c, out);
+        }
+        fprintf(out, "\",\n");
+        fprintf(out, "      \"width\": %d,\n      \"height\": %d,\n", r.width, r.height);
+        fprintf(out, "      \"frames\": %lld,\n      \"seconds\": %.6f,\n", r.frames, r.seconds);
+        fprintf(out, "      \"fps\": %.2f,\n      \"decoded_mb_per_sec\": %.2f,\n", fps, mbps);
+        fprintf(out, "      \"latency_ms\": { \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f }\n",
+            percentile(r.latencies_ms, 50), percentile(r.latencies_ms, 95), percentile(r.latencies_ms, 99),
+            r.latencies_ms.empty() ? 0.0 : r.latencies_ms.back());
+        fprintf(out, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void print_usage(const char* prog) {
+    fprintf(stdout, "Usage: %s [options] [files...]\n", prog);
+    fprintf(stdout, "  --synthetic WxH:N   generate an N-frame testsrc2 clip of size WxH and bench it (repeatable)\n");
+    fprintf(stdout, "  --encoder NAME      encoder for synthetic clips (default mpeg4)\n");
+    fprintf(stdout, "  --fps N             frame rate of synthetic clips (default 30)\n");
+    fprintf(stdout, "  --max-frames N      stop each file after N frames (default: whole file)\n");
+    fprintf(stdout, "  --threads N|auto    decoder threads (default auto)\n");
+    fprintf(stdout, "  --thread-type T     auto, frame, slice, none or codec=T\n");
+    fprintf(stdout, "  --io MODE           file reads: default (FFmpeg), readahead (prefetch thread) or mmap\n");
+    fprintf(stdout, "  --read-ahead-mb N   read-ahead ring / page-in window (default %d)\n", DEFAULT_READ_AHEAD_MB);
+    fprintf(stdout, "  --json FILE         write the JSON report to FILE (default decode_bench.json, - for stdout)\n");
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> files;
+    std::vector<SyntheticClip> synthetic;
+    const char* encoder_name = "mpeg4";
+    const char* json_path = "decode_bench.json";
+    int synthetic_fps = 30;
+    int max_frames = 0;
+    DecoderOptions decoder_options = default_decoder_options();
+
+    // Parse command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+            SyntheticClip clip;
+            if (sscanf(argv[++i], "%dx%d:%d", &clip.width, &clip.height, &clip.frames) != 3) {
+                fprintf(stderr, "Invalid --synthetic value: %s\n", argv[i]);
+                return -1;
+            }
+            synthetic.push_back(clip);
+        }
+        else if (strcmp(argv[i], "--encoder") == 0 && i + 1 < argc) {
+            encoder_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            synthetic_fps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-frames") == 0 && i + 1 < argc) {
+            max_frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            const char* value = argv[++i];
+            decoder_options.thread_count = strcmp(value, "auto") == 0 ? 0 : atoi(value);
+        }
+        else if (strcmp(argv[i], "--thread-type") == 0 && i + 1 < argc) {
+            if (add_decoder_thread_type_arg(&decoder_options, argv[++i]) < 0) {
+                fprintf(stderr, "Unknown thread type: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            if (parse_read_ahead_mode(argv[++i], &decoder_options.read_ahead) < 0) {
+                fprintf(stderr, "Unknown I/O mode: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--read-ahead-mb") == 0 && i + 1 < argc) {
+            decoder_options.read_ahead_mb = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        }
+        else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return -1;
+        }
+        else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    for (size_t i = 0; i < synthetic.size(); i++) {
+        synthetic[i].fps = synthetic_fps;
+        char path[256];
+        snprintf(path, sizeof(path), "synthetic_%dx%d_%d_%s.mkv",
+            synthetic[i].width, synthetic[i].height, synthetic[i].frames, encoder_name);
+        fprintf(stderr, "Generating %s\n", path);
+        if (generate_synthetic_clip(synthetic[i], encoder_name, path) < 0) {
+            return -1;
+        }
+        files.push_back(path);
+    }
+
+    if (files.empty()) {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    set_decoder_options(decoder_options);
+
+    std::vector<BenchResult> results;
+    for (size_t i = 0; i < files.size(); i++) {
+        BenchResult result;
+        if (bench_file(files[i].c_str(), max_frames, &result) < 0) {
+            fprintf(stderr, "Decode failed: %s\n", files[i].c_str());
+            return -1;
+        }
+        fprintf(stderr, "%s: %lld frames in %.3fs (%.1f fps)\n", files[i].c_str(), result.frames, result.seconds,
+            result.seconds > 0.0 ? result.frames / result.seconds : 0.0);
+        results.push_back(result);
+    }
+
+    FILE* out = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+    if (!out) {
+        fprintf(stderr, "Could not open %s for writing\n", json_path);
+        return -1;
+    }
+    write_json(out, results, decoder_options);
+    if (out != stdout) {
+        fclose(out);
+        fprintf(stderr, "Wrote %s\n", json_path);
+    }
+    return 0;
+}
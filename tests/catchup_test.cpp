@@ -0,0 +1,88 @@
+// Catch-up controller on a simulated clock: escalation under a steady lag, no overshoot once the
+// lag clears, and recovery from keyframes-only decoding within a bounded time.
+// Exits with 0 when every check passes.
+
+#include <stdio.h>
+
+extern "C" {
+#include<libavcodec/avcodec.h>
+}
+
+#include "catchup.h"
+
+static const double FRAME_DURATION = 1.0 / 30.0;
+// Keyframe interval: at level 4 only these are decoded and presented
+static const double GOP_SECONDS = 2.0;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    fprintf(stdout, "%s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+// Plays `seconds` of video: each presented frame is reported `lateness(level)` late and followed by a
+// decode. Frames come every FRAME_DURATION, or every GOP_SECONDS at the keyframes-only level.
+// Returns the simulated time at which the level first reached `stop_level` (-1: never).
+static double play(CatchUpController* c, AVCodecContext* ctx, double* now, double seconds,
+    double (*lateness)(int level), int stop_level, int* max_level) {
+    double end = *now + seconds;
+    while (*now < end) {
+        *now += c->level >= CATCHUP_MAX_LEVEL ? GOP_SECONDS : FRAME_DURATION;
+        catchup_report_lateness_at(c, lateness(c->level), *now);
+        int level = catchup_update_at(c, ctx, *now);
+        if (level > *max_level) {
+            *max_level = level;
+        }
+        if (level == stop_level) {
+            return *now;
+        }
+    }
+    return -1.0;
+}
+
+static double always_late(int) {
+    return 0.2;
+}
+
+static double late_below_level_2(int level) {
+    return level >= 2 ? 0.0 : 0.2;
+}
+
+static double on_time(int) {
+    return 0.0;
+}
+
+int main() {
+    AVCodecContext* ctx = avcodec_alloc_context3(nullptr);
+    if (!ctx) {
+        return 1;
+    }
+
+    // A steady lag climbs all the way to keyframes only
+    CatchUpController c;
+    catchup_init(&c, FRAME_DURATION);
+    double now = c.last_update;
+    int max_level = 0;
+    double start = now;
+    double reached = play(&c, ctx, &now, 10.0, always_late, CATCHUP_MAX_LEVEL, &max_level);
+    check(reached >= 0.0, "a steady 200 ms lag reaches level 4");
+
+    // From there, on-time keyframes bring it back to full decoding within a few hold periods
+    start = now;
+    double recovered = play(&c, ctx, &now, 30.0, on_time, 0, &max_level);
+    fprintf(stdout, "  level 4 -> 0 in %.1f s\n", recovered >= 0.0 ? recovered - start : now - start);
+    check(recovered >= 0.0 && recovered - start <= 12.0, "recovers from level 4 within 12 s");
+
+    // A lag that level 2 cures stops the escalation there
+    catchup_init(&c, FRAME_DURATION);
+    now = c.last_update;
+    max_level = 0;
+    play(&c, ctx, &now, 10.0, late_below_level_2, -1, &max_level);
+    check(max_level == 2, "escalation stops at the level that clears the lag");
+
+    avcodec_free_context(&ctx);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+#include "audio_sink.h"
+
+int parse_audio_sink_type(const char* name, AudioSinkType* out) {
+    if (strcmp(name, "device") == 0) *out = AUDIO_SINK_DEVICE;
+    else if (strcmp(name, "null") == 0) *out = AUDIO_SINK_NULL;
+    else if (strcmp(name, "wav") == 0) *out = AUDIO_SINK_WAV;
+    else return -1;
+    return 0;
+}
+
+// --- Null / WAV sink ---
+// Consumes samples at the sample rate measured on the system clock, exactly like a device
+// would: the clock stops when the sink runs dry and while it is paused.
+
+struct NullSinkState {
+    std::mutex mutex;
+    int64_t written_frames;
+    double played_frames;
+    std::chrono::steady_clock::time_point last_update;
+    bool paused;
+
+    FILE* wav;
+    uint32_t wav_data_bytes;
+};
+
+// Caller holds the mutex.
+static void null_sink_advance(AudioSink* sink, NullSinkState* s) {
+    auto now = std::chrono::steady_clock::now();
+    if (!s->paused) {
+        s->played_frames += std::chrono::duration<double>(now - s->last_update).count() * sink->sample_rate;
+        if (s->played_frames > (double)s->written_frames) {
+            s->played_frames = (double)s->written_frames; // Underrun: nothing left to play
+        }
+    }
+    s->last_update = now;
+}
+
+static int null_sink_write(AudioSink* sink, const int16_t* samples, int frames) {
+    NullSinkState* s = (NullSinkState*)sink->priv;
+    std::lock_guard<std::mutex> lock(s->mutex);
+    null_sink_advance(sink, s);
+    s->written_frames += frames;
+
+    if (s->wav) {
+        size_t count = (size_t)frames * sink->channels;
+        if (fwrite(samples, sizeof(int16_t), count, s->wav) != count) {
+            fprintf(stderr, "Audio: WAV write failed, closing the file\n");
+            fclose(s->wav);
+            s->wav = nullptr;
+            return -1;
+        }
+        s->wav_data_bytes += (uint32_t)(count * sizeof(int16_t));
+    }
+    return 0;
+}
+
+static double null_sink_buffered(AudioSink* sink) {
+    NullSinkState* s = (NullSinkState*)sink->priv;
+    std::lock_guard<std::mutex> lock(s->mutex);
+    null_sink_advance(sink, s);
+    return (s->written_frames - s->played_frames) / sink->sample_rate;
+}
+
+static void null_sink_pause(AudioSink* sink, bool paused) {
+    NullSinkState* s = (NullSinkState*)sink->priv;
+    std::lock_guard<std::mutex> lock(s->mutex);
+    null_sink_advance(sink, s);
+    s->paused = paused;
+}
+
+static void null_sink_flush(AudioSink* sink) {
+    NullSinkState* s = (NullSinkState*)sink->priv;
+    std::lock_guard<std::mutex> lock(s->mutex);
+    null_sink_advance(sink, s);
+    s->played_frames = (double)s->written_frames;
+}
+
+static void write_le16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static void write_le32(uint8_t* p, uint32_t v) { write_le16(p, (uint16_t)v); write_le16(p + 2, (uint16_t)(v >> 16)); }
+
+// 44-byte canonical PCM header; the sizes are patched in when the file is closed
+static void write_wav_header(FILE* f, int sample_rate, int channels, uint32_t data_bytes) {
+    uint8_t h[44];
+    memcpy(h, "RIFF", 4);
+    write_le32(h + 4, 36 + data_bytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    write_le32(h + 16, 16);
+    write_le16(h + 20, 1); // PCM
+    write_le16(h + 22, (uint16_t)channels);
+    write_le32(h + 24, (uint32_t)sample_rate);
+    write_le32(h + 28, (uint32_t)(sample_rate * channels * 2));
+    write_le16(h + 32, (uint16_t)(channels * 2));
+    write_le16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    write_le32(h + 40, data_bytes);
+    fwrite(h, 1, sizeof(h), f);
+}
+
+static void null_sink_close(AudioSink* sink) {
+    NullSinkState* s = (NullSinkState*)sink->priv;
+    if (s->wav) {
+        fseek(s->wav, 0, SEEK_SET);
+        write_wav_header(s->wav, sink->sample_rate, sink->channels, s->wav_data_bytes);
+        fclose(s->wav);
+    }
+    delete s;
+}
+
+static bool open_null_sink(AudioSink* sink, const char* wav_path) {
+    NullSinkState* s = new NullSinkState();
+    s->written_frames = 0;
+    s->played_frames = 0.0;
+    s->last_update = std::chrono::steady_clock::now();
+    s->paused = false;
+    s->wav = nullptr;
+    s->wav_data_bytes = 0;
+
+    if (wav_path) {
+        s->wav = fopen(wav_path, "wb");
+        if (!s->wav) {
+            fprintf(stderr, "Audio: could not create %s\n", wav_path);
+            delete s;
+            return false;
+        }
+        write_wav_header(s->wav, sink->sample_rate, sink->channels, 0);
+    }
+
+    sink->name = wav_path ? "wav" : "null";
+    sink->priv = s;
+    sink->write = null_sink_write;
+    sink->buffered = null_sink_buffered;
+    sink->pause = null_sink_pause;
+    sink->flush = null_sink_flush;
+    sink->close = null_sink_close;
+    return true;
+}
+
+// --- Device sink ---
+
+#ifdef _WIN32
+// waveOut plays a ring of fixed-size buffers; 16 x 2048 frames is ~0.7 s at 48 kHz, well
+// above the latency the audio thread keeps queued, so write() practically never waits.
+static const int WAVEOUT_BUFFER_COUNT = 16;
+static const int WAVEOUT_BUFFER_FRAMES = 2048;
+
+struct WaveOutState {
+    HWAVEOUT device;
+    WAVEHDR headers[WAVEOUT_BUFFER_COUNT];
+    std::vector<int16_t> buffers[WAVEOUT_BUFFER_COUNT];
+    int next;
+    int64_t written_frames; // Since open or the last flush; waveOut's position resets with it
+};
+
+static bool waveout_header_busy(const WAVEHDR* hdr) {
+    return (hdr->dwFlags & WHDR_PREPARED) && !(hdr->dwFlags & WHDR_DONE);
+}
+
+static int waveout_write(AudioSink* sink, const int16_t* samples, int frames) {
+    WaveOutState* s = (WaveOutState*)sink->priv;
+    while (frames > 0) {
+        WAVEHDR* hdr = &s->headers[s->next];
+        while (waveout_header_busy(hdr)) {
+            Sleep(1);
+        }
+        if (hdr->dwFlags & WHDR_PREPARED) {
+            waveOutUnprepareHeader(s->device, hdr, sizeof(WAVEHDR));
+        }
+
+        int chunk = frames < WAVEOUT_BUFFER_FRAMES ? frames : WAVEOUT_BUFFER_FRAMES;
+        std::vector<int16_t>& buffer = s->buffers[s->next];
+        memcpy(buffer.data(), samples, (size_t)chunk * sink->channels * sizeof(int16_t));
+
+        memset(hdr, 0, sizeof(WAVEHDR));
+        hdr->lpData = (LPSTR)buffer.data();
+        hdr->dwBufferLength = (DWORD)(chunk * sink->channels * sizeof(int16_t));
+        if (waveOutPrepareHeader(s->device, hdr, sizeof(WAVEHDR)) != MMSYSERR_NOERROR ||
+            waveOutWrite(s->device, hdr, sizeof(WAVEHDR)) != MMSYSERR_NOERROR) {
+            fprintf(stderr, "Audio: waveOutWrite failed\n");
+            return -1;
+        }
+
+        s->written_frames += chunk;
+        s->next = (s->next + 1) % WAVEOUT_BUFFER_COUNT;
+        samples += (size_t)chunk * sink->channels;
+        frames -= chunk;
+    }
+    return 0;
+}
+
+static double waveout_buffered(AudioSink* sink) {
+    WaveOutState* s = (WaveOutState*)sink->priv;
+    MMTIME position;
+    position.wType = TIME_SAMPLES;
+    if (waveOutGetPosition(s->device, &position, sizeof(position)) != MMSYSERR_NOERROR || position.wType != TIME_SAMPLES) {
+        return 0.0;
+    }
+    int64_t queued = s->written_frames - (int64_t)position.u.sample;
+    return queued > 0 ? (double)queued / sink->sample_rate : 0.0;
+}
+
+static void waveout_pause(AudioSink* sink, bool paused) {
+    WaveOutState* s = (WaveOutState*)sink->priv;
+    if (paused) waveOutPause(s->device);
+    else waveOutRestart(s->device);
+}
+
+// waveOutReset() returns every buffer and rewinds the position to 0
+static void waveout_reset(WaveOutState* s) {
+    waveOutReset(s->device);
+    for (int i = 0; i < WAVEOUT_BUFFER_COUNT; i++) {
+        if (s->headers[i].dwFlags & WHDR_PREPARED) {
+            waveOutUnprepareHeader(s->device, &s->headers[i], sizeof(WAVEHDR));
+        }
+        s->headers[i].dwFlags = 0;
+    }
+    s->written_frames = 0;
+}
+
+static void waveout_flush(AudioSink* sink) {
+    waveout_reset((WaveOutState*)sink->priv);
+}
+
+static void waveout_close(AudioSink* sink) {
+    WaveOutState* s = (WaveOutState*)sink->priv;
+    waveout_reset(s);
+    waveOutClose(s->device);
+    delete s;
+}
+
+static bool open_device_sink(AudioSink* sink) {
+    WAVEFORMATEX format;
+    memset(&format, 0, sizeof(format));
+    format.wFormatTag = WAVE_FORMAT_PCM;
+    format.nChannels = (WORD)sink->channels;
+    format.nSamplesPerSec = (DWORD)sink->sample_rate;
+    format.wBitsPerSample = 16;
+    format.nBlockAlign = (WORD)(sink->channels * 2);
+    format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+
+    WaveOutState* s = new WaveOutState();
+    if (waveOutOpen(&s->device, WAVE_MAPPER, &format, 0, 0, CALLBACK_NULL) != MMSYSERR_NOERROR) {
+        fprintf(stderr, "Audio: could not open the output device (%d Hz, %d ch)\n", sink->sample_rate, sink->channels);
+        delete s;
+        return false;
+    }
+    for (int i = 0; i < WAVEOUT_BUFFER_COUNT; i++) {
+        memset(&s->headers[i], 0, sizeof(WAVEHDR));
+        s->buffers[i].resize((size_t)WAVEOUT_BUFFER_FRAMES * sink->channels);
+    }
+    s->next = 0;
+    s->written_frames = 0;
+
+    sink->name = "device";
+    sink->priv = s;
+    sink->write = waveout_write;
+    sink->buffered = waveout_buffered;
+    sink->pause = waveout_pause;
+    sink->flush = waveout_flush;
+    sink->close = waveout_close;
+    return true;
+}
+#else
+static bool open_device_sink(AudioSink*) {
+    fprintf(stderr, "Audio: no output device backend on this platform\n");
+    return false;
+}
+#endif
+
+AudioSink* audio_sink_open(AudioSinkType type, const char* wav_path, int sample_rate, int channels) {
+    if (type == AUDIO_SINK_NONE) {
+        return nullptr;
+    }
+
+    AudioSink* sink = new AudioSink();
+    memset(sink, 0, sizeof(AudioSink));
+    sink->sample_rate = sample_rate;
+    sink->channels = channels;
+
+    bool ok = false;
+    switch (type) {
+    case AUDIO_SINK_DEVICE: ok = open_device_sink(sink); break;
+    case AUDIO_SINK_NULL: ok = open_null_sink(sink, nullptr); break;
+    case AUDIO_SINK_WAV: ok = open_null_sink(sink, wav_path); break;
+    default: break;
+    }
+    if (!ok) {
+        delete sink;
+        return nullptr;
+    }
+
+    fprintf(stdout, "Audio sink: %s, %d Hz, %d channel(s)\n", sink->name, sample_rate, channels);
+    return sink;
+}
+
+void audio_sink_close(AudioSink* sink) {
+    if (!sink) {
+        return;
+    }
+    sink->close(sink);
+    delete sink;
+}
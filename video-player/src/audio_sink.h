@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// Audio output. A sink consumes interleaved signed 16-bit PCM and reports how much of what it
+// was given has not been heard yet; the audio clock is derived from that.
+//
+// Implementations fill in the function pointers; callers only go through them.
+//   device: the default output device (waveOut on Windows)
+//   null:   discards samples but consumes them in real time, so the clock runs without hardware
+//   wav:    a null sink that also writes what it consumed to a WAV file
+
+enum AudioSinkType {
+    AUDIO_SINK_NONE = 0,   // Audio disabled
+    AUDIO_SINK_DEVICE,
+    AUDIO_SINK_NULL,
+    AUDIO_SINK_WAV
+};
+
+struct AudioSink {
+    const char* name;
+    int sample_rate;
+    int channels;
+    void* priv;
+
+    // Queues `frames` sample frames. Blocks only if the sink has no room at all.
+    int (*write)(AudioSink* sink, const int16_t* samples, int frames);
+    // Seconds of audio queued but not played yet
+    double (*buffered)(AudioSink* sink);
+    void (*pause)(AudioSink* sink, bool paused);
+    // Drops everything queued (after a seek)
+    void (*flush)(AudioSink* sink);
+    void (*close)(AudioSink* sink);
+};
+
+// Opens a sink of the given type. wav_path is only used by AUDIO_SINK_WAV.
+// Returns nullptr on failure (or AUDIO_SINK_NONE).
+AudioSink* audio_sink_open(AudioSinkType type, const char* wav_path, int sample_rate, int channels);
+void audio_sink_close(AudioSink* sink);
+
+// Parses "device", "null" or "wav" (case-sensitive). Returns 0 or -1.
+int parse_audio_sink_type(const char* name, AudioSinkType* out);
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+
+#include "catchup.h"
+#include "trace.h"
+
+// Time constant of the lateness average. A sample's weight grows with the time since the previous
+// one, so keyframe-only playback (a frame every few seconds) updates it as fast as smooth playback.
+static const double LATENESS_TIME_CONSTANT = 0.3;
+
+// Lag that raises the level: two frames, but at least 40 ms so 60 fps content isn't degraded by jitter
+static const double ESCALATE_FRAMES = 2.0;
+static const double ESCALATE_MIN_SECONDS = 0.040;
+
+// Lag under which playback counts as on time again
+static const double RECOVER_FRAMES = 0.5;
+
+// Minimum time at a level before moving up (the last step needs time to show an effect)
+// or down (don't bounce straight back into the lag we just escaped)
+static const double ESCALATE_HOLD_SECONDS = 0.5;
+static const double RECOVER_HOLD_SECONDS = 2.0;
+
+static double now_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void catchup_init(CatchUpController* c, double frame_duration) {
+    c->frame_duration = frame_duration > 0.0 ? frame_duration : 1.0 / 30.0;
+    c->lateness = 0.0;
+    c->reset_requested = false;
+    c->level = 0;
+    c->floor_level = 0;
+    c->applied_level = 0;
+    c->level_since = now_seconds();
+    c->last_update = c->level_since;
+    c->last_report = c->level_since;
+    for (int i = 0; i <= CATCHUP_MAX_LEVEL; i++) {
+        c->level_seconds[i] = 0.0;
+        c->level_frames[i] = 0;
+    }
+    c->packets_dropped = 0;
+    c->escalations = 0;
+    c->recoveries = 0;
+    c->max_lateness = 0.0;
+}
+
+void catchup_report_lateness(CatchUpController* c, double lateness) {
+    catchup_report_lateness_at(c, lateness, now_seconds());
+}
+
+void catchup_report_lateness_at(CatchUpController* c, double lateness, double now) {
+    if (lateness < 0.0) {
+        lateness = 0.0;
+    }
+    double elapsed = now - c->last_report;
+    c->last_report = now;
+    double weight = elapsed > 0.0 ? 1.0 - exp(-elapsed / LATENESS_TIME_CONSTANT) : 0.0;
+    double smoothed = c->lateness.load(std::memory_order_relaxed);
+    c->lateness.store(smoothed + weight * (lateness - smoothed), std::memory_order_relaxed);
+}
+
+void catchup_reset(CatchUpController* c) {
+    c->lateness.store(0.0, std::memory_order_relaxed);
+    c->reset_requested.store(true, std::memory_order_release);
+}
+
+static void apply_level(AVCodecContext* ctx, int level) {
+    ctx->skip_frame = level >= 4 ? AVDISCARD_NONKEY : level >= 1 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    ctx->skip_loop_filter = level >= 3 ? AVDISCARD_NONKEY : level >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    ctx->skip_idct = level >= 3 ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+}
+
+static void set_level(CatchUpController* c, int level, double now, double lateness) {
+    if (level == c->level) {
+        return;
+    }
+    if (level > c->level) {
+        c->escalations++;
+    }
+    else {
+        c->recoveries++;
+    }
+    fprintf(stdout, "Catch-up: level %d -> %d (video %.0f ms late)\n", c->level, level, 1000.0 * lateness);
+    trace_instant("catch-up level", level);
+    c->level = level;
+    c->level_since = now;
+}
+
+int catchup_update(CatchUpController* c, AVCodecContext* ctx) {
+    return catchup_update_at(c, ctx, now_seconds());
+}
+
+int catchup_update_at(CatchUpController* c, AVCodecContext* ctx, double now) {
+    c->level_seconds[c->level] += now - c->last_update;
+    c->last_update = now;
+
+    double lateness = c->lateness.load(std::memory_order_relaxed);
+    if (lateness > c->max_lateness) {
+        c->max_lateness = lateness;
+    }
+
+    if (c->reset_requested.exchange(false, std::memory_order_acquire)) {
+        c->level = 0;
+        c->level_since = now;
+    }
+    else {
+        double escalate_lag = c->frame_duration * ESCALATE_FRAMES;
+        if (escalate_lag < ESCALATE_MIN_SECONDS) {
+            escalate_lag = ESCALATE_MIN_SECONDS;
+        }
+        double held = now - c->level_since;
+        if (lateness > escalate_lag && held > ESCALATE_HOLD_SECONDS && c->level < CATCHUP_MAX_LEVEL) {
+            set_level(c, c->level + 1, now, lateness);
+        }
+        else if (lateness < c->frame_duration * RECOVER_FRAMES && held > RECOVER_HOLD_SECONDS && c->level > 0) {
+            set_level(c, c->level - 1, now, lateness);
+        }
+    }
+
+    int effective = c->level > c->floor_level ? c->level : c->floor_level;
+    if (c->applied_level != effective) {
+        apply_level(ctx, effective);
+        c->applied_level = effective;
+    }
+    c->level_frames[c->level]++;
+    return c->level;
+}
+
+void catchup_set_floor(CatchUpController* c, int level) {
+    c->floor_level = level < 0 ? 0 : level > CATCHUP_MAX_LEVEL ? CATCHUP_MAX_LEVEL : level;
+}
+
+bool catchup_should_drop_packet(CatchUpController* c, const AVPacket* pkt) {
+    // Disposable packets (flagged by the demuxer/parser) are never referenced by other frames
+    if (c->level >= 1 && (pkt->flags & AV_PKT_FLAG_DISPOSABLE) && !(pkt->flags & AV_PKT_FLAG_KEY)) {
+        c->packets_dropped++;
+        return true;
+    }
+    return false;
+}
+
+void catchup_suspend(CatchUpController* c, AVCodecContext* ctx) {
+    if (c->applied_level != 0) {
+        apply_level(ctx, 0);
+        c->applied_level = 0;
+    }
+}
+
+void catchup_print_stats(const CatchUpController* c) {
+    fprintf(stdout, "Catch-up: %d escalation(s), %d recovery step(s), %lld packet(s) dropped before decode, max lag %.0f ms\n",
+        c->escalations, c->recoveries, c->packets_dropped, 1000.0 * c->max_lateness);
+    for (int i = 0; i <= CATCHUP_MAX_LEVEL; i++) {
+        if (c->level_frames[i] > 0) {
+            fprintf(stdout, "  level %d: %8.1f s, %lld decode call(s)\n", i, c->level_seconds[i], c->level_frames[i]);
+        }
+    }
+}
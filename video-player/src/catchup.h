@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+
+extern "C" {
+#include<libavcodec/avcodec.h>
+}
+
+// Adaptive catch-up for when decoding falls behind presentation.
+//
+// The render thread reports how late each presented frame is. The decoder thread turns the
+// lateness, averaged over time (not over frames, which get sparse at the higher levels), into a
+// degradation level and applies it before the work is done, instead of
+// fully decoding frames the render thread then has to discard:
+//   0  full decode
+//   1  disposable packets dropped before avcodec_send_packet, skip_frame = NONREF
+//   2  + no loop filter on non-reference frames
+//   3  + no loop filter and no IDCT on any non-key frame
+//   4  keyframes only
+// The level rises one step at a time while the lag persists and steps back down once playback
+// has been on time for a while.
+//
+// Trick play sets a floor under the level (NONREF decoding when fast-forwarding, keyframes only
+// at high rates); the codec is configured for whichever is higher.
+
+const int CATCHUP_MAX_LEVEL = 4;
+
+struct CatchUpController {
+    double frame_duration;
+
+    // Render thread -> decoder thread
+    std::atomic<double> lateness;        // Smoothed lateness of presented frames, seconds
+    std::atomic<bool> reset_requested;
+
+    // Render thread only
+    double last_report;                  // When the previous lateness was reported
+
+    // Decoder thread only
+    int level;
+    int floor_level;                     // catchup_set_floor()
+    int applied_level;                   // Level the codec context is configured for
+    double level_since;                  // When the level last changed
+    double last_update;
+    double level_seconds[CATCHUP_MAX_LEVEL + 1];
+    long long level_frames[CATCHUP_MAX_LEVEL + 1];  // Decode calls made at each level
+    long long packets_dropped;
+    int escalations;
+    int recoveries;
+    double max_lateness;
+};
+
+void catchup_init(CatchUpController* c, double frame_duration);
+
+// Render thread: a frame was presented `lateness` seconds after it was due (<= 0: on time).
+void catchup_report_lateness(CatchUpController* c, double lateness);
+
+// Any thread: the playback clock restarted (seek); forget the lag and go back to full decoding.
+void catchup_reset(CatchUpController* c);
+
+// Decoder thread, before each forward decode: moves the level and configures ctx for it.
+// Returns the current level.
+int catchup_update(CatchUpController* c, AVCodecContext* ctx);
+
+// Decoder thread: the lowest level the codec is configured for, whatever the lag. Takes effect
+// at the next catchup_update().
+void catchup_set_floor(CatchUpController* c, int level);
+
+// Decoder thread: true if the packet is skipped at the current level (counted as dropped).
+bool catchup_should_drop_packet(CatchUpController* c, const AVPacket* pkt);
+
+// Decoder thread: full decoding for work that needs every frame (seeks, GOP caching).
+// The next catchup_update() restores the level.
+void catchup_suspend(CatchUpController* c, AVCodecContext* ctx);
+
+// catchup_report_lateness() and catchup_update() at an explicit time (seconds on the steady
+// clock, as catchup_init() reads it), for driving the controller with a simulated clock.
+void catchup_report_lateness_at(CatchUpController* c, double lateness, double now);
+int catchup_update_at(CatchUpController* c, AVCodecContext* ctx, double now);
+
+// Summary of time spent and frames decoded at each level.
+void catchup_print_stats(const CatchUpController* c);
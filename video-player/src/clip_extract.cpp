@@ -0,0 +1,661 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+extern "C" {
+#include<libavcodec/avcodec.h>
+#include<libavformat/avformat.h>
+}
+
+#include "clip_extract.h"
+#include "decode_video.h"
+#include "trace.h"
+
+// Once the video has ended the clip, the other streams are read until this far past its end:
+// demuxers interleave audio up to about a second apart, and sparse subtitle streams may never get there.
+static const double INTERLEAVE_MARGIN_SECONDS = 2.0;
+
+// Keyframe interval of the re-encoded boundary GOPs; they are shorter than this anyway
+static const int SMART_CUT_GOP_SIZE = 600;
+
+enum ClipVideoState {
+    CLIP_WAIT_KEYFRAME = 0,   // Video packets before the first keyframe after the seek are dropped
+    CLIP_COPY,                // Copying GOPs (smart cut: each one held until the next keyframe)
+    CLIP_DONE                 // The clip end is known
+};
+
+struct ClipStream {
+    int out_index;            // -1 = not copied
+    AVRational time_base;     // Input time base
+    bool done;                // A packet at or past the clip end was seen
+};
+
+struct ClipJob {
+    ClipExtractOptions options;
+    AVFormatContext* in;
+    AVIOContext* io;          // Read-ahead layer (nullptr when FFmpeg reads the file itself)
+    AVFormatContext* out;
+    std::vector<ClipStream> streams;
+    int video;
+    AVRational video_tb;
+
+    // In the video stream's time base
+    int64_t origin_ts;        // The video stream's start time: the input's time 0
+    int64_t from_ts;          // Requested start
+    int64_t to_ts;            // Requested end (AV_NOPTS_VALUE: end of file)
+    int64_t start_ts;         // Becomes output time 0 (AV_NOPTS_VALUE until the first keyframe)
+    int64_t end_ts;           // Clip end once state is CLIP_DONE (AV_NOPTS_VALUE: end of file)
+    ClipVideoState state;
+    bool smart_cut;
+
+    std::deque<AVPacket*> held;    // Other streams' packets waiting for start_ts or end_ts
+    std::vector<AVPacket*> gop;    // Smart cut: the GOP being read, from its keyframe on
+
+    // Smart cut decoder, shared by both boundaries
+    AVCodecContext* decoder;
+    AVFrame* frame;
+
+    // Statistics
+    double last_read_seconds;
+    int64_t bytes_read;
+    int64_t bytes_written;
+    long long packets_copied;
+    long long frames_encoded;
+    int gops_reencoded;
+};
+
+ClipExtractOptions default_clip_extract_options() {
+    ClipExtractOptions options;
+    options.start = 0.0;
+    options.end = 0.0;
+    options.smart_cut = false;
+    options.read_ahead = READ_AHEAD_THREAD;
+    options.read_ahead_mb = DEFAULT_READ_AHEAD_MB;
+    return options;
+}
+
+static int64_t packet_ts(const AVPacket* pkt) {
+    return pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+}
+
+// ts < limit, where an AV_NOPTS_VALUE limit means no limit
+static bool ts_before(int64_t ts, AVRational tb, int64_t limit, AVRational limit_tb) {
+    return limit == AV_NOPTS_VALUE || av_compare_ts(ts, tb, limit, limit_tb) < 0;
+}
+
+static int open_clip_input(ClipJob* job, const char* path) {
+    job->io = read_ahead_open(path, job->options.read_ahead, job->options.read_ahead_mb);
+    if (job->io) {
+        job->in = avformat_alloc_context();
+        if (!job->in) {
+            read_ahead_close(&job->io);
+            return AVERROR(ENOMEM);
+        }
+        job->in->pb = job->io;
+        job->in->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    int ret = avformat_open_input(&job->in, path, nullptr, nullptr);
+    if (ret < 0) {
+        fprintf(stderr, "Extract: could not open %s\n", path);
+        read_ahead_close(&job->io); // A failed open frees the context but never a custom pb
+        return ret;
+    }
+    ret = avformat_find_stream_info(job->in, nullptr);
+    if (ret < 0) {
+        return ret;
+    }
+    job->video = av_find_best_stream(job->in, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (job->video < 0) {
+        fprintf(stderr, "Extract: %s has no video stream\n", path);
+        return job->video;
+    }
+    job->video_tb = job->in->streams[job->video]->time_base;
+    return 0;
+}
+
+// One output stream per copied input stream: the video stream, every audio and subtitle stream
+static int open_clip_output(ClipJob* job) {
+    const char* path = job->options.output_path.c_str();
+    int ret = avformat_alloc_output_context2(&job->out, nullptr, nullptr, path);
+    if (ret < 0 || !job->out) {
+        fprintf(stderr, "Extract: no container format for %s\n", path);
+        return ret < 0 ? ret : AVERROR(EINVAL);
+    }
+
+    job->streams.resize(job->in->nb_streams);
+    for (unsigned i = 0; i < job->in->nb_streams; i++) {
+        AVStream* in_stream = job->in->streams[i];
+        ClipStream* s = &job->streams[i];
+        s->out_index = -1;
+        s->time_base = in_stream->time_base;
+        s->done = false;
+
+        AVMediaType type = in_stream->codecpar->codec_type;
+        bool copy = (int)i == job->video || type == AVMEDIA_TYPE_AUDIO || type == AVMEDIA_TYPE_SUBTITLE;
+        if (!copy) {
+            in_stream->discard = AVDISCARD_ALL; // Not even demuxed
+            continue;
+        }
+        AVStream* out_stream = avformat_new_stream(job->out, nullptr);
+        if (!out_stream) {
+            return AVERROR(ENOMEM);
+        }
+        ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+        if (ret < 0) {
+            return ret;
+        }
+        out_stream->codecpar->codec_tag = 0; // Let the muxer pick the tag for its container
+        out_stream->time_base = in_stream->time_base;
+        s->out_index = out_stream->index;
+    }
+
+    if (!(job->out->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&job->out->pb, path, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            fprintf(stderr, "Extract: could not create %s\n", path);
+            return ret;
+        }
+    }
+    return avformat_write_header(job->out, nullptr);
+}
+
+// Shifts the packet onto the clip timeline and hands it to the muxer. Frees the packet.
+static int write_clip_packet(ClipJob* job, AVPacket* pkt, int in_index) {
+    const ClipStream* s = &job->streams[in_index];
+    int64_t offset = av_rescale_q(job->start_ts, job->video_tb, s->time_base);
+    if (pkt->pts != AV_NOPTS_VALUE) {
+        pkt->pts -= offset;
+    }
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        pkt->dts -= offset;
+    }
+    av_packet_rescale_ts(pkt, s->time_base, job->out->streams[s->out_index]->time_base);
+    pkt->stream_index = s->out_index;
+    pkt->pos = -1;
+    job->bytes_written += pkt->size;
+
+    int ret = av_interleaved_write_frame(job->out, pkt);
+    av_packet_free(&pkt);
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+    }
+    return ret;
+}
+
+// Audio and subtitle packets: cut to [start_ts, end_ts). Held while either bound is still open.
+static int handle_other_packet(ClipJob* job, AVPacket* pkt) {
+    ClipStream* s = &job->streams[pkt->stream_index];
+    int64_t ts = packet_ts(pkt);
+    if (ts == AV_NOPTS_VALUE) {
+        av_packet_free(&pkt);
+        return 0;
+    }
+    if (job->start_ts == AV_NOPTS_VALUE) {
+        job->held.push_back(pkt);
+        return 0;
+    }
+    if (av_compare_ts(ts, s->time_base, job->start_ts, job->video_tb) < 0) {
+        av_packet_free(&pkt);
+        return 0;
+    }
+    if (job->state == CLIP_DONE) {
+        if (!ts_before(ts, s->time_base, job->end_ts, job->video_tb)) {
+            s->done = true;
+            av_packet_free(&pkt);
+            return 0;
+        }
+    }
+    else if (!ts_before(ts, s->time_base, job->to_ts, job->video_tb)) {
+        // Past the requested end, but the video may end the clip later (at its next keyframe)
+        job->held.push_back(pkt);
+        return 0;
+    }
+    job->packets_copied++;
+    return write_clip_packet(job, pkt, pkt->stream_index);
+}
+
+// Start or end of the clip just became known: place what was held back
+static int release_held(ClipJob* job) {
+    std::deque<AVPacket*> held;
+    held.swap(job->held);
+    int ret = 0;
+    while (!held.empty()) {
+        AVPacket* pkt = held.front();
+        held.pop_front();
+        if (ret < 0) {
+            av_packet_free(&pkt);
+            continue;
+        }
+        ret = handle_other_packet(job, pkt);
+    }
+    return ret;
+}
+
+// --- Smart cut ---
+
+// Encoder matching the decoded frames. No B-frames, so dts can simply trail pts and the
+// re-encoded packets slot in next to the copied ones. The time base comes from the frame rate,
+// not the container (1/90000 is beyond what encoders like mpeg4 accept); frames and packets are
+// rescaled between the two.
+static AVCodecContext* open_smart_cut_encoder(ClipJob* job, int width, int height, AVPixelFormat pix_fmt,
+    AVColorRange color_range, AVColorSpace colorspace) {
+    AVStream* stream = job->in->streams[job->video];
+    const AVCodec* codec = avcodec_find_encoder(stream->codecpar->codec_id);
+    AVCodecContext* ctx = codec ? avcodec_alloc_context3(codec) : nullptr;
+    if (!ctx) {
+        return nullptr;
+    }
+    ctx->width = width;
+    ctx->height = height;
+    ctx->pix_fmt = pix_fmt;
+    ctx->sample_aspect_ratio = job->decoder->sample_aspect_ratio;
+    ctx->color_range = color_range;
+    ctx->colorspace = colorspace;
+    ctx->framerate = av_guess_frame_rate(job->in, stream, nullptr);
+    ctx->time_base = ctx->framerate.num > 0 && ctx->framerate.den > 0 ? av_inv_q(ctx->framerate) : AVRational{ 1, 1000 };
+    ctx->max_b_frames = 0;
+    ctx->gop_size = SMART_CUT_GOP_SIZE;
+    if (stream->codecpar->bit_rate > 0) {
+        ctx->bit_rate = stream->codecpar->bit_rate;
+    }
+    int ret = avcodec_open2(ctx, codec, nullptr);
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+        avcodec_free_context(&ctx);
+    }
+    return ctx;
+}
+
+static int open_smart_cut_decoder(ClipJob* job) {
+    if (job->out->oformat->flags & AVFMT_GLOBALHEADER) {
+        // The encoder's parameter sets would differ from the copied stream's extradata
+        fprintf(stderr, "Extract: the %s muxer stores parameter sets in a global header, which re-encoded GOPs "
+            "can't share; cutting on keyframes instead\n", job->out->oformat->name);
+        return AVERROR(ENOSYS);
+    }
+    const AVCodecParameters* par = job->in->streams[job->video]->codecpar;
+    const AVCodec* codec = avcodec_find_decoder(par->codec_id);
+    if (!codec || !avcodec_find_encoder(par->codec_id)) {
+        fprintf(stderr, "Extract: no %s for %s; cutting on keyframes instead\n",
+            codec ? "encoder" : "decoder", avcodec_get_name(par->codec_id));
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+    job->decoder = avcodec_alloc_context3(codec);
+    job->frame = av_frame_alloc();
+    if (!job->decoder || !job->frame) {
+        return AVERROR(ENOMEM);
+    }
+    int ret = avcodec_parameters_to_context(job->decoder, par);
+    if (ret >= 0) {
+        job->decoder->pkt_timebase = job->video_tb;
+        ret = avcodec_open2(job->decoder, codec, nullptr);
+    }
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+        return ret;
+    }
+
+    // Open an encoder up front: one that rejects these parameters must fail here, while falling
+    // back to keyframe cuts is still possible, not halfway through writing the clip
+    AVCodecContext* dec = job->decoder;
+    AVCodecContext* probe = open_smart_cut_encoder(job, dec->width, dec->height, dec->pix_fmt, dec->color_range, dec->colorspace);
+    if (!probe) {
+        fprintf(stderr, "Extract: could not open a %s encoder for this stream; cutting on keyframes instead\n",
+            avcodec_get_name(par->codec_id));
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+    avcodec_free_context(&probe);
+    return 0;
+}
+
+// Sends a frame (nullptr = flush) and collects whatever packets the encoder has ready
+static int encode_clip_frame(AVCodecContext* enc, const AVFrame* frame, std::vector<AVPacket*>* out) {
+    int ret = avcodec_send_frame(enc, frame);
+    while (ret >= 0) {
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            return AVERROR(ENOMEM);
+        }
+        ret = avcodec_receive_packet(enc, pkt);
+        if (ret < 0) {
+            av_packet_free(&pkt);
+            break;
+        }
+        out->push_back(pkt);
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// Decodes a GOP and re-encodes its frames with pts in [lo, hi) (hi = AV_NOPTS_VALUE: no bound).
+// Encoded dts are pts - dts_shift, so they stay below the dts of copied packets that follow.
+static int reencode_gop(ClipJob* job, const std::vector<AVPacket*>& gop, int64_t lo, int64_t hi, int64_t dts_shift) {
+    TRACE_SCOPE("smart cut re-encode");
+    AVCodecContext* dec = job->decoder;
+    AVFrame* frame = job->frame;
+    AVCodecContext* enc = nullptr;
+    int64_t last_enc_pts = AV_NOPTS_VALUE;
+    std::vector<AVPacket*> encoded;
+    size_t next = 0;
+    int ret = 0;
+
+    avcodec_flush_buffers(dec);
+    while (ret >= 0) {
+        ret = avcodec_receive_frame(dec, frame);
+        if (ret == 0) {
+            int64_t pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+            if (pts != AV_NOPTS_VALUE && pts >= lo && (hi == AV_NOPTS_VALUE || pts < hi)) {
+                if (!enc) {
+                    enc = open_smart_cut_encoder(job, frame->width, frame->height, (AVPixelFormat)frame->format,
+                        frame->color_range, frame->colorspace);
+                }
+                int64_t enc_pts = enc ? av_rescale_q(pts, job->video_tb, enc->time_base) : AV_NOPTS_VALUE;
+                // Frames closer together than the encoder's tick (variable frame rate) would collide
+                if (!enc || last_enc_pts == AV_NOPTS_VALUE || enc_pts > last_enc_pts) {
+                    frame->pts = enc_pts;
+                    frame->pict_type = AV_PICTURE_TYPE_NONE; // The encoder starts its own GOP
+                    ret = enc ? encode_clip_frame(enc, frame, &encoded) : AVERROR_ENCODER_NOT_FOUND;
+                    last_enc_pts = enc_pts;
+                    job->frames_encoded++;
+                }
+            }
+            av_frame_unref(frame);
+            continue;
+        }
+        if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        }
+        if (ret != AVERROR(EAGAIN)) {
+            break;
+        }
+        // Feed the next packet of the GOP, then drain the decoder
+        ret = avcodec_send_packet(dec, next < gop.size() ? gop[next] : nullptr);
+        next++;
+    }
+    if (enc && ret >= 0) {
+        ret = encode_clip_frame(enc, nullptr, &encoded);
+    }
+    AVRational enc_tb = enc ? enc->time_base : job->video_tb;
+    avcodec_free_context(&enc);
+
+    for (AVPacket* pkt : encoded) {
+        if (ret < 0) {
+            av_packet_free(&pkt);
+            continue;
+        }
+        pkt->pts = av_rescale_q(pkt->pts, enc_tb, job->video_tb);
+        pkt->dts = pkt->pts - dts_shift;
+        pkt->duration = av_rescale_q(pkt->duration, enc_tb, job->video_tb);
+        ret = write_clip_packet(job, pkt, job->video);
+    }
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+    }
+    job->gops_reencoded++;
+    return ret;
+}
+
+static void free_gop(ClipJob* job) {
+    for (AVPacket* pkt : job->gop) {
+        av_packet_free(&pkt);
+    }
+    job->gop.clear();
+}
+
+// Smart cut: the GOP in job->gop is complete (next_key is the keyframe after it, or nullptr at
+// end of file). Copies it if it lies inside the requested range, else re-encodes the part inside.
+static int finish_gop(ClipJob* job, const AVPacket* next_key) {
+    if (job->gop.empty()) {
+        return 0;
+    }
+    const AVPacket* key = job->gop.front();
+    bool head = key->pts < job->from_ts;
+    bool tail = false;
+    for (const AVPacket* pkt : job->gop) {
+        int64_t ts = packet_ts(pkt);
+        if (ts != AV_NOPTS_VALUE && !ts_before(ts, job->video_tb, job->to_ts, job->video_tb)) {
+            tail = true;
+        }
+    }
+
+    int ret = 0;
+    if (head || tail) {
+        // The GOP's leading pictures (open GOP) reference the previous one and can't be decoded here
+        int64_t lo = head ? job->from_ts : key->pts;
+        // Head: encoded dts must stay below the next (copied) keyframe's; tail: above the GOP's own
+        int64_t shift = key->pts - key->dts;
+        if (!tail && next_key && next_key->dts != AV_NOPTS_VALUE) {
+            shift = next_key->pts - next_key->dts;
+        }
+        ret = reencode_gop(job, job->gop, lo, job->to_ts, shift > 0 ? shift : 0);
+    }
+    else {
+        for (AVPacket*& pkt : job->gop) {
+            int64_t ts = packet_ts(pkt);
+            if (ret >= 0 && (ts == AV_NOPTS_VALUE || ts >= job->start_ts)) {
+                job->packets_copied++;
+                ret = write_clip_packet(job, pkt, job->video);
+                pkt = nullptr;
+            }
+        }
+    }
+    free_gop(job);
+
+    if (tail || (next_key && !ts_before(next_key->pts, job->video_tb, job->to_ts, job->video_tb))) {
+        job->state = CLIP_DONE;
+        job->end_ts = job->to_ts;
+    }
+    return ret;
+}
+
+static int handle_video_packet(ClipJob* job, AVPacket* pkt) {
+    bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+    int64_t ts = packet_ts(pkt);
+
+    if (job->state == CLIP_WAIT_KEYFRAME) {
+        if (!key || ts == AV_NOPTS_VALUE) {
+            av_packet_free(&pkt);
+            return 0;
+        }
+        // Keyframe snapping starts the clip here; a smart cut starts it on the requested frame
+        job->start_ts = job->smart_cut && ts < job->from_ts ? job->from_ts : ts;
+        job->state = CLIP_COPY;
+        int ret = release_held(job);
+        if (ret < 0) {
+            av_packet_free(&pkt);
+            return ret;
+        }
+    }
+    else if (job->state == CLIP_DONE) {
+        av_packet_free(&pkt);
+        return 0;
+    }
+
+    if (job->smart_cut) {
+        int ret = 0;
+        if (key && !job->gop.empty()) {
+            ret = finish_gop(job, pkt);
+            if (job->state == CLIP_DONE) {
+                av_packet_free(&pkt);
+                return ret < 0 ? ret : release_held(job);
+            }
+        }
+        job->gop.push_back(pkt);
+        return ret;
+    }
+
+    if (key && ts != AV_NOPTS_VALUE && !ts_before(ts, job->video_tb, job->to_ts, job->video_tb)) {
+        // Keyframe snapping: the clip ends before the first keyframe at or after the requested end
+        job->state = CLIP_DONE;
+        job->end_ts = ts;
+        av_packet_free(&pkt);
+        return release_held(job);
+    }
+    if (ts != AV_NOPTS_VALUE && ts < job->start_ts) {
+        av_packet_free(&pkt); // Leading pictures of an open GOP, referencing the GOP before the clip
+        return 0;
+    }
+    job->packets_copied++;
+    return write_clip_packet(job, pkt, job->video);
+}
+
+// Video ended the clip and every other stream has passed its end (or the margin has)
+static bool clip_complete(const ClipJob* job) {
+    if (job->state != CLIP_DONE || job->end_ts == AV_NOPTS_VALUE) {
+        return false;
+    }
+    if (job->last_read_seconds >= job->end_ts * av_q2d(job->video_tb) + INTERLEAVE_MARGIN_SECONDS) {
+        return true;
+    }
+    for (size_t i = 0; i < job->streams.size(); i++) {
+        if ((int)i != job->video && job->streams[i].out_index >= 0 && !job->streams[i].done) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void close_clip_job(ClipJob* job) {
+    free_gop(job);
+    for (AVPacket* pkt : job->held) {
+        av_packet_free(&pkt);
+    }
+    job->held.clear();
+    avcodec_free_context(&job->decoder);
+    av_frame_free(&job->frame);
+    if (job->out) {
+        if (!(job->out->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&job->out->pb);
+        }
+        avformat_free_context(job->out);
+        job->out = nullptr;
+    }
+    if (job->in) {
+        avformat_close_input(&job->in);
+    }
+    read_ahead_close(&job->io);
+}
+
+int run_clip_extract(const char* input_path, const ClipExtractOptions& options) {
+    auto started = std::chrono::steady_clock::now();
+
+    ClipJob job;
+    job.options = options;
+    job.in = nullptr;
+    job.io = nullptr;
+    job.out = nullptr;
+    job.video = -1;
+    job.origin_ts = 0;
+    job.from_ts = 0;
+    job.to_ts = AV_NOPTS_VALUE;
+    job.start_ts = AV_NOPTS_VALUE;
+    job.end_ts = AV_NOPTS_VALUE;
+    job.state = CLIP_WAIT_KEYFRAME;
+    job.smart_cut = options.smart_cut;
+    job.decoder = nullptr;
+    job.frame = nullptr;
+    job.last_read_seconds = 0.0;
+    job.bytes_read = 0;
+    job.bytes_written = 0;
+    job.packets_copied = 0;
+    job.frames_encoded = 0;
+    job.gops_reencoded = 0;
+
+    int ret = open_clip_input(&job, input_path);
+    if (ret >= 0) {
+        double start = options.start > 0.0 ? options.start : 0.0;
+        int64_t origin = job.in->streams[job.video]->start_time;
+        job.origin_ts = origin != AV_NOPTS_VALUE ? origin : 0;
+        job.from_ts = job.origin_ts + (int64_t)(start / av_q2d(job.video_tb));
+        job.to_ts = options.end > start ? job.origin_ts + (int64_t)(options.end / av_q2d(job.video_tb)) : AV_NOPTS_VALUE;
+        ret = open_clip_output(&job);
+    }
+    if (ret >= 0 && job.smart_cut && open_smart_cut_decoder(&job) < 0) {
+        job.smart_cut = false;
+    }
+    if (ret >= 0 && options.start > 0.0) {
+        // Lands on the keyframe at or before the start; the first video packet read is that keyframe
+        int seek_ret = av_seek_frame(job.in, job.video, job.from_ts, AVSEEK_FLAG_BACKWARD);
+        if (seek_ret < 0) {
+            fprintf(stderr, "Extract: seek failed, reading from the beginning\n");
+        }
+    }
+
+    while (ret >= 0 && !clip_complete(&job)) {
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        {
+            TRACE_SCOPE("demux");
+            ret = av_read_frame(job.in, pkt);
+        }
+        if (ret < 0) {
+            av_packet_free(&pkt);
+            if (ret == AVERROR_EOF) {
+                ret = 0;
+            }
+            break;
+        }
+        job.bytes_read += pkt->size;
+        const ClipStream* s = &job.streams[pkt->stream_index];
+        if (s->out_index < 0) {
+            av_packet_free(&pkt);
+            continue;
+        }
+        int64_t ts = packet_ts(pkt);
+        if (ts != AV_NOPTS_VALUE) {
+            job.last_read_seconds = ts * av_q2d(s->time_base);
+        }
+        ret = pkt->stream_index == job.video ? handle_video_packet(&job, pkt) : handle_other_packet(&job, pkt);
+    }
+
+    // End of file (or of the clip): the last GOP, then whatever is still held back
+    if (ret >= 0 && job.state != CLIP_DONE) {
+        if (job.smart_cut) {
+            ret = finish_gop(&job, nullptr);
+        }
+        job.state = CLIP_DONE;
+        job.end_ts = job.to_ts;
+    }
+    if (ret >= 0 && job.start_ts != AV_NOPTS_VALUE) {
+        ret = release_held(&job);
+    }
+    if (ret >= 0 && job.start_ts == AV_NOPTS_VALUE) {
+        fprintf(stderr, "Extract: no video keyframe in the requested range\n");
+        ret = AVERROR_INVALIDDATA;
+    }
+    if (ret >= 0) {
+        ret = av_write_trailer(job.out);
+    }
+
+    if (ret >= 0) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        double tb = av_q2d(job.video_tb);
+        double clip_end = job.end_ts != AV_NOPTS_VALUE ? (job.end_ts - job.origin_ts) * tb
+            : job.last_read_seconds - job.origin_ts * tb;
+        double mb = (job.bytes_read + job.bytes_written) / (1024.0 * 1024.0);
+        char requested_end[32] = "end";
+        if (job.to_ts != AV_NOPTS_VALUE) {
+            snprintf(requested_end, sizeof(requested_end), "%.3f", options.end);
+        }
+        fprintf(stdout, "Extract: %s -> %s, %.3f-%.3fs (requested %.3f-%s), %lld packet(s) copied",
+            input_path, options.output_path.c_str(), (job.start_ts - job.origin_ts) * tb, clip_end, options.start,
+            requested_end, job.packets_copied);
+        if (job.smart_cut) {
+            fprintf(stdout, ", %lld frame(s) re-encoded in %d boundary GOP(s)", job.frames_encoded, job.gops_reencoded);
+        }
+        fprintf(stdout, "\nExtract: %.1f MB read, %.1f MB written in %.2f s (%.1f MB/s)\n",
+            job.bytes_read / (1024.0 * 1024.0), job.bytes_written / (1024.0 * 1024.0), seconds,
+            seconds > 0.0 ? mb / seconds : 0.0);
+    }
+    else {
+        print_ffmpeerr(ret);
+    }
+
+    close_clip_job(&job);
+    return ret < 0 ? ret : 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include "read_ahead.h"
+
+// Clip extraction by stream copy: packets between two timestamps are remuxed into a new
+// container, no window, no GL, no decode.
+//
+// The clip starts on the video keyframe at or before `start` and ends just before the first
+// video keyframe at or after `end`, so every copied GOP is complete and the clip covers the
+// requested range. Audio and subtitle packets are cut to the same span. With smart_cut the
+// partial GOPs at either boundary are decoded and re-encoded instead, and only those: the clip
+// then starts and ends on the requested frames while everything in between is still copied.
+// Re-encoded frames carry their parameter sets in-band, so smart cut needs a container that does
+// too (MPEG-TS); for containers with global headers (MP4, MOV, Matroska), or when FFmpeg has no
+// encoder for the codec or its encoder rejects the stream, extraction falls back to keyframe snapping.
+
+struct ClipExtractOptions {
+    std::string output_path;    // The container follows the extension (.mp4, .mkv, .ts, ...)
+    double start;               // Seconds
+    double end;                 // Seconds; <= start copies to the end of the file
+    bool smart_cut;
+    ReadAheadMode read_ahead;   // How the input is read (see read_ahead.h)
+    int read_ahead_mb;
+};
+
+ClipExtractOptions default_clip_extract_options();
+
+// Writes the clip and prints what was copied and re-encoded and the throughput in MB/s.
+// Returns 0, or a negative error.
+int run_clip_extract(const char* input_path, const ClipExtractOptions& options);
@@ -0,0 +1,780 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+
+extern "C" {
+#include<libavutil/cpu.h>
+#include<libavutil/pixdesc.h>
+}
+
+#include "cpu_render.h"
+#include "task_pool.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_RENDER_X86 1
+#include <immintrin.h>
+// MSVC compiles any intrinsic without flags; GCC and Clang need the target per function
+#if defined(_MSC_VER)
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/fb.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <vector>
+#endif
+
+const char* CPU_KERNEL_NAMES[CPU_KERNEL_COUNT] = { "scalar", "sse2", "avx2" };
+
+// Fixed point used between the row preparation and the kernels:
+//   Y       normalized sample * 2^13 (0..8192)
+//   U, V    (normalized sample - 0.5) * 2^15 (-16384..16384)
+// A coefficient c as K = c * 2^14 gives mulhi(U, K) = (U * K) >> 16 = c * U in Y's scale.
+static const int LUMA_ONE = 8192;
+static const int CHROMA_ONE = 32768;
+static const int K_RV = 25801;  // 1.5748
+static const int K_GU = 3069;   // 0.1873
+static const int K_GV = 7669;   // 0.4681
+static const int K_BU = 30402;  // 1.8556
+// Y scale -> 8 bits: mulhi(v + 16, 2040) = round(v * 255 / 8192)
+static const int OUT_ROUND = 16;
+static const int OUT_SCALE = 2040;
+
+typedef void (*ConvertRowFunc)(const int16_t* y, const int16_t* u, const int16_t* v, uint8_t* rgba, int width);
+
+struct CpuRenderBand {
+    CpuRenderer* renderer;
+    const AVFrame* frame;
+    const YUVFormatLayout* layout;
+    uint8_t* dst;
+    int dst_stride;
+    int first_row;
+    int end_row;
+
+    // Full-width rows handed to the kernel, and chroma rows at chroma resolution
+    std::vector<int16_t> y_row, u_row, v_row;
+    std::vector<int16_t> u_near, v_near, u_far, v_far;
+};
+
+// --- Kernels ---
+
+static inline uint8_t unorm8(float v) {
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint8_t)(v * 255.0f + 0.5f);
+}
+
+// Reference: the fragment shader's conversion in float
+static void convert_row_scalar(const int16_t* y, const int16_t* u, const int16_t* v, uint8_t* rgba, int width) {
+    for (int x = 0; x < width; x++) {
+        float Y = y[x] * (1.0f / LUMA_ONE);
+        float U = u[x] * (1.0f / CHROMA_ONE);
+        float V = v[x] * (1.0f / CHROMA_ONE);
+        rgba[4 * x + 0] = unorm8(Y + 1.5748f * V);
+        rgba[4 * x + 1] = unorm8(Y - 0.1873f * U - 0.4681f * V);
+        rgba[4 * x + 2] = unorm8(Y + 1.8556f * U);
+        rgba[4 * x + 3] = 255;
+    }
+}
+
+static inline int mulhi16(int a, int b) {
+    return (a * b) >> 16;
+}
+
+static inline uint8_t fixed_to_byte(int v) {
+    v = mulhi16(v + OUT_ROUND, OUT_SCALE);
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// The SIMD kernels' arithmetic one pixel at a time, for the pixels left over at the end of a row
+static void convert_row_fixed(const int16_t* y, const int16_t* u, const int16_t* v, uint8_t* rgba, int width) {
+    for (int x = 0; x < width; x++) {
+        rgba[4 * x + 0] = fixed_to_byte(y[x] + mulhi16(v[x], K_RV));
+        rgba[4 * x + 1] = fixed_to_byte(y[x] - mulhi16(u[x], K_GU) - mulhi16(v[x], K_GV));
+        rgba[4 * x + 2] = fixed_to_byte(y[x] + mulhi16(u[x], K_BU));
+        rgba[4 * x + 3] = 255;
+    }
+}
+
+#ifdef CPU_RENDER_X86
+TARGET_SSE2 static void convert_row_sse2(const int16_t* y, const int16_t* u, const int16_t* v, uint8_t* rgba, int width) {
+    const __m128i k_rv = _mm_set1_epi16(K_RV);
+    const __m128i k_gu = _mm_set1_epi16(K_GU);
+    const __m128i k_gv = _mm_set1_epi16(K_GV);
+    const __m128i k_bu = _mm_set1_epi16(K_BU);
+    const __m128i round = _mm_set1_epi16(OUT_ROUND);
+    const __m128i scale = _mm_set1_epi16(OUT_SCALE);
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i Y = _mm_loadu_si128((const __m128i*)(y + x));
+        __m128i U = _mm_loadu_si128((const __m128i*)(u + x));
+        __m128i V = _mm_loadu_si128((const __m128i*)(v + x));
+
+        __m128i r = _mm_add_epi16(Y, _mm_mulhi_epi16(V, k_rv));
+        __m128i g = _mm_sub_epi16(_mm_sub_epi16(Y, _mm_mulhi_epi16(U, k_gu)), _mm_mulhi_epi16(V, k_gv));
+        __m128i b = _mm_add_epi16(Y, _mm_mulhi_epi16(U, k_bu));
+        r = _mm_mulhi_epi16(_mm_add_epi16(r, round), scale);
+        g = _mm_mulhi_epi16(_mm_add_epi16(g, round), scale);
+        b = _mm_mulhi_epi16(_mm_add_epi16(b, round), scale);
+
+        // Saturate to bytes, then interleave: RG pairs and BA pairs, then RGBA quads
+        __m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(g, g));
+        __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), alpha);
+        _mm_storeu_si128((__m128i*)(rgba + 4 * x), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(rgba + 4 * x + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+    convert_row_fixed(y + x, u + x, v + x, rgba + 4 * x, width - x);
+}
+
+TARGET_AVX2 static void convert_row_avx2(const int16_t* y, const int16_t* u, const int16_t* v, uint8_t* rgba, int width) {
+    const __m256i k_rv = _mm256_set1_epi16(K_RV);
+    const __m256i k_gu = _mm256_set1_epi16(K_GU);
+    const __m256i k_gv = _mm256_set1_epi16(K_GV);
+    const __m256i k_bu = _mm256_set1_epi16(K_BU);
+    const __m256i round = _mm256_set1_epi16(OUT_ROUND);
+    const __m256i scale = _mm256_set1_epi16(OUT_SCALE);
+    const __m256i alpha = _mm256_set1_epi8((char)0xFF);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i Y = _mm256_loadu_si256((const __m256i*)(y + x));
+        __m256i U = _mm256_loadu_si256((const __m256i*)(u + x));
+        __m256i V = _mm256_loadu_si256((const __m256i*)(v + x));
+
+        __m256i r = _mm256_add_epi16(Y, _mm256_mulhi_epi16(V, k_rv));
+        __m256i g = _mm256_sub_epi16(_mm256_sub_epi16(Y, _mm256_mulhi_epi16(U, k_gu)), _mm256_mulhi_epi16(V, k_gv));
+        __m256i b = _mm256_add_epi16(Y, _mm256_mulhi_epi16(U, k_bu));
+        r = _mm256_mulhi_epi16(_mm256_add_epi16(r, round), scale);
+        g = _mm256_mulhi_epi16(_mm256_add_epi16(g, round), scale);
+        b = _mm256_mulhi_epi16(_mm256_add_epi16(b, round), scale);
+
+        // Packs and unpacks work per 128-bit lane: lo holds pixels 0-3 | 8-11, hi 4-7 | 12-15
+        __m256i rg = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), _mm256_packus_epi16(g, g));
+        __m256i ba = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), alpha);
+        __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+        __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+        _mm256_storeu_si256((__m256i*)(rgba + 4 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(rgba + 4 * x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    convert_row_fixed(y + x, u + x, v + x, rgba + 4 * x, width - x);
+}
+#endif
+
+static ConvertRowFunc kernel_function(CpuConvertKernel kernel) {
+#ifdef CPU_RENDER_X86
+    if (kernel == CPU_KERNEL_AVX2) return convert_row_avx2;
+    if (kernel == CPU_KERNEL_SSE2) return convert_row_sse2;
+#endif
+    return convert_row_scalar;
+}
+
+bool cpu_kernel_supported(CpuConvertKernel kernel) {
+#ifdef CPU_RENDER_X86
+    int flags = av_get_cpu_flags();
+    if (kernel == CPU_KERNEL_AVX2) return (flags & AV_CPU_FLAG_AVX2) != 0;
+    if (kernel == CPU_KERNEL_SSE2) return (flags & AV_CPU_FLAG_SSE2) != 0;
+#endif
+    return kernel == CPU_KERNEL_SCALAR;
+}
+
+CpuConvertKernel cpu_best_kernel() {
+    for (int k = CPU_KERNEL_COUNT - 1; k > 0; k--) {
+        if (cpu_kernel_supported((CpuConvertKernel)k)) {
+            return (CpuConvertKernel)k;
+        }
+    }
+    return CPU_KERNEL_SCALAR;
+}
+
+int parse_cpu_kernel(const char* name, CpuConvertKernel* out) {
+    if (strcmp(name, "auto") == 0) {
+        *out = cpu_best_kernel();
+        return 0;
+    }
+    for (int k = 0; k < CPU_KERNEL_COUNT; k++) {
+        if (strcmp(name, CPU_KERNEL_NAMES[k]) == 0) {
+            if (!cpu_kernel_supported((CpuConvertKernel)k)) {
+                fprintf(stderr, "CPU render: this CPU has no %s\n", name);
+                return -1;
+            }
+            *out = (CpuConvertKernel)k;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// --- Row preparation ---
+
+// Sample values -> fixed point, normalized the way GL samples the format's textures
+static void build_luts(CpuRenderer* r, const YUVFormatLayout* layout) {
+    int size = 1 << layout->bit_depth;
+    // Top-aligned samples are read as value / 65535 with the low bits zero
+    double max_code = layout->msb_aligned ? 65535.0 / (1 << (16 - layout->bit_depth)) : size - 1;
+    r->luma_lut.resize(size);
+    r->chroma_lut.resize(size);
+    for (int i = 0; i < size; i++) {
+        double norm = i / max_code;
+        r->luma_lut[i] = (int16_t)lrint(norm * LUMA_ONE);
+        long c = lrint((norm - 0.5) * CHROMA_ONE);
+        r->chroma_lut[i] = (int16_t)(c > 32767 ? 32767 : c);
+    }
+    r->lut_layout = layout;
+}
+
+// Converts `count` samples of one row, every `step`-th one starting at `first` (interleaved UV)
+static void load_samples(const uint8_t* row, const YUVFormatLayout* layout, const int16_t* lut,
+    int first, int step, int count, int16_t* out) {
+    if (layout->bytes_per_sample == 1) {
+        for (int i = 0; i < count; i++) {
+            out[i] = lut[row[first + i * step]];
+        }
+        return;
+    }
+    const uint16_t* row16 = (const uint16_t*)row;
+    if (layout->msb_aligned) {
+        int shift = 16 - layout->bit_depth;
+        for (int i = 0; i < count; i++) {
+            out[i] = lut[row16[first + i * step] >> shift];
+        }
+    }
+    else {
+        int mask = (1 << layout->bit_depth) - 1;
+        for (int i = 0; i < count; i++) {
+            out[i] = lut[row16[first + i * step] & mask];
+        }
+    }
+}
+
+static void load_chroma_row(const CpuRenderBand* band, int row, int count, int16_t* u, int16_t* v) {
+    const AVFrame* f = band->frame;
+    const YUVFormatLayout* layout = band->layout;
+    const int16_t* lut = band->renderer->chroma_lut.data();
+    if (layout->plane_count == 2) {
+        const uint8_t* uv = f->data[1] + (size_t)row * f->linesize[1];
+        load_samples(uv, layout, lut, 0, 2, count, u);
+        load_samples(uv, layout, lut, 1, 2, count, v);
+    }
+    else {
+        load_samples(f->data[1] + (size_t)row * f->linesize[1], layout, lut, 0, 1, count, u);
+        load_samples(f->data[2] + (size_t)row * f->linesize[2], layout, lut, 0, 1, count, v);
+    }
+}
+
+// Chroma samples sit at the centers of their texels, as for GL_LINEAR: at full resolution each
+// output sample is 3/4 of the nearest chroma sample and 1/4 of the next one out (edges clamped).
+static void upsample_chroma(const int16_t* in, int in_count, int16_t* out, int out_count) {
+    for (int x = 0; x < out_count; x++) {
+        int k = x >> 1;
+        int n = (x & 1) ? (k + 1 < in_count ? k + 1 : in_count - 1) : (k > 0 ? k - 1 : 0);
+        out[x] = (int16_t)((3 * in[k] + in[n] + 2) >> 2);
+    }
+}
+
+// Fills the band's Y, U and V rows for output row y
+static void prepare_row(CpuRenderBand* band, int y) {
+    const AVFrame* f = band->frame;
+    const YUVFormatLayout* layout = band->layout;
+    int width = f->width;
+    load_samples(f->data[0] + (size_t)y * f->linesize[0], layout, band->renderer->luma_lut.data(), 0, 1, width, band->y_row.data());
+
+    int chroma_width, chroma_height;
+    yuv_plane_size(layout, 1, f->width, f->height, &chroma_width, &chroma_height);
+
+    int16_t* u = band->u_near.data();
+    int16_t* v = band->v_near.data();
+    if (layout->chroma_shift_y) {
+        int k = y >> 1;
+        int far = (y & 1) ? (k + 1 < chroma_height ? k + 1 : chroma_height - 1) : (k > 0 ? k - 1 : 0);
+        load_chroma_row(band, k, chroma_width, u, v);
+        load_chroma_row(band, far, chroma_width, band->u_far.data(), band->v_far.data());
+        for (int i = 0; i < chroma_width; i++) {
+            u[i] = (int16_t)((3 * u[i] + band->u_far[i] + 2) >> 2);
+            v[i] = (int16_t)((3 * v[i] + band->v_far[i] + 2) >> 2);
+        }
+    }
+    else {
+        load_chroma_row(band, y, chroma_width, u, v);
+    }
+
+    if (layout->chroma_shift_x) {
+        upsample_chroma(u, chroma_width, band->u_row.data(), width);
+        upsample_chroma(v, chroma_width, band->v_row.data(), width);
+    }
+    else {
+        memcpy(band->u_row.data(), u, width * sizeof(int16_t));
+        memcpy(band->v_row.data(), v, width * sizeof(int16_t));
+    }
+}
+
+static void convert_band(CpuRenderBand* band) {
+    TRACE_SCOPE("cpu convert band");
+    int width = band->frame->width;
+    if ((int)band->y_row.size() < width) {
+        for (std::vector<int16_t>* row : { &band->y_row, &band->u_row, &band->v_row, &band->u_near, &band->v_near, &band->u_far, &band->v_far }) {
+            row->resize(width);
+        }
+    }
+    ConvertRowFunc convert = kernel_function(band->renderer->kernel);
+    for (int y = band->first_row; y < band->end_row; y++) {
+        prepare_row(band, y);
+        convert(band->y_row.data(), band->u_row.data(), band->v_row.data(), band->dst + (size_t)y * band->dst_stride, width);
+    }
+}
+
+static void band_task(void* arg) {
+    CpuRenderBand* band = (CpuRenderBand*)arg;
+    convert_band(band);
+    CpuRenderer* r = band->renderer;
+    std::lock_guard<std::mutex> lock(r->mutex);
+    if (--r->bands_left == 0) {
+        r->bands_done.notify_one();
+    }
+}
+
+// --- Renderer ---
+
+CpuRenderer* cpu_renderer_create(int threads, CpuConvertKernel kernel) {
+    if (threads <= 0) {
+        threads = (int)std::thread::hardware_concurrency();
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    CpuRenderer* r = new CpuRenderer();
+    r->kernel = cpu_kernel_supported(kernel) ? kernel : CPU_KERNEL_SCALAR;
+    // The calling thread converts the first band itself
+    r->pool = threads > 1 ? task_pool_create(threads - 1) : nullptr;
+    for (int i = 0; i < threads; i++) {
+        CpuRenderBand* band = new CpuRenderBand();
+        band->renderer = r;
+        r->bands.push_back(band);
+    }
+    r->lut_layout = nullptr;
+    r->bands_left = 0;
+    r->frames = 0;
+    r->convert_seconds = 0.0;
+    return r;
+}
+
+void cpu_renderer_destroy(CpuRenderer* r) {
+    if (!r) {
+        return;
+    }
+    if (r->pool) {
+        task_pool_destroy(r->pool);
+    }
+    for (CpuRenderBand* band : r->bands) {
+        delete band;
+    }
+    delete r;
+}
+
+int cpu_renderer_convert(CpuRenderer* r, const AVFrame* frame, uint8_t* dst, int dst_stride) {
+    const YUVFormatLayout* layout = yuv_format_layout(frame->format);
+    if (!layout) {
+        return AVERROR(ENOSYS);
+    }
+    TRACE_SCOPE("cpu convert");
+    auto start = std::chrono::steady_clock::now();
+    if (layout != r->lut_layout) {
+        build_luts(r, layout);
+    }
+
+    // Even band boundaries, so 4:2:0 bands split on chroma rows
+    int band_count = (int)r->bands.size();
+    int rows_per_band = ((frame->height + band_count - 1) / band_count + 1) & ~1;
+    int used = 0;
+    for (int i = 0; i < band_count; i++) {
+        CpuRenderBand* band = r->bands[i];
+        band->frame = frame;
+        band->layout = layout;
+        band->dst = dst;
+        band->dst_stride = dst_stride;
+        band->first_row = i * rows_per_band < frame->height ? i * rows_per_band : frame->height;
+        band->end_row = band->first_row + rows_per_band < frame->height ? band->first_row + rows_per_band : frame->height;
+        if (band->end_row > band->first_row) {
+            used = i + 1;
+        }
+    }
+
+    r->bands_left = used - 1;
+    for (int i = 1; i < used; i++) {
+        task_pool_submit(r->pool, band_task, r->bands[i]);
+    }
+    convert_band(r->bands[0]);
+    {
+        std::unique_lock<std::mutex> lock(r->mutex);
+        r->bands_done.wait(lock, [r] { return r->bands_left == 0; });
+    }
+
+    r->frames++;
+    r->convert_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return 0;
+}
+
+void cpu_renderer_print_stats(const CpuRenderer* r) {
+    fprintf(stdout, "CPU render: %lld frame(s) converted with %s on %d thread(s), %.3f ms/frame\n",
+        r->frames, CPU_KERNEL_NAMES[r->kernel], (int)r->bands.size(),
+        r->frames > 0 ? 1000.0 * r->convert_seconds / r->frames : 0.0);
+    if (r->pool) {
+        task_pool_print_stats(r->pool);
+    }
+}
+
+// --- Framebuffer ---
+
+#ifdef __linux__
+struct CpuFramebuffer {
+    int fd;
+    uint8_t* mem;
+    size_t size;
+    uint8_t* visible;   // Start of the visible area (panning offsets applied)
+    int width;
+    int height;
+    int stride;
+    int red_shift;
+    int green_shift;
+    int blue_shift;
+};
+
+CpuFramebuffer* cpu_framebuffer_open(const char* device) {
+    int fd = open(device, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "CPU render: could not open %s\n", device);
+        return nullptr;
+    }
+    fb_var_screeninfo var;
+    fb_fix_screeninfo fix;
+    if (ioctl(fd, FBIOGET_VSCREENINFO, &var) < 0 || ioctl(fd, FBIOGET_FSCREENINFO, &fix) < 0) {
+        fprintf(stderr, "CPU render: %s is not a framebuffer device\n", device);
+        close(fd);
+        return nullptr;
+    }
+    if (var.bits_per_pixel != 32) {
+        fprintf(stderr, "CPU render: %s is %u bits per pixel; only 32 is supported\n", device, var.bits_per_pixel);
+        close(fd);
+        return nullptr;
+    }
+    void* mem = mmap(nullptr, fix.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "CPU render: could not map %s\n", device);
+        close(fd);
+        return nullptr;
+    }
+
+    CpuFramebuffer* fb = new CpuFramebuffer();
+    fb->fd = fd;
+    fb->mem = (uint8_t*)mem;
+    fb->size = fix.smem_len;
+    fb->stride = fix.line_length;
+    fb->visible = fb->mem + (size_t)var.yoffset * fb->stride + (size_t)var.xoffset * 4;
+    fb->width = var.xres;
+    fb->height = var.yres;
+    fb->red_shift = var.red.offset;
+    fb->green_shift = var.green.offset;
+    fb->blue_shift = var.blue.offset;
+    fprintf(stdout, "CPU render: %s %dx%d\n", device, fb->width, fb->height);
+    return fb;
+}
+
+bool cpu_framebuffer_present(CpuFramebuffer* fb, const uint8_t* rgba, int stride, int width, int height) {
+    TRACE_SCOPE("framebuffer copy");
+    // Centered; whatever doesn't fit is cropped equally on both sides
+    int copy_width = width < fb->width ? width : fb->width;
+    int copy_height = height < fb->height ? height : fb->height;
+    int src_x = (width - copy_width) / 2;
+    int src_y = (height - copy_height) / 2;
+    int dst_x = (fb->width - copy_width) / 2;
+    int dst_y = (fb->height - copy_height) / 2;
+
+    for (int y = 0; y < copy_height; y++) {
+        const uint8_t* src = rgba + (size_t)(src_y + y) * stride + (size_t)src_x * 4;
+        uint32_t* dst = (uint32_t*)(fb->visible + (size_t)(dst_y + y) * fb->stride) + dst_x;
+        for (int x = 0; x < copy_width; x++) {
+            dst[x] = ((uint32_t)src[4 * x] << fb->red_shift) | ((uint32_t)src[4 * x + 1] << fb->green_shift) |
+                ((uint32_t)src[4 * x + 2] << fb->blue_shift);
+        }
+    }
+    return true;
+}
+
+void cpu_framebuffer_close(CpuFramebuffer* fb) {
+    if (!fb) {
+        return;
+    }
+    munmap(fb->mem, fb->size);
+    close(fb->fd);
+    delete fb;
+}
+#elif defined(_WIN32)
+// No framebuffer device: a plain window drawn with GDI, sized to the frames (scaled when resized)
+struct CpuFramebuffer {
+    HWND window;
+    bool closed;                // The user closed the window
+    int width;                  // Frame size the window was last sized for (0 = still hidden)
+    int height;
+    std::vector<uint8_t> bgrx;  // GDI's 32-bit DIBs are BGRX
+};
+
+static const wchar_t* FRAMEBUFFER_WINDOW_CLASS = L"video-player CPU render";
+
+static LRESULT CALLBACK framebuffer_window_proc(HWND window, UINT message, WPARAM wparam, LPARAM lparam) {
+    if (message == WM_CLOSE) {
+        CpuFramebuffer* fb = (CpuFramebuffer*)GetWindowLongPtrW(window, GWLP_USERDATA);
+        if (fb) {
+            fb->closed = true;
+        }
+        return 0;
+    }
+    return DefWindowProcW(window, message, wparam, lparam);
+}
+
+CpuFramebuffer* cpu_framebuffer_open(const char* device) {
+    (void)device; // fb:<device> names a Linux device; there is only the one window here
+    HINSTANCE instance = GetModuleHandleW(nullptr);
+    WNDCLASSW window_class = {};
+    window_class.lpfnWndProc = framebuffer_window_proc;
+    window_class.hInstance = instance;
+    window_class.hCursor = LoadCursor(nullptr, IDC_ARROW);
+    window_class.hbrBackground = (HBRUSH)GetStockObject(BLACK_BRUSH);
+    window_class.lpszClassName = FRAMEBUFFER_WINDOW_CLASS;
+    if (!RegisterClassW(&window_class) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
+        fprintf(stderr, "CPU render: could not register the window class (error %lu)\n", GetLastError());
+        return nullptr;
+    }
+    HWND window = CreateWindowW(FRAMEBUFFER_WINDOW_CLASS, L"Video Player (CPU render)", WS_OVERLAPPEDWINDOW,
+        CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, nullptr, nullptr, instance, nullptr);
+    if (!window) {
+        fprintf(stderr, "CPU render: could not create a window (error %lu)\n", GetLastError());
+        return nullptr;
+    }
+
+    CpuFramebuffer* fb = new CpuFramebuffer();
+    fb->window = window;
+    fb->closed = false;
+    fb->width = 0;
+    fb->height = 0;
+    SetWindowLongPtrW(window, GWLP_USERDATA, (LONG_PTR)fb);
+    fprintf(stdout, "CPU render: GDI window\n");
+    return fb;
+}
+
+bool cpu_framebuffer_present(CpuFramebuffer* fb, const uint8_t* rgba, int stride, int width, int height) {
+    TRACE_SCOPE("framebuffer copy");
+    // This thread owns the window: its messages are handled between frames
+    MSG message;
+    while (PeekMessageW(&message, nullptr, 0, 0, PM_REMOVE)) {
+        TranslateMessage(&message);
+        DispatchMessageW(&message);
+    }
+    if (fb->closed) {
+        return false;
+    }
+
+    if (width != fb->width || height != fb->height) {
+        // First frame or a resolution change: client area of the frame's size
+        RECT rect = { 0, 0, width, height };
+        AdjustWindowRect(&rect, WS_OVERLAPPEDWINDOW, FALSE);
+        SetWindowPos(fb->window, nullptr, 0, 0, rect.right - rect.left, rect.bottom - rect.top, SWP_NOMOVE | SWP_NOZORDER);
+        if (fb->width == 0) {
+            ShowWindow(fb->window, SW_SHOW);
+        }
+        fb->width = width;
+        fb->height = height;
+    }
+
+    fb->bgrx.resize((size_t)width * height * 4);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src = rgba + (size_t)y * stride;
+        uint8_t* dst = fb->bgrx.data() + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++) {
+            dst[4 * x] = src[4 * x + 2];
+            dst[4 * x + 1] = src[4 * x + 1];
+            dst[4 * x + 2] = src[4 * x];
+            dst[4 * x + 3] = 0;
+        }
+    }
+
+    BITMAPINFO info = {};
+    info.bmiHeader.biSize = sizeof(info.bmiHeader);
+    info.bmiHeader.biWidth = width;
+    info.bmiHeader.biHeight = -height; // Top-down
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+    RECT client;
+    GetClientRect(fb->window, &client);
+    HDC dc = GetDC(fb->window);
+    SetStretchBltMode(dc, COLORONCOLOR);
+    StretchDIBits(dc, 0, 0, client.right, client.bottom, 0, 0, width, height, fb->bgrx.data(), &info,
+        DIB_RGB_COLORS, SRCCOPY);
+    ReleaseDC(fb->window, dc);
+    return true;
+}
+
+void cpu_framebuffer_close(CpuFramebuffer* fb) {
+    if (!fb) {
+        return;
+    }
+    DestroyWindow(fb->window);
+    delete fb;
+}
+#else
+struct CpuFramebuffer {
+    int unused;
+};
+
+CpuFramebuffer* cpu_framebuffer_open(const char* device) {
+    fprintf(stderr, "CPU render: framebuffer output (%s) needs Linux fbdev or Windows; write frames with checksum, raw: or png: instead\n", device);
+    return nullptr;
+}
+
+bool cpu_framebuffer_present(CpuFramebuffer*, const uint8_t*, int, int, int) {
+    return false;
+}
+
+void cpu_framebuffer_close(CpuFramebuffer*) {
+}
+#endif
+
+// --- Microbenchmark ---
+
+// Deterministic noise at the format's depth: worst case for the chroma interpolation
+static int fill_benchmark_frame(AVFrame* frame, const YUVFormatLayout* layout) {
+    int ret = av_frame_get_buffer(frame, 64);
+    if (ret < 0) {
+        return ret;
+    }
+    uint32_t seed = 12345;
+    int shift = layout->msb_aligned ? 16 - layout->bit_depth : 0;
+    for (int i = 0; i < layout->plane_count; i++) {
+        int w, h;
+        yuv_plane_size(layout, i, frame->width, frame->height, &w, &h);
+        int samples = w * yuv_plane_components(layout, i);
+        for (int y = 0; y < h; y++) {
+            uint8_t* row = frame->data[i] + (size_t)y * frame->linesize[i];
+            for (int x = 0; x < samples; x++) {
+                seed = seed * 1664525u + 1013904223u;
+                int value = (int)((seed >> 8) & ((1u << layout->bit_depth) - 1));
+                if (layout->bytes_per_sample == 1) {
+                    row[x] = (uint8_t)value;
+                }
+                else {
+                    ((uint16_t*)row)[x] = (uint16_t)(value << shift);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static double time_converts(CpuRenderer* r, const AVFrame* frame, uint8_t* dst, int iterations) {
+    cpu_renderer_convert(r, frame, dst, frame->width * 4); // Warm-up: LUTs, row buffers, caches
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        cpu_renderer_convert(r, frame, dst, frame->width * 4);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int cpu_convert_benchmark(int width, int height, int iterations, int threads) {
+    const AVPixelFormat formats[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_P010LE };
+    const int TOLERANCE = 2;
+    if (width < 2 || height < 2 || iterations < 1) {
+        fprintf(stderr, "CPU convert benchmark: invalid size or iteration count\n");
+        return -1;
+    }
+
+    size_t rgba_size = (size_t)width * height * 4;
+    std::vector<uint8_t> reference(rgba_size);
+    std::vector<uint8_t> output(rgba_size);
+    std::vector<int16_t> y_row(width), u_row(width), v_row(width);
+    double mpix = (double)width * height * iterations / 1e6;
+    int worst = 0;
+
+    fprintf(stdout, "CPU convert benchmark: %dx%d, %d iteration(s), best kernel %s\n", width, height, iterations,
+        CPU_KERNEL_NAMES[cpu_best_kernel()]);
+    for (AVPixelFormat format : formats) {
+        const YUVFormatLayout* layout = yuv_format_layout(format);
+        AVFrame* frame = av_frame_alloc();
+        frame->width = width;
+        frame->height = height;
+        frame->format = format;
+        if (!layout || fill_benchmark_frame(frame, layout) < 0) {
+            av_frame_free(&frame);
+            continue;
+        }
+        fprintf(stdout, "  %s\n", av_get_pix_fmt_name(format));
+
+        CpuRenderer* scalar = cpu_renderer_create(1, CPU_KERNEL_SCALAR);
+        cpu_renderer_convert(scalar, frame, reference.data(), width * 4);
+        cpu_renderer_destroy(scalar);
+
+        for (int k = 0; k < CPU_KERNEL_COUNT; k++) {
+            if (!cpu_kernel_supported((CpuConvertKernel)k)) {
+                continue;
+            }
+            CpuRenderer* r = cpu_renderer_create(1, (CpuConvertKernel)k);
+            double frame_seconds = time_converts(r, frame, output.data(), iterations);
+
+            // Kernel alone, on rows prepared once: what the SIMD code itself sustains
+            r->bands[0]->frame = frame;
+            r->bands[0]->layout = layout;
+            prepare_row(r->bands[0], height / 2);
+            ConvertRowFunc convert = kernel_function((CpuConvertKernel)k);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                for (int y = 0; y < height; y++) {
+                    convert(r->bands[0]->y_row.data(), r->bands[0]->u_row.data(), r->bands[0]->v_row.data(),
+                        output.data() + (size_t)y * width * 4, width);
+                }
+            }
+            double kernel_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // Compared on a full conversion again (the kernel-only loop overwrote the output)
+            cpu_renderer_convert(r, frame, output.data(), width * 4);
+            int max_diff = 0;
+            for (size_t i = 0; i < rgba_size; i++) {
+                int diff = abs((int)output[i] - (int)reference[i]);
+                max_diff = diff > max_diff ? diff : max_diff;
+            }
+            worst = max_diff > worst ? max_diff : worst;
+            fprintf(stdout, "    %-7s kernel %8.1f Mpix/s   frame %8.1f Mpix/s   max diff vs scalar %d\n", CPU_KERNEL_NAMES[k],
+                kernel_seconds > 0.0 ? mpix / kernel_seconds : 0.0, frame_seconds > 0.0 ? mpix / frame_seconds : 0.0, max_diff);
+            cpu_renderer_destroy(r);
+        }
+
+        CpuRenderer* r = cpu_renderer_create(threads, cpu_best_kernel());
+        double seconds = time_converts(r, frame, output.data(), iterations);
+        fprintf(stdout, "    %-7s x%d threads       frame %8.1f Mpix/s\n", CPU_KERNEL_NAMES[r->kernel], (int)r->bands.size(),
+            seconds > 0.0 ? mpix / seconds : 0.0);
+        cpu_renderer_destroy(r);
+        av_frame_free(&frame);
+    }
+
+    if (worst > TOLERANCE) {
+        fprintf(stderr, "CPU convert benchmark: a kernel differs from the scalar reference by %d (tolerance %d)\n", worst, TOLERANCE);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include<libavutil/frame.h>
+}
+
+#include "yuv_format.h"
+
+struct TaskPool;
+
+// CPU rendering backend: decoded frames converted to RGBA without a GPU (kiosks, VMs with
+// software GL), for the framebuffer or a frame writer.
+//
+// The conversion is the fragment shader's: samples normalized per bit depth, chroma upsampled
+// bilinearly with the texture sampler's centered siting, then the same BT.709 full-range matrix.
+// Every row is first expanded to full-width 16-bit Y/U/V rows (LUT + chroma interpolation, any
+// layout in yuv_format.h); a kernel then turns those into RGBA pixels:
+//   scalar  float reference, the shader's math as written
+//   sse2    8 pixels per step, 16-bit fixed point
+//   avx2    16 pixels per step, same arithmetic as sse2
+// The SIMD kernels agree with each other exactly and with the reference within 1-2 levels.
+// Frames are split into row bands converted in parallel on a work-stealing pool.
+
+enum CpuConvertKernel {
+    CPU_KERNEL_SCALAR = 0,
+    CPU_KERNEL_SSE2,
+    CPU_KERNEL_AVX2,
+    CPU_KERNEL_COUNT
+};
+
+extern const char* CPU_KERNEL_NAMES[CPU_KERNEL_COUNT];
+
+bool cpu_kernel_supported(CpuConvertKernel kernel);
+// Fastest kernel this CPU runs (runtime dispatch on the CPUID flags)
+CpuConvertKernel cpu_best_kernel();
+// "scalar", "sse2", "avx2" or "auto". Returns <0 if unknown or not supported here.
+int parse_cpu_kernel(const char* name, CpuConvertKernel* out);
+
+struct CpuRenderBand;
+
+struct CpuRenderer {
+    CpuConvertKernel kernel;
+    TaskPool* pool;
+    std::vector<CpuRenderBand*> bands;
+
+    // Sample -> 16-bit fixed point tables for the last frame's layout
+    const YUVFormatLayout* lut_layout;
+    std::vector<int16_t> luma_lut;
+    std::vector<int16_t> chroma_lut;
+
+    // Bands of the frame being converted that are still running
+    std::mutex mutex;
+    std::condition_variable bands_done;
+    int bands_left;
+
+    // Statistics
+    long long frames;
+    double convert_seconds;
+};
+
+// threads <= 0 uses the hardware concurrency; 1 converts on the calling thread.
+CpuRenderer* cpu_renderer_create(int threads, CpuConvertKernel kernel);
+void cpu_renderer_destroy(CpuRenderer* renderer);
+
+// Converts the frame into top-down RGBA (dst_stride bytes per row, frame size).
+// Returns 0, or AVERROR(ENOSYS) for a pixel format without a layout.
+int cpu_renderer_convert(CpuRenderer* renderer, const AVFrame* frame, uint8_t* dst, int dst_stride);
+void cpu_renderer_print_stats(const CpuRenderer* renderer);
+
+// Screen output without GL. Linux: the framebuffer device (fbdev), frames centered on the screen
+// (cropped if larger). Windows: a GDI window sized to the frames; `device` is ignored.
+// present() returns false once the output is gone (the window was closed).
+struct CpuFramebuffer;
+CpuFramebuffer* cpu_framebuffer_open(const char* device);
+bool cpu_framebuffer_present(CpuFramebuffer* fb, const uint8_t* rgba, int stride, int width, int height);
+void cpu_framebuffer_close(CpuFramebuffer* fb);
+
+// Microbenchmark: a synthetic width x height frame of every layout family converted with every
+// kernel the CPU supports, single-threaded and on the pool. Prints megapixels/sec per kernel and the
+// largest difference from the scalar reference. Returns 0, or -1 if a kernel is off by more than 2.
+int cpu_convert_benchmark(int width, int height, int iterations, int threads);
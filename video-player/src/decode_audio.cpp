@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "decode_audio.h"
+#include "decode_video.h"
+#include "trace.h"
+
+extern "C" {
+#include<libswresample/swresample.h>
+#include<libavutil/channel_layout.h>
+}
+
+// Audio kept queued in the sink. Larger survives longer stalls of the audio thread, smaller
+// makes pause and seek respond faster.
+static const double AUDIO_SINK_LATENCY = 0.15;
+
+// Drift beyond this is noticeable (ITU-R BT.1359 detectability threshold for audio leading)
+static const double AUDIO_DRIFT_WARN_MS = 45.0;
+static const double AUDIO_DRIFT_REPORT_INTERVAL = 10.0;
+
+static AVCodecContext* audio_codec_ctx = nullptr;   // nullptr while a playlist item without audio plays
+static AVRational audio_time_base;
+static double audio_pts_offset = 0.0;   // Playlist time - stream time of the item being decoded
+static AudioSink* audio_sink = nullptr;
+static SwrContext* swr_ctx = nullptr;
+static int swr_in_format = -1;
+static int swr_in_rate = 0;
+static int swr_in_channels = 0;
+
+// Packet queue (demuxer thread -> audio thread). A null packet marks end of file.
+// Every flush bumps the serial; the audio thread resets its decoder and sink when it changes.
+// A switch entry (gapless playlists) hands over the decoder for the packets queued after it.
+struct QueuedAudioPacket {
+    AVPacket* pkt;
+    int serial;
+    double seconds;
+    bool stream_switch;
+    AVCodecContext* next_decoder;
+    AVRational next_time_base;
+    double next_pts_offset;
+};
+static std::mutex audio_queue_mutex;
+static std::condition_variable audio_queue_cond;
+static std::deque<QueuedAudioPacket> audio_packets;
+static double audio_packets_seconds = 0.0;
+static AVRational queue_time_base;   // Time base of the packets being queued (demuxer side)
+static std::atomic<int> audio_serial(0);
+static double audio_start_seconds = 0.0;   // Samples before this are dropped (seek target)
+
+static std::thread audio_thread;
+static std::atomic<bool> audio_stop_requested(false);
+
+// Clock: PTS at the end of the last samples written. Updated together with the write so
+// the render thread never sees one without the other.
+static std::mutex audio_clock_mutex;
+static double audio_written_end_pts = 0.0;
+static bool audio_clock_valid = false;
+
+// Drift samples (video PTS - audio clock, in ms) for every presented frame
+static std::vector<float> drift_samples;
+static size_t drift_report_start = 0;
+static std::chrono::steady_clock::time_point drift_report_time;
+
+static double packet_seconds(const AVPacket* pkt) {
+    return pkt && pkt->duration > 0 ? pkt->duration * av_q2d(queue_time_base) : 0.0;
+}
+
+static bool stream_switch_queued() {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex);
+    return !audio_packets.empty() && audio_packets.front().stream_switch;
+}
+
+// Audio thread: the previous item is fully decoded; continue with the next item's decoder.
+static void switch_audio_stream(const QueuedAudioPacket& item) {
+    avcodec_free_context(&audio_codec_ctx);
+    audio_codec_ctx = item.next_decoder;
+    audio_time_base = item.next_time_base;
+    std::lock_guard<std::mutex> lock(audio_clock_mutex);
+    audio_pts_offset = item.next_pts_offset;
+}
+
+static bool pop_audio_packet(QueuedAudioPacket* out) {
+    std::unique_lock<std::mutex> lock(audio_queue_mutex);
+    audio_queue_cond.wait_for(lock, std::chrono::milliseconds(10),
+        [] { return !audio_packets.empty() || audio_stop_requested.load(); });
+    if (audio_packets.empty()) {
+        return false;
+    }
+    *out = audio_packets.front();
+    audio_packets.pop_front();
+    audio_packets_seconds -= out->seconds;
+    return true;
+}
+
+// (Re)creates the resampler when the decoded format changes; output stays sink format.
+static int configure_resampler(const AVFrame* frame) {
+    if (swr_ctx && frame->format == swr_in_format && frame->sample_rate == swr_in_rate &&
+        frame->ch_layout.nb_channels == swr_in_channels) {
+        return 0;
+    }
+    swr_free(&swr_ctx);
+
+    AVChannelLayout out_layout;
+    av_channel_layout_default(&out_layout, audio_sink->channels);
+    int ret = swr_alloc_set_opts2(&swr_ctx, &out_layout, AV_SAMPLE_FMT_S16, audio_sink->sample_rate,
+        &frame->ch_layout, (AVSampleFormat)frame->format, frame->sample_rate, 0, nullptr);
+    av_channel_layout_uninit(&out_layout);
+    if (ret >= 0) {
+        ret = swr_init(swr_ctx);
+    }
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+        swr_free(&swr_ctx);
+        return ret;
+    }
+    swr_in_format = frame->format;
+    swr_in_rate = frame->sample_rate;
+    swr_in_channels = frame->ch_layout.nb_channels;
+    return 0;
+}
+
+// Converts a decoded frame and writes it to the sink, trimming anything before the seek target.
+static void output_frame(AVFrame* frame, int serial, std::vector<int16_t>& samples) {
+    TRACE_SCOPE("audio output");
+    if (configure_resampler(frame) < 0) {
+        return;
+    }
+
+    int channels = audio_sink->channels;
+    int out_count = swr_get_out_samples(swr_ctx, frame->nb_samples);
+    samples.resize((size_t)out_count * channels);
+    uint8_t* out = (uint8_t*)samples.data();
+    int frames = swr_convert(swr_ctx, &out, out_count, (const uint8_t**)frame->extended_data, frame->nb_samples);
+    if (frames <= 0) {
+        return;
+    }
+
+    int64_t ts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+
+    std::lock_guard<std::mutex> lock(audio_clock_mutex);
+    double pts = ts != AV_NOPTS_VALUE ? ts * av_q2d(audio_time_base) + audio_pts_offset : audio_written_end_pts;
+
+    // After a seek, audio resumes exactly at the target: drop whole frames before it and trim the first one
+    int skip = 0;
+    if (pts < audio_start_seconds) {
+        skip = (int)((audio_start_seconds - pts) * audio_sink->sample_rate);
+        if (skip >= frames) {
+            return;
+        }
+    }
+    if (serial != audio_serial.load()) {
+        return; // Flushed while converting
+    }
+
+    if (audio_sink->write(audio_sink, samples.data() + (size_t)skip * channels, frames - skip) < 0) {
+        return;
+    }
+    audio_written_end_pts = pts + (double)frames / audio_sink->sample_rate;
+    audio_clock_valid = true;
+}
+
+static void audio_thread_main() {
+    trace_set_thread_name("audio");
+    AVFrame* frame = av_frame_alloc();
+    std::vector<int16_t> samples;
+    int decoder_serial = -1;
+    bool draining = false;
+
+    while (frame && !audio_stop_requested.load(std::memory_order_relaxed)) {
+        // A flush from the demuxer: forget everything decoded or queued before it
+        int serial = audio_serial.load();
+        if (serial != decoder_serial) {
+            if (audio_codec_ctx) {
+                avcodec_flush_buffers(audio_codec_ctx);
+            }
+            audio_sink->flush(audio_sink);
+            std::lock_guard<std::mutex> lock(audio_clock_mutex);
+            audio_clock_valid = false;
+            decoder_serial = serial;
+            draining = false;
+        }
+
+        // Keep only AUDIO_SINK_LATENCY queued in the sink; the rest waits as packets
+        if (audio_sink->buffered(audio_sink) > AUDIO_SINK_LATENCY) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+
+        int ret = AVERROR_EOF; // A playlist item without audio decodes nothing
+        if (audio_codec_ctx) {
+            TRACE_SCOPE("audio decode");
+            ret = avcodec_receive_frame(audio_codec_ctx, frame);
+        }
+        if (ret == 0) {
+            output_frame(frame, decoder_serial, samples);
+            av_frame_unref(frame);
+            continue;
+        }
+        if ((ret == AVERROR_EOF || draining) && !stream_switch_queued()) {
+            // Track ended: idle until a seek flushes the decoder or the next playlist item starts
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        if (ret != AVERROR(EAGAIN)) {
+            print_ffmpeerr(ret);
+        }
+
+        QueuedAudioPacket item;
+        if (!pop_audio_packet(&item)) {
+            continue;
+        }
+        if (item.stream_switch) {
+            // Whatever the old decoder still held was drained above (or dropped by a seek)
+            switch_audio_stream(item);
+            draining = false;
+            continue;
+        }
+        if (item.serial == decoder_serial && audio_codec_ctx) {
+            ret = avcodec_send_packet(audio_codec_ctx, item.pkt);
+            if (!item.pkt) {
+                draining = true;
+            }
+            else if (ret < 0 && ret != AVERROR(EAGAIN)) {
+                print_ffmpeerr(ret); // A corrupt packet only costs its own samples
+            }
+        }
+        av_packet_free(&item.pkt);
+    }
+
+    av_frame_free(&frame);
+}
+
+AVCodecContext* audio_open_decoder(AVFormatContext* fmt_ctx, int stream_index) {
+    AVStream* stream = fmt_ctx->streams[stream_index];
+    const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        fprintf(stderr, "Audio: unsupported codec\n");
+        return nullptr;
+    }
+
+    AVCodecContext* ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        return nullptr;
+    }
+    int ret = avcodec_parameters_to_context(ctx, stream->codecpar);
+    if (ret >= 0) {
+        ctx->pkt_timebase = stream->time_base;
+        ret = avcodec_open2(ctx, codec, nullptr);
+    }
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+        avcodec_free_context(&ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+int audio_open(AVFormatContext* fmt_ctx, int stream_index, AudioSinkType sink_type, const char* wav_path) {
+    AVStream* stream = fmt_ctx->streams[stream_index];
+    audio_codec_ctx = audio_open_decoder(fmt_ctx, stream_index);
+    if (!audio_codec_ctx) {
+        return -1;
+    }
+
+    // Sink format: the stream's rate, downmixed to at most stereo
+    int channels = audio_codec_ctx->ch_layout.nb_channels >= 2 ? 2 : 1;
+    audio_sink = audio_sink_open(sink_type, wav_path, audio_codec_ctx->sample_rate, channels);
+    if (!audio_sink) {
+        avcodec_free_context(&audio_codec_ctx);
+        return -1;
+    }
+
+    audio_time_base = stream->time_base;
+    queue_time_base = stream->time_base;
+    audio_pts_offset = 0.0;
+    audio_stop_requested.store(false);
+    audio_clock_valid = false;
+    drift_samples.clear();
+    drift_report_start = 0;
+    drift_report_time = std::chrono::steady_clock::now();
+    audio_thread = std::thread(audio_thread_main);
+
+    fprintf(stdout, "Audio: stream %d, %s, %d Hz, %d channel(s)\n", stream_index, audio_codec_ctx->codec->name,
+        audio_codec_ctx->sample_rate, audio_codec_ctx->ch_layout.nb_channels);
+    return 0;
+}
+
+void audio_queue_packet(const AVPacket* pkt) {
+    AVPacket* copy = nullptr;
+    if (pkt) {
+        copy = av_packet_clone(pkt);
+        if (!copy) {
+            return;
+        }
+    }
+    std::lock_guard<std::mutex> lock(audio_queue_mutex);
+    QueuedAudioPacket item = {};
+    item.pkt = copy;
+    item.serial = audio_serial.load(std::memory_order_relaxed);
+    item.seconds = packet_seconds(copy);
+    audio_packets.push_back(item);
+    audio_packets_seconds += item.seconds;
+    audio_queue_cond.notify_one();
+}
+
+void audio_queue_stream_switch(AVCodecContext* decoder, AVRational time_base, double pts_offset) {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex);
+    QueuedAudioPacket item = {};
+    item.serial = audio_serial.load(std::memory_order_relaxed);
+    item.stream_switch = true;
+    item.next_decoder = decoder;
+    item.next_time_base = time_base;
+    item.next_pts_offset = pts_offset;
+    audio_packets.push_back(item);
+    queue_time_base = time_base;
+    audio_queue_cond.notify_one();
+}
+
+// Frees a queued entry; returns the switch entries a flush must keep (the decoder changes regardless).
+static bool free_queued_packet(QueuedAudioPacket& item) {
+    av_packet_free(&item.pkt);
+    return item.stream_switch;
+}
+
+double audio_queued_seconds() {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex);
+    return audio_packets_seconds;
+}
+
+void audio_flush(double start_seconds) {
+    {
+        std::lock_guard<std::mutex> lock(audio_queue_mutex);
+        std::deque<QueuedAudioPacket> switches;
+        for (QueuedAudioPacket& item : audio_packets) {
+            if (free_queued_packet(item)) {
+                switches.push_back(item);
+            }
+        }
+        audio_packets.swap(switches);
+        audio_packets_seconds = 0.0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(audio_clock_mutex);
+        audio_start_seconds = start_seconds;
+        audio_clock_valid = false;
+        audio_serial.fetch_add(1);
+    }
+    audio_queue_cond.notify_one();
+}
+
+void audio_set_paused(bool paused) {
+    if (audio_sink) {
+        audio_sink->pause(audio_sink, paused);
+    }
+}
+
+bool audio_get_clock(double* seconds) {
+    if (!audio_sink) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(audio_clock_mutex);
+    if (!audio_clock_valid) {
+        return false;
+    }
+    double buffered = audio_sink->buffered(audio_sink);
+    if (buffered <= 0.0 && audio_queued_seconds() <= 0.0) {
+        return false; // Ran dry (end of track or starved): the clock would just stand still
+    }
+    *seconds = audio_written_end_pts - buffered;
+    return true;
+}
+
+// Summary of drift_samples[begin, end)
+static void print_drift_stats(const char* label, size_t begin, size_t end) {
+    if (begin >= end) {
+        return;
+    }
+    std::vector<float> abs_ms;
+    abs_ms.reserve(end - begin);
+    double sum = 0.0;
+    int over = 0;
+    for (size_t i = begin; i < end; i++) {
+        sum += drift_samples[i];
+        abs_ms.push_back(fabsf(drift_samples[i]));
+        if (abs_ms.back() > AUDIO_DRIFT_WARN_MS) {
+            over++;
+        }
+    }
+    std::sort(abs_ms.begin(), abs_ms.end());
+    size_t p95 = (size_t)(0.95 * (abs_ms.size() - 1));
+    fprintf(stdout, "A/V drift (%s): %zu frames, mean %+.1f ms, p95 |%.1f| ms, max |%.1f| ms, %d frame(s) beyond %.0f ms\n",
+        label, abs_ms.size(), sum / abs_ms.size(), abs_ms[p95], abs_ms.back(), over, AUDIO_DRIFT_WARN_MS);
+}
+
+void audio_record_drift(double video_pts) {
+    double clock;
+    if (!audio_get_clock(&clock)) {
+        return;
+    }
+    drift_samples.push_back((float)((video_pts - clock) * 1000.0));
+
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - drift_report_time).count() >= AUDIO_DRIFT_REPORT_INTERVAL) {
+        print_drift_stats("recent", drift_report_start, drift_samples.size());
+        drift_report_start = drift_samples.size();
+        drift_report_time = now;
+    }
+}
+
+void audio_close() {
+    if (!audio_sink) {
+        return;
+    }
+    audio_stop_requested.store(true);
+    audio_queue_cond.notify_one();
+    if (audio_thread.joinable()) {
+        audio_thread.join();
+    }
+
+    print_drift_stats("session", 0, drift_samples.size());
+
+    for (QueuedAudioPacket& item : audio_packets) {
+        av_packet_free(&item.pkt);
+        avcodec_free_context(&item.next_decoder);
+    }
+    audio_packets.clear();
+    audio_packets_seconds = 0.0;
+
+    swr_free(&swr_ctx);
+    swr_in_format = -1;
+    audio_sink_close(audio_sink);
+    audio_sink = nullptr;
+    avcodec_free_context(&audio_codec_ctx);
+    audio_codec_ctx = nullptr;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+extern "C" {
+#include<libavcodec/avcodec.h>
+#include<libavformat/avformat.h>
+}
+
+#include "audio_sink.h"
+
+// Audio decode + resample thread and the audio-master clock.
+//
+// The demuxer in decode_video.cpp routes the audio stream's packets here; the audio thread
+// decodes them, converts to interleaved 16-bit PCM and feeds the sink. The clock is the PTS
+// of the sample being heard: PTS at the end of the last write minus what the sink still holds.
+
+// Opens the decoder for the stream and the sink, and starts the audio thread. Returns <0 on error.
+int audio_open(AVFormatContext* fmt_ctx, int stream_index, AudioSinkType sink_type, const char* wav_path);
+
+// Opens a decoder for the stream without touching the sink (the next item of a gapless playlist).
+AVCodecContext* audio_open_decoder(AVFormatContext* fmt_ctx, int stream_index);
+
+// Demuxer thread: packets queued from now on belong to the next playlist item. The audio thread
+// drains the current decoder, then continues with `decoder` (takes ownership; nullptr for an item
+// without audio) and adds pts_offset to its timestamps so the clock stays on the playlist timeline.
+void audio_queue_stream_switch(AVCodecContext* decoder, AVRational time_base, double pts_offset);
+
+// Demuxer thread: queues a packet of the audio stream (takes a new reference), or
+// nullptr at end of file so the decoder is drained.
+void audio_queue_packet(const AVPacket* pkt);
+// Demuxer thread: seconds of audio waiting in the packet queue.
+double audio_queued_seconds();
+// Demuxer thread: drops queued and buffered audio; output restarts at start_seconds (after a seek).
+void audio_flush(double start_seconds);
+
+void audio_set_paused(bool paused);
+
+// Render thread: the audio clock in seconds. Returns false while no audio is playing
+// (before the first samples after a seek, after the track ended), so the caller can fall back.
+bool audio_get_clock(double* seconds);
+
+// Render thread: records the A/V drift of a video frame just presented. Prints a summary periodically.
+void audio_record_drift(double video_pts);
+
+// Stops the audio thread, prints the drift statistics and closes the sink.
+void audio_close();
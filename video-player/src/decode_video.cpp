@@ -1,9 +1,24 @@
 #include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+#include <math.h>
 
-extern "C" {
-#include<libavcodec/avcodec.h>
-#include<libavformat/avformat.h>
-}
+#include "decode_video.h"
+#include "decode_audio.h"
+#include "catchup.h"
+#include "frame_cache.h"
+#include "frame_pool.h"
+#include "frame_queue.h"
+#include "keyframe_index.h"
+#include "startup_timing.h"
+#include "trace.h"
 
 AVFormatContext* fmt_ctx;
 AVCodecContext* codec_ctx = nullptr;
@@ -11,6 +26,82 @@ AVPacket* packet = nullptr;
 int video_stream_index = -1;
 // Global variable to hold the stream's time base (Crucial for PTS conversion)
 AVRational video_stream_time_base;
+static double video_frame_delay = 0.0;
+
+// Playlist time minus stream time of the current input (0 for the first input). Frame PTS are
+// reported, and seek targets given, on the playlist timeline. See "Gapless playlist" below.
+static double item_pts_offset = 0.0;
+
+// Degrades decoding while presentation lags (decoder thread, forward playback only). The
+// controller always runs so trick play can set its floor; catchup_enabled is the adaptive part.
+static CatchUpController catchup;
+static bool catchup_enabled = false;
+static bool catchup_forward = false;   // The current decode_next_frame() call may drop packets
+
+// Trick play: the rate requested by the render thread (see set_playback_rate()) and the decoder
+// thread's setup for it, redone whenever the rate changes
+static std::atomic<double> requested_playback_rate(1.0);
+static std::atomic<double> display_refresh_period(1.0 / 60.0);
+static double trick_rate = 1.0;
+static double trick_refresh_period = 1.0 / 60.0;
+static bool trick_keyframes_only = false;
+static double trick_frame_spacing = 0.0;      // Media seconds between frames worth decoding (0 = all)
+static double trick_last_queued = -HUGE_VAL;  // pts of the last frame queued
+static double trick_last_key = -HUGE_VAL;     // pts of the last keyframe sent to the decoder
+static long long trick_packets_skipped = 0;
+static long long trick_frames_skipped = 0;
+static long long trick_keyframes_decoded = 0;
+
+// Custom I/O of the open file (nullptr when FFmpeg reads it itself)
+static AVIOContext* read_ahead_io = nullptr;
+
+// Receive thread and jitter buffer of a network input (nullptr for local files). Only the input
+// given to init_ffmpeg() uses it; later playlist items are read directly.
+static NetInput* net_input = nullptr;
+static bool network_initialized = false;   // avformat_network_init() was called (sockets, TLS)
+
+// Keyframe index of the open file (nullptr if disabled)
+static KeyframeIndex* keyframe_index = nullptr;
+
+// Decoded-frame cache for backward stepping / reverse playback (nullptr if disabled)
+static FrameCache* frame_cache = nullptr;
+// Input playing: 0 = init_ffmpeg()'s, i = playlist[i - 1]. Keys the frame cache entries.
+static int current_item = 0;
+
+// Frame decoded past a seek target, returned by the next decode_next_frame() call
+static AVFrame* pending_seek_frame = nullptr;
+
+// First frames of the current playlist item, decoded by the preload thread and returned by
+// decode_next_frame() before anything else
+static std::deque<AVFrame*> preroll_frames;
+
+// Audio stream routed to decode_audio.cpp (-1 if none or disabled). GOP decodes for the
+// frame cache turn routing off; that audio would never be played.
+static int audio_stream_index = -1;
+static bool route_audio_packets = true;
+// The audio thread runs (audio_open() succeeded); later playlist items switch its decoder
+static bool audio_enabled = false;
+
+// Video packets demuxed early to keep the audio queue fed while the frame queue is full.
+// decode_next_frame() consumes these before reading more.
+static std::deque<AVPacket*> video_packet_backlog;
+
+// Demux ahead for audio until this much is queued, holding at most MAX_VIDEO_BACKLOG video
+// packets. Containers interleave audio in chunks of up to ~1 s, more than the frame queue covers.
+static const double AUDIO_DEMUX_AHEAD_SECONDS = 1.0;
+static const size_t MAX_VIDEO_BACKLOG = 256;
+
+// Threading configuration used by the next init_ffmpeg() call
+static DecoderOptions decoder_options = default_decoder_options();
+
+// Probe limits with DecoderOptions::fast_start (FFmpeg's defaults are 5 MB and 5 s). Enough for
+// containers that carry the codec parameters in their header (MP4, MKV) and for most TS streams.
+static const int64_t FAST_START_PROBESIZE = 512 * 1024;
+static const int64_t FAST_START_ANALYZE_US = 500 * 1000;
+
+// Upper bound for auto-detected decode threads; libavcodec warns above 16 frame threads
+// and the extra frames of latency stop paying for themselves well before that.
+static const int MAX_AUTO_DECODE_THREADS = 16;
 
 void print_ffmpeerr(int err_code) {
     char err_buf[AV_ERROR_MAX_STRING_SIZE];
@@ -18,79 +109,379 @@ void print_ffmpeerr(int err_code) {
     fprintf(stderr, "FFmpeg Error: %s\n", err_buf);
 }
 
-// Initialization: Opens the file and sets up the decoding context.
-// frame_delay_out is now unused but kept in signature for compatibility.
-int init_ffmpeg(const char* file_name, int* w, int* h, double* frame_delay_out, AVFrame** frame) {
+DecoderOptions default_decoder_options() {
+    DecoderOptions options;
+    options.thread_count = 0;
+    options.thread_type = DECODER_THREAD_AUTO;
+    options.override_count = 0;
+    options.use_frame_pool = false;
+    options.use_keyframe_index = false;
+    options.frame_cache_mb = 0;
+    options.audio_sink = AUDIO_SINK_NONE;
+    options.audio_wav_path[0] = '\0';
+    options.read_ahead = READ_AHEAD_OFF;
+    options.read_ahead_mb = DEFAULT_READ_AHEAD_MB;
+    options.catch_up = false;
+    options.fast_start = false;
+    options.network = default_net_input_options();
+    return options;
+}
+
+void set_decoder_options(const DecoderOptions& options) {
+    decoder_options = options;
+}
+
+// Parses a --thread-type value. Returns 0 on success, -1 if the name is unknown.
+int parse_decoder_thread_type(const char* name, DecoderThreadType* out) {
+    if (strcmp(name, "auto") == 0) *out = DECODER_THREAD_AUTO;
+    else if (strcmp(name, "frame") == 0) *out = DECODER_THREAD_FRAME;
+    else if (strcmp(name, "slice") == 0) *out = DECODER_THREAD_SLICE;
+    else if (strcmp(name, "none") == 0) *out = DECODER_THREAD_NONE;
+    else return -1;
+    return 0;
+}
+
+// Applies a --thread-type argument: either "T" (the default for every codec) or
+// "codec=T" (only for that decoder, e.g. "hevc=slice"). Returns 0 on success, -1 if invalid.
+int add_decoder_thread_type_arg(DecoderOptions* options, const char* arg) {
+    const char* eq = strchr(arg, '=');
+    if (!eq) {
+        return parse_decoder_thread_type(arg, &options->thread_type);
+    }
+
+    size_t name_len = eq - arg;
+    if (name_len == 0 || name_len >= sizeof(options->overrides[0].codec_name) ||
+        options->override_count >= MAX_DECODER_THREAD_OVERRIDES) {
+        return -1;
+    }
+
+    DecoderThreadOverride* entry = &options->overrides[options->override_count];
+    if (parse_decoder_thread_type(eq + 1, &entry->thread_type) < 0) {
+        return -1;
+    }
+    memcpy(entry->codec_name, arg, name_len);
+    entry->codec_name[name_len] = '\0';
+    options->override_count++;
+    return 0;
+}
+
+static const char* active_thread_type_name(int active_thread_type) {
+    if (active_thread_type & FF_THREAD_FRAME) return "frame";
+    if (active_thread_type & FF_THREAD_SLICE) return "slice";
+    return "none";
+}
+
+// Sets thread_count/thread_type on the codec context from decoder_options.
+// Must be called between avcodec_alloc_context3() and avcodec_open2().
+static void apply_decoder_threading(AVCodecContext* ctx, const AVCodec* codec) {
+    int threads = decoder_options.thread_count;
+    if (threads <= 0) {
+        // hardware_concurrency() may return 0 when it can't tell; fall back to libavcodec's own detection.
+        unsigned int cores = std::thread::hardware_concurrency();
+        threads = cores > 0 ? (int)cores : 0;
+        if (threads > MAX_AUTO_DECODE_THREADS) {
+            threads = MAX_AUTO_DECODE_THREADS;
+        }
+    }
+
+    // A per-codec override wins over the default threading model
+    DecoderThreadType thread_type = decoder_options.thread_type;
+    for (int i = 0; i < decoder_options.override_count; i++) {
+        if (strcmp(decoder_options.overrides[i].codec_name, codec->name) == 0) {
+            thread_type = decoder_options.overrides[i].thread_type;
+        }
+    }
+
+    int type = 0;
+    switch (thread_type) {
+    case DECODER_THREAD_AUTO:  type = FF_THREAD_FRAME | FF_THREAD_SLICE; break;
+    case DECODER_THREAD_FRAME: type = FF_THREAD_FRAME; break;
+    case DECODER_THREAD_SLICE: type = FF_THREAD_SLICE; break;
+    case DECODER_THREAD_NONE:  type = 0; threads = 1; break;
+    }
+
+    if ((type & FF_THREAD_FRAME) && !(codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)) {
+        fprintf(stderr, "Warning: %s has no frame threading support\n", codec->name);
+    }
+    if ((type & FF_THREAD_SLICE) && !(codec->capabilities & AV_CODEC_CAP_SLICE_THREADS)) {
+        fprintf(stderr, "Warning: %s has no slice threading support\n", codec->name);
+    }
+
+    ctx->thread_count = threads;
+    ctx->thread_type = type;
+}
+
+// Pool the decoder allocates frames from (nullptr = libavcodec's default allocator).
+// Read from libavcodec's frame threads, hence atomic.
+static std::atomic<FramePool*> decoder_frame_pool(nullptr);
+
+static int decoder_get_buffer2(AVCodecContext* ctx, AVFrame* frame, int flags) {
+    FramePool* pool = decoder_frame_pool.load(std::memory_order_acquire);
+    if (!pool) {
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+    return frame_pool_get_buffer(pool, ctx, frame, flags);
+}
+
+void set_decoder_frame_pool(FramePool* pool) {
+    decoder_frame_pool.store(pool, std::memory_order_release);
+}
+
+// Size of one decoded frame buffer for the current stream, including decoder padding.
+size_t decoder_frame_buffer_size() {
+    return frame_pool_buffer_size(codec_ctx, codec_ctx->width, codec_ctx->height, codec_ctx->pix_fmt);
+}
+
+// Pixel format the current stream decodes to (as probed; frames carry their own).
+int decoder_pixel_format() {
+    return codec_ctx ? codec_ctx->pix_fmt : AV_PIX_FMT_NONE;
+}
+
+// A demuxer and video decoder opened for one input. init_ffmpeg() installs one into the globals
+// above; the next playlist item is opened into a spare one on the preload thread.
+struct OpenedInput {
+    AVFormatContext* fmt_ctx;
+    AVIOContext* io;                 // Read-ahead layer (nullptr when FFmpeg reads the file itself)
+    AVCodecContext* codec_ctx;
+    int video_stream_index;
+    AVRational time_base;
+    double frame_delay;
+    KeyframeIndex* keyframe_index;
+};
+
+static void close_input(OpenedInput* in) {
+    if (in->keyframe_index) {
+        keyframe_index_close(in->keyframe_index);
+        in->keyframe_index = nullptr;
+    }
+    avcodec_free_context(&in->codec_ctx);
+    if (in->fmt_ctx) {
+        avformat_close_input(&in->fmt_ctx);
+    }
+    read_ahead_close(&in->io);
+}
+
+// Whether a capped probe found what playback needs: geometry and pixel format of the video
+// stream, and the sample format of the audio stream that would be played.
+static bool probe_complete(AVFormatContext* ctx) {
+    int video = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video < 0) {
+        return false;
+    }
+    const AVCodecParameters* par = ctx->streams[video]->codecpar;
+    if (par->width <= 0 || par->height <= 0 || par->format == AV_PIX_FMT_NONE) {
+        return false;
+    }
+    if (decoder_options.audio_sink != AUDIO_SINK_NONE) {
+        int audio = av_find_best_stream(ctx, AVMEDIA_TYPE_AUDIO, -1, video, nullptr, 0);
+        if (audio >= 0) {
+            par = ctx->streams[audio]->codecpar;
+            if (par->sample_rate <= 0 || par->ch_layout.nb_channels <= 0 || par->format < 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Opens the file, probes it and opens the video decoder. On failure nothing is left open.
+// fast_probe caps the probe (DecoderOptions::fast_start); an incomplete result is probed again in full.
+static int open_input(const char* file_name, OpenedInput* in, bool fast_probe) {
     int ret;
+    memset(in, 0, sizeof(*in));
+    in->video_stream_index = -1;
+    uint64_t phase_start = trace_now_ns();
 
-    // 1. Open the file
-    ret = avformat_open_input(&fmt_ctx, file_name, nullptr, nullptr);
+    // 1. Open the file, through the read-ahead layer unless it is off or the input is a URL
+    AVDictionary* format_opts = nullptr;
+    bool network = net_input_is_url(file_name);
+    in->io = read_ahead_open(file_name, decoder_options.read_ahead, decoder_options.read_ahead_mb);
+    if (in->io) {
+        in->fmt_ctx = avformat_alloc_context();
+        if (!in->fmt_ctx) {
+            read_ahead_close(&in->io);
+            return AVERROR(ENOMEM);
+        }
+        in->fmt_ctx->pb = in->io;
+        in->fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    else if (network) {
+        // Timeouts and an interrupt callback, so a dead connection can't hang the decoder
+        in->fmt_ctx = net_input_alloc_context(&decoder_options.network);
+        if (!in->fmt_ctx) {
+            return AVERROR(ENOMEM);
+        }
+        net_input_open_options(file_name, &decoder_options.network, &format_opts);
+    }
+    if (fast_probe) {
+        av_dict_set_int(&format_opts, "probesize", FAST_START_PROBESIZE, 0);
+        av_dict_set_int(&format_opts, "analyzeduration", FAST_START_ANALYZE_US, 0);
+    }
+    ret = avformat_open_input(&in->fmt_ctx, file_name, nullptr, &format_opts);
+    av_dict_free(&format_opts);
     if (ret < 0) {
         fprintf(stderr, "Could not open input file: %s\n", file_name);
         print_ffmpeerr(ret);
+        read_ahead_close(&in->io); // A failed open frees fmt_ctx but never a custom pb
         return ret;
     }
+    startup_phase("open input", phase_start);
 
     // 2. Find stream info
-    ret = avformat_find_stream_info(fmt_ctx, nullptr);
+    phase_start = trace_now_ns();
+    ret = avformat_find_stream_info(in->fmt_ctx, nullptr);
     if (ret < 0) {
         print_ffmpeerr(ret);
+        close_input(in);
         return ret;
     }
+    startup_phase(fast_probe ? "probe streams (capped)" : "probe streams", phase_start);
+    if (fast_probe && !probe_complete(in->fmt_ctx)) {
+        fprintf(stdout, "Fast start: capped probe missed stream parameters, probing %s again with default limits\n", file_name);
+        close_input(in);
+        return open_input(file_name, in, false);
+    }
 
     // 3. Find video stream and its decoder
     const AVCodec* codec;
-    video_stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    in->video_stream_index = av_find_best_stream(in->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
 
-    if (video_stream_index == -1) {
+    if (in->video_stream_index < 0) {
         fprintf(stderr, "No video stream found\n");
+        close_input(in);
         return -1;
     }
 
     if (!codec) {
         fprintf(stderr, "Unsupported codec\n");
+        close_input(in);
         return -1;
     }
 
-    AVCodecParameters* codec_par = fmt_ctx->streams[video_stream_index]->codecpar;
+    AVStream* stream = in->fmt_ctx->streams[in->video_stream_index];
+    AVCodecParameters* codec_par = stream->codecpar;
 
-    // 4. Calculate and save the stream's time base and frame rate info (for logging)
-    video_stream_time_base = fmt_ctx->streams[video_stream_index]->time_base;
-    AVRational frame_rate = av_guess_frame_rate(fmt_ctx, fmt_ctx->streams[video_stream_index], nullptr);
+    // Keyframe index for seeking: mapped from the sidecar or built by a background scan (local regular files only)
+    if (decoder_options.use_keyframe_index && !network) {
+        in->keyframe_index = keyframe_index_open(file_name, in->video_stream_index, stream->time_base,
+            decoder_options.read_ahead, decoder_options.read_ahead_mb);
+    }
+
+    // 4. Save the stream's time base and frame rate info (for logging)
+    in->time_base = stream->time_base;
+    AVRational frame_rate = av_guess_frame_rate(in->fmt_ctx, stream, nullptr);
 
-    double frame_delay = 0.0;
     if (frame_rate.num > 0 && frame_rate.den > 0) {
-        frame_delay = 1.0 / av_q2d(frame_rate);
+        in->frame_delay = 1.0 / av_q2d(frame_rate);
     }
     else {
         // Fallback for logging if rate estimation fails
-        frame_delay = 1.0 / 30.0;
+        in->frame_delay = 1.0 / 30.0;
     }
 
     // 5. Create codec context and copy parameters
-    codec_ctx = avcodec_alloc_context3(codec);
-    if (!codec_ctx) {
+    phase_start = trace_now_ns();
+    in->codec_ctx = avcodec_alloc_context3(codec);
+    if (!in->codec_ctx) {
         fprintf(stderr, "Could not allocate codec context\n");
+        close_input(in);
         return -1;
     }
 
-    ret = avcodec_parameters_to_context(codec_ctx, codec_par);
+    ret = avcodec_parameters_to_context(in->codec_ctx, codec_par);
     if (ret < 0) {
         print_ffmpeerr(ret);
+        close_input(in);
         return ret;
     }
 
-    // 6. Open the codec
-    ret = avcodec_open2(codec_ctx, codec, nullptr);
+    // 6. Configure decoder threading, then open the codec
+    apply_decoder_threading(in->codec_ctx, codec);
+
+    // get_buffer2 must be in place before avcodec_open2(): frame threads copy it at open time
+    if (decoder_options.use_frame_pool) {
+        if (codec->capabilities & AV_CODEC_CAP_DR1) {
+            in->codec_ctx->get_buffer2 = decoder_get_buffer2;
+        }
+        else {
+            fprintf(stderr, "Warning: %s can't decode into custom buffers; zero-copy disabled\n", codec->name);
+        }
+    }
+
+    ret = avcodec_open2(in->codec_ctx, codec, nullptr);
     if (ret < 0) {
         print_ffmpeerr(ret);
+        close_input(in);
+        return ret;
+    }
+    startup_phase("open video decoder", phase_start);
+
+    // Report what libavcodec actually chose; it may downgrade the requested model.
+    AVCodecContext* ctx = in->codec_ctx;
+    int frame_latency = (ctx->active_thread_type & FF_THREAD_FRAME) ? ctx->thread_count - 1 : 0;
+    fprintf(stdout, "Decoder: %s, %d thread(s), %s threading (+%d frame(s) latency)\n",
+        codec->name, ctx->thread_count, active_thread_type_name(ctx->active_thread_type), frame_latency);
+    return 0;
+}
+
+// Makes `in` the input every decode function works on. Ownership moves to the globals.
+static void install_input(const OpenedInput& in) {
+    fmt_ctx = in.fmt_ctx;
+    read_ahead_io = in.io;
+    codec_ctx = in.codec_ctx;
+    video_stream_index = in.video_stream_index;
+    video_stream_time_base = in.time_base;
+    keyframe_index = in.keyframe_index;
+    video_frame_delay = in.frame_delay;
+}
+
+// Initialization: Opens the file and sets up the decoding context.
+// frame_delay_out is now unused but kept in signature for compatibility.
+int init_ffmpeg(const char* file_name, int* w, int* h, double* frame_delay_out, AVFrame** frame) {
+    if (net_input_is_url(file_name) && !network_initialized) {
+        avformat_network_init();
+        network_initialized = true;
+    }
+    OpenedInput input;
+    int ret = open_input(file_name, &input, decoder_options.fast_start);
+    if (ret < 0) {
         return ret;
     }
+    install_input(input);
+    double frame_delay = input.frame_delay;
+
+    if (decoder_options.frame_cache_mb > 0) {
+        frame_cache = frame_cache_create((size_t)decoder_options.frame_cache_mb * 1024 * 1024);
+    }
+
+    if (net_input_is_url(file_name) || net_input_impaired(&decoder_options.network)) {
+        net_input = net_input_open(fmt_ctx, file_name, video_stream_index, &decoder_options.network);
+    }
+
+    catchup_init(&catchup, frame_delay);
+    catchup_enabled = decoder_options.catch_up;
+
+    // Audio: best audio stream related to the video, decoded on its own thread
+    if (decoder_options.audio_sink != AUDIO_SINK_NONE) {
+        STARTUP_SCOPE("open audio");
+        int index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, video_stream_index, nullptr, 0);
+        if (index < 0) {
+            fprintf(stdout, "No audio stream; playing video only\n");
+        }
+        else if (audio_open(fmt_ctx, index, decoder_options.audio_sink, decoder_options.audio_wav_path) < 0) {
+            fprintf(stderr, "Warning: audio disabled (could not open decoder or sink)\n");
+        }
+        else {
+            audio_stream_index = index;
+            audio_enabled = true;
+        }
+    }
 
     // 7. Allocate packet and frame
     packet = av_packet_alloc();
     *frame = av_frame_alloc();
-    if (!packet || !frame) {
+    pending_seek_frame = av_frame_alloc();
+    if (!packet || !*frame || !pending_seek_frame) {
         fprintf(stderr, "Could not allocate packet or frame\n");
         return -1;
     }
@@ -108,75 +499,1113 @@ int init_ffmpeg(const char* file_name, int* w, int* h, double* frame_delay_out,
     return 0;
 }
 
+// Hands an audio packet to the audio thread, or drops it. Other streams are ignored.
+static void route_packet(const AVPacket* pkt) {
+    if (pkt->stream_index == audio_stream_index && route_audio_packets) {
+        audio_queue_packet(pkt);
+    }
+}
+
+// Next packet from the demuxer, or from the jitter buffer of a network input
+static int read_packet(AVPacket* pkt) {
+    return net_input ? net_input_read(net_input, pkt) : av_read_frame(fmt_ctx, pkt);
+}
+
+// Moves the demuxer; a network input also drops what it buffered
+static int seek_demuxer(int64_t timestamp, int flags) {
+    if (net_input) {
+        return net_input_seek(net_input, video_stream_index, timestamp, flags);
+    }
+    return av_seek_frame(fmt_ctx, video_stream_index, timestamp, flags);
+}
+
+// Next packet of the video stream: from the backlog first, then from the demuxer.
+// Audio packets read on the way are routed to the audio thread.
+static int read_video_packet(AVPacket* pkt) {
+    if (!video_packet_backlog.empty()) {
+        AVPacket* queued = video_packet_backlog.front();
+        video_packet_backlog.pop_front();
+        av_packet_move_ref(pkt, queued);
+        av_packet_free(&queued);
+        return 0;
+    }
+
+    while (true) {
+        TRACE_SCOPE("demux");
+        int ret = read_packet(pkt);
+        if (ret < 0) {
+            return ret;
+        }
+        if (pkt->stream_index == video_stream_index) {
+            return 0;
+        }
+        route_packet(pkt);
+        av_packet_unref(pkt);
+    }
+}
+
+// Keeps demuxing while the audio queue runs low, parking video packets in the backlog.
+// Called by the decoder thread while it waits for room in the frame queue.
+static void demux_ahead_for_audio() {
+    while (audio_stream_index >= 0 && video_packet_backlog.size() < MAX_VIDEO_BACKLOG &&
+        audio_queued_seconds() < AUDIO_DEMUX_AHEAD_SECONDS) {
+        TRACE_SCOPE("demux ahead");
+        AVPacket* pkt = av_packet_alloc();
+        // A network input only gives up what it buffered beyond its target
+        int ret = !pkt ? AVERROR(ENOMEM) : net_input ? net_input_try_read(net_input, pkt) : av_read_frame(fmt_ctx, pkt);
+        if (ret < 0) {
+            av_packet_free(&pkt); // End of file is reported again to the normal read path
+            return;
+        }
+        if (pkt->stream_index == video_stream_index) {
+            video_packet_backlog.push_back(pkt);
+        }
+        else {
+            route_packet(pkt);
+            av_packet_free(&pkt);
+        }
+    }
+}
+
+// Drops demuxed-ahead packets; the demuxer is about to move.
+static void clear_video_packet_backlog() {
+    for (AVPacket* pkt : video_packet_backlog) {
+        av_packet_free(&pkt);
+    }
+    video_packet_backlog.clear();
+}
+
+static void clear_preroll_frames() {
+    for (AVFrame* frame : preroll_frames) {
+        av_frame_free(&frame);
+    }
+    preroll_frames.clear();
+}
+
+// Frames less than this far (media seconds) apart are too close to both be shown at the
+// current rate. Half a frame of slack for timestamp rounding.
+static double trick_min_spacing() {
+    double frame = video_frame_delay > 0.0 ? video_frame_delay : 1.0 / 30.0;
+    return trick_frame_spacing - 0.5 * frame;
+}
+
+// Decoder thread, before each forward decode: sets decoding up for the requested rate.
+static void update_trick_play() {
+    double rate = requested_playback_rate.load(std::memory_order_relaxed);
+    double refresh = display_refresh_period.load(std::memory_order_relaxed);
+    if (rate == trick_rate && refresh == trick_refresh_period) {
+        return;
+    }
+    trick_rate = rate;
+    trick_refresh_period = refresh;
+
+    // Media time that passes between two refreshes: of the frames inside it only one can be shown
+    double per_refresh = rate * refresh;
+    double frame = video_frame_delay > 0.0 ? video_frame_delay : 1.0 / 30.0;
+    trick_keyframes_only = rate >= TRICK_KEYFRAME_RATE;
+    if (trick_keyframes_only) {
+        double paced = rate / TRICK_KEYFRAMES_PER_SECOND;
+        trick_frame_spacing = per_refresh > paced ? per_refresh : paced;
+    }
+    else if (rate > 1.0 && per_refresh > 1.5 * frame) {
+        trick_frame_spacing = per_refresh;
+    }
+    else {
+        trick_frame_spacing = 0.0;
+    }
+    catchup_set_floor(&catchup, trick_keyframes_only ? CATCHUP_MAX_LEVEL : trick_frame_spacing > 0.0 ? 1 : 0);
+    trick_last_queued = -HUGE_VAL;
+    trick_last_key = -HUGE_VAL;
+
+    if (trick_keyframes_only) {
+        fprintf(stdout, "Trick play: %.2fx, keyframes only, at least %.2f s apart\n", rate, trick_frame_spacing);
+    }
+    else if (trick_frame_spacing > 0.0) {
+        fprintf(stdout, "Trick play: %.2fx, one frame per %.0f ms of video\n", rate, 1000.0 * trick_frame_spacing);
+    }
+    else {
+        fprintf(stdout, "Trick play: %.2fx, every frame decoded\n", rate);
+    }
+}
+
+// Decoder thread: true if trick play skips this video packet before decode. Non-key packets
+// go in keyframe-only mode, disposable ones (which the decoder would discard at NONREF anyway)
+// whenever frames are skipped; keyframes too close to the last one are skipped as well.
+static bool trick_should_skip_packet(const AVPacket* pkt) {
+    if (trick_frame_spacing <= 0.0) {
+        return false;
+    }
+    if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+        if (trick_keyframes_only || (pkt->flags & AV_PKT_FLAG_DISPOSABLE)) {
+            trick_packets_skipped++;
+            return true;
+        }
+        return false;
+    }
+    if (trick_keyframes_only) {
+        int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (ts != AV_NOPTS_VALUE) {
+            double seconds = ts * av_q2d(video_stream_time_base) + item_pts_offset;
+            // Timestamps going back (next playlist item, reconnect) restart the pacing
+            if (seconds >= trick_last_key && seconds - trick_last_key < trick_min_spacing()) {
+                trick_packets_skipped++;
+                return true;
+            }
+            trick_last_key = seconds;
+        }
+        trick_keyframes_decoded++;
+    }
+    return false;
+}
+
+// Core decode step shared by get_next_frame() and the decoder thread.
+// Drains the decoder before feeding it more packets, and flushes it at end of file so the
+// frames it still holds back for reordering (B-frames) are not lost.
+static int decode_next_frame(AVFrame* frame) {
+    int ret;
+
+    // A seek decodes one frame past its target; hand that one out first
+    if (pending_seek_frame->buf[0]) {
+        av_frame_move_ref(frame, pending_seek_frame);
+        return 0;
+    }
+    // The start of a playlist item was decoded ahead
+    if (!preroll_frames.empty()) {
+        AVFrame* first = preroll_frames.front();
+        preroll_frames.pop_front();
+        av_frame_move_ref(frame, first);
+        av_frame_free(&first);
+        return 0;
+    }
+
+    while (true) {
+        {
+            TRACE_SCOPE("decode receive");
+            ret = avcodec_receive_frame(codec_ctx, frame);
+        }
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret == AVERROR_EOF) {
+            // Decoder fully drained after the flush packet
+            return AVERROR_EOF;
+        }
+        if (ret != AVERROR(EAGAIN)) {
+            print_ffmpeerr(ret);
+            return ret; // Decoding error
+        }
+
+        // Decoder needs more input: the next video packet
+        ret = read_video_packet(packet);
+        if (ret == AVERROR_EOF) {
+            if (audio_stream_index >= 0 && route_audio_packets) {
+                audio_queue_packet(nullptr);
+            }
+            // Enter draining mode; the next receive calls return the delayed frames then EOF
+            ret = avcodec_send_packet(codec_ctx, nullptr);
+            if (ret < 0 && ret != AVERROR_EOF) {
+                print_ffmpeerr(ret);
+                return ret;
+            }
+            continue;
+        }
+        if (ret == AVERROR(EAGAIN)) {
+            return ret; // Network input woken while buffering (seek or stop)
+        }
+        if (ret < 0) {
+            print_ffmpeerr(ret);
+            return ret; // I/O error
+        }
+
+        // Fast-forwarding or behind schedule: don't spend decode time on frames that won't be shown
+        if (catchup_forward && (trick_should_skip_packet(packet) || catchup_should_drop_packet(&catchup, packet))) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        // Send packet to decoder
+        uint64_t send_start = trace_enabled() ? trace_now_ns() : 0;
+        ret = avcodec_send_packet(codec_ctx, packet);
+        if (send_start) {
+            trace_complete("decode send", send_start, trace_now_ns(), packet->size);
+        }
+        av_packet_unref(packet); // Always unref the packet after sending
+
+        if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            print_ffmpeerr(ret);
+            return ret; // Decoding error
+        }
+    }
+}
+
+// Converts a decoded frame's PTS (in stream time_base units) to seconds.
+static double frame_pts_to_seconds(const AVFrame* frame) {
+    // NOTE: best_effort_timestamp falls back to the DTS when the container gives no PTS.
+    int64_t pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+    if (pts == AV_NOPTS_VALUE) {
+        fprintf(stderr, "Warning: Decoded frame has no valid PTS. Using 0.0\n");
+        return 0.0;
+    }
+    return av_q2d(video_stream_time_base) * pts + item_pts_offset;
+}
+
+// Playlist time (seconds) to a timestamp of the current input's video stream.
+static int64_t seconds_to_stream_pts(double seconds) {
+    return (int64_t)llround((seconds - item_pts_offset) / av_q2d(video_stream_time_base));
+}
+
 // Frame Retrieval: Reads, decodes, and returns 0 if successful, or <0 on error/EOF.
 // The frame's presentation timestamp (PTS) in seconds is returned via pts_out.
+// Synchronous version, for callers that don't run the decoder thread.
 int get_next_frame(AVFrame** frame, double* pts_out) {
+    int ret = decode_next_frame(*frame);
+    if (ret < 0) {
+        return ret;
+    }
+    *pts_out = frame_pts_to_seconds(*frame);
+    return 0;
+}
+
+// Seeks so that the next frame returned is the one on screen at target_seconds.
+// Jumps to the nearest preceding keyframe (from the keyframe index when it is ready, else
+// from plain av_seek_frame) and decodes forward, discarding frames until the target is reached.
+// On success `frame` holds the landed frame. Seek latency is reported on stdout.
+static int seek_decoder(double target_seconds, AVFrame* frame) {
+    auto start = std::chrono::steady_clock::now();
+    int64_t target_pts = seconds_to_stream_pts(target_seconds);
+
+    const KeyframeEntry* key = keyframe_index_lookup(keyframe_index, target_pts);
     int ret;
 
-    // Loop until a video frame is decoded
-    while (ret = av_read_frame(fmt_ctx, packet) >= 0) {
-        if (packet->stream_index == video_stream_index) {
+    av_frame_unref(pending_seek_frame);
+    clear_preroll_frames();
+    clear_video_packet_backlog();
+    catchup_suspend(&catchup, codec_ctx); // Every frame up to the target must decode
+    if (key) {
+        ret = seek_demuxer(key->pts, AVSEEK_FLAG_BACKWARD);
+        if (ret < 0 && key->pos >= 0) {
+            // Containers without a timestamp index (e.g. MPEG-TS) seek precisely by byte position
+            ret = seek_demuxer(key->pos, AVSEEK_FLAG_BYTE);
+        }
+    }
+    else {
+        ret = seek_demuxer(target_pts, AVSEEK_FLAG_BACKWARD);
+    }
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+        return ret;
+    }
+    avcodec_flush_buffers(codec_ctx);
 
-            // Send packet to decoder
-            ret = avcodec_send_packet(codec_ctx, packet);
-            av_packet_unref(packet); // Always unref the packet after sending
+    // Decode forward: the target is the last frame with pts <= target_pts
+    AVFrame* candidate = av_frame_alloc();
+    if (!candidate) {
+        return AVERROR(ENOMEM);
+    }
+    int discarded = 0;
+    bool have_candidate = false;
+    while ((ret = decode_next_frame(frame)) == 0) {
+        int64_t pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+        if (pts != AV_NOPTS_VALUE && pts > target_pts) {
+            break;
+        }
+        if (have_candidate) {
+            discarded++;
+        }
+        av_frame_unref(candidate);
+        av_frame_move_ref(candidate, frame);
+        have_candidate = true;
+    }
 
-            if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
-                print_ffmpeerr(ret);
-                return ret; // Decoding error
-            }
+    // `frame` now holds the first frame past the target (or nothing at EOF). Prefer the
+    // candidate before it, since that one is on screen at the target time.
+    if (have_candidate) {
+        if (ret == 0) {
+            // Keep the frame past the target: decode_next_frame() returns it next
+            av_frame_move_ref(pending_seek_frame, frame);
+        }
+        av_frame_move_ref(frame, candidate);
+        ret = 0;
+    }
+    av_frame_free(&candidate);
+    if (ret < 0) {
+        return ret;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stdout, "Seek to %.3fs (%s): landed on %.3fs, %d frame(s) decoded and discarded, %.1f ms\n",
+        target_seconds, key ? "keyframe index" : "av_seek_frame", frame_pts_to_seconds(frame), discarded, ms);
+    return 0;
+}
+
+// Start (in stream time_base units) of the GOP containing target_pts, or AV_NOPTS_VALUE if unknown.
+static int64_t gop_start_pts(int64_t target_pts, int64_t* next_gop_pts) {
+    const KeyframeEntry* key = keyframe_index_lookup(keyframe_index, target_pts);
+    if (!key) {
+        return AV_NOPTS_VALUE;
+    }
+    if (next_gop_pts) {
+        const KeyframeEntry* last = keyframe_index->entries + keyframe_index->count - 1;
+        *next_gop_pts = key < last ? (key + 1)->pts : INT64_MAX;
+    }
+    return key->pts;
+}
+
+// Decodes the whole GOP containing target_seconds into the frame cache.
+// Without a keyframe index, decodes from the keyframe av_seek_frame picks up to the target.
+// Moves the demuxer, so forward decoding must be re-synced with a seek afterwards.
+static int decode_gop(double target_seconds, AVFrame* scratch) {
+    auto start = std::chrono::steady_clock::now();
+    int64_t target_pts = seconds_to_stream_pts(target_seconds);
+    int64_t end_pts = target_pts + 1;
+    int64_t start_pts = gop_start_pts(target_pts, &end_pts);
+
+    av_frame_unref(pending_seek_frame);
+    clear_preroll_frames();
+    clear_video_packet_backlog();
+    catchup_suspend(&catchup, codec_ctx); // Cached frames must be complete
+    int ret = seek_demuxer(start_pts != AV_NOPTS_VALUE ? start_pts : target_pts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+        return ret;
+    }
+    avcodec_flush_buffers(codec_ctx);
+
+    int frames = 0;
+    route_audio_packets = false;
+    while ((ret = decode_next_frame(scratch)) == 0) {
+        int64_t pts = scratch->pts != AV_NOPTS_VALUE ? scratch->pts : scratch->best_effort_timestamp;
+        if (pts != AV_NOPTS_VALUE && pts >= end_pts) {
+            break;
+        }
+        // Leading frames of an open GOP reference the previous GOP and decode broken; skip them
+        if (pts != AV_NOPTS_VALUE && (start_pts == AV_NOPTS_VALUE || pts >= start_pts)) {
+            frame_cache_insert(frame_cache, current_item, frame_pts_to_seconds(scratch), scratch);
+            frames++;
+        }
+        av_frame_unref(scratch);
+    }
+    route_audio_packets = true;
+    av_frame_unref(scratch);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        return ret;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stdout, "Cached GOP at %.3fs: %d frame(s) in %.1f ms\n",
+        start_pts != AV_NOPTS_VALUE ? start_pts * av_q2d(video_stream_time_base) + item_pts_offset : target_seconds, frames, ms);
+    return 0;
+}
+
+// Synchronous seek, for callers that don't run the decoder thread.
+int seek_to_time(double target_seconds, AVFrame** frame, double* pts_out) {
+    int ret = seek_decoder(target_seconds, *frame);
+    if (ret < 0) {
+        return ret;
+    }
+    *pts_out = frame_pts_to_seconds(*frame);
+    return 0;
+}
+
+// --- Decoder Thread ---
+// Runs demux + decode ahead of presentation and hands ref-counted frames to the render
+// thread through a bounded lock-free ring. When the ring is full the decoder waits
+// (back-pressure), so at most queue_depth decoded frames are held in memory.
+
+static SpscRing<DecodedFrame>* frame_queue = nullptr;
+static std::atomic<void (*)()> frame_ready_callback(nullptr);
+static std::thread decode_thread;
+static std::atomic<bool> decode_stop_requested(false);
+static std::atomic<bool> decode_finished(false);
+static std::atomic<bool> decode_at_eof(false);
+static std::atomic<int> decode_status(0);
+
+// Seek requests from the render thread. Every request bumps the serial; frames carry the
+// serial they were decoded under, so the render thread can drop frames queued before a seek.
+static std::mutex seek_mutex;
+static bool seek_pending = false;
+static double seek_target = 0.0;
+static std::atomic<int> seek_serial(0);
+
+static bool take_seek_request(double* target, int* serial) {
+    std::lock_guard<std::mutex> lock(seek_mutex);
+    if (!seek_pending) {
+        return false;
+    }
+    seek_pending = false;
+    decode_at_eof.store(false, std::memory_order_relaxed); // Under the lock: see decode_thread_status()
+    *target = seek_target;
+    *serial = seek_serial.load(std::memory_order_relaxed);
+    return true;
+}
+
+// GOP decode requests (keyed by GOP start, or by target when there is no index) and
+// whether the decoder thread should keep decoding forward into the queue.
+static std::deque<std::pair<double, int64_t>> gop_requests; // (target seconds, in-flight key)
+static std::set<int64_t> gops_in_flight;
+// GOPs decoded into the frame cache since the last seek. Forgotten whenever the cache evicts
+// anything, since the evicted frames may be theirs.
+static std::set<int64_t> gops_cached;
+static long long gops_cached_evictions = 0;  // frame_cache->evictions when gops_cached was last valid
+static std::atomic<bool> forward_decoding(true);
+
+// Caller holds seek_mutex.
+static void forget_evicted_gops() {
+    long long evictions;
+    {
+        std::lock_guard<std::mutex> lock(frame_cache->mutex);
+        evictions = frame_cache->evictions;
+    }
+    if (evictions != gops_cached_evictions) {
+        gops_cached.clear();
+        gops_cached_evictions = evictions;
+    }
+}
+
+static int64_t gop_request_key(double target_seconds) {
+    int64_t target_pts = seconds_to_stream_pts(target_seconds);
+    int64_t key = gop_start_pts(target_pts, nullptr);
+    return key != AV_NOPTS_VALUE ? key : target_pts;
+}
+
+static bool take_gop_request(double* target, int64_t* key) {
+    std::lock_guard<std::mutex> lock(seek_mutex);
+    if (gop_requests.empty()) {
+        return false;
+    }
+    *target = gop_requests.front().first;
+    *key = gop_requests.front().second;
+    gop_requests.pop_front();
+    return true;
+}
+
+// `cached`: the GOP was decoded in full. A seek since the request (no longer in flight) voids it.
+static void finish_gop_request(int64_t key, bool cached) {
+    std::lock_guard<std::mutex> lock(seek_mutex);
+    bool current = gops_in_flight.erase(key) > 0;
+    if (cached && current && frame_cache) {
+        forget_evicted_gops(); // Evictions made room for this GOP: the others may have lost frames
+        gops_cached.insert(key);
+    }
+}
+
+static bool has_seek_request() {
+    std::lock_guard<std::mutex> lock(seek_mutex);
+    return seek_pending;
+}
+
+// --- Gapless playlist ---
+// Inputs queued with set_playlist() play after the first one on a single timeline. While an item
+// plays, the preload thread opens and probes the next one and decodes its first frames, so at end
+// of file the decoder thread only swaps contexts and the next frame is ready at once. Timestamps
+// are shifted onto the playlist timeline, so the render thread's clock just carries on across
+// the transition. Seeks and GOP decodes stay inside the item that is playing.
+
+// Preloading starts this long before the current item ends (at once if its duration is unknown)
+static const double PRELOAD_LEAD_SECONDS = 10.0;
+// Frames decoded ahead: the decoder's warm-up (frame-thread latency) happens before the switch
+static const int PRELOAD_FRAMES = 4;
+// Audio demuxed while decoding those frames is kept for the switch, up to this many packets
+static const size_t MAX_PRELOAD_AUDIO_PACKETS = 256;
+
+struct PreloadedItem {
+    OpenedInput input;
+    int audio_stream_index;          // -1 without audio (or when audio is disabled)
+    AVCodecContext* audio_decoder;
+    std::vector<AVFrame*> frames;
+    std::vector<AVPacket*> audio_packets;
+    int status;
+    double open_ms;                  // Open, probe and codec open
+    double preroll_ms;               // First frames
+};
+
+static std::vector<std::string> playlist;   // Inputs after the first
+static size_t playlist_next = 0;            // Entry of `playlist` the next switch plays
+static double item_end_seconds = 0.0;       // Playlist time at which the last decoded frame ends
+static std::thread preload_thread;
+static bool preload_started = false;
+static PreloadedItem preloaded;             // Written by the preload thread until it is joined
+
+void set_playlist(const std::vector<std::string>& next_inputs) {
+    playlist = next_inputs;
+    playlist_next = 0;
+    current_item = 0;
+}
 
-            // Receive decoded frame (can yield multiple frames, typically one)
-            ret = avcodec_receive_frame(codec_ctx, *frame);
+static void free_preloaded_item(PreloadedItem* item) {
+    for (AVFrame* frame : item->frames) {
+        av_frame_free(&frame);
+    }
+    item->frames.clear();
+    for (AVPacket* pkt : item->audio_packets) {
+        av_packet_free(&pkt);
+    }
+    item->audio_packets.clear();
+    avcodec_free_context(&item->audio_decoder);
+    close_input(&item->input);
+}
+
+// Preload thread: decodes the first PRELOAD_FRAMES frames of the item. Audio packets read on
+// the way are kept for the audio thread; other streams are dropped.
+static int preroll_item(PreloadedItem* item) {
+    OpenedInput* in = &item->input;
+    AVPacket* pkt = av_packet_alloc();
+    int ret = pkt ? 0 : AVERROR(ENOMEM);
 
+    while (ret == 0 && (int)item->frames.size() < PRELOAD_FRAMES) {
+        AVFrame* frame = av_frame_alloc();
+        if (!frame) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        ret = avcodec_receive_frame(in->codec_ctx, frame);
+        if (ret == 0) {
+            item->frames.push_back(frame);
+            continue;
+        }
+        av_frame_free(&frame);
+        if (ret != AVERROR(EAGAIN)) {
+            break;
+        }
+
+        ret = av_read_frame(in->fmt_ctx, pkt);
+        if (ret == AVERROR_EOF) {
+            // A very short item: decode_next_frame() hits end of file again and drains the decoder
+            ret = 0;
+            break;
+        }
+        if (ret < 0) {
+            break;
+        }
+        if (pkt->stream_index == in->video_stream_index) {
+            ret = avcodec_send_packet(in->codec_ctx, pkt);
             if (ret == AVERROR(EAGAIN)) {
-                // Decoder buffer empty, need to read more packets
-                continue;
+                ret = 0;
             }
-            else if (ret == AVERROR_EOF) {
-                // Stream finished
-                return AVERROR_EOF;
+        }
+        else if (pkt->stream_index == item->audio_stream_index && item->audio_packets.size() < MAX_PRELOAD_AUDIO_PACKETS) {
+            AVPacket* copy = av_packet_clone(pkt);
+            if (copy) {
+                item->audio_packets.push_back(copy);
             }
-            else if (ret < 0) {
-                print_ffmpeerr(ret);
-                return ret; // Decoding error
+        }
+        av_packet_unref(pkt);
+    }
+
+    av_packet_free(&pkt);
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+    }
+    return ret;
+}
+
+static void preload_thread_main(std::string file_name) {
+    trace_set_thread_name("preload");
+    TRACE_SCOPE("preload");
+    PreloadedItem* item = &preloaded;
+    auto start = std::chrono::steady_clock::now();
+
+    item->status = open_input(file_name.c_str(), &item->input, decoder_options.fast_start);
+    auto opened = std::chrono::steady_clock::now();
+    if (item->status >= 0) {
+        if (audio_enabled) {
+            AVFormatContext* ctx = item->input.fmt_ctx;
+            int index = av_find_best_stream(ctx, AVMEDIA_TYPE_AUDIO, -1, item->input.video_stream_index, nullptr, 0);
+            if (index >= 0) {
+                item->audio_decoder = audio_open_decoder(ctx, index);
+                item->audio_stream_index = item->audio_decoder ? index : -1;
             }
+        }
+        item->status = preroll_item(item);
+    }
+
+    item->open_ms = std::chrono::duration<double, std::milli>(opened - start).count();
+    item->preroll_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - opened).count();
+}
+
+// Decoder thread: starts opening the next item once the current one is within
+// PRELOAD_LEAD_SECONDS of its end (pts_seconds is the playlist time just decoded).
+static void maybe_start_preload(double pts_seconds) {
+    if (preload_started || playlist_next >= playlist.size()) {
+        return;
+    }
+    if (fmt_ctx->duration != AV_NOPTS_VALUE && fmt_ctx->duration > 0) {
+        double start = fmt_ctx->start_time != AV_NOPTS_VALUE ? fmt_ctx->start_time / (double)AV_TIME_BASE : 0.0;
+        double end = item_pts_offset + start + fmt_ctx->duration / (double)AV_TIME_BASE;
+        if (pts_seconds < end - PRELOAD_LEAD_SECONDS) {
+            return;
+        }
+    }
+
+    preloaded = PreloadedItem();
+    preloaded.audio_stream_index = -1;
+    preload_started = true;
+    preload_thread = std::thread(preload_thread_main, playlist[playlist_next]);
+}
+
+// Decoder thread: makes the preloaded item current. Its first frame follows the last frame
+// decoded from the item that just ended.
+static void switch_to_preloaded_item() {
+    PreloadedItem* item = &preloaded;
+
+    double first_seconds = 0.0;
+    if (!item->frames.empty()) {
+        AVFrame* first = item->frames.front();
+        int64_t pts = first->pts != AV_NOPTS_VALUE ? first->pts : first->best_effort_timestamp;
+        if (pts != AV_NOPTS_VALUE) {
+            first_seconds = pts * av_q2d(item->input.time_base);
+        }
+    }
+
+    catchup_suspend(&catchup, codec_ctx); // The new decoder starts at full quality
+    catchup.frame_duration = item->input.frame_delay;
+    av_frame_unref(pending_seek_frame);
+    clear_video_packet_backlog();
+
+    OpenedInput finished = OpenedInput();
+    NetInput* finished_net = nullptr;
+    {
+        // The render thread reads the keyframe index, time base and network input under this lock
+        std::lock_guard<std::mutex> lock(seek_mutex);
+        finished_net = net_input;
+        net_input = nullptr;
+        finished.fmt_ctx = fmt_ctx;
+        finished.io = read_ahead_io;
+        finished.codec_ctx = codec_ctx;
+        finished.keyframe_index = keyframe_index;
+        install_input(item->input);
+        item_pts_offset = item_end_seconds - first_seconds;
+        current_item = (int)playlist_next; // Entry playlist_next - 1 of `playlist`, input 0 being the first
+        // GOP requests and keys are in the finished item's pts; its cached frames stay under its item
+        gops_cached.clear();
+        gop_requests.clear();
+        gops_in_flight.clear();
+    }
+    net_input_close(&finished_net); // Stops reading `finished` before it is closed
+    close_input(&finished);
+    item->input = OpenedInput();
+
+    preroll_frames.insert(preroll_frames.end(), item->frames.begin(), item->frames.end());
+    item->frames.clear();
+
+    if (audio_enabled) {
+        AVRational time_base = { 1, 1 };
+        if (item->audio_decoder) {
+            time_base = fmt_ctx->streams[item->audio_stream_index]->time_base;
+        }
+        audio_queue_stream_switch(item->audio_decoder, time_base, item_pts_offset);
+        item->audio_decoder = nullptr;
+        audio_stream_index = item->audio_stream_index;
+        for (AVPacket* pkt : item->audio_packets) {
+            route_packet(pkt);
+        }
+    }
+    free_preloaded_item(item);
+}
 
-            // Frame successfully decoded: calculate and return its timestamp in seconds.
-            // NOTE: AVFrame->pts contains the presentation timestamp in time_base units.
-            if ((*frame)->pts != AV_NOPTS_VALUE) {
-                *pts_out = av_q2d(video_stream_time_base) * (*frame)->pts;
+// Decoder thread, at the end of the current item: switches to the next item that opens.
+// Returns 0 when one was installed, AVERROR_EOF when the playlist is done.
+static int advance_playlist() {
+    while (playlist_next < playlist.size()) {
+        maybe_start_preload(HUGE_VAL);
+        auto start = std::chrono::steady_clock::now();
+        {
+            TRACE_SCOPE("preload wait");
+            preload_thread.join();
+        }
+        preload_started = false;
+        double wait_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        const std::string& file_name = playlist[playlist_next++];
+        if (preloaded.status < 0) {
+            fprintf(stderr, "Playlist: skipping %s\n", file_name.c_str());
+            free_preloaded_item(&preloaded);
+            continue;
+        }
+
+        TRACE_SCOPE("playlist switch");
+        size_t preroll_count = preloaded.frames.size();
+        switch_to_preloaded_item();
+        fprintf(stdout, "Playlist: item %d/%zu %s at %.3fs (opened in %.1f ms, %zu frame(s) decoded ahead in %.1f ms, %.1f ms waited at the switch)\n",
+            current_item + 1, playlist.size() + 1, file_name.c_str(), item_end_seconds, preloaded.open_ms,
+            preroll_count, preloaded.preroll_ms, wait_ms);
+        return 0;
+    }
+    return AVERROR_EOF;
+}
+
+static void decode_thread_main() {
+    trace_set_thread_name("decoder");
+    AVFrame* scratch = av_frame_alloc();
+    int ret = scratch ? 0 : AVERROR(ENOMEM);
+    int serial = seek_serial.load();
+    bool first_frame_queued = false;
+
+    while (ret == 0 && !decode_stop_requested.load(std::memory_order_relaxed)) {
+        double target;
+        int64_t gop_key;
+        bool forward = false;
+        if (take_seek_request(&target, &serial)) {
+            if (audio_stream_index >= 0) {
+                audio_flush(target); // Audio restarts at the seek target too
+            }
+            TRACE_SCOPE("seek");
+            ret = seek_decoder(target, scratch);
+            trick_last_queued = -HUGE_VAL;
+            trick_last_key = -HUGE_VAL;
+        }
+        else if (take_gop_request(&target, &gop_key)) {
+            if (frame_cache) {
+                TRACE_SCOPE("gop decode");
+                ret = decode_gop(target, scratch);
             }
-            else {
-                // If PTS is missing, we must use the old approach or rely on the container. 
-                // For simplicity here, we'll signal an error if PTS is absolutely necessary.
-                fprintf(stderr, "Warning: Decoded frame has no valid PTS. Using 0.0\n");
-                *pts_out = 0.0;
+            finish_gop_request(gop_key, frame_cache && ret >= 0);
+            if (ret == AVERROR(EAGAIN)) {
+                ret = 0; // Network input woken while buffering; the request behind it is served next
             }
+            continue;
+        }
+        else if (!forward_decoding.load(std::memory_order_relaxed)) {
+            // Reverse playback / stepping back: only GOP requests are served
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        else if (decode_at_eof.load(std::memory_order_relaxed)) {
+            // Stream ended: stay alive so the render thread can still seek back
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        else {
+            update_trick_play();
+            catchup_update(&catchup, codec_ctx);
+            catchup_forward = true;
+            ret = decode_next_frame(scratch);
+            catchup_forward = false;
+            forward = true;
+        }
 
-            return 0;
+        if (ret == AVERROR(EAGAIN)) {
+            // Network input woken while buffering: serve the seek (or stop) that woke it
+            ret = 0;
+            continue;
+        }
+        if (ret == AVERROR_EOF) {
+            // Gapless playlist: carry on with the next item
+            ret = advance_playlist();
+            if (ret == AVERROR_EOF) {
+                decode_at_eof.store(true, std::memory_order_release);
+                ret = 0;
+            }
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        // Fast-forward: frames closer than a refresh to the last one queued would never be shown
+        if (forward && trick_frame_spacing > 0.0) {
+            double pts = frame_pts_to_seconds(scratch);
+            if (pts >= trick_last_queued && pts - trick_last_queued < trick_min_spacing()) {
+                av_frame_unref(scratch);
+                trick_frames_skipped++;
+                continue;
+            }
+            trick_last_queued = pts;
+        }
+
+        // Hand the decoded buffers over to a fresh frame so the scratch frame can be reused
+        DecodedFrame item;
+        item.frame = av_frame_alloc();
+        if (!item.frame) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        av_frame_move_ref(item.frame, scratch);
+        item.pts = frame_pts_to_seconds(item.frame);
+        item.serial = serial;
+        item.playlist_item = current_item;
+        item.source_ns = 0;
+        if (net_input) {
+            int64_t pts = item.frame->pts != AV_NOPTS_VALUE ? item.frame->pts : item.frame->best_effort_timestamp;
+            item.source_ns = net_input_source_ns(net_input, pts);
+        }
+
+        double duration = item.frame->duration > 0 ? item.frame->duration * av_q2d(video_stream_time_base) : video_frame_delay;
+        item_end_seconds = item.pts + duration;
+        maybe_start_preload(item.pts);
+
+        // Back-pressure: wait for the render thread to free a slot
+        uint64_t wait_start = 0;
+        while (!frame_queue->push(item)) {
+            if (!wait_start && trace_enabled()) {
+                wait_start = trace_now_ns();
+            }
+            // A pending seek makes this frame stale; drop it instead of waiting
+            if (decode_stop_requested.load(std::memory_order_relaxed) || has_seek_request()) {
+                av_frame_free(&item.frame);
+                break;
+            }
+            demux_ahead_for_audio();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (wait_start) {
+            trace_complete("queue full", wait_start, trace_now_ns());
+        }
+        if (item.frame && !first_frame_queued) {
+            startup_milestone("first frame decoded");
+            first_frame_queued = true;
+        }
+        // The render thread only blocks on an empty queue; wake it for the first frame
+        void (*ready_callback)() = frame_ready_callback.load(std::memory_order_acquire);
+        if (item.frame && ready_callback && frame_queue->size() == 1) {
+            ready_callback();
         }
-        av_packet_unref(packet); // Unref packet if it's not the video stream
     }
 
-    // End of file reached (or error during av_read_frame)
-    // print_ffmpeerr(ret); // Suppress error print on EOF from av_read_frame
+    av_frame_free(&scratch);
+    if (preload_started) {
+        preload_thread.join();
+        preload_started = false;
+        free_preloaded_item(&preloaded);
+    }
+    decode_status.store(ret == 0 ? AVERROR_EXIT : ret, std::memory_order_relaxed);
+    decode_finished.store(true, std::memory_order_release);
+}
 
-    return ret;
+// Starts the decoder thread. init_ffmpeg() must have succeeded first.
+int start_decode_thread(int queue_depth) {
+    if (queue_depth < 1) {
+        fprintf(stderr, "Invalid decode queue depth %d\n", queue_depth);
+        return -1;
+    }
+
+    frame_queue = new SpscRing<DecodedFrame>(queue_depth);
+    decode_stop_requested.store(false);
+    decode_finished.store(false);
+    decode_at_eof.store(false);
+    decode_status.store(0);
+    forward_decoding.store(true);
+    decode_thread = std::thread(decode_thread_main);
+
+    fprintf(stdout, "Decoder thread started (queue depth: %d frames)\n", queue_depth);
+    return 0;
+}
+
+void set_frame_ready_callback(void (*callback)()) {
+    frame_ready_callback.store(callback, std::memory_order_release);
+}
+
+// Render thread: the oldest decoded frame not yet presented, or nullptr if none is ready.
+DecodedFrame* peek_decoded_frame() {
+    return frame_queue ? frame_queue->front() : nullptr;
+}
+
+// Render thread: the frame queued after peek_decoded_frame(), or nullptr.
+DecodedFrame* peek_next_decoded_frame() {
+    return frame_queue ? frame_queue->second() : nullptr;
+}
+
+// Render thread: the frame `index` places behind peek_decoded_frame() (0 = that frame), or nullptr.
+// Lets the render thread prepare for frames before they are due.
+DecodedFrame* peek_decoded_frame_at(int index) {
+    return frame_queue && index >= 0 ? frame_queue->at((size_t)index) : nullptr;
+}
+
+// Render thread: releases the slot returned by peek_decoded_frame().
+// Ownership of slot->frame moves to the caller, who must av_frame_free() it.
+void pop_decoded_frame() {
+    frame_queue->pop();
+}
+
+// Returns 0 while the decoder is running, AVERROR_EOF once the stream ended,
+// or another negative error. Frames may still be queued after it returns nonzero.
+int decode_thread_status() {
+    if (decode_finished.load(std::memory_order_acquire)) {
+        return decode_status.load(std::memory_order_relaxed);
+    }
+    if (!decode_at_eof.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    // EOF and a pending seek are read together: taking the seek clears EOF under the same lock
+    std::lock_guard<std::mutex> lock(seek_mutex);
+    if (decode_at_eof.load(std::memory_order_acquire) && !seek_pending) {
+        return AVERROR_EOF;
+    }
+    return 0;
+}
+
+// Render thread: asks the decoder thread to seek. Returns the serial that frames decoded
+// after the seek will carry; frames with an older serial should be dropped.
+int request_seek(double target_seconds) {
+    std::lock_guard<std::mutex> lock(seek_mutex);
+    // GOP decodes queued before the seek would move the demuxer away from the new position
+    gop_requests.clear();
+    gops_in_flight.clear();
+    gops_cached.clear();
+    seek_pending = true;
+    seek_target = target_seconds < 0.0 ? 0.0 : target_seconds;
+    if (net_input) {
+        net_input_wake(net_input); // The decoder may be blocked waiting for the network
+    }
+    if (catchup_enabled) {
+        catchup_reset(&catchup); // Lag before the seek says nothing about the new position
+    }
+    return seek_serial.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+// Render thread: playback rate for trick play (see decode_video.h).
+void set_playback_rate(double rate, double refresh_period) {
+    if (rate < MIN_PLAYBACK_RATE) {
+        rate = MIN_PLAYBACK_RATE;
+    }
+    if (rate > MAX_PLAYBACK_RATE) {
+        rate = MAX_PLAYBACK_RATE;
+    }
+    if (refresh_period > 0.0) {
+        display_refresh_period.store(refresh_period, std::memory_order_relaxed);
+    }
+    requested_playback_rate.store(rate, std::memory_order_relaxed);
+}
+
+// Render thread: how late a frame was presented, for the catch-up controller.
+void report_presentation_lateness(double seconds) {
+    if (catchup_enabled) {
+        catchup_report_lateness(&catchup, seconds);
+    }
+}
+
+// Render thread: asks the decoder thread to decode the GOP of playlist_item containing pts_seconds
+// into the frame cache. Requests for a GOP already queued, being decoded or still cached are
+// ignored. Returns false if playlist_item is no longer the open input (decoding has moved on to
+// the next item), in which case its GOPs can't be decoded any more.
+bool request_gop_decode(double pts_seconds, int playlist_item) {
+    if (!frame_cache || pts_seconds < 0.0) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(seek_mutex);
+    if (playlist_item != current_item) {
+        return false;
+    }
+    int64_t key = gop_request_key(pts_seconds);
+    forget_evicted_gops();
+    if (gops_cached.count(key) == 0 && gops_in_flight.insert(key).second) {
+        gop_requests.push_back(std::make_pair(pts_seconds, key));
+    }
+    return true;
+}
+
+// Render thread: start (seconds) of the GOP of playlist_item containing pts_seconds, or -1 if the
+// keyframe index isn't ready or the item is no longer the open input.
+double gop_start_time(double pts_seconds, int playlist_item) {
+    std::lock_guard<std::mutex> lock(seek_mutex); // The decoder thread swaps inputs under it
+    if (playlist_item != current_item) {
+        return -1.0;
+    }
+    int64_t start = gop_start_pts(seconds_to_stream_pts(pts_seconds), nullptr);
+    return start != AV_NOPTS_VALUE ? start * av_q2d(video_stream_time_base) + item_pts_offset : -1.0;
+}
+
+// Render thread: pauses/resumes forward decoding into the frame queue. After GOP decodes,
+// resume with a seek, since they move the demuxer.
+void set_forward_decoding(bool enabled) {
+    forward_decoding.store(enabled, std::memory_order_relaxed);
+}
+
+FrameCache* decoder_frame_cache() {
+    return frame_cache;
+}
+
+// Serial of the most recent seek request (0 before any seek).
+int current_seek_serial() {
+    return seek_serial.load(std::memory_order_relaxed);
+}
+
+bool decoder_input_rebuffering() {
+    std::lock_guard<std::mutex> lock(seek_mutex); // The decoder thread drops the network input under it
+    return net_input && net_input_rebuffering(net_input);
+}
+
+void report_frame_latency(uint64_t source_ns) {
+    if (!source_ns) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(seek_mutex);
+    if (net_input) {
+        net_input_record_latency(net_input, source_ns);
+    }
+}
+
+// Stops the decoder thread and frees any frames still in the queue.
+void stop_decode_thread() {
+    if (!frame_queue) {
+        return;
+    }
+
+    decode_stop_requested.store(true);
+    {
+        std::lock_guard<std::mutex> lock(seek_mutex);
+        if (net_input) {
+            net_input_wake(net_input);
+        }
+    }
+    if (decode_thread.joinable()) {
+        decode_thread.join();
+    }
+
+    while (DecodedFrame* item = frame_queue->front()) {
+        av_frame_free(&item->frame);
+        frame_queue->pop();
+    }
+    delete frame_queue;
+    frame_queue = nullptr;
 }
 
 // Cleanup: Frees all allocated resources.
 void cleanup_ffmpeg() {
+    if (catchup_enabled) {
+        catchup_print_stats(&catchup);
+        catchup_enabled = false;
+    }
+    if (trick_packets_skipped > 0 || trick_frames_skipped > 0) {
+        fprintf(stdout, "Trick play: %lld packet(s) skipped before decode, %lld decoded frame(s) skipped, %lld keyframe(s) decoded keyframes-only\n",
+            trick_packets_skipped, trick_frames_skipped, trick_keyframes_decoded);
+        trick_packets_skipped = 0;
+        trick_frames_skipped = 0;
+        trick_keyframes_decoded = 0;
+    }
+    if (audio_stream_index >= 0) {
+        audio_close();
+        audio_stream_index = -1;
+    }
+    audio_enabled = false;
+    clear_video_packet_backlog();
+    clear_preroll_frames();
+    if (frame_cache) {
+        frame_cache_print_stats(frame_cache);
+        frame_cache_destroy(frame_cache);
+        frame_cache = nullptr;
+    }
+    if (keyframe_index) {
+        keyframe_index_close(keyframe_index);
+        keyframe_index = nullptr;
+    }
     if (codec_ctx) {
         avcodec_free_context(&codec_ctx);
         codec_ctx = nullptr;
     }
+    net_input_close(&net_input); // Before the input it reads from
     if (fmt_ctx) {
         avformat_close_input(&fmt_ctx);
         fmt_ctx = nullptr;
     }
+    read_ahead_close(&read_ahead_io);
+    if (network_initialized) {
+        avformat_network_deinit();
+        network_initialized = false;
+    }
     if (packet) {
         av_packet_free(&packet);
         packet = nullptr;
     }
+    av_frame_free(&pending_seek_frame);
 }
\ No newline at end of file
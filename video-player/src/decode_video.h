@@ -0,0 +1,127 @@
+#pragma once
+
+extern "C" {
+#include<libavcodec/avcodec.h>
+#include<libavformat/avformat.h>
+}
+
+#include <string>
+#include <vector>
+
+#include "audio_sink.h"
+#include "net_input.h"
+#include "read_ahead.h"
+
+struct FrameCache;
+struct FramePool;
+
+// A decoded frame handed from the decoder thread to the render thread.
+struct DecodedFrame {
+    AVFrame* frame;     // Owns a reference to the decoded buffers
+    double pts;         // Presentation timestamp in seconds
+    int serial;         // Seek serial the frame was decoded under
+    int playlist_item;  // Playlist input it came from (0 = the one given to init_ffmpeg())
+    uint64_t source_ns; // Network input: when its packet was sent/received (trace_now_ns()), 0 if unknown
+};
+
+// Decoder threading configuration, applied by init_ffmpeg() before the codec is opened.
+// Frame threading decodes several frames in parallel and adds one frame of latency per
+// extra thread; slice threading splits a single frame and adds none, but only helps
+// when the stream was encoded with multiple slices.
+enum DecoderThreadType {
+    DECODER_THREAD_AUTO = 0,   // Frame + slice, whatever the codec supports
+    DECODER_THREAD_FRAME,
+    DECODER_THREAD_SLICE,
+    DECODER_THREAD_NONE        // Single-threaded decode
+};
+
+// Per-codec override of the threading model, e.g. "hevc=slice"
+struct DecoderThreadOverride {
+    char codec_name[32];
+    DecoderThreadType thread_type;
+};
+
+const int MAX_DECODER_THREAD_OVERRIDES = 8;
+
+struct DecoderOptions {
+    int thread_count;              // 0 = auto-detect from std::thread::hardware_concurrency
+    DecoderThreadType thread_type; // Used unless an override matches the codec
+    DecoderThreadOverride overrides[MAX_DECODER_THREAD_OVERRIDES];
+    int override_count;
+    bool use_frame_pool;           // Decode into buffers from set_decoder_frame_pool() (zero-copy upload)
+    bool use_keyframe_index;       // Build/map a keyframe index sidecar and seek with it
+    int frame_cache_mb;            // Memory budget of the decoded-frame cache (0 = disabled)
+    AudioSinkType audio_sink;      // Where the best audio stream plays (AUDIO_SINK_NONE = video only)
+    char audio_wav_path[260];      // Output file for AUDIO_SINK_WAV
+    ReadAheadMode read_ahead;      // How the demuxer reads local files (READ_AHEAD_OFF = FFmpeg's file protocol)
+    int read_ahead_mb;             // Ring / page-in window size for read_ahead
+    bool catch_up;                 // Skip decode work while presentation lags (see catchup.h)
+    bool fast_start;               // Cap probesize/analyzeduration; probe again in full if that misses stream parameters
+    NetInputOptions network;       // Jitter buffer, reconnects and timeouts of URL inputs (or a simulated network)
+};
+
+DecoderOptions default_decoder_options();
+void set_decoder_options(const DecoderOptions& options);
+int parse_decoder_thread_type(const char* name, DecoderThreadType* out);
+int add_decoder_thread_type_arg(DecoderOptions* options, const char* arg);
+
+// Functions implemented in decode_video.cpp
+void print_ffmpeerr(int err_code);
+int init_ffmpeg(const char* file_name, int* w, int* h, double* frame_delay_out, AVFrame** frame);
+int get_next_frame(AVFrame** frame, double* pts_out);
+int seek_to_time(double target_seconds, AVFrame** frame, double* pts_out);
+void cleanup_ffmpeg();
+
+// Zero-copy decode target. init_ffmpeg() installs the get_buffer2 hook when
+// DecoderOptions::use_frame_pool is set; frames use libavcodec's own buffers until a pool is attached.
+size_t decoder_frame_buffer_size();
+int decoder_pixel_format();
+void set_decoder_frame_pool(FramePool* pool);
+
+// Gapless playlist: inputs the decoder thread plays after the one given to init_ffmpeg(), in
+// order and on one timeline (frame PTS keep increasing across items). The next item is opened
+// and its first frames decoded in the background before the current one ends. Set before
+// start_decode_thread(). Items that fail to open are skipped.
+void set_playlist(const std::vector<std::string>& next_inputs);
+
+// Decoder thread (demux + decode ahead of presentation)
+int start_decode_thread(int queue_depth);
+DecodedFrame* peek_decoded_frame();
+DecodedFrame* peek_next_decoded_frame();
+DecodedFrame* peek_decoded_frame_at(int index);
+void pop_decoded_frame();
+int decode_thread_status();
+int request_seek(double target_seconds);
+void report_presentation_lateness(double seconds);
+// Called on the decoder thread when a frame lands in an empty queue, so a render loop blocked
+// waiting for events can wake up (e.g. glfwPostEmptyEvent). May be set while the thread runs.
+void set_frame_ready_callback(void (*callback)());
+int current_seek_serial();
+// Network input: the jitter buffer ran dry and is refilling, so playback should resume from the
+// next frame rather than catch up with the clock. Render thread.
+bool decoder_input_rebuffering();
+// Render thread: a frame with this DecodedFrame::source_ns is on screen; feeds the network
+// input's latency statistics.
+void report_frame_latency(uint64_t source_ns);
+
+// Trick play (variable-speed playback)
+const double MIN_PLAYBACK_RATE = 0.25;
+const double MAX_PLAYBACK_RATE = 32.0;
+// From this rate up only keyframes are decoded
+const double TRICK_KEYFRAME_RATE = 8.0;
+// Keyframe-only mode decodes at most this many keyframes per second of wall time
+const double TRICK_KEYFRAMES_PER_SECOND = 12.0;
+// Render thread: the playback rate and the display refresh period. Above 1x the decoder skips
+// frames that could never be shown: frames closer together (in media time) than rate x refresh
+// are dropped, non-reference ones before they are decoded; from TRICK_KEYFRAME_RATE up nothing
+// but keyframes is decoded (AVDISCARD_NONKEY), at most TRICK_KEYFRAMES_PER_SECOND of them.
+void set_playback_rate(double rate, double refresh_period);
+
+// GOP-aware decoded-frame cache (backward stepping and reverse playback)
+FrameCache* decoder_frame_cache();
+// Both take the playlist item the pts belongs to; GOPs can only be decoded while it is the open
+// input (request_gop_decode() returns false once decoding has moved on to the next one).
+bool request_gop_decode(double pts_seconds, int playlist_item);
+double gop_start_time(double pts_seconds, int playlist_item);
+void set_forward_decoding(bool enabled);
+void stop_decode_thread();
@@ -0,0 +1,131 @@
+#include <stdio.h>
+
+#include "frame_cache.h"
+
+extern "C" {
+#include<libavutil/imgutils.h>
+}
+
+FrameCache* frame_cache_create(size_t budget_bytes) {
+    FrameCache* cache = new FrameCache();
+    cache->budget_bytes = budget_bytes;
+    cache->used_bytes = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+    cache->peak_bytes = 0;
+    return cache;
+}
+
+void frame_cache_destroy(FrameCache* cache) {
+    if (!cache) {
+        return;
+    }
+    frame_cache_clear(cache);
+    delete cache;
+}
+
+// Caller holds the mutex.
+static void evict_entry(FrameCache* cache, std::map<FrameCacheKey, FrameCacheEntry>::iterator it) {
+    cache->used_bytes -= it->second.bytes;
+    cache->lru.erase(it->second.lru_pos);
+    av_frame_free(&it->second.frame);
+    cache->entries.erase(it);
+}
+
+void frame_cache_insert(FrameCache* cache, int item, double pts, const AVFrame* frame) {
+    FrameCacheKey key(item, pts);
+    size_t bytes = (size_t)av_image_get_buffer_size((AVPixelFormat)frame->format, frame->width, frame->height, 1);
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    auto existing = cache->entries.find(key);
+    if (existing != cache->entries.end()) {
+        evict_entry(cache, existing);
+    }
+
+    while (!cache->lru.empty() && cache->used_bytes + bytes > cache->budget_bytes) {
+        evict_entry(cache, cache->entries.find(cache->lru.back()));
+        cache->evictions++;
+    }
+
+    FrameCacheEntry entry;
+    entry.frame = av_frame_clone(frame);
+    if (!entry.frame) {
+        return;
+    }
+    entry.bytes = bytes;
+    cache->lru.push_front(key);
+    entry.lru_pos = cache->lru.begin();
+    cache->entries[key] = entry;
+
+    cache->used_bytes += bytes;
+    if (cache->used_bytes > cache->peak_bytes) {
+        cache->peak_bytes = cache->used_bytes;
+    }
+}
+
+// Caller holds the mutex. Marks the entry as used and hands out a reference.
+static bool use_entry(FrameCache* cache, std::map<FrameCacheKey, FrameCacheEntry>::iterator it, AVFrame* out, double* pts_out) {
+    cache->lru.splice(cache->lru.begin(), cache->lru, it->second.lru_pos);
+    av_frame_unref(out);
+    if (av_frame_ref(out, it->second.frame) < 0) {
+        return false;
+    }
+    *pts_out = it->first.second;
+    cache->hits++;
+    return true;
+}
+
+bool frame_cache_lookup(FrameCache* cache, int item, double target, double max_gap, AVFrame* out, double* pts_out) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    // First entry after the target, then step back to the one on screen at the target time
+    auto it = cache->entries.upper_bound(FrameCacheKey(item, target));
+    if (it == cache->entries.begin() || (--it, it->first.first != item || target - it->first.second > max_gap)) {
+        cache->misses++;
+        return false;
+    }
+    return use_entry(cache, it, out, pts_out);
+}
+
+bool frame_cache_lookup_before(FrameCache* cache, int item, double pts, double max_gap, AVFrame* out, double* pts_out) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    auto it = cache->entries.lower_bound(FrameCacheKey(item, pts));
+    if (it == cache->entries.begin() || (--it, it->first.first != item || pts - it->first.second > max_gap)) {
+        cache->misses++;
+        return false;
+    }
+    return use_entry(cache, it, out, pts_out);
+}
+
+bool frame_cache_lookup_after(FrameCache* cache, int item, double pts, double max_gap, AVFrame* out, double* pts_out) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    auto it = cache->entries.upper_bound(FrameCacheKey(item, pts));
+    if (it == cache->entries.end() || it->first.first != item || it->first.second - pts > max_gap) {
+        cache->misses++;
+        return false;
+    }
+    return use_entry(cache, it, out, pts_out);
+}
+
+void frame_cache_clear(FrameCache* cache) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    for (auto& kv : cache->entries) {
+        av_frame_free(&kv.second.frame);
+    }
+    cache->entries.clear();
+    cache->lru.clear();
+    cache->used_bytes = 0;
+}
+
+void frame_cache_print_stats(FrameCache* cache) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    long long lookups = cache->hits + cache->misses;
+    fprintf(stdout, "Frame cache: %zu frames, %.1f/%.1f MB (peak %.1f MB), %lld hits / %lld lookups (%.1f%%), %lld evictions\n",
+        cache->entries.size(), cache->used_bytes / (1024.0 * 1024.0), cache->budget_bytes / (1024.0 * 1024.0),
+        cache->peak_bytes / (1024.0 * 1024.0), cache->hits, lookups,
+        lookups > 0 ? 100.0 * cache->hits / lookups : 0.0, cache->evictions);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+
+extern "C" {
+#include<libavutil/frame.h>
+}
+
+// Decoded-frame cache keyed by playlist item and PTS (seconds), used for backward stepping and
+// reverse playback. The decoder thread fills it one whole GOP at a time; the render thread reads
+// from it. Lookups only return frames of the item asked for, so frames decoded from an item that
+// has ended never stand in for the next one's around the boundary.
+// Holds frame references (no pixel copies) up to a memory budget, evicting least recently used.
+
+// (playlist item, pts)
+typedef std::pair<int, double> FrameCacheKey;
+
+struct FrameCacheEntry {
+    AVFrame* frame;
+    size_t bytes;
+    std::list<FrameCacheKey>::iterator lru_pos;
+};
+
+struct FrameCache {
+    std::mutex mutex;
+    std::map<FrameCacheKey, FrameCacheEntry> entries;
+    std::list<FrameCacheKey> lru; // Front = most recently used
+    size_t budget_bytes;
+    size_t used_bytes;
+
+    // Statistics
+    long long hits;
+    long long misses;
+    long long evictions;
+    size_t peak_bytes;
+};
+
+FrameCache* frame_cache_create(size_t budget_bytes);
+void frame_cache_destroy(FrameCache* cache);
+
+// Adds a reference to `frame` under (`item`, `pts`). Evicts LRU entries to stay within the budget.
+void frame_cache_insert(FrameCache* cache, int item, double pts, const AVFrame* frame);
+
+// Finds the latest cached frame of `item` with pts <= target and at most `max_gap` seconds before it.
+// On a hit, `out` receives a new reference and `pts_out` its PTS.
+bool frame_cache_lookup(FrameCache* cache, int item, double target, double max_gap, AVFrame* out, double* pts_out);
+
+// Finds the latest cached frame strictly before `pts` (for stepping back), within `max_gap`.
+bool frame_cache_lookup_before(FrameCache* cache, int item, double pts, double max_gap, AVFrame* out, double* pts_out);
+
+// Finds the earliest cached frame strictly after `pts` (for stepping forward), within `max_gap`.
+bool frame_cache_lookup_after(FrameCache* cache, int item, double pts, double max_gap, AVFrame* out, double* pts_out);
+
+void frame_cache_clear(FrameCache* cache);
+void frame_cache_print_stats(FrameCache* cache);
@@ -0,0 +1,170 @@
+#include <stdio.h>
+
+#include "frame_pool.h"
+
+extern "C" {
+#include<libavutil/imgutils.h>
+#include<libavutil/pixdesc.h>
+}
+
+// Row and plane alignment inside a slab. 64 bytes covers AVX-512 decoders and GL's unpack rules.
+static const int FRAME_POOL_ALIGN = 64;
+
+// Computes per-plane linesizes and byte offsets for a frame; returns the total size, or 0 if
+// the pixel format can't be described (hardware formats etc.).
+static size_t frame_pool_layout(AVCodecContext* ctx, int width, int height, AVPixelFormat format,
+    int linesize[4], size_t offset[4]) {
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    int w = width;
+    int h = height;
+
+    // The decoder may write past the visible area (macroblock padding, edge emulation)
+    avcodec_align_dimensions2(ctx, &w, &h, linesize_align);
+
+    if (av_image_fill_linesizes(linesize, format, w) < 0) {
+        return 0;
+    }
+
+    ptrdiff_t linesize_ptr[4];
+    for (int i = 0; i < 4; i++) {
+        linesize[i] = FFALIGN(linesize[i], FRAME_POOL_ALIGN);
+        linesize_ptr[i] = linesize[i];
+    }
+
+    size_t plane_size[4];
+    if (av_image_fill_plane_sizes(plane_size, format, h, linesize_ptr) < 0) {
+        return 0;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < 4; i++) {
+        offset[i] = total;
+        if (plane_size[i] > 0) {
+            // Extra padding: some decoders read/write a few bytes past the last row
+            total += FFALIGN(plane_size[i] + 16 + FRAME_POOL_ALIGN - 1, FRAME_POOL_ALIGN);
+        }
+    }
+    return total;
+}
+
+size_t frame_pool_buffer_size(AVCodecContext* ctx, int width, int height, AVPixelFormat format) {
+    int linesize[4];
+    size_t offset[4];
+    return frame_pool_layout(ctx, width, height, format, linesize, offset);
+}
+
+FramePool* frame_pool_create(uint8_t* arena, size_t slab_size, int slab_count) {
+    slab_size = FFALIGN(slab_size, FRAME_POOL_ALIGN);
+
+    FramePool* pool = new FramePool();
+    pool->owns_arena = (arena == nullptr);
+    pool->arena = arena ? arena : (uint8_t*)av_malloc(slab_size * slab_count);
+    pool->slab_size = slab_size;
+    pool->slab_count = slab_count;
+    pool->pooled_allocs = 0;
+    pool->fallback_allocs = 0;
+
+    if (!pool->arena) {
+        fprintf(stderr, "Could not allocate frame pool (%zu bytes)\n", slab_size * slab_count);
+        delete pool;
+        return nullptr;
+    }
+
+    pool->slabs = new FramePoolSlab[slab_count];
+    for (int i = 0; i < slab_count; i++) {
+        pool->slabs[i].pool = pool;
+        pool->slabs[i].offset = slab_size * i;
+        pool->slabs[i].data = pool->arena + pool->slabs[i].offset;
+        pool->slabs[i].state = 0;
+    }
+
+    fprintf(stdout, "Frame pool: %d slabs x %.2f MB (%s memory)\n", slab_count,
+        slab_size / (1024.0 * 1024.0), pool->owns_arena ? "CPU" : "mapped GL");
+    return pool;
+}
+
+void frame_pool_destroy(FramePool* pool) {
+    if (!pool) {
+        return;
+    }
+    if (pool->owns_arena) {
+        av_free(pool->arena);
+    }
+    delete[] pool->slabs;
+    delete pool;
+}
+
+// AVBuffer free callback: the decoder and every queued/displayed frame dropped the slab.
+static void frame_pool_release_decoder(void* opaque, uint8_t*) {
+    FramePoolSlab* slab = (FramePoolSlab*)opaque;
+    slab->state.fetch_and(~FRAME_SLAB_DECODER, std::memory_order_release);
+}
+
+int frame_pool_get_buffer(FramePool* pool, AVCodecContext* ctx, AVFrame* frame, int flags) {
+    int linesize[4];
+    size_t offset[4];
+    size_t size = frame_pool_layout(ctx, frame->width, frame->height, (AVPixelFormat)frame->format, linesize, offset);
+
+    if (size == 0 || size > pool->slab_size) {
+        // Geometry doesn't fit the slabs (e.g. resolution change): let libavcodec allocate.
+        pool->fallback_allocs++;
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+
+    // Called from libavcodec's frame threads too, so slabs are claimed with a CAS.
+    FramePoolSlab* slab = nullptr;
+    for (int i = 0; i < pool->slab_count; i++) {
+        int expected = 0;
+        if (pool->slabs[i].state.compare_exchange_strong(expected, FRAME_SLAB_DECODER, std::memory_order_acquire)) {
+            slab = &pool->slabs[i];
+            break;
+        }
+    }
+
+    if (!slab) {
+        pool->fallback_allocs++;
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+
+    frame->buf[0] = av_buffer_create(slab->data, pool->slab_size, frame_pool_release_decoder, slab, 0);
+    if (!frame->buf[0]) {
+        slab->state.store(0);
+        return AVERROR(ENOMEM);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        frame->linesize[i] = linesize[i];
+        frame->data[i] = linesize[i] ? slab->data + offset[i] : nullptr;
+    }
+    frame->extended_data = frame->data;
+
+    pool->pooled_allocs++;
+    return 0;
+}
+
+FramePoolSlab* frame_pool_find(FramePool* pool, const AVFrame* frame) {
+    if (!pool || !frame->data[0]) {
+        return nullptr;
+    }
+    const uint8_t* p = frame->data[0];
+    if (p < pool->arena || p >= pool->arena + pool->slab_size * pool->slab_count) {
+        return nullptr;
+    }
+    return &pool->slabs[(p - pool->arena) / pool->slab_size];
+}
+
+void frame_pool_mark_gpu_busy(FramePoolSlab* slab) {
+    slab->state.fetch_or(FRAME_SLAB_GPU, std::memory_order_relaxed);
+}
+
+void frame_pool_release_gpu(FramePoolSlab* slab) {
+    slab->state.fetch_and(~FRAME_SLAB_GPU, std::memory_order_release);
+}
+
+void frame_pool_print_stats(const FramePool* pool) {
+    long long pooled = pool->pooled_allocs.load();
+    long long fallback = pool->fallback_allocs.load();
+    long long total = pooled + fallback;
+    fprintf(stdout, "Frame pool: %lld frames decoded in place, %lld fallback allocations (%.1f%% zero-copy)\n",
+        pooled, fallback, total > 0 ? 100.0 * pooled / total : 0.0);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+extern "C" {
+#include<libavcodec/avcodec.h>
+}
+
+// Pool of fixed-size frame buffers handed to libavcodec through get_buffer2, so the decoder
+// writes pixels straight into memory the upload path can read from.
+//
+// The arena is either a persistently mapped GL pixel-unpack buffer (zero-copy: the texture
+// upload reads the decoded planes in place) or plain CPU memory when GL isn't available.
+// This file has no GL dependency; the render thread owns the GL side.
+//
+// A slab is reused only when both owners are done with it:
+//  - FRAME_SLAB_DECODER: cleared when the last AVBufferRef to the slab is released
+//  - FRAME_SLAB_GPU: set by the render thread when it uploads from the slab, cleared once
+//    the fence it inserted after the upload has signaled
+enum {
+    FRAME_SLAB_DECODER = 1,
+    FRAME_SLAB_GPU = 2
+};
+
+struct FramePool;
+
+struct FramePoolSlab {
+    FramePool* pool;
+    uint8_t* data;
+    size_t offset;              // Byte offset of the slab inside the arena
+    std::atomic<int> state;     // FRAME_SLAB_* flags, 0 when free
+};
+
+struct FramePool {
+    uint8_t* arena;
+    bool owns_arena;            // True for the CPU fallback (arena allocated by the pool)
+    size_t slab_size;
+    int slab_count;
+    FramePoolSlab* slabs;
+
+    // Statistics
+    std::atomic<long long> pooled_allocs;
+    std::atomic<long long> fallback_allocs; // Pool exhausted or frame too large for a slab
+};
+
+// Bytes needed to hold one frame of the given geometry with the decoder's alignment requirements.
+size_t frame_pool_buffer_size(AVCodecContext* ctx, int width, int height, AVPixelFormat format);
+
+// Creates a pool over an existing arena (slab_size * slab_count bytes), or over CPU memory if arena is nullptr.
+FramePool* frame_pool_create(uint8_t* arena, size_t slab_size, int slab_count);
+
+// Must only be called once every frame from the pool has been released.
+void frame_pool_destroy(FramePool* pool);
+
+// get_buffer2 implementation. Falls back to avcodec_default_get_buffer2 when no slab is free.
+int frame_pool_get_buffer(FramePool* pool, AVCodecContext* ctx, AVFrame* frame, int flags);
+
+// Returns the slab backing the frame, or nullptr if the frame was not allocated from this pool.
+FramePoolSlab* frame_pool_find(FramePool* pool, const AVFrame* frame);
+
+// Render thread: GPU is (no longer) reading from the slab.
+void frame_pool_mark_gpu_busy(FramePoolSlab* slab);
+void frame_pool_release_gpu(FramePoolSlab* slab);
+
+void frame_pool_print_stats(const FramePool* pool);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// Bounded single-producer/single-consumer ring buffer.
+// The decoder thread is the only producer and the render thread the only consumer,
+// so head and tail each have exactly one writer and no lock is needed.
+// One slot is always left empty to tell "full" apart from "empty".
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t depth)
+        : capacity(depth + 1), slots(new T[depth + 1]), head(0), tail(0) {}
+
+    ~SpscRing() { delete[] slots; }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side: returns false if the ring is full (caller applies back-pressure).
+    bool push(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t next = (t + 1) % capacity;
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: pointer to the oldest item (or nullptr if empty). Valid until pop().
+    T* front() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[h];
+    }
+
+    // Consumer side: pointer to the item after front() (or nullptr), used to look one frame ahead.
+    T* second() {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        if (h == t || (h + 1) % capacity == t) {
+            return nullptr;
+        }
+        return &slots[(h + 1) % capacity];
+    }
+
+    // Consumer side: the item `index` places after front() (0 = front()), or nullptr past the newest.
+    T* at(size_t index) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        if (index >= (t + capacity - h) % capacity) {
+            return nullptr;
+        }
+        return &slots[(h + index) % capacity];
+    }
+
+    // Consumer side: releases the slot returned by front().
+    void pop() {
+        size_t h = head.load(std::memory_order_relaxed);
+        head.store((h + 1) % capacity, std::memory_order_release);
+    }
+
+    // Approximate fill level (exact when called from either endpoint's own thread).
+    size_t size() const {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return (t + capacity - h) % capacity;
+    }
+
+    size_t depth() const { return capacity - 1; }
+
+private:
+    const size_t capacity;
+    T* slots;
+    // Keep the two indices on separate cache lines so producer and consumer don't false-share.
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
@@ -0,0 +1,214 @@
+#include <string.h>
+
+#include "frame_writer.h"
+#include "decode_video.h"
+
+static const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static int open_png_encoder(FrameWriter* writer) {
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!codec) {
+        fprintf(stderr, "Frame writer: this FFmpeg build has no PNG encoder\n");
+        return -1;
+    }
+    writer->png_ctx = avcodec_alloc_context3(codec);
+    writer->png_frame = av_frame_alloc();
+    writer->png_packet = av_packet_alloc();
+    if (!writer->png_ctx || !writer->png_frame || !writer->png_packet) {
+        return AVERROR(ENOMEM);
+    }
+    writer->png_ctx->width = writer->width;
+    writer->png_ctx->height = writer->height;
+    writer->png_ctx->pix_fmt = AV_PIX_FMT_RGBA;
+    writer->png_ctx->time_base = av_make_q(1, 25);
+    int ret = avcodec_open2(writer->png_ctx, codec, nullptr);
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+        return ret;
+    }
+
+    writer->png_frame->format = AV_PIX_FMT_RGBA;
+    writer->png_frame->width = writer->width;
+    writer->png_frame->height = writer->height;
+    return av_frame_get_buffer(writer->png_frame, 0);
+}
+
+static void free_writer(FrameWriter* writer) {
+    if (writer->raw_file) {
+        fclose(writer->raw_file);
+    }
+    avcodec_free_context(&writer->png_ctx);
+    av_frame_free(&writer->png_frame);
+    av_packet_free(&writer->png_packet);
+    delete writer;
+}
+
+FrameWriter* frame_writer_open(const char* spec, int width, int height) {
+    FrameWriter* writer = new FrameWriter();
+    memset(writer, 0, sizeof(FrameWriter));
+    writer->width = width;
+    writer->height = height;
+    writer->run_checksum = FNV_OFFSET_BASIS;
+
+    bool ok = true;
+    if (strcmp(spec, "checksum") == 0) {
+        writer->type = FRAME_WRITER_CHECKSUM;
+    }
+    else if (strncmp(spec, "raw:", 4) == 0 && spec[4] != '\0') {
+        writer->type = FRAME_WRITER_RAW;
+        snprintf(writer->path, sizeof(writer->path), "%s", spec + 4);
+        writer->raw_file = fopen(writer->path, "wb");
+        ok = writer->raw_file != nullptr;
+    }
+    else if (strncmp(spec, "png:", 4) == 0 && spec[4] != '\0') {
+        writer->type = FRAME_WRITER_PNG;
+        snprintf(writer->path, sizeof(writer->path), "%s", spec + 4);
+        ok = open_png_encoder(writer) >= 0;
+    }
+    else {
+        fprintf(stderr, "Frame writer: unknown output '%s' (checksum, raw:<file> or png:<directory>)\n", spec);
+        ok = false;
+    }
+
+    if (!ok) {
+        if (writer->type != FRAME_WRITER_CHECKSUM) {
+            fprintf(stderr, "Frame writer: could not open %s\n", writer->path);
+        }
+        free_writer(writer);
+        return nullptr;
+    }
+    return writer;
+}
+
+static int write_png(FrameWriter* writer) {
+    int ret = avcodec_send_frame(writer->png_ctx, writer->png_frame);
+    if (ret >= 0) {
+        ret = avcodec_receive_packet(writer->png_ctx, writer->png_packet);
+    }
+    if (ret < 0) {
+        print_ffmpeerr(ret);
+        return ret;
+    }
+
+    char file_name[300];
+    snprintf(file_name, sizeof(file_name), "%s/frame_%06lld.png", writer->path, writer->frames);
+    FILE* f = fopen(file_name, "wb");
+    bool ok = f && fwrite(writer->png_packet->data, 1, writer->png_packet->size, f) == (size_t)writer->png_packet->size;
+    if (f) {
+        fclose(f);
+    }
+    av_packet_unref(writer->png_packet);
+    if (!ok) {
+        fprintf(stderr, "Frame writer: could not write %s\n", file_name);
+        return -1;
+    }
+    return 0;
+}
+
+// Rows top-down: the first at top_row, each next one row_step bytes further
+static int write_rows(FrameWriter* writer, const uint8_t* top_row, ptrdiff_t row_step, double pts) {
+    size_t row_bytes = (size_t)writer->width * 4;
+    uint64_t checksum = FNV_OFFSET_BASIS;
+
+    if (writer->type == FRAME_WRITER_PNG) {
+        int ret = av_frame_make_writable(writer->png_frame);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    // Walk the rows top-down: checksum them and hand them to the output
+    for (int y = 0; y < writer->height; y++) {
+        const uint8_t* row = top_row + y * row_step;
+        checksum = fnv1a(checksum, row, row_bytes);
+
+        if (writer->type == FRAME_WRITER_RAW) {
+            if (fwrite(row, 1, row_bytes, writer->raw_file) != row_bytes) {
+                fprintf(stderr, "Frame writer: write to %s failed\n", writer->path);
+                return -1;
+            }
+        }
+        else if (writer->type == FRAME_WRITER_PNG) {
+            memcpy(writer->png_frame->data[0] + (size_t)y * writer->png_frame->linesize[0], row, row_bytes);
+        }
+    }
+
+    if (writer->type == FRAME_WRITER_PNG && write_png(writer) < 0) {
+        return -1;
+    }
+    if (writer->type == FRAME_WRITER_CHECKSUM) {
+        fprintf(stdout, "frame %6lld  pts %9.3f  checksum %016llx\n", writer->frames, pts, (unsigned long long)checksum);
+    }
+
+    writer->run_checksum = fnv1a(writer->run_checksum, (const uint8_t*)&checksum, sizeof(checksum));
+    writer->frames++;
+    return 0;
+}
+
+int frame_writer_write(FrameWriter* writer, const uint8_t* bottom_up_rgba, int stride, double pts) {
+    return write_rows(writer, bottom_up_rgba + (size_t)(writer->height - 1) * stride, -(ptrdiff_t)stride, pts);
+}
+
+int frame_writer_write_top_down(FrameWriter* writer, const uint8_t* rgba, int stride, double pts) {
+    return write_rows(writer, rgba, stride, pts);
+}
+
+int frame_writer_check_golden(const FrameWriter* writer, const char* golden_path) {
+    FILE* f = fopen(golden_path, "r");
+    if (!f) {
+        fprintf(stderr, "Frame writer: could not open %s\n", golden_path);
+        return -1;
+    }
+    // The last summary wins, should the file hold several runs
+    bool found = false;
+    long long frames = 0;
+    int width = 0;
+    int height = 0;
+    unsigned long long checksum = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        long long n;
+        int w, h;
+        unsigned long long c;
+        if (sscanf(line, "Frame writer: %lld frame(s) %dx%d, run checksum %llx", &n, &w, &h, &c) == 4) {
+            found = true;
+            frames = n;
+            width = w;
+            height = h;
+            checksum = c;
+        }
+    }
+    fclose(f);
+    if (!found) {
+        fprintf(stderr, "Frame writer: no run checksum in %s\n", golden_path);
+        return -1;
+    }
+
+    bool match = frames == writer->frames && width == writer->width && height == writer->height &&
+        checksum == writer->run_checksum;
+    if (!match) {
+        fprintf(stderr, "Frame writer: MISMATCH with %s: expected %lld frame(s) %dx%d, run checksum %016llx; "
+            "got %lld frame(s) %dx%d, run checksum %016llx\n", golden_path, frames, width, height, checksum,
+            writer->frames, writer->width, writer->height, (unsigned long long)writer->run_checksum);
+        return -1;
+    }
+    fprintf(stdout, "Frame writer: matches %s\n", golden_path);
+    return 0;
+}
+
+void frame_writer_close(FrameWriter* writer) {
+    if (!writer) {
+        return;
+    }
+    fprintf(stdout, "Frame writer: %lld frame(s) %dx%d, run checksum %016llx\n",
+        writer->frames, writer->width, writer->height, (unsigned long long)writer->run_checksum);
+    free_writer(writer);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+extern "C" {
+#include<libavcodec/avcodec.h>
+}
+
+// Output for rendered frames read back from the GPU (offscreen mode) or converted on the CPU.
+//   checksum: prints a 64-bit FNV-1a checksum per frame and one for the whole run (golden tests)
+//   raw:      appends tightly packed RGBA frames to one file
+//   png:      writes one PNG per frame into a directory (libavcodec's PNG encoder)
+// Every mode computes the checksums, so they can be compared across modes and machines.
+
+enum FrameWriterType {
+    FRAME_WRITER_CHECKSUM = 0,
+    FRAME_WRITER_RAW,
+    FRAME_WRITER_PNG
+};
+
+struct FrameWriter {
+    FrameWriterType type;
+    int width;
+    int height;
+    char path[260];
+
+    FILE* raw_file;
+    AVCodecContext* png_ctx;
+    AVFrame* png_frame;
+    AVPacket* png_packet;
+
+    long long frames;
+    uint64_t run_checksum;
+};
+
+// Parses "checksum", "raw:<file>" or "png:<directory>". Returns nullptr on a bad spec or open failure.
+FrameWriter* frame_writer_open(const char* spec, int width, int height);
+
+// Writes one RGBA frame given bottom-up, as glReadPixels returns it (`stride` bytes per row).
+// Images are stored top-down. Returns <0 on a write error.
+int frame_writer_write(FrameWriter* writer, const uint8_t* bottom_up_rgba, int stride, double pts);
+// Same for a frame stored top-down (CPU rendering). Checksums match frame_writer_write() of the same image.
+int frame_writer_write_top_down(FrameWriter* writer, const uint8_t* rgba, int stride, double pts);
+
+// Compares the run so far with the summary line ("Frame writer: ... run checksum ...") that an
+// earlier run printed into `golden_path`. Returns 0 on a match, <0 if it differs, or if the file
+// can't be read or has no summary.
+int frame_writer_check_golden(const FrameWriter* writer, const char* golden_path);
+
+// Prints the run checksum and closes the output.
+void frame_writer_close(FrameWriter* writer);
@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "keyframe_index.h"
+
+// Sidecar layout: header followed by `count` KeyframeEntry records, all little-endian.
+static const char KFIDX_MAGIC[8] = { 'K', 'F', 'I', 'D', 'X', 0, 0, 1 };
+
+struct KeyframeIndexHeader {
+    char magic[8];
+    int64_t media_size;     // Used to detect a stale sidecar
+    int64_t media_mtime;
+    int32_t stream_index;
+    int32_t time_base_num;
+    int32_t time_base_den;
+    uint32_t entry_size;    // sizeof(KeyframeEntry), guards against layout changes
+    uint64_t count;
+};
+
+static bool get_file_stat(const char* path, int64_t* size, int64_t* mtime) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path, &st) != 0) return false;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+#endif
+    *size = (int64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+// Pipes, devices and FIFOs can't be read a second time by the scan without stealing the player's data
+static bool is_regular_file(const char* path) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path, &st) != 0) return false;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+#endif
+    return (st.st_mode & S_IFMT) == S_IFREG;
+}
+
+// Maps a whole file read-only. Returns nullptr on failure.
+static void* map_file(const char* path, size_t* size_out) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // The view keeps the mapping alive
+    *size_out = (size_t)size.QuadPart;
+    return data;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return nullptr;
+    *size_out = (size_t)st.st_size;
+    return data;
+#endif
+}
+
+static void unmap_file(void* data, size_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+// Tries to use an existing sidecar. Returns true if it matched the media and was mapped.
+static bool load_sidecar(KeyframeIndex* index) {
+    int64_t media_size, media_mtime;
+    if (!get_file_stat(index->media_path.c_str(), &media_size, &media_mtime)) {
+        return false;
+    }
+
+    size_t size = 0;
+    void* data = map_file(index->sidecar_path.c_str(), &size);
+    if (!data) {
+        return false;
+    }
+
+    const KeyframeIndexHeader* header = (const KeyframeIndexHeader*)data;
+    bool valid = size >= sizeof(KeyframeIndexHeader) &&
+        memcmp(header->magic, KFIDX_MAGIC, sizeof(KFIDX_MAGIC)) == 0 &&
+        header->media_size == media_size &&
+        header->media_mtime == media_mtime &&
+        header->stream_index == index->stream_index &&
+        header->time_base_num == index->time_base.num &&
+        header->time_base_den == index->time_base.den &&
+        header->entry_size == sizeof(KeyframeEntry) &&
+        // Not count * entry size: a corrupt count can wrap the product around to the file size
+        (size - sizeof(KeyframeIndexHeader)) % sizeof(KeyframeEntry) == 0 &&
+        header->count == (size - sizeof(KeyframeIndexHeader)) / sizeof(KeyframeEntry);
+
+    if (!valid) {
+        fprintf(stderr, "Keyframe index: ignoring stale sidecar %s\n", index->sidecar_path.c_str());
+        unmap_file(data, size);
+        return false;
+    }
+
+    index->mapping = data;
+    index->mapping_size = size;
+    index->entries = (const KeyframeEntry*)((const uint8_t*)data + sizeof(KeyframeIndexHeader));
+    index->count = (size_t)header->count;
+    return true;
+}
+
+static void save_sidecar(KeyframeIndex* index) {
+    KeyframeIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KFIDX_MAGIC, sizeof(KFIDX_MAGIC));
+    if (!get_file_stat(index->media_path.c_str(), &header.media_size, &header.media_mtime)) {
+        return;
+    }
+    header.stream_index = index->stream_index;
+    header.time_base_num = index->time_base.num;
+    header.time_base_den = index->time_base.den;
+    header.entry_size = sizeof(KeyframeEntry);
+    header.count = index->built.size();
+
+    // Write to a temporary name first so a crash never leaves a truncated sidecar behind
+    std::string tmp_path = index->sidecar_path + ".tmp";
+    FILE* f = fopen(tmp_path.c_str(), "wb");
+    if (!f) {
+        // Read-only media directory: the index just stays in memory for this session
+        fprintf(stderr, "Keyframe index: could not write %s\n", tmp_path.c_str());
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+        (index->built.empty() || fwrite(index->built.data(), sizeof(KeyframeEntry), index->built.size(), f) == index->built.size());
+    ok = (fclose(f) == 0) && ok;
+
+    remove(index->sidecar_path.c_str());
+    if (!ok || rename(tmp_path.c_str(), index->sidecar_path.c_str()) != 0) {
+        fprintf(stderr, "Keyframe index: could not write %s\n", index->sidecar_path.c_str());
+        remove(tmp_path.c_str());
+    }
+}
+
+// Background scan: demux every packet of the stream (no decoding) and record the keyframes.
+static void scan_thread_main(KeyframeIndex* index) {
+    auto start = std::chrono::steady_clock::now();
+    AVFormatContext* ctx = nullptr;
+    AVPacket* pkt = av_packet_alloc();
+
+    // Same I/O path as the player's demuxer, with its own read-ahead window
+    AVIOContext* io = read_ahead_open(index->media_path.c_str(), index->read_ahead, index->read_ahead_mb);
+    if (io) {
+        ctx = avformat_alloc_context();
+        if (ctx) {
+            ctx->pb = io;
+            ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+    }
+    int ret = io && !ctx ? AVERROR(ENOMEM) : avformat_open_input(&ctx, index->media_path.c_str(), nullptr, nullptr);
+    if (ret < 0 || !pkt) {
+        fprintf(stderr, "Keyframe index: could not open %s for scanning\n", index->media_path.c_str());
+        avformat_close_input(&ctx);
+        read_ahead_close(&io); // A failed open frees ctx but never a custom pb
+        av_packet_free(&pkt);
+        return;
+    }
+
+    // Only the indexed stream matters; let the demuxer skip the others cheaply
+    for (unsigned int i = 0; i < ctx->nb_streams; i++) {
+        ctx->streams[i]->discard = (int)i == index->stream_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+
+    while (!index->stop_requested.load(std::memory_order_relaxed) && av_read_frame(ctx, pkt) >= 0) {
+        if (pkt->stream_index == index->stream_index) {
+            if (pkt->flags & AV_PKT_FLAG_KEY) {
+                KeyframeEntry entry;
+                entry.pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+                entry.pos = pkt->pos;
+                entry.gop_size = 0;
+                entry.reserved = 0;
+                if (entry.pts != AV_NOPTS_VALUE) {
+                    index->built.push_back(entry);
+                }
+            }
+            if (!index->built.empty()) {
+                index->built.back().gop_size++;
+            }
+        }
+        av_packet_unref(pkt);
+    }
+
+    av_packet_free(&pkt);
+    avformat_close_input(&ctx);
+    read_ahead_close(&io);
+
+    if (index->stop_requested.load()) {
+        return;
+    }
+
+    std::sort(index->built.begin(), index->built.end(),
+        [](const KeyframeEntry& a, const KeyframeEntry& b) { return a.pts < b.pts; });
+
+    index->entries = index->built.data();
+    index->count = index->built.size();
+    index->scan_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    index->ready.store(true, std::memory_order_release);
+
+    fprintf(stdout, "Keyframe index: scanned %zu keyframes in %.2fs\n", index->count, index->scan_seconds);
+    save_sidecar(index);
+}
+
+KeyframeIndex* keyframe_index_open(const char* media_path, int stream_index, AVRational time_base,
+    ReadAheadMode read_ahead, int read_ahead_mb) {
+    if (!is_regular_file(media_path)) {
+        fprintf(stdout, "Keyframe index: %s is not a regular file, seeking without an index\n", media_path);
+        return nullptr;
+    }
+
+    KeyframeIndex* index = new KeyframeIndex();
+    index->media_path = media_path;
+    index->sidecar_path = index->media_path + ".kfidx";
+    index->stream_index = stream_index;
+    index->time_base = time_base;
+    index->read_ahead = read_ahead;
+    index->read_ahead_mb = read_ahead_mb;
+    index->ready = false;
+    index->entries = nullptr;
+    index->count = 0;
+    index->mapping = nullptr;
+    index->mapping_size = 0;
+    index->stop_requested = false;
+    index->scan_seconds = 0.0;
+
+    if (load_sidecar(index)) {
+        index->ready.store(true, std::memory_order_release);
+        fprintf(stdout, "Keyframe index: mapped %zu keyframes from %s\n", index->count, index->sidecar_path.c_str());
+        return index;
+    }
+
+    index->scan_thread = std::thread(scan_thread_main, index);
+    return index;
+}
+
+const KeyframeEntry* keyframe_index_lookup(KeyframeIndex* index, int64_t target_pts) {
+    if (!index || !index->ready.load(std::memory_order_acquire) || index->count == 0) {
+        return nullptr;
+    }
+
+    // Binary search for the first keyframe after the target, then step back one
+    const KeyframeEntry* begin = index->entries;
+    const KeyframeEntry* end = index->entries + index->count;
+    const KeyframeEntry* it = std::upper_bound(begin, end, target_pts,
+        [](int64_t pts, const KeyframeEntry& e) { return pts < e.pts; });
+    return it == begin ? begin : it - 1;
+}
+
+void keyframe_index_close(KeyframeIndex* index) {
+    if (!index) {
+        return;
+    }
+    index->stop_requested.store(true);
+    if (index->scan_thread.joinable()) {
+        index->scan_thread.join();
+    }
+    if (index->mapping) {
+        unmap_file(index->mapping, index->mapping_size);
+    }
+    delete index;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include<libavformat/avformat.h>
+}
+
+#include "read_ahead.h"
+
+// Keyframe index for fast, frame-accurate seeking.
+//
+// Built by a background scan that only demuxes (no decode), then saved as a compact binary
+// sidecar next to the media ("<file>.kfidx"). Later opens memory-map the sidecar instead of
+// scanning again, as long as the media file's size and modification time still match.
+
+struct KeyframeEntry {
+    int64_t pts;        // Keyframe PTS in stream time_base units
+    int64_t pos;        // Byte position of the keyframe packet (-1 if unknown)
+    uint32_t gop_size;  // Packets from this keyframe up to the next one
+    uint32_t reserved;
+};
+
+struct KeyframeIndex {
+    std::string media_path;
+    std::string sidecar_path;
+    int stream_index;
+    AVRational time_base;
+    ReadAheadMode read_ahead;      // How the scan reads the media, as the player's demuxer does
+    int read_ahead_mb;
+
+    // Published once the index is complete (loaded from the sidecar or scan finished)
+    std::atomic<bool> ready;
+    const KeyframeEntry* entries;
+    size_t count;
+
+    // Backing storage: either the scan results or the mapped sidecar
+    std::vector<KeyframeEntry> built;
+    void* mapping;
+    size_t mapping_size;
+
+    std::thread scan_thread;
+    std::atomic<bool> stop_requested;
+    double scan_seconds;
+};
+
+// Maps a valid sidecar if there is one, otherwise starts a background scan that reads the media
+// through read_ahead_open() like the player does. Never blocks on the scan. Returns nullptr for
+// anything but a regular file (pipes and devices can't be read twice).
+KeyframeIndex* keyframe_index_open(const char* media_path, int stream_index, AVRational time_base,
+    ReadAheadMode read_ahead, int read_ahead_mb);
+
+// Last keyframe with pts <= target_pts (the first keyframe if the target is before it),
+// or nullptr while the index is still being built.
+const KeyframeEntry* keyframe_index_lookup(KeyframeIndex* index, int64_t target_pts);
+
+// Stops a running scan and releases the index.
+void keyframe_index_close(KeyframeIndex* index);
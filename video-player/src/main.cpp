@@ -2,17 +2,32 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <thread>
+#include <chrono>
+#include <stdlib.h>
 #include <string.h> // **NEW: For memcpy in PBO update**
+#include <vector>
+#include <string>
+#include <math.h>
+#include <algorithm>
+
 extern "C" {
-#include<libavformat/avformat.h>
-#include <chrono>
+#include<libavutil/pixdesc.h>
 }
 
-// Declaring the functions that are in decode_video
-// NOTE: Modified signature to include 'double* pts_out'
-int init_ffmpeg(const char* file_name, int* w, int* h, double* frame_delay_out, AVFrame** frame);
-int get_next_frame(AVFrame** frame, double* pts_out);
-void cleanup_ffmpeg();
+#include "decode_video.h"
+#include "frame_pool.h"
+#include "frame_cache.h"
+#include "decode_audio.h"
+#include "present_scheduler.h"
+#include "wall_decoder.h"
+#include "frame_writer.h"
+#include "thumbnailer.h"
+#include "clip_extract.h"
+#include "yuv_format.h"
+#include "cpu_render.h"
+#include "post_process.h"
+#include "startup_timing.h"
+#include "trace.h"
 
 // Global vars used
 int v_frame_width;
@@ -25,13 +40,116 @@ unsigned int V_txt;
 unsigned int shader_program;
 unsigned int VAO;
 
-// **NEW:** PBO IDs for ping-pong: 2 buffers per plane (Y, U, V)
-unsigned int Y_pbo_ids[2];
-unsigned int U_pbo_ids[2];
-unsigned int V_pbo_ids[2];
-
-// **NEW:** Index to track which PBO to use for the current frame
-int pbo_index = 0;
+// Upload ring: ONE persistently mapped unpack buffer split into N slots, each holding the
+// Y, U and V planes of one frame. Every slot is guarded by the fence inserted after its
+// glTexSubImage2D calls, so the CPU never overwrites data the GPU hasn't consumed yet.
+const int MAX_UPLOAD_SLOTS = 16;
+unsigned int upload_ring_buffer = 0;
+uint8_t* upload_ring_ptr = nullptr;
+int upload_ring_slots = 3;
+size_t upload_slot_size = 0;
+GLsync upload_slot_fences[MAX_UPLOAD_SLOTS];
+int upload_slot_index = 0;
+long long upload_fence_waits = 0; // Times the CPU had to block on a slot still in use
+
+// Zero-copy decode target: one persistently mapped unpack buffer carved into frame slabs.
+// The decoder writes straight into it and glTexSubImage2D reads the planes in place.
+unsigned int frame_arena_buffer = 0;
+uint8_t* frame_arena_ptr = nullptr;
+FramePool* frame_pool = nullptr;
+
+// Uploads the GPU may still be reading: the slab is only reused once the fence has signaled.
+struct PendingUpload {
+    FramePoolSlab* slab;
+    GLsync fence;
+};
+std::vector<PendingUpload> pending_uploads;
+
+// Seek requested from the keyboard (seconds relative to the frame on screen), applied by the main loop
+double pending_seek_offset = 0.0;
+
+// Seek step for the arrow keys; Shift makes it a long jump
+const double SEEK_STEP = 5.0;
+const double SEEK_STEP_LONG = 60.0;
+
+// Pause, frame stepping and reverse playback, requested from the keyboard
+bool paused = false;
+int pending_frame_steps = 0;      // >0 forward, <0 backward; only while paused
+bool reverse_toggle_requested = false;
+
+// Trick play: media seconds per wall second. ']' doubles it, '[' halves it, Backslash goes back to 1x.
+double playback_rate = 1.0;
+double requested_playback_rate = 1.0;
+
+// GPU post-processing (post_process.h), set from the command line and toggled with D (deinterlace
+// mode), S (downscale) and H (sharpen)
+PostSettings post_settings = { DEINTERLACE_OFF, false, false, 0.0 };
+double sharpen_strength = DEFAULT_SHARPEN_AMOUNT;   // What H turns on
+bool post_settings_changed = false;      // Printed by the render loop
+
+// The frame in the textures for the post-processing chain, and which of its fields is shown
+PostFrame post_frame = { 0, 0, -1, false, true, 0 };
+
+// 'T': write the trace collected so far (--trace)
+bool trace_dump_requested = false;
+
+// The window needs the frame on screen drawn again (resize, expose) although it hasn't changed
+bool redraw_requested = true;
+
+// Render loop states. Only PLAYING presents on a clock; the others change the screen on demand
+// (keys, cached frames). Every state blocks in glfwWaitEvents* while nothing on screen changes.
+enum PlaybackState {
+    PLAYBACK_PLAYING = 0,
+    PLAYBACK_PAUSED,
+    PLAYBACK_STEPPING,     // Paused with frame steps pending
+    PLAYBACK_REVERSE,
+    PLAYBACK_STATE_COUNT
+};
+const char* PLAYBACK_STATE_NAMES[PLAYBACK_STATE_COUNT] = { "playing", "paused", "stepping", "reverse" };
+
+// Render loop activity per state: time in it, loop iterations (wakeups), draws and uploads
+struct LoopActivity {
+    double seconds;
+    long long wakeups;
+    long long renders;
+    long long uploads;
+};
+LoopActivity loop_activity[PLAYBACK_STATE_COUNT];
+long long frames_rendered_total = 0;
+long long frames_uploaded_total = 0;
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action != GLFW_PRESS && action != GLFW_REPEAT) {
+        return;
+    }
+    double step = (mods & GLFW_MOD_SHIFT) ? SEEK_STEP_LONG : SEEK_STEP;
+    if (key == GLFW_KEY_RIGHT) pending_seek_offset += step;
+    if (key == GLFW_KEY_LEFT) pending_seek_offset -= step;
+
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) paused = !paused;
+    if (key == GLFW_KEY_R && action == GLFW_PRESS) reverse_toggle_requested = true;
+    if (key == GLFW_KEY_PERIOD) { paused = true; pending_frame_steps++; }
+    if (key == GLFW_KEY_COMMA) { paused = true; pending_frame_steps--; }
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) trace_dump_requested = true;
+
+    if (key == GLFW_KEY_RIGHT_BRACKET) requested_playback_rate = std::clamp(requested_playback_rate * 2.0, MIN_PLAYBACK_RATE, MAX_PLAYBACK_RATE);
+    if (key == GLFW_KEY_LEFT_BRACKET) requested_playback_rate = std::clamp(requested_playback_rate * 0.5, MIN_PLAYBACK_RATE, MAX_PLAYBACK_RATE);
+    if (key == GLFW_KEY_BACKSLASH) requested_playback_rate = 1.0;
+
+    if (key == GLFW_KEY_D && action == GLFW_PRESS) {
+        post_settings.deinterlace = (DeinterlaceMode)((post_settings.deinterlace + 1) % DEINTERLACE_MODE_COUNT);
+        post_settings_changed = true;
+    }
+    if (key == GLFW_KEY_S && action == GLFW_PRESS) {
+        post_settings.downscale = !post_settings.downscale;
+        post_settings_changed = true;
+    }
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        post_settings.sharpen = post_settings.sharpen > 0.0 ? 0.0 : sharpen_strength;
+        post_settings_changed = true;
+    }
+    if (post_settings_changed) redraw_requested = true;
+}
 
 // **NEW:** Function for robust OpenGL Error Checking
 void checkGLError(const char* func) {
@@ -56,23 +174,32 @@ void main()
 }
 )";
 
+// Compiled once per plane layout: buildYUVFragmentShader() puts the #version line and the
+// format's SEMI_PLANAR / SAMPLE_SCALE defines in front, so nothing is decided per pixel.
+// Chroma subsampling needs nothing here, the chroma textures are just smaller.
 const char* fragmentShaderSource = R"(
-#version 330 core
 out vec4 FragColor;
 
 in vec2 TexCoord;
 
-// Uniforms for the three texture planes
+// Uniforms for the texture planes (semi-planar formats: U_tex holds UV, V_tex is unused)
 uniform sampler2D Y_tex;
 uniform sampler2D U_tex;
 uniform sampler2D V_tex;
 
 void main()
 {
-    // 1. Sample Y, U, V values from their respective textures.
-    float Y = texture(Y_tex, TexCoord).r;
-    float U = texture(U_tex, TexCoord).r;
-    float V = texture(V_tex, TexCoord).r;
+    // 1. Sample Y, U, V values from their respective textures, scaled to [0, 1] for 10/12-bit
+    // samples sitting in the low bits of GL_R16 texels.
+    float Y = texture(Y_tex, TexCoord).r * SAMPLE_SCALE;
+#if SEMI_PLANAR
+    vec2 UV = texture(U_tex, TexCoord).rg * SAMPLE_SCALE;
+    float U = UV.r;
+    float V = UV.g;
+#else
+    float U = texture(U_tex, TexCoord).r * SAMPLE_SCALE;
+    float V = texture(V_tex, TexCoord).r * SAMPLE_SCALE;
+#endif
 
     // The chrominance components (U and V) are centered around 0.5.
     U = U - 0.5;
@@ -89,14 +216,33 @@ void main()
 )";
 
 
-void cleanup_pbo() {
-    // Only delete buffers if they were generated (Y_pbo_ids[0] will be > 0)
-    if (Y_pbo_ids[0] != 0) {
-        glDeleteBuffers(2, Y_pbo_ids);
-        glDeleteBuffers(2, U_pbo_ids);
-        glDeleteBuffers(2, V_pbo_ids);
-        checkGLError("glDeleteBuffers (PBO)");
+// Waits until the GPU is done with every slot, then frees the ring.
+void releaseUploadRing() {
+    if (upload_ring_buffer == 0) {
+        return;
+    }
+    for (int i = 0; i < upload_ring_slots; i++) {
+        if (upload_slot_fences[i]) {
+            glClientWaitSync(upload_slot_fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+            glDeleteSync(upload_slot_fences[i]);
+            upload_slot_fences[i] = 0;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_ring_buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &upload_ring_buffer);
+    upload_ring_buffer = 0;
+    upload_ring_ptr = nullptr;
+    checkGLError("glDeleteBuffers (Upload Ring)");
+}
+
+void cleanup_upload_ring() {
+    if (upload_ring_buffer == 0) {
+        return;
     }
+    releaseUploadRing();
+    fprintf(stdout, "Upload ring: %lld fence wait(s)\n", upload_fence_waits);
 }
 
 unsigned int compileShader(int type, const char* source) {
@@ -148,64 +294,297 @@ unsigned int createShaderProgram(const char* vs, const char* fs) {
     return program;
 }
 
-void setupYUVTextures() {
-    // 1. TEXTURE ALLOCATION (Your existing code)
-    glGenTextures(1, &Y_txt);
-    glGenTextures(1, &U_txt);
-    glGenTextures(1, &V_txt);
-    checkGLError("glGenTextures"); // Check for texture generation errors
+// --- Shader variants: one program per plane layout ---
+// Planar vs. semi-planar and the sample scale are baked in when the program is compiled; texture
+// sets point at the program their format needs, so switching formats only switches programs.
+const int MAX_SHADER_VARIANTS = 8;
+
+struct YUVShaderVariant {
+    int plane_count;
+    double sample_scale;
+    unsigned int program;
+};
+
+YUVShaderVariant shader_variants[MAX_SHADER_VARIANTS];
+int shader_variant_count = 0;
+
+std::string buildYUVFragmentShader(const YUVFormatLayout* layout) {
+    char defines[128];
+    snprintf(defines, sizeof(defines), "#version 330 core\n#define SEMI_PLANAR %d\n#define SAMPLE_SCALE %.9f\n",
+        layout->plane_count == 2 ? 1 : 0, yuv_sample_scale(layout));
+    return std::string(defines) + fragmentShaderSource;
+}
 
-    // Y Plane (Full Resolution)
-    glBindTexture(GL_TEXTURE_2D, Y_txt);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, v_frame_width, v_frame_height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+// Program for the layout, compiled (and its sampler uniforms set) the first time it is needed.
+// Returns 0 if compiling failed.
+unsigned int yuvShaderProgram(const YUVFormatLayout* layout) {
+    double scale = yuv_sample_scale(layout);
+    for (int i = 0; i < shader_variant_count; i++) {
+        if (shader_variants[i].plane_count == layout->plane_count && shader_variants[i].sample_scale == scale) {
+            return shader_variants[i].program;
+        }
+    }
+    if (shader_variant_count == MAX_SHADER_VARIANTS) {
+        return shader_variants[0].program;
+    }
 
-    // U Plane (Half Resolution)
-    glBindTexture(GL_TEXTURE_2D, U_txt);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, v_frame_width / 2, v_frame_height / 2, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+    TRACE_SCOPE("shader compile");
+    std::string fragment_source = buildYUVFragmentShader(layout);
+    unsigned int program = createShaderProgram(vertexShaderSource, fragment_source.c_str());
+    if (program == 0) {
+        return 0;
+    }
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "Y_tex"), 0); // Texture unit 0
+    glUniform1i(glGetUniformLocation(program, "U_tex"), 1); // Texture unit 1
+    glUniform1i(glGetUniformLocation(program, "V_tex"), 2); // Texture unit 2
+
+    YUVShaderVariant& variant = shader_variants[shader_variant_count++];
+    variant.plane_count = layout->plane_count;
+    variant.sample_scale = scale;
+    variant.program = program;
+    return program;
+}
 
-    // V Plane (Half Resolution)
-    glBindTexture(GL_TEXTURE_2D, V_txt);
+void cleanup_shader_variants() {
+    for (int i = 0; i < shader_variant_count; i++) {
+        glDeleteProgram(shader_variants[i].program);
+    }
+    shader_variant_count = 0;
+    shader_program = 0;
+}
+
+// --- Texture pool: one Y/U/V texture set per frame geometry ---
+// Adaptive-bitrate streams and spliced recordings change resolution mid-stream. Every geometry
+// (size and pixel format) gets its own texture set, kept in a small LRU pool, so a switch only
+// changes which textures are uploaded to and drawn. Sets are allocated before they are needed:
+// prewarmTextureSets() looks through the frames queued ahead of presentation and creates the
+// sets (and upload ring room) they will need while the old geometry is still on screen.
+const int MAX_TEXTURE_SETS = 4;
+
+struct YUVTextureSet {
+    int width;
+    int height;
+    int format;
+    const YUVFormatLayout* layout;
+    unsigned int textures[3];   // Y, U, V (semi-planar: Y, UV, 0)
+    unsigned int program;       // Shader variant for the format
+    long long last_used;        // Upload count when it was last used (LRU eviction)
+};
+
+YUVTextureSet texture_sets[MAX_TEXTURE_SETS];
+int texture_set_count = 0;
+int active_texture_set = -1;
+long long texture_set_uploads = 0;
+
+// Geometry switch statistics
+long long geometry_switches = 0;
+long long switches_allocated = 0;      // The set had to be created on the switch frame itself
+long long texture_sets_created = 0;
+long long texture_sets_evicted = 0;
+long long upload_ring_grows = 0;
+double switch_upload_seconds = 0.0;
+double switch_upload_max_seconds = 0.0;
+double steady_upload_seconds = 0.0;    // Uploads that kept the geometry, for comparison
+long long steady_uploads = 0;
+
+// Texture format of one plane: R or RG (interleaved UV), 8 or 16 bits per component
+struct PlaneTexelFormat {
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    int bytes;                  // Per texel
+};
+
+PlaneTexelFormat planeTexelFormat(const YUVFormatLayout* layout, int plane) {
+    int components = yuv_plane_components(layout, plane);
+    bool deep = layout->bytes_per_sample == 2;
+    PlaneTexelFormat texel;
+    texel.internal_format = components == 2 ? (deep ? GL_RG16 : GL_RG8) : (deep ? GL_R16 : GL_R8);
+    texel.format = components == 2 ? GL_RG : GL_RED;
+    texel.type = deep ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    texel.bytes = components * layout->bytes_per_sample;
+    return texel;
+}
+
+unsigned int createPlaneTexture(int width, int height, const PlaneTexelFormat& texel) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, v_frame_width / 2, v_frame_height / 2, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
-    checkGLError("glTexImage2D (Textures)");
+    glTexImage2D(GL_TEXTURE_2D, 0, texel.internal_format, width, height, 0, texel.format, texel.type, NULL);
+    return texture;
+}
+
+// Index of the set for this geometry. Creates it if needed (created = true), evicting the least
+// recently used set other than the active one when the pool is full. The format must have a layout.
+int acquireTextureSet(int width, int height, int format, bool* created) {
+    *created = false;
+    for (int i = 0; i < texture_set_count; i++) {
+        if (texture_sets[i].width == width && texture_sets[i].height == height && texture_sets[i].format == format) {
+            return i;
+        }
+    }
+
+    int index = texture_set_count;
+    if (index == MAX_TEXTURE_SETS) {
+        index = -1;
+        for (int i = 0; i < texture_set_count; i++) {
+            if (i != active_texture_set && (index < 0 || texture_sets[i].last_used < texture_sets[index].last_used)) {
+                index = i;
+            }
+        }
+        glDeleteTextures(3, texture_sets[index].textures);
+        texture_sets_evicted++;
+    }
+    else {
+        texture_set_count++;
+    }
+
+    TRACE_SCOPE("texture set alloc");
+    YUVTextureSet& set = texture_sets[index];
+    set.width = width;
+    set.height = height;
+    set.format = format;
+    set.layout = yuv_format_layout(format);
+    // Y at full resolution, chroma smaller by the format's subsampling
+    set.textures[2] = 0;
+    for (int i = 0; i < set.layout->plane_count; i++) {
+        int plane_width, plane_height;
+        yuv_plane_size(set.layout, i, width, height, &plane_width, &plane_height);
+        set.textures[i] = createPlaneTexture(plane_width, plane_height, planeTexelFormat(set.layout, i));
+    }
+    set.program = yuvShaderProgram(set.layout);
+    set.last_used = texture_set_uploads;
+    checkGLError("glTexImage2D (Texture Set)");
 
-    // 2. PBO ALLOCATION (Staging Buffers for DMA)
-    glGenBuffers(2, Y_pbo_ids);
-    glGenBuffers(2, U_pbo_ids);
-    glGenBuffers(2, V_pbo_ids);
-    checkGLError("glGenBuffers (PBOs)");
+    texture_sets_created++;
+    *created = true;
+    return index;
+}
 
-    int y_size = v_frame_width * v_frame_height;
-    int uv_size = (v_frame_width / 2) * (v_frame_height / 2);
+// Bytes one frame of this geometry takes in an upload ring slot (planes tightly packed)
+size_t uploadFrameSize(int width, int height, int format) {
+    const YUVFormatLayout* layout = yuv_format_layout(format);
+    return layout ? yuv_frame_size(layout, width, height) : 0;
+}
 
-    // Allocate storage for all 6 PBOs (ping-pong)
-    for (int i = 0; i < 2; ++i) {
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Y_pbo_ids[i]);
-        // GL_STREAM_DRAW: hint that the data is updated frequently
-        glBufferData(GL_PIXEL_UNPACK_BUFFER, y_size, NULL, GL_STREAM_DRAW);
+// Creates the upload ring with slots of at least frame_size bytes.
+void setupUploadRing(size_t frame_size) {
+    upload_slot_size = FFALIGN(frame_size, 256);
+    upload_slot_index = 0;
+    for (int i = 0; i < MAX_UPLOAD_SLOTS; i++) {
+        upload_slot_fences[i] = 0;
+    }
 
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, U_pbo_ids[i]);
-        glBufferData(GL_PIXEL_UNPACK_BUFFER, uv_size, NULL, GL_STREAM_DRAW);
+    if (!GLEW_ARB_buffer_storage) {
+        // No persistent mapping: updateYUVTexturesFromAVFrame() uploads from client memory instead.
+        fprintf(stderr, "Warning: ARB_buffer_storage not available; uploading without a PBO\n");
+        return;
+    }
 
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, V_pbo_ids[i]);
-        glBufferData(GL_PIXEL_UNPACK_BUFFER, uv_size, NULL, GL_STREAM_DRAW);
+    // Mapped once for the lifetime of the player: no map/unmap per frame. COHERENT means
+    // plain CPU writes are visible to the GPU without explicit flushes.
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &upload_ring_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_ring_buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, upload_slot_size * upload_ring_slots, NULL, flags);
+    upload_ring_ptr = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, upload_slot_size * upload_ring_slots, flags);
+    checkGLError("glBufferStorage/glMapBufferRange (Upload Ring)");
+
+    if (!upload_ring_ptr) {
+        fprintf(stderr, "Warning: Could not map the upload ring; uploading without a PBO\n");
+        glDeleteBuffers(1, &upload_ring_buffer);
+        upload_ring_buffer = 0;
     }
-    checkGLError("glBufferData (PBOs Allocation)");
 
     // Unbind the PBO
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 }
+
+// Makes the ring slots big enough for frame_size bytes. Reallocating waits for the GPU to finish
+// with every slot, so it normally happens when a larger geometry shows up in the decode queue.
+void growUploadRing(size_t frame_size) {
+    if (upload_ring_buffer == 0 || frame_size <= upload_slot_size) {
+        return;
+    }
+    TRACE_SCOPE("upload ring grow");
+    releaseUploadRing();
+    setupUploadRing(frame_size);
+    upload_ring_grows++;
+}
+
+// Allocates what the frames waiting in the decode queue need before the first of them is due,
+// so the switch frame itself finds its textures and ring room ready.
+void prewarmTextureSets() {
+    for (int i = 0; DecodedFrame* item = peek_decoded_frame_at(i); i++) {
+        const AVFrame* frame = item->frame;
+        if (!frame || !yuv_format_layout(frame->format)) {
+            continue;
+        }
+        bool created;
+        acquireTextureSet(frame->width, frame->height, frame->format, &created);
+        bool in_place = frame_arena_buffer != 0 && frame_pool_find(frame_pool, frame);
+        if (!in_place) {
+            growUploadRing(uploadFrameSize(frame->width, frame->height, frame->format));
+        }
+    }
+}
+
+// Makes the frame's texture set the one uploaded to and drawn. Returns true if the geometry changed.
+bool selectTextureSet(int width, int height, int format, bool* created) {
+    int index = acquireTextureSet(width, height, format, created);
+    YUVTextureSet& set = texture_sets[index];
+    set.last_used = ++texture_set_uploads;
+    if (index == active_texture_set) {
+        return false;
+    }
+
+    bool first = active_texture_set < 0;
+    active_texture_set = index;
+    Y_txt = set.textures[0];
+    U_txt = set.textures[1];
+    V_txt = set.textures[2];
+    shader_program = set.program;
+    v_frame_width = set.width;
+    v_frame_height = set.height;
+    return !first;
+}
+
+void setupYUVTextures() {
+    // 1. TEXTURES for the stream's starting geometry (the pool adds more if it changes)
+    int format = decoder_pixel_format();
+    if (!yuv_format_layout(format)) {
+        fprintf(stderr, "Warning: Pixel format %s can't be shown without conversion\n", av_get_pix_fmt_name((AVPixelFormat)format));
+        format = AV_PIX_FMT_YUV420P;
+    }
+    bool created;
+    selectTextureSet(v_frame_width, v_frame_height, format, &created);
+
+    // 2. UPLOAD RING ALLOCATION (Staging Buffer for DMA)
+    setupUploadRing(uploadFrameSize(v_frame_width, v_frame_height, format));
+}
+
+void cleanup_texture_pool() {
+    if (texture_set_count == 0) {
+        return;
+    }
+    fprintf(stdout, "Texture pool: %lld geometry switch(es), %lld allocated on the switch frame; %lld set(s) created, %lld evicted, upload ring grown %lld time(s)\n",
+        geometry_switches, switches_allocated, texture_sets_created, texture_sets_evicted, upload_ring_grows);
+    if (geometry_switches > 0) {
+        fprintf(stdout, "Texture pool: switch upload avg %.3f ms, max %.3f ms (other uploads avg %.3f ms)\n",
+            1000.0 * switch_upload_seconds / geometry_switches, 1000.0 * switch_upload_max_seconds,
+            steady_uploads > 0 ? 1000.0 * steady_upload_seconds / steady_uploads : 0.0);
+    }
+    for (int i = 0; i < texture_set_count; i++) {
+        glDeleteTextures(3, texture_sets[i].textures);
+    }
+    texture_set_count = 0;
+    active_texture_set = -1;
+}
 // Quad setup (normalized device coordinates from -1 to 1) - UNCHANGED
 void setupQuad() {
     // Vertices for a full-screen quad and corresponding texture coordinates
@@ -239,114 +618,265 @@ void setupQuad() {
     glBindVertexArray(0); // Unbind VAO
 }
 
-// Function to update the texture data using the FFmpeg AVFrame structure
-// This is the CRITICAL integration point, handling FFmpeg's linesize.
-void updateYUVTexturesFromAVFrame(AVFrame* frame) {
-    if (!frame || frame->format != AV_PIX_FMT_YUV420P) {
-        fprintf(stderr, "Error: Invalid or non-YUV420P frame provided. Skipping update.\n");
+// Creates the frame pool the decoder allocates into. Uses a persistently mapped GL buffer when
+// ARB_buffer_storage is available and plain CPU memory otherwise (frames are then copied as before).
+void setupFramePool(int slab_count) {
+    size_t slab_size = decoder_frame_buffer_size();
+    if (slab_size == 0) {
+        fprintf(stderr, "Warning: Unsupported pixel format for the frame pool; zero-copy disabled\n");
         return;
     }
+    slab_size = FFALIGN(slab_size, 64);
+
+    if (GLEW_ARB_buffer_storage) {
+        // The decoder also *reads* reference frames from these slabs, so ask for cached client
+        // memory (READ + CLIENT_STORAGE) rather than write-combined memory, which is very slow to read.
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &frame_arena_buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame_arena_buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slab_size * slab_count, NULL, flags | GL_CLIENT_STORAGE_BIT);
+        frame_arena_ptr = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slab_size * slab_count, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        checkGLError("glBufferStorage/glMapBufferRange (Frame Pool)");
 
-    // next_pbo: the buffer we will WRITE to (CPU's target)
-    int next_pbo = pbo_index;
-    // current_pbo: the buffer the GPU will READ from (from the previous frame)
-    int current_pbo = (pbo_index + 1) % 2;
+        if (!frame_arena_ptr) {
+            fprintf(stderr, "Warning: Could not map the frame pool buffer; using CPU memory\n");
+            glDeleteBuffers(1, &frame_arena_buffer);
+            frame_arena_buffer = 0;
+        }
+    }
 
-    // Set GL_UNPACK_ALIGNMENT to 1 byte
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    frame_pool = frame_pool_create(frame_arena_ptr, slab_size, slab_count);
+    set_decoder_frame_pool(frame_pool);
+}
 
-    // --- PHASE 1: ASYNCHRONOUS DATA COPY (CPU -> PBO) ---
-    // The CPU writes the new frame data into the 'next_pbo'
-    int uv_size = (frame->width / 2) * (frame->height / 2);
+// Gives slabs back to the decoder once the GPU has finished the uploads that read them.
+void retireCompletedUploads(GLuint64 timeout_ns) {
+    size_t kept = 0;
+    for (size_t i = 0; i < pending_uploads.size(); i++) {
+        GLenum status = glClientWaitSync(pending_uploads[i].fence, 0, timeout_ns);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            glDeleteSync(pending_uploads[i].fence);
+            frame_pool_release_gpu(pending_uploads[i].slab);
+        }
+        else {
+            pending_uploads[kept++] = pending_uploads[i];
+        }
+    }
+    pending_uploads.resize(kept);
+}
 
+// Must run after the decoder is closed and every frame is freed.
+void cleanup_frame_pool() {
+    if (!frame_pool) {
+        return;
+    }
+    // Wait (bounded) for in-flight uploads before the memory goes away
+    retireCompletedUploads(100000000);
 
-    // 1. Y Plane Copy
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Y_pbo_ids[next_pbo]);
-    // Use GL_MAP_UNSYNCHRONIZED_BIT for maximum CPU performance; ping-pong ensures safety.
-    GLubyte* ptr_y = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
-        0,
-        frame->width * frame->height,
-        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    set_decoder_frame_pool(nullptr);
+    frame_pool_print_stats(frame_pool);
+    frame_pool_destroy(frame_pool);
+    frame_pool = nullptr;
 
-    if (!ptr_y) {
-        fprintf(stderr, "FATAL: glMapBufferRange failed for Y plane. Skipping frame.\n");
+    if (frame_arena_buffer != 0) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame_arena_buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-        return;
+        glDeleteBuffers(1, &frame_arena_buffer);
+        frame_arena_buffer = 0;
+        frame_arena_ptr = nullptr;
     }
+}
 
-    // Copy data row by row, respecting FFmpeg's linesize
-    for (int i = 0; i < frame->height; i++) {
-        memcpy(ptr_y + i * frame->width, frame->data[0] + i * frame->linesize[0], frame->width);
+// Geometry and texel format of each plane of a frame, as uploaded
+struct UploadPlanes {
+    int count;
+    int width[3];
+    int height[3];
+    PlaneTexelFormat texel[3];
+};
+
+UploadPlanes uploadPlanes(const AVFrame* frame, const YUVFormatLayout* layout) {
+    UploadPlanes planes;
+    planes.count = layout->plane_count;
+    for (int i = 0; i < planes.count; i++) {
+        yuv_plane_size(layout, i, frame->width, frame->height, &planes.width[i], &planes.height[i]);
+        planes.texel[i] = planeTexelFormat(layout, i);
     }
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return planes;
+}
 
-    // 2. U Plane Copy
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, U_pbo_ids[next_pbo]);
-    GLubyte* ptr_u = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
-        0,
-        uv_size,
-        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
-    if (!ptr_u) {
-        fprintf(stderr, "FATAL: glMapBufferRange failed for U plane. Skipping frame.\n");
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-        return;
-    }
-    for (int i = 0; i < frame->height / 2; i++) {
-        memcpy(ptr_u + i * (frame->width / 2), frame->data[1] + i * frame->linesize[1], frame->width / 2);
+// Zero-copy upload: the frame was decoded into the mapped arena, so the textures are fed
+// directly from it (GL_UNPACK_ROW_LENGTH handles FFmpeg's linesize). No CPU copy at all.
+void uploadFrameInPlace(AVFrame* frame, const UploadPlanes& planes, FramePoolSlab* slab) {
+    TRACE_SCOPE("glTexSubImage2D");
+    unsigned int textures[3] = { Y_txt, U_txt, V_txt };
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame_arena_buffer);
+
+    for (int i = 0; i < planes.count; i++) {
+        const PlaneTexelFormat& texel = planes.texel[i];
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        // Row length is in texels, linesize in bytes
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[i] / texel.bytes);
+        // With a PBO bound the pointer argument is a byte offset into the buffer
+        size_t offset = frame->data[i] - frame_arena_ptr;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes.width[i], planes.height[i], texel.format, texel.type, (void*)offset);
     }
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
 
-    // 3. V Plane Copy
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, V_pbo_ids[next_pbo]);
-    GLubyte* ptr_v = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
-        0,
-        uv_size,
-        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
-    if (!ptr_v) {
-        fprintf(stderr, "FATAL: glMapBufferRange failed for V plane. Skipping frame.\n");
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    checkGLError("glTexSubImage2D (Zero-Copy)");
+
+    // The slab stays reserved until the GPU is done reading it
+    frame_pool_mark_gpu_busy(slab);
+    PendingUpload upload = { slab, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+    pending_uploads.push_back(upload);
+}
+
+// Copies the frame's planes into the active texture set, which matches its geometry and format.
+// This is the CRITICAL integration point, handling FFmpeg's linesize.
+void uploadYUVPlanes(AVFrame* frame, const YUVFormatLayout* layout) {
+    UploadPlanes planes = uploadPlanes(frame, layout);
+
+    // Frames decoded into the mapped arena need no copy
+    FramePoolSlab* slab = frame_arena_buffer != 0 ? frame_pool_find(frame_pool, frame) : nullptr;
+    if (slab) {
+        uploadFrameInPlace(frame, planes, slab);
         return;
     }
-    for (int i = 0; i < frame->height / 2; i++) {
-        memcpy(ptr_v + i * (frame->width / 2), frame->data[2] + i * frame->linesize[2], frame->width / 2);
-    }
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-    checkGLError("glMapBufferRange/glUnmapBuffer");
 
+    unsigned int textures[3] = { Y_txt, U_txt, V_txt };
 
-    // --- PHASE 2: ASYNCHRONOUS TEXTURE TRANSFER (GPU Reads) ---
-    // The GPU is told to start reading data from the previous frame's PBO (current_pbo)
+    // Set GL_UNPACK_ALIGNMENT to 1 byte
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    // 1. Update Y Plane
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, Y_txt);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Y_pbo_ids[current_pbo]);
-    // The NULL pointer (0) signals OpenGL to use the bound GL_PIXEL_UNPACK_BUFFER
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->width, frame->height, GL_RED, GL_UNSIGNED_BYTE, 0);
+    // Normally done by prewarmTextureSets() already; frames shown outside the queue (cache, stepping) land here
+    size_t frame_size = yuv_frame_size(layout, frame->width, frame->height);
+    growUploadRing(frame_size);
+
+    if (upload_ring_buffer == 0) {
+        // No upload ring: let the driver copy straight from the decoder's buffers.
+        for (int i = 0; i < planes.count; i++) {
+            const PlaneTexelFormat& texel = planes.texel[i];
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[i] / texel.bytes);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes.width[i], planes.height[i], texel.format, texel.type, frame->data[i]);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        checkGLError("glTexSubImage2D (Client Memory)");
+        return;
+    }
 
-    // 2. Update U Plane
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, U_txt);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, U_pbo_ids[current_pbo]);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->width / 2, frame->height / 2, GL_RED, GL_UNSIGNED_BYTE, 0);
+    // --- PHASE 1: WAIT FOR THE SLOT ---
+    // The fence was inserted right after this slot's last upload; once it has signaled the
+    // GPU is done reading and the slot can be overwritten.
+    int slot = upload_slot_index;
+    if (upload_slot_fences[slot]) {
+        GLenum status = glClientWaitSync(upload_slot_fences[slot], 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            TRACE_SCOPE("upload slot wait");
+            upload_fence_waits++;
+            status = glClientWaitSync(upload_slot_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+        if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+            fprintf(stderr, "Error: glClientWaitSync failed for upload slot %d. Skipping frame.\n", slot);
+            return;
+        }
+        glDeleteSync(upload_slot_fences[slot]);
+        upload_slot_fences[slot] = 0;
+    }
 
-    // 3. Update V Plane
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, V_txt);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, V_pbo_ids[current_pbo]);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame->width / 2, frame->height / 2, GL_RED, GL_UNSIGNED_BYTE, 0);
+    // --- PHASE 2: DATA COPY (CPU -> mapped slot) ---
+    size_t slot_offset = upload_slot_size * slot;
+    size_t plane_offset[3];
+    uint8_t* dst = upload_ring_ptr + slot_offset;
+    uint64_t copy_start = trace_enabled() ? trace_now_ns() : 0;
+    for (int i = 0; i < planes.count; i++) {
+        plane_offset[i] = dst - upload_ring_ptr;
+        // Copy data row by row, respecting FFmpeg's linesize
+        size_t row_bytes = (size_t)planes.width[i] * planes.texel[i].bytes;
+        for (int row = 0; row < planes.height[i]; row++) {
+            memcpy(dst + row * row_bytes, frame->data[i] + row * frame->linesize[i], row_bytes);
+        }
+        dst += row_bytes * planes.height[i];
+    }
+    if (copy_start) {
+        trace_complete("pbo copy", copy_start, trace_now_ns(), (int64_t)frame_size);
+    }
+
+    // --- PHASE 3: TEXTURE TRANSFER (GPU Reads) ---
+    // The slot we just filled is the one uploaded, so the frame uploaded is the frame presented.
+    TRACE_SCOPE("glTexSubImage2D");
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_ring_buffer);
+    for (int i = 0; i < planes.count; i++) {
+        const PlaneTexelFormat& texel = planes.texel[i];
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        // With a PBO bound the pointer argument is a byte offset into the buffer
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, planes.width[i], planes.height[i], texel.format, texel.type, (void*)plane_offset[i]);
+    }
 
     // Unbind PBO and check for errors
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-    checkGLError("glTexSubImage2D (PBO Transfer)");
+    checkGLError("glTexSubImage2D (Upload Ring)");
 
-    // Flip the index for the next frame's operation
-    pbo_index = current_pbo;
+    upload_slot_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    upload_slot_index = (slot + 1) % upload_ring_slots;
 }
-void render() {
-    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
 
+// Function to update the texture data using the FFmpeg AVFrame structure.
+// Switches texture sets when the frame's geometry differs from the last one and times the switch.
+void updateYUVTexturesFromAVFrame(AVFrame* frame) {
+    TRACE_SCOPE("upload");
+    const YUVFormatLayout* layout = frame ? yuv_format_layout(frame->format) : nullptr;
+    if (!layout) {
+        fprintf(stderr, "Error: Invalid frame or unsupported pixel format (%s) provided. Skipping update.\n",
+            frame ? av_get_pix_fmt_name((AVPixelFormat)frame->format) : "none");
+        return;
+    }
+
+    // A new frame always starts on its first field
+    post_frame.interlaced = (frame->flags & AV_FRAME_FLAG_INTERLACED) != 0;
+    post_frame.top_field_first = !post_frame.interlaced || (frame->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST) != 0;
+    post_frame.field = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    int old_width = v_frame_width;
+    int old_height = v_frame_height;
+    bool created;
+    bool switched = selectTextureSet(frame->width, frame->height, frame->format, &created);
+    uploadYUVPlanes(frame, layout);
+    frames_uploaded_total++;
+    post_frame.width = v_frame_width;
+    post_frame.height = v_frame_height;
+    post_frame.upload = frames_uploaded_total;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!switched) {
+        steady_upload_seconds += seconds;
+        steady_uploads++;
+        return;
+    }
+    geometry_switches++;
+    if (created) {
+        switches_allocated++;
+    }
+    switch_upload_seconds += seconds;
+    if (seconds > switch_upload_max_seconds) {
+        switch_upload_max_seconds = seconds;
+    }
+    trace_instant("geometry switch", (int64_t)(1000000.0 * seconds));
+    fprintf(stdout, "Video geometry: %dx%d -> %dx%d %s (%s, upload %.3f ms)\n", old_width, old_height,
+        frame->width, frame->height, av_get_pix_fmt_name((AVPixelFormat)frame->format),
+        created ? "allocated on the switch frame" : "texture set ready", 1000.0 * seconds);
+}
+// Draws the frame in the Y/U/V textures, converted to RGB, over the viewport of the bound framebuffer.
+void drawYUVFrame() {
     glUseProgram(shader_program);
 
     // Bind all three texture units
@@ -364,133 +894,1850 @@ void render() {
     glDrawArrays(GL_TRIANGLES, 0, 6);
 }
 
-int main() {
-    fprintf(stdout, "FFmpeg C++ Video Player\n");
+// GPU side of the trace: GL_TIMESTAMP queries before the upload, between upload and draw, and
+// after the draw. Results are collected a few frames later without waiting, converted to the
+// CPU clock and put on the trace's GPU track. A frame is skipped when every query set is in flight.
+const int GPU_TRACE_FRAMES = 8;
+GLuint gpu_trace_queries[GPU_TRACE_FRAMES][3];
+bool gpu_trace_pending[GPU_TRACE_FRAMES];
+int gpu_trace_next = 0;        // Next set to record into (the oldest one once all are used)
+int gpu_trace_current = -1;    // Set recording this frame, -1 if none
+bool gpu_trace_ready = false;
+int64_t gpu_clock_offset_ns = 0;   // trace_now_ns() - GL_TIMESTAMP
+uint64_t gpu_clock_calibrated_ns = 0;
+
+// The GPU and CPU clocks drift apart; re-anchored once a second
+const uint64_t GPU_CLOCK_CALIBRATION_INTERVAL_NS = 1000000000ULL;
+
+void calibrateGpuClock() {
+    GLint64 gpu_now = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    gpu_clock_calibrated_ns = trace_now_ns();
+    gpu_clock_offset_ns = (int64_t)gpu_clock_calibrated_ns - gpu_now;
+    post_process_set_trace_clock(gpu_clock_offset_ns);
+}
 
-    //Createing a video frame placeholder
-    AVFrame* video_frame = nullptr;
-    // frame_delay is now only for logging the estimated FPS, not for timing
-    double estimated_frame_delay = 0.0;
+void setupGpuTrace() {
+    if (!trace_enabled()) {
+        return;
+    }
+    glGenQueries(GPU_TRACE_FRAMES * 3, &gpu_trace_queries[0][0]);
+    for (int i = 0; i < GPU_TRACE_FRAMES; i++) {
+        gpu_trace_pending[i] = false;
+    }
+    calibrateGpuClock();
+    checkGLError("setupGpuTrace");
+    gpu_trace_ready = true;
+}
+
+// mark 0: before the upload, 1: before the draw, 2: after the draw
+void gpuTraceMark(int mark) {
+    if (!gpu_trace_ready) {
+        return;
+    }
+    if (mark == 0) {
+        gpu_trace_current = gpu_trace_pending[gpu_trace_next] ? -1 : gpu_trace_next;
+    }
+    if (gpu_trace_current < 0) {
+        return;
+    }
+    glQueryCounter(gpu_trace_queries[gpu_trace_current][mark], GL_TIMESTAMP);
+    if (mark == 2) {
+        gpu_trace_pending[gpu_trace_current] = true;
+        gpu_trace_next = (gpu_trace_current + 1) % GPU_TRACE_FRAMES;
+        gpu_trace_current = -1;
+    }
+}
 
-    // Init FFmpeg and get frame resolution
-    int ret = init_ffmpeg("C:\\Users\\meyzat11\\source\\repos\\video-player\\x64\\Debug\\test.mp4", &v_frame_width, &v_frame_height, &estimated_frame_delay, &video_frame);
+// Records every finished query set, oldest first, and stops at the first one still in flight.
+void collectGpuTrace() {
+    if (!gpu_trace_ready) {
+        return;
+    }
+    for (int n = 0; n < GPU_TRACE_FRAMES; n++) {
+        int i = (gpu_trace_next + n) % GPU_TRACE_FRAMES;
+        if (!gpu_trace_pending[i]) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(gpu_trace_queries[i][2], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 t[3];
+        for (int k = 0; k < 3; k++) {
+            glGetQueryObjectui64v(gpu_trace_queries[i][k], GL_QUERY_RESULT, &t[k]);
+        }
+        if (t[1] > t[0]) {
+            trace_gpu_complete("upload (GPU)", t[0] + gpu_clock_offset_ns, t[1] + gpu_clock_offset_ns);
+        }
+        trace_gpu_complete("draw (GPU)", t[1] + gpu_clock_offset_ns, t[2] + gpu_clock_offset_ns);
+        gpu_trace_pending[i] = false;
+    }
+    if (trace_now_ns() - gpu_clock_calibrated_ns > GPU_CLOCK_CALIBRATION_INTERVAL_NS) {
+        calibrateGpuClock();
+    }
+}
 
-    //Error handling
-    if (ret < 0) {
-        fprintf(stderr, "Failed to Init ffmpeg\n");
-        return ret;
+void cleanup_gpu_trace() {
+    if (gpu_trace_ready) {
+        glDeleteQueries(GPU_TRACE_FRAMES * 3, &gpu_trace_queries[0][0]);
+        gpu_trace_ready = false;
     }
+}
 
-    fprintf(stdout, "FFmpeg inited successfully\n");
+void render() {
+    TRACE_SCOPE("draw");
+    redraw_requested = false;
+    frames_rendered_total++;
+    if (post_process_active(&post_settings, &post_frame)) {
+        post_process_run(&post_settings, &post_frame);
+        return;
+    }
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    drawYUVFrame();
+}
 
-    //Crateing a window and initing GLFW 
-    GLFWwindow* window;
+// Default input when no file is given on the command line
+const char* DEFAULT_INPUT_FILE = "C:\\Users\\meyzat11\\source\\repos\\video-player\\x64\\Debug\\test.mp4";
+
+// How many decoded frames the decoder thread may run ahead of presentation
+const int DEFAULT_DECODE_QUEUE_DEPTH = 8;
+
+// Decoded-frame cache budget (backward stepping, reverse playback). ~512 MB holds a few
+// 1080p GOPs; reverse playback needs at least two GOPs to play while prefetching.
+const int DEFAULT_FRAME_CACHE_MB = 512;
+
+// Zero-copy pool slabs beyond the queue depth: reference frames held by the decoder
+// (up to 16 for H.264/HEVC), frames in flight in frame threads and the frame on screen.
+const int FRAME_POOL_EXTRA_SLABS = 20;
+
+// Shows a frame outside the normal queue path (frame cache, stepping): upload, draw, swap.
+void presentFrame(GLFWwindow* window, AVFrame* frame) {
+    updateYUVTexturesFromAVFrame(frame);
+    render();
+    glfwSwapBuffers(window);
+}
+
+PlaybackState playbackState(bool reverse_playback) {
+    if (reverse_playback) return PLAYBACK_REVERSE;
+    if (!paused) return PLAYBACK_PLAYING;
+    return pending_frame_steps != 0 ? PLAYBACK_STEPPING : PLAYBACK_PAUSED;
+}
+
+// Charges the loop iteration that just ended (since *last_time) to `state`.
+void recordLoopActivity(PlaybackState state, double now, double* last_time, long long* last_renders, long long* last_uploads) {
+    LoopActivity& a = loop_activity[state];
+    a.seconds += now - *last_time;
+    a.wakeups++;
+    a.renders += frames_rendered_total - *last_renders;
+    a.uploads += frames_uploaded_total - *last_uploads;
+    *last_time = now;
+    *last_renders = frames_rendered_total;
+    *last_uploads = frames_uploaded_total;
+}
+
+void printLoopActivity() {
+    fprintf(stdout, "Render loop: state     time s  wakeups/s  draws/s  uploads/s\n");
+    for (int i = 0; i < PLAYBACK_STATE_COUNT; i++) {
+        const LoopActivity& a = loop_activity[i];
+        if (a.wakeups == 0 || a.seconds <= 0.0) {
+            continue;
+        }
+        fprintf(stdout, "Render loop: %-8s %8.1f  %9.1f  %7.1f  %9.1f\n", PLAYBACK_STATE_NAMES[i], a.seconds,
+            a.wakeups / a.seconds, a.renders / a.seconds, a.uploads / a.seconds);
+    }
+}
+
+// Creates the window and GL context (GLFW + GLEW), with swaps synced to vblank.
+// refresh_rate <= 0 is replaced by the monitor's rate. Returns nullptr on failure.
+GLFWwindow* createPlayerWindow(const char* title, double* refresh_rate) {
+    uint64_t phase_start = trace_now_ns();
     if (!glfwInit())
-        return -2;
+        return nullptr;
+    startup_phase("GLFW init", phase_start);
 
-    window = glfwCreateWindow(800, 600, "Test", nullptr, nullptr);
+    phase_start = trace_now_ns();
+    GLFWwindow* window = glfwCreateWindow(800, 600, title, nullptr, nullptr);
+    if (!window)
+        return nullptr;
     glfwMakeContextCurrent(window);
+    startup_phase("create window + GL context", phase_start);
+
+    // Swaps wait for vblank; the presentation scheduler paces the render loop on them
+    glfwSwapInterval(1);
+    if (*refresh_rate <= 0.0) {
+        const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        *refresh_rate = mode && mode->refreshRate > 0 ? mode->refreshRate : 60.0;
+    }
+    fprintf(stdout, "Display refresh: %.3f Hz\n", *refresh_rate);
     glViewport(0, 0, 800, 600);
 
     //Ininting glew
+    phase_start = trace_now_ns();
     if (glewInit() != GLEW_OK)
-        return -1;
+        return nullptr;
+    startup_phase("GLEW init", phase_start);
 
     //This function allows opengl to be aware if the windows size was changed by the user
-    glfwSetFramebufferSizeCallback(window, [](GLFWwindow* w, int width, int height) { glViewport(0, 0, width, height); });
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow* w, int width, int height) { glViewport(0, 0, width, height); redraw_requested = true; });
+    // Exposed or damaged: the render loop only redraws on request while the frame is unchanged
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow* w) { redraw_requested = true; });
+    glfwSetKeyCallback(window, keyCallback);
+    return window;
+}
 
-    //Createing a shader to render the frame using
-    shader_program = createShaderProgram(vertexShaderSource, fragmentShaderSource);
+// --- Video wall: N streams tiled in one window ---
+// All streams share three GL_TEXTURE_2D_ARRAYs (one layer per stream, sized to the largest
+// stream) and are drawn with one instanced draw call; each instance places the quad in its
+// grid cell and samples its own layer. Must match the uniform array size in the wall shader.
+const int MAX_WALL_STREAMS = 64;
 
-    if (shader_program == 0) {
-        fprintf(stderr, "Couldent create a program");
-        return -1;
-    }
+const char* wallVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoord;
 
-    setupYUVTextures();
-    setupQuad();
+uniform int grid_cols;
+uniform int grid_rows;
+uniform vec2 tile_uv_scale[64]; // Stream size / texture array size
 
-    // Set texture uniform locations once
-    glUseProgram(shader_program);
-    glUniform1i(glGetUniformLocation(shader_program, "Y_tex"), 0); // Texture unit 0
-    glUniform1i(glGetUniformLocation(shader_program, "U_tex"), 1); // Texture unit 1
-    glUniform1i(glGetUniformLocation(shader_program, "V_tex"), 2); // Texture unit 2
+out vec2 TexCoord;
+flat out int Layer;
 
-    // Master Clock: Stores the time when the video started playing relative to its first frame's PTS
-    double video_start_time = -1.0;
+void main()
+{
+    // One instance per stream: squeeze the full-screen quad into the stream's grid cell
+    int col = gl_InstanceID % grid_cols;
+    int row = gl_InstanceID / grid_cols;
+    vec2 cell = vec2(2.0 / float(grid_cols), 2.0 / float(grid_rows));
+    vec2 origin = vec2(-1.0 + float(col) * cell.x, 1.0 - float(row + 1) * cell.y);
+    gl_Position = vec4(origin + (aPos * 0.5 + 0.5) * cell, 0.0, 1.0);
+    TexCoord = aTexCoord * tile_uv_scale[gl_InstanceID];
+    Layer = gl_InstanceID;
+}
+)";
 
-    // A reasonable threshold to decide if a frame is too old and should be dropped (e.g., 2 frames worth of delay)
-    const double MAX_CATCHUP_DELAY = 0.08;
+const char* wallFragmentShaderSource = R"(
+#version 330 core
+out vec4 FragColor;
 
-    while (!glfwWindowShouldClose(window)) {
-        double frame_pts_seconds = 0.0;
-        int ret;
+in vec2 TexCoord;
+flat in int Layer;
 
-        // --- 1. Frame Retrieval Loop & Frame Dropping ---
-        // Continuously decode frames until we get one that isn't too stale.
-        while (true) {
-            ret = get_next_frame(&video_frame, &frame_pts_seconds);
+uniform sampler2DArray Y_tex;
+uniform sampler2DArray U_tex;
+uniform sampler2DArray V_tex;
 
-            if (ret < 0) {
-                if (ret != AVERROR_EOF) {
-                    fprintf(stderr, "Critical error during decoding. Stopping playback.\n");
-                }
-                goto cleanup_and_exit;
-            }
+void main()
+{
+    float Y = texture(Y_tex, vec3(TexCoord, Layer)).r;
+    float U = texture(U_tex, vec3(TexCoord, Layer)).r - 0.5;
+    float V = texture(V_tex, vec3(TexCoord, Layer)).r - 0.5;
 
-            double master_clock = glfwGetTime();
+    // Same BT.709 conversion as the single-stream shader
+    FragColor = vec4(Y + 1.5748 * V, Y - 0.1873 * U - 0.4681 * V, Y + 1.8556 * U, 1.0);
+}
+)";
 
-            // Initialize the video start time on the very first frame
-            if (video_start_time < 0.0) {
-                // video_start_time = SystemTime (master_clock) - FramePTS
-                // This establishes a sync point: when the first frame (at its PTS) *should* be shown.
-                video_start_time = master_clock - frame_pts_seconds;
-            }
+GLuint wall_textures[3] = { 0, 0, 0 };
+int wall_array_width = 0;
+int wall_array_height = 0;
+
+void setupWallTextures(int layers) {
+    glGenTextures(3, wall_textures);
+    for (int i = 0; i < 3; i++) {
+        int w = i == 0 ? wall_array_width : (wall_array_width + 1) / 2;
+        int h = i == 0 ? wall_array_height : (wall_array_height + 1) / 2;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, wall_textures[i]);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, w, h, layers, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    checkGLError("setupWallTextures");
+}
 
-            // Calculate the intended time this frame *should* appear on screen.
-            double intended_render_time = frame_pts_seconds + video_start_time;
+// Uploads a YUV420P frame into its stream's layer (clipped to the array size if the stream grew).
+void uploadWallFrame(AVFrame* frame, int layer) {
+    TRACE_SCOPE("wall upload");
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; i < 3; i++) {
+        int w = i == 0 ? frame->width : (frame->width + 1) / 2;
+        int h = i == 0 ? frame->height : (frame->height + 1) / 2;
+        int max_w = i == 0 ? wall_array_width : (wall_array_width + 1) / 2;
+        int max_h = i == 0 ? wall_array_height : (wall_array_height + 1) / 2;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, wall_textures[i]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[i]);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, w < max_w ? w : max_w, h < max_h ? h : max_h, 1,
+            GL_RED, GL_UNSIGNED_BYTE, frame->data[i]);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
 
-            // Calculate how much time is left until the intended render time.
-            double time_to_render = intended_render_time - master_clock;
+void renderWall(GLuint program, int stream_count) {
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUseProgram(program);
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, wall_textures[i]);
+    }
+    glBindVertexArray(VAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, stream_count);
+}
 
-            // If the frame is too late (stale), drop it and continue the loop to get the next one.
-            if (time_to_render < -MAX_CATCHUP_DELAY) {
-                // The -MAX_CATCHUP_DELAY ensures we drop frames only if we're behind by more than 2 frames worth of time (0.08s).
-                fprintf(stderr, "Dropping stale frame (PTS: %.3fs, Clock: %.3fs). Need to catch up.\n", frame_pts_seconds, master_clock);
-                continue; // Loop back and decode the next frame immediately.
-            }
+// Runs the video wall until the window is closed. Returns 0 or a negative error.
+int runVideoWall(const std::vector<std::string>& inputs, int queue_depth, int pool_threads, double refresh_rate) {
+    std::vector<std::string> paths(inputs);
+    if ((int)paths.size() > MAX_WALL_STREAMS) {
+        fprintf(stderr, "Wall: showing the first %d of %zu inputs\n", MAX_WALL_STREAMS, paths.size());
+        paths.resize(MAX_WALL_STREAMS);
+    }
 
-            // We have a frame that is either early or only slightly late/on time.
-            break; // Exit the retrieval loop to process and render this frame.
-        }
+    VideoWall* wall = video_wall_open(paths, queue_depth, pool_threads);
+    if (!wall) {
+        return -1;
+    }
+    int count = (int)wall->streams.size();
 
-        // The current frame (video_frame) is the one we will present.
+    GLFWwindow* window = createPlayerWindow("Video Wall", &refresh_rate);
+    if (!window) {
+        video_wall_close(wall);
+        return -2;
+    }
 
-        // --- 2. Synchronization Wait (Blocking Sleep) ---
-        // Recalculate time_to_render, as decoding/dropping took time.
-        double current_master_clock = glfwGetTime();
-        double intended_render_time = frame_pts_seconds + video_start_time;
-        double time_to_wait = intended_render_time - current_master_clock;
+    GLuint program = createShaderProgram(wallVertexShaderSource, wallFragmentShaderSource);
+    if (program == 0) {
+        video_wall_close(wall);
+        glfwTerminate();
+        return -1;
+    }
 
-        if (time_to_wait > 0.0) {
-            // Frame is early: sleep for the remainder.
-            auto remaining_sleep = std::chrono::duration<double>(time_to_wait);
-            std::this_thread::sleep_for(remaining_sleep);
-        }
+    // Near-square grid; the texture arrays are sized to the largest stream
+    int cols = (int)ceil(sqrt((double)count));
+    int rows = (count + cols - 1) / cols;
+    for (WallStream* s : wall->streams) {
+        if (s->width > wall_array_width) wall_array_width = s->width;
+        if (s->height > wall_array_height) wall_array_height = s->height;
+    }
+    setupWallTextures(count);
+    setupQuad();
 
-        // --- 3. Render ---
-        updateYUVTexturesFromAVFrame(video_frame);
-        render();
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "Y_tex"), 0);
+    glUniform1i(glGetUniformLocation(program, "U_tex"), 1);
+    glUniform1i(glGetUniformLocation(program, "V_tex"), 2);
+    glUniform1i(glGetUniformLocation(program, "grid_cols"), cols);
+    glUniform1i(glGetUniformLocation(program, "grid_rows"), rows);
+    std::vector<float> uv_scale(2 * count);
+    for (int i = 0; i < count; i++) {
+        uv_scale[2 * i] = (float)wall->streams[i]->width / wall_array_width;
+        uv_scale[2 * i + 1] = (float)wall->streams[i]->height / wall_array_height;
+    }
+    glUniform2fv(glGetUniformLocation(program, "tile_uv_scale"), count, uv_scale.data());
+    fprintf(stdout, "Wall: %d stream(s) in a %dx%d grid, %dx%d texture array\n", count, cols, rows, wall_array_width, wall_array_height);
 
-        glfwSwapBuffers(window);
+    // Per-stream presentation: same vblank targeting as single-stream playback, one clock per stream
+    PresentScheduler scheduler;
+    present_scheduler_init(&scheduler, refresh_rate, wall->streams[0]->frame_delay, false);
+    std::vector<double> displayed_pts(count, -1.0);
+
+    video_wall_start(wall);
+
+    while (!glfwWindowShouldClose(window)) {
+        double sleep_time = present_scheduler_sleep_time(&scheduler, glfwGetTime());
+        if (sleep_time > 0.0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(sleep_time));
+        }
+        double target_vsync = present_scheduler_next_vsync(&scheduler, glfwGetTime());
+        bool any_new = false;
+
+        for (int i = 0; i < count; i++) {
+            WallStream* s = wall->streams[i];
+            DecodedFrame* next = s->queue->front();
+            if (!next) {
+                // The stream's next frame is due but hasn't been decoded yet
+                if (s->start_time >= 0.0 &&
+                    present_scheduler_frame_due(&scheduler, displayed_pts[i] + s->frame_delay + s->start_time, target_vsync)) {
+                    s->underruns++;
+                }
+                continue;
+            }
+            if (s->start_time < 0.0) {
+                s->start_time = target_vsync - next->pts;
+            }
+
+            bool consumed = false;
+            DecodedFrame* after = s->queue->second();
+            while (after && present_scheduler_frame_due(&scheduler, after->pts + s->start_time, target_vsync)) {
+                // Superseded before it could be shown
+                av_frame_free(&next->frame);
+                s->queue->pop();
+                s->frames_dropped++;
+                consumed = true;
+                next = after;
+                after = s->queue->second();
+            }
+            if (present_scheduler_frame_due(&scheduler, next->pts + s->start_time, target_vsync)) {
+                uploadWallFrame(next->frame, i);
+                displayed_pts[i] = next->pts;
+                av_frame_free(&next->frame);
+                s->queue->pop();
+                s->frames_presented++;
+                consumed = true;
+                any_new = true;
+            }
+            if (consumed) {
+                video_wall_kick(wall, s);
+            }
+        }
+
+        renderWall(program, count);
+        {
+            TRACE_SCOPE("swap");
+            glfwSwapBuffers(window);
+        }
+        present_scheduler_on_swap(&scheduler, glfwGetTime(), any_new);
+        if (trace_dump_requested) {
+            trace_dump_requested = false;
+            trace_dump();
+        }
         glfwPollEvents();
     }
 
+    present_scheduler_print_stats(&scheduler);
+    video_wall_close(wall);
+    glDeleteTextures(3, wall_textures);
+    glDeleteProgram(program);
+    glfwTerminate();
+    return 0;
+}
+
+// --- Offscreen rendering: no window, frames rendered into an FBO and read back ---
+// Used as a render-throughput benchmark and for golden-image checksums of the YUV shader.
+// Readback goes through a ring of pack PBOs: glReadPixels into a PBO only queues a copy, and a
+// slot is mapped once its fence has signaled, a few frames later, so the render loop never
+// waits on the GPU unless every slot is still in flight.
+const int MAX_READBACK_SLOTS = 16;
+const int DEFAULT_READBACK_SLOTS = 3;
+
+GLuint offscreen_fbo = 0;
+GLuint offscreen_color = 0;
+int offscreen_width = 0;
+int offscreen_height = 0;
+
+GLuint readback_pbos[MAX_READBACK_SLOTS];
+GLsync readback_fences[MAX_READBACK_SLOTS];
+double readback_pts[MAX_READBACK_SLOTS];
+int readback_slots = DEFAULT_READBACK_SLOTS;
+int readback_oldest = 0;   // Slot of the oldest readback still in flight
+int readback_pending = 0;
+long long readback_stalls = 0;        // Times the ring was full and we had to wait for the GPU
+double readback_stall_seconds = 0.0;
+
+// --offscreen-compare-cpu: every rendered frame is also converted by the CPU backend and the two
+// images are compared channel by channel (synchronous readback, so this is a check, not a benchmark)
+const int CPU_COMPARE_TOLERANCE = 2;
+CpuRenderer* cpu_compare_renderer = nullptr;
+std::vector<uint8_t> cpu_compare_gl_pixels;
+std::vector<uint8_t> cpu_compare_cpu_pixels;
+long long cpu_compare_frames = 0;
+long long cpu_compare_channels = 0;
+long long cpu_compare_off = 0;        // Channels off by more than the tolerance
+double cpu_compare_diff_sum = 0.0;
+int cpu_compare_max_diff = 0;
+
+// Creates a GL context without a visible window. "egl" uses GLFW's null platform with EGL,
+// which is surfaceless EGL on Mesa (no display server at all); "osmesa" renders on the CPU
+// (llvmpipe); "hidden" is an invisible window on the normal platform. Returns nullptr on failure.
+GLFWwindow* createHeadlessContext(const char* api) {
+#ifdef GLFW_PLATFORM_NULL
+    if (strcmp(api, "hidden") != 0 && glfwPlatformSupported(GLFW_PLATFORM_NULL)) {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
+#endif
+    if (!glfwInit())
+        return nullptr;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (strcmp(api, "egl") == 0) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    }
+    else if (strcmp(api, "osmesa") == 0) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    }
+
+    // The window only carries the context; everything is drawn into the FBO
+    GLFWwindow* window = glfwCreateWindow(16, 16, "Offscreen", nullptr, nullptr);
+    if (!window) {
+        fprintf(stderr, "Could not create a headless '%s' GL context\n", api);
+        return nullptr;
+    }
+    glfwMakeContextCurrent(window);
+
+    // A GLX build of GLEW reports the missing X display after loading the core entry points
+    glewExperimental = GL_TRUE;
+    GLenum err = glewInit();
+    if (err != GLEW_OK && err != GLEW_ERROR_NO_GLX_DISPLAY)
+        return nullptr;
+    glGetError(); // glewInit can leave GL_INVALID_ENUM behind on core profiles
+
+    fprintf(stdout, "Offscreen context (%s): %s\n", api, (const char*)glGetString(GL_RENDERER));
+    return window;
+}
+
+// Render target for offscreen mode; stays bound, so render() draws into it.
+bool setupOffscreenTarget(int width, int height) {
+    offscreen_width = width;
+    offscreen_height = height;
+
+    glGenRenderbuffers(1, &offscreen_color);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreen_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenFramebuffers(1, &offscreen_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreen_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen_color);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Offscreen framebuffer is incomplete\n");
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4); // RGBA rows are always 4-byte aligned
+    checkGLError("setupOffscreenTarget");
+
+    // Readback ring: one frame per PBO. STREAM_READ lets the driver place them in cached memory.
+    size_t frame_size = (size_t)width * height * 4;
+    glGenBuffers(readback_slots, readback_pbos);
+    for (int i = 0; i < readback_slots; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frame_size, NULL, GL_STREAM_READ);
+        readback_fences[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    checkGLError("glBufferData (Readback Ring)");
+    return true;
+}
+
+// Maps the oldest in-flight readback and hands it to the writer. With wait == false it returns
+// 0 right away if the GPU hasn't finished the copy yet. Returns 1 if a frame was consumed, <0 on error.
+int completeOldestReadback(FrameWriter* writer, bool wait) {
+    if (readback_pending == 0) {
+        return 0;
+    }
+    int slot = readback_oldest;
+    GLenum status = glClientWaitSync(readback_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000 : 0);
+    if (status == GL_TIMEOUT_EXPIRED && !wait) {
+        return 0;
+    }
+    if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+        fprintf(stderr, "Readback fence wait failed\n");
+        return -1;
+    }
+    glDeleteSync(readback_fences[slot]);
+    readback_fences[slot] = 0;
+
+    TRACE_SCOPE("readback write");
+    size_t frame_size = (size_t)offscreen_width * offscreen_height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_pbos[slot]);
+    const uint8_t* pixels = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_size, GL_MAP_READ_BIT);
+    int ret = pixels ? frame_writer_write(writer, pixels, offscreen_width * 4, readback_pts[slot]) : -1;
+    if (pixels) {
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback_oldest = (readback_oldest + 1) % readback_slots;
+    readback_pending--;
+    return ret < 0 ? ret : 1;
+}
+
+// Queues an asynchronous copy of the rendered frame into the next free PBO.
+int queueReadback(FrameWriter* writer, double pts) {
+    if (readback_pending == readback_slots) {
+        // Every slot still in flight: the only place offscreen rendering waits on the GPU
+        TRACE_SCOPE("readback stall");
+        auto start = std::chrono::steady_clock::now();
+        int ret = completeOldestReadback(writer, true);
+        readback_stall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        readback_stalls++;
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    int slot = (readback_oldest + readback_pending) % readback_slots;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_pbos[slot]);
+    glReadPixels(0, 0, offscreen_width, offscreen_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback_pts[slot] = pts;
+    readback_pending++;
+    checkGLError("glReadPixels (Readback Ring)");
+    return 0;
+}
+
+void cleanup_offscreen_target() {
+    for (int i = 0; i < readback_slots; i++) {
+        if (readback_fences[i]) {
+            glDeleteSync(readback_fences[i]);
+            readback_fences[i] = 0;
+        }
+    }
+    if (offscreen_fbo) {
+        glDeleteBuffers(readback_slots, readback_pbos);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &offscreen_fbo);
+        glDeleteRenderbuffers(1, &offscreen_color);
+        offscreen_fbo = 0;
+    }
+}
+
+// Reads the frame just drawn back from the FBO and compares it with the CPU backend's conversion.
+void compareWithCpuRender(const AVFrame* frame) {
+    if (frame->width != offscreen_width || frame->height != offscreen_height) {
+        if (cpu_compare_frames == 0) {
+            fprintf(stderr, "Warning: --offscreen-compare-cpu needs the render target at the video size; not comparing\n");
+        }
+        cpu_compare_frames = -1;
+        return;
+    }
+    TRACE_SCOPE("cpu compare");
+    size_t row_bytes = (size_t)offscreen_width * 4;
+    cpu_compare_gl_pixels.resize(row_bytes * offscreen_height);
+    cpu_compare_cpu_pixels.resize(row_bytes * offscreen_height);
+    glReadPixels(0, 0, offscreen_width, offscreen_height, GL_RGBA, GL_UNSIGNED_BYTE, cpu_compare_gl_pixels.data());
+    if (cpu_renderer_convert(cpu_compare_renderer, frame, cpu_compare_cpu_pixels.data(), (int)row_bytes) < 0) {
+        return;
+    }
+
+    // glReadPixels is bottom-up, the CPU image top-down
+    for (int y = 0; y < offscreen_height; y++) {
+        const uint8_t* gl_row = cpu_compare_gl_pixels.data() + (offscreen_height - 1 - y) * row_bytes;
+        const uint8_t* cpu_row = cpu_compare_cpu_pixels.data() + y * row_bytes;
+        for (size_t i = 0; i < row_bytes; i++) {
+            int diff = abs((int)gl_row[i] - (int)cpu_row[i]);
+            cpu_compare_diff_sum += diff;
+            if (diff > cpu_compare_max_diff) cpu_compare_max_diff = diff;
+            if (diff > CPU_COMPARE_TOLERANCE) cpu_compare_off++;
+        }
+    }
+    cpu_compare_channels += (long long)row_bytes * offscreen_height;
+    cpu_compare_frames++;
+}
+
+void printCpuComparison() {
+    if (cpu_compare_frames <= 0) {
+        return;
+    }
+    fprintf(stdout, "CPU vs GL: %lld frame(s), max difference %d, mean %.3f, %.4f%% of channels off by more than %d (%s kernel)\n",
+        cpu_compare_frames, cpu_compare_max_diff, cpu_compare_diff_sum / cpu_compare_channels,
+        100.0 * cpu_compare_off / cpu_compare_channels, CPU_COMPARE_TOLERANCE, CPU_KERNEL_NAMES[cpu_compare_renderer->kernel]);
+}
+
+// Renders every decoded frame (up to max_frames, <= 0 for all) as fast as possible into the
+// offscreen target and passes it to the writer. Prints throughput. Returns 0 or a negative error.
+int runOffscreen(FrameWriter* writer, AVFrame* video_frame, long long max_frames) {
+    const double DECODER_POLL_INTERVAL = 0.001;
+    long long rendered = 0;
+    double render_seconds = 0.0;   // Upload + draw + queueing the readback
+    double decoder_wait_seconds = 0.0;
+    int ret = 0;
+
+    auto run_start = std::chrono::steady_clock::now();
+    while (max_frames <= 0 || rendered < max_frames) {
+        retireCompletedUploads(0);
+        prewarmTextureSets();
+
+        DecodedFrame* next = peek_decoded_frame();
+        if (!next) {
+            int status = decode_thread_status();
+            if (status < 0) {
+                if (status != AVERROR_EOF) {
+                    fprintf(stderr, "Critical error during decoding. Stopping offscreen render.\n");
+                    ret = status;
+                }
+                break;
+            }
+            auto wait_start = std::chrono::steady_clock::now();
+            std::this_thread::sleep_for(std::chrono::duration<double>(DECODER_POLL_INTERVAL));
+            decoder_wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count();
+            continue;
+        }
+
+        av_frame_unref(video_frame);
+        av_frame_move_ref(video_frame, next->frame);
+        double pts = next->pts;
+        av_frame_free(&next->frame);
+        pop_decoded_frame();
+
+        auto start = std::chrono::steady_clock::now();
+        collectGpuTrace();
+        gpuTraceMark(0);
+        updateYUVTexturesFromAVFrame(video_frame);
+        gpuTraceMark(1);
+        render();
+        gpuTraceMark(2);
+        if (cpu_compare_renderer && cpu_compare_frames >= 0) {
+            compareWithCpuRender(video_frame);
+        }
+        ret = queueReadback(writer, pts);
+        // Hand over whatever the GPU has already finished, without waiting
+        while (ret >= 0 && (ret = completeOldestReadback(writer, false)) > 0) {
+        }
+        render_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (ret < 0) {
+            break;
+        }
+        rendered++;
+        if (rendered == 1) {
+            startup_first_frame("first frame rendered");
+        }
+    }
+
+    // Drain the frames still in flight
+    while (ret >= 0 && readback_pending > 0) {
+        ret = completeOldestReadback(writer, true);
+    }
+    double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+
+    fprintf(stdout, "Offscreen: %lld frame(s) %dx%d in %.3f s (%.1f fps end to end)\n",
+        rendered, offscreen_width, offscreen_height, total_seconds, total_seconds > 0.0 ? rendered / total_seconds : 0.0);
+    fprintf(stdout, "Offscreen: render + readback %.1f fps (%.3f ms/frame), waited %.3f s on the decoder\n",
+        render_seconds > 0.0 ? rendered / render_seconds : 0.0, rendered > 0 ? 1000.0 * render_seconds / rendered : 0.0,
+        decoder_wait_seconds);
+    fprintf(stdout, "Offscreen: %d readback slot(s), %lld stall(s), %.3f ms waiting on the GPU\n",
+        readback_slots, readback_stalls, 1000.0 * readback_stall_seconds);
+    return ret < 0 ? ret : 0;
+}
+
+// --cpu-render OUT: "fb" or "fb:<device>" shows frames on the Linux framebuffer (a GDI window on
+// Windows), anything else is a frame writer spec
+bool isFramebufferOutput(const char* output) {
+    return strncmp(output, "fb", 2) == 0 && (output[2] == '\0' || output[2] == ':');
+}
+
+// CPU rendering backend, no GL at all: frames from the decoder thread are converted to RGBA by
+// the CPU renderer. A frame writer gets every frame as fast as possible; the framebuffer gets them
+// on time, paced by the audio clock (the system clock without audio), dropping frames that are
+// more than a frame late. Prints throughput. Returns 0 or a negative error.
+int runCpuRender(const char* output, CpuRenderer* renderer, AVFrame* video_frame, long long max_frames, double frame_duration) {
+    const double DECODER_POLL_INTERVAL = 0.001;
+    const double MAX_PACING_SLEEP = 0.1;
+
+    bool paced = isFramebufferOutput(output);
+    FrameWriter* writer = nullptr;
+    CpuFramebuffer* fb = nullptr;
+    if (paced) {
+        fb = cpu_framebuffer_open(output[2] == ':' ? output + 3 : "/dev/fb0");
+    }
+    else {
+        writer = frame_writer_open(output, v_frame_width, v_frame_height);
+    }
+    if (!writer && !fb) {
+        return -1;
+    }
+
+    std::vector<uint8_t> rgba;
+    long long presented = 0;
+    long long dropped = 0;
+    long long skipped_size = 0;    // Frames whose size differs from the writer's (resolution change)
+    double clock_origin = -1.0;    // System clock pacing: clock time and pts of the first frame
+    double pts_origin = 0.0;
+    int ret = 0;
+
+    auto run_start = std::chrono::steady_clock::now();
+    while (max_frames <= 0 || presented < max_frames) {
+        DecodedFrame* next = peek_decoded_frame();
+        if (!next) {
+            int status = decode_thread_status();
+            if (status < 0) {
+                if (status != AVERROR_EOF) {
+                    fprintf(stderr, "Critical error during decoding. Stopping CPU render.\n");
+                    ret = status;
+                }
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::duration<double>(DECODER_POLL_INTERVAL));
+            continue;
+        }
+
+        if (paced) {
+            double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+            double position;
+            if (!audio_get_clock(&position)) {
+                if (clock_origin < 0.0) {
+                    clock_origin = now;
+                    pts_origin = next->pts;
+                }
+                position = pts_origin + (now - clock_origin);
+            }
+            double ahead = next->pts - position;
+            if (ahead > DECODER_POLL_INTERVAL) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(ahead < MAX_PACING_SLEEP ? ahead : MAX_PACING_SLEEP));
+                continue;
+            }
+            if (-ahead > frame_duration && peek_next_decoded_frame()) {
+                // Late and its successor is already decoded: don't spend a conversion on it
+                av_frame_free(&next->frame);
+                pop_decoded_frame();
+                dropped++;
+                continue;
+            }
+        }
+
+        av_frame_unref(video_frame);
+        av_frame_move_ref(video_frame, next->frame);
+        double pts = next->pts;
+        av_frame_free(&next->frame);
+        pop_decoded_frame();
+
+        if (writer && (video_frame->width != writer->width || video_frame->height != writer->height)) {
+            skipped_size++;
+            continue;
+        }
+        int stride = video_frame->width * 4;
+        rgba.resize((size_t)stride * video_frame->height);
+        ret = cpu_renderer_convert(renderer, video_frame, rgba.data(), stride);
+        if (ret < 0) {
+            fprintf(stderr, "Error: Pixel format %s can't be converted on the CPU\n", av_get_pix_fmt_name((AVPixelFormat)video_frame->format));
+            break;
+        }
+        if (writer) {
+            ret = frame_writer_write_top_down(writer, rgba.data(), stride, pts);
+            if (ret < 0) {
+                break;
+            }
+        }
+        else if (!cpu_framebuffer_present(fb, rgba.data(), stride, video_frame->width, video_frame->height)) {
+            break; // Window closed
+        }
+        presented++;
+        if (presented == 1) {
+            startup_first_frame("first frame rendered");
+        }
+    }
+    double total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+
+    fprintf(stdout, "CPU render: %lld frame(s) %s in %.3f s (%.1f fps)", presented, writer ? "written" : "presented",
+        total_seconds, total_seconds > 0.0 ? presented / total_seconds : 0.0);
+    if (paced) {
+        fprintf(stdout, ", %lld dropped late", dropped);
+    }
+    if (skipped_size > 0) {
+        fprintf(stdout, ", %lld skipped (size differs from the output's)", skipped_size);
+    }
+    fprintf(stdout, "\n");
+    cpu_renderer_print_stats(renderer);
+    frame_writer_close(writer);
+    cpu_framebuffer_close(fb);
+    return ret < 0 ? ret : 0;
+}
+
+// Headless context used by --offscreen unless --offscreen-context says otherwise
+#ifdef _WIN32
+const char* DEFAULT_OFFSCREEN_CONTEXT = "hidden";
+#else
+const char* DEFAULT_OFFSCREEN_CONTEXT = "egl";
+#endif
+
+// Appends the entries of an M3U-style playlist (one file or URL per line, '#' lines ignored).
+// Relative paths are taken relative to the playlist's directory. Returns false if it can't be read.
+bool loadPlaylistFile(const char* path, std::vector<std::string>* inputs) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Could not open playlist %s\n", path);
+        return false;
+    }
+    std::string dir(path);
+    size_t slash = dir.find_last_of("/\\");
+    dir = slash != std::string::npos ? dir.substr(0, slash + 1) : std::string();
+
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+        bool absolute = line[0] == '/' || line[0] == '\\' || (len > 1 && line[1] == ':') || strstr(line, "://");
+        inputs->push_back(absolute ? std::string(line) : dir + line);
+    }
+    fclose(f);
+    return true;
+}
+
+void print_usage(const char* prog) {
+    fprintf(stdout, "Usage: %s [options] [input file...]\n", prog);
+    fprintf(stdout, "  Several input files play back to back without gaps (the next one is opened while the current one plays)\n");
+    fprintf(stdout, "  --playlist FILE    add the entries of an M3U playlist to the inputs\n");
+    fprintf(stdout, "  --fast-start       cap stream probing and open the input while the window and GL are set up\n");
+    fprintf(stdout, "  --queue-depth N    decoded frames buffered ahead of presentation (default %d)\n", DEFAULT_DECODE_QUEUE_DEPTH);
+    fprintf(stdout, "  --threads N|auto   decoder threads (default auto = hardware concurrency)\n");
+    fprintf(stdout, "  --thread-type T    auto, frame, slice or none (default auto)\n");
+    fprintf(stdout, "  --thread-type C=T  threading model for codec C only, e.g. hevc=slice (repeatable)\n");
+    fprintf(stdout, "  --upload-slots N   slots in the fenced upload ring (default 3, max %d)\n", MAX_UPLOAD_SLOTS);
+    fprintf(stdout, "  --frame-cache-mb N memory budget for stepping back / reverse playback (default %d, 0 = off)\n", DEFAULT_FRAME_CACHE_MB);
+    fprintf(stdout, "  --audio-sink S     device (default), null (real-time clock, no output) or wav:<file>\n");
+    fprintf(stdout, "  --no-audio         play video only, timed by the system clock\n");
+    fprintf(stdout, "  --refresh-rate HZ  display refresh used for frame scheduling (default: from the monitor)\n");
+    fprintf(stdout, "  --simulate-vsync FPS:HZ[:N]  print the frame cadence of N frames on a simulated display and exit\n");
+    fprintf(stdout, "  --wall             tile every input file in one window (video wall), e.g. --wall a.mp4 b.mp4 c.mp4\n");
+    fprintf(stdout, "  --wall-copies N    repeat the wall inputs N times (load testing)\n");
+    fprintf(stdout, "  --wall-threads N   decode pool threads for the wall (default: hardware concurrency)\n");
+    fprintf(stdout, "  --offscreen OUT    render without a window into an FBO and read frames back; OUT is checksum,\n");
+    fprintf(stdout, "                     raw:<file> (RGBA) or png:<directory>. Prints render throughput\n");
+    fprintf(stdout, "  --offscreen-frames N     stop after N frames (default: whole file)\n");
+    fprintf(stdout, "  --offscreen-expect FILE  compare with the output of an earlier run saved in FILE; exit non-zero on a mismatch\n");
+    fprintf(stdout, "  --offscreen-size WxH     render target size (default: video size)\n");
+    fprintf(stdout, "  --offscreen-context C    egl (surfaceless), osmesa or hidden (invisible window; default %s)\n", DEFAULT_OFFSCREEN_CONTEXT);
+    fprintf(stdout, "  --readback-slots N       pack PBOs in the readback ring (default %d, max %d)\n", DEFAULT_READBACK_SLOTS, MAX_READBACK_SLOTS);
+    fprintf(stdout, "  --offscreen-compare-cpu  also convert every frame on the CPU and report how far it is from the GL image\n");
+    fprintf(stdout, "  --cpu-render OUT   no GL: convert frames to RGBA on the CPU; OUT is fb[:device] (Linux framebuffer or a\n");
+    fprintf(stdout, "                     GDI window on Windows, played in real time) or checksum, raw:<file>, png:<directory>\n");
+    fprintf(stdout, "                     (--offscreen-frames applies)\n");
+    fprintf(stdout, "  --cpu-kernel K     scalar, sse2, avx2 or auto (default: fastest this CPU has)\n");
+    fprintf(stdout, "  --cpu-threads N    row bands converted in parallel (default: hardware concurrency)\n");
+    fprintf(stdout, "  --cpu-convert-bench WxH[:N]  time every CPU conversion kernel on N synthetic frames and exit\n");
+    fprintf(stdout, "  --thumbnails DIR   no playback: write a keyframe contact sheet (PNG) and pts index (JSON) for every\n");
+    fprintf(stdout, "                     input file, or every video file in an input directory, into DIR\n");
+    fprintf(stdout, "  --thumb-width N    tile width in pixels (default %d)\n", DEFAULT_THUMB_WIDTH);
+    fprintf(stdout, "  --thumb-columns N  tiles per sheet row (default %d)\n", DEFAULT_THUMB_COLUMNS);
+    fprintf(stdout, "  --thumb-interval S at most one tile every S seconds (default: every keyframe)\n");
+    fprintf(stdout, "  --thumb-threads N  decode pool threads (default: hardware concurrency)\n");
+    fprintf(stdout, "  --extract OUT      no playback: copy a clip into OUT without decoding (container from the extension);\n");
+    fprintf(stdout, "                     starts on the keyframe at or before --extract-from, ends before the first one after --extract-to\n");
+    fprintf(stdout, "  --extract-from S   clip start in seconds (default 0)\n");
+    fprintf(stdout, "  --extract-to S     clip end in seconds (default: end of file)\n");
+    fprintf(stdout, "  --smart-cut        re-encode only the partial GOPs at the clip boundaries to cut on the exact frames\n");
+    fprintf(stdout, "  --no-catch-up      always decode every frame, even when playback falls behind\n");
+    fprintf(stdout, "  --deinterlace M    GPU deinterlacing of frames flagged interlaced: off (default), frame (one picture\n");
+    fprintf(stdout, "                     per frame) or field (one per field, e.g. 50 per second for 50i; window only)\n");
+    fprintf(stdout, "  --deinterlace-all  deinterlace every frame, flagged or not\n");
+    fprintf(stdout, "  --downscale        Lanczos downscaling on the GPU when the window is smaller than the video\n");
+    fprintf(stdout, "  --sharpen A        GPU unsharp mask of strength A (H toggles it, default %.1f)\n", DEFAULT_SHARPEN_AMOUNT);
+    fprintf(stdout, "  --rate R           playback rate, %g to %g (default 1); audio only plays at 1x. From %gx up only keyframes are decoded\n",
+        MIN_PLAYBACK_RATE, MAX_PLAYBACK_RATE, TRICK_KEYFRAME_RATE);
+    fprintf(stdout, "  --io MODE          how local files are read: readahead (default, prefetch thread), mmap or default (FFmpeg)\n");
+    fprintf(stdout, "  --read-ahead-mb N  read-ahead ring / page-in window (default %d)\n", DEFAULT_READ_AHEAD_MB);
+    fprintf(stdout, "  Inputs may be URLs (http://, rtsp://, HLS, ...): a receive thread feeds a jitter buffer sized from the arrival jitter\n");
+    fprintf(stdout, "  --net-preset P     low-latency, balanced (default) or robust: buffer limits, reconnects and timeouts\n");
+    fprintf(stdout, "  --net-buffer-ms MIN[:MAX]  jitter buffer limits (override the preset)\n");
+    fprintf(stdout, "  --net-reconnect N  reconnect attempts per outage (-1 = forever, 0 = off; overrides the preset)\n");
+    fprintf(stdout, "  --net-impair DELAY_MS[:JITTER_MS[:LOSS_PCT]]  simulate a bad network (also turns a local file into a\n");
+    fprintf(stdout, "                     paced live source) to test the jitter buffer\n");
+    fprintf(stdout, "  --trace FILE       record a Chrome trace (chrome://tracing, Perfetto) of every pipeline stage;\n");
+    fprintf(stdout, "                     written on exit and when T is pressed\n");
+    fprintf(stdout, "  --no-keyframe-index  seek with plain av_seek_frame instead of the keyframe index sidecar\n");
+    fprintf(stdout, "  --no-zero-copy     decode into libavcodec's buffers and copy each frame into the upload ring\n");
+    fprintf(stdout, "  --frame-pool-slabs N  frame buffers in the zero-copy pool (default queue depth + %d)\n", FRAME_POOL_EXTRA_SLABS);
+    fprintf(stdout, "Keys: Left/Right seek %.0fs (Shift: %.0fs), Space pause, Period/Comma step one frame, R reverse, ]/[ double/halve the rate, Backslash 1x,\n"
+        "      D deinterlace off/frame/field, S downscale, H sharpen, T write trace\n", SEEK_STEP, SEEK_STEP_LONG);
+}
+
+int main(int argc, char** argv) {
+    startup_timing_begin();
+    fprintf(stdout, "FFmpeg C++ Video Player\n");
+
+    const char* input_file = DEFAULT_INPUT_FILE;
+    int queue_depth = DEFAULT_DECODE_QUEUE_DEPTH;
+    DecoderOptions decoder_options = default_decoder_options();
+    decoder_options.use_frame_pool = true;
+    decoder_options.use_keyframe_index = true;
+    decoder_options.frame_cache_mb = DEFAULT_FRAME_CACHE_MB;
+    decoder_options.audio_sink = AUDIO_SINK_DEVICE;
+    decoder_options.read_ahead = READ_AHEAD_THREAD;
+    decoder_options.catch_up = true;
+    NetPreset net_preset = NET_PRESET_BALANCED;
+    double net_min_buffer_ms = -1.0;   // <0: from the preset
+    double net_max_buffer_ms = -1.0;
+    int net_reconnect = -2;            // -2: from the preset
+    int frame_pool_slabs = 0;
+    double refresh_rate = 0.0; // 0 = ask the monitor
+    bool wall_mode = false;
+    int wall_copies = 1;
+    int wall_threads = 0;
+    std::vector<std::string> inputs;
+    const char* offscreen_output = nullptr;
+    const char* offscreen_expect = nullptr;
+    long long offscreen_frames = 0;
+    int offscreen_target_width = 0;
+    int offscreen_target_height = 0;
+    const char* offscreen_context = DEFAULT_OFFSCREEN_CONTEXT;
+    ThumbnailOptions thumbnail_options = default_thumbnail_options();
+    ClipExtractOptions extract_options = default_clip_extract_options();
+    bool fast_start = false;
+    const char* cpu_render_output = nullptr;
+    bool offscreen_compare_cpu = false;
+    CpuConvertKernel cpu_kernel = cpu_best_kernel();
+    int cpu_threads = 0;
+
+    // Parse command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc) {
+            queue_depth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            const char* value = argv[++i];
+            decoder_options.thread_count = strcmp(value, "auto") == 0 ? 0 : atoi(value);
+        }
+        else if (strcmp(argv[i], "--thread-type") == 0 && i + 1 < argc) {
+            if (add_decoder_thread_type_arg(&decoder_options, argv[++i]) < 0) {
+                fprintf(stderr, "Unknown thread type: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--upload-slots") == 0 && i + 1 < argc) {
+            upload_ring_slots = atoi(argv[++i]);
+            if (upload_ring_slots < 1 || upload_ring_slots > MAX_UPLOAD_SLOTS) {
+                fprintf(stderr, "--upload-slots must be between 1 and %d\n", MAX_UPLOAD_SLOTS);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--frame-cache-mb") == 0 && i + 1 < argc) {
+            decoder_options.frame_cache_mb = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--audio-sink") == 0 && i + 1 < argc) {
+            // device, null, or wav:<path>
+            const char* value = argv[++i];
+            if (strncmp(value, "wav:", 4) == 0 && value[4] != '\0') {
+                decoder_options.audio_sink = AUDIO_SINK_WAV;
+                snprintf(decoder_options.audio_wav_path, sizeof(decoder_options.audio_wav_path), "%s", value + 4);
+            }
+            else if (strcmp(value, "wav") == 0 || parse_audio_sink_type(value, &decoder_options.audio_sink) < 0) {
+                fprintf(stderr, "Unknown audio sink: %s\n", value);
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--no-audio") == 0) {
+            decoder_options.audio_sink = AUDIO_SINK_NONE;
+        }
+        else if (strcmp(argv[i], "--refresh-rate") == 0 && i + 1 < argc) {
+            refresh_rate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--simulate-vsync") == 0 && i + 1 < argc) {
+            // FPS:HZ[:FRAMES], e.g. 23.976:60 -- runs the scheduler on a simulated display and exits
+            double fps = 0.0, hz = 0.0;
+            int frames = 240;
+            if (sscanf(argv[++i], "%lf:%lf:%d", &fps, &hz, &frames) < 2 || fps <= 0.0 || hz <= 0.0 || frames < 1) {
+                fprintf(stderr, "Invalid --simulate-vsync value: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+            return present_scheduler_simulate(fps, hz, frames);
+        }
+        else if (strcmp(argv[i], "--wall") == 0) {
+            wall_mode = true;
+        }
+        else if (strcmp(argv[i], "--wall-copies") == 0 && i + 1 < argc) {
+            wall_copies = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--wall-threads") == 0 && i + 1 < argc) {
+            wall_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--offscreen") == 0 && i + 1 < argc) {
+            offscreen_output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--offscreen-expect") == 0 && i + 1 < argc) {
+            offscreen_expect = argv[++i];
+        }
+        else if (strcmp(argv[i], "--offscreen-compare-cpu") == 0) {
+            offscreen_compare_cpu = true;
+        }
+        else if (strcmp(argv[i], "--cpu-render") == 0 && i + 1 < argc) {
+            cpu_render_output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cpu-kernel") == 0 && i + 1 < argc) {
+            if (parse_cpu_kernel(argv[++i], &cpu_kernel) < 0) {
+                fprintf(stderr, "Unknown or unsupported CPU kernel: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--cpu-threads") == 0 && i + 1 < argc) {
+            cpu_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cpu-convert-bench") == 0 && i + 1 < argc) {
+            // WxH[:ITERATIONS] -- converts synthetic frames with every kernel and exits
+            int width = 0, height = 0, iterations = 50;
+            if (sscanf(argv[++i], "%dx%d:%d", &width, &height, &iterations) < 2) {
+                fprintf(stderr, "Invalid --cpu-convert-bench value: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+            return cpu_convert_benchmark(width, height, iterations, cpu_threads);
+        }
+        else if (strcmp(argv[i], "--offscreen-frames") == 0 && i + 1 < argc) {
+            offscreen_frames = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--offscreen-size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &offscreen_target_width, &offscreen_target_height) != 2 ||
+                offscreen_target_width <= 0 || offscreen_target_height <= 0) {
+                fprintf(stderr, "Invalid --offscreen-size value: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--offscreen-context") == 0 && i + 1 < argc) {
+            offscreen_context = argv[++i];
+            if (strcmp(offscreen_context, "egl") != 0 && strcmp(offscreen_context, "osmesa") != 0 && strcmp(offscreen_context, "hidden") != 0) {
+                fprintf(stderr, "Unknown offscreen context: %s\n", offscreen_context);
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--readback-slots") == 0 && i + 1 < argc) {
+            readback_slots = atoi(argv[++i]);
+            if (readback_slots < 1 || readback_slots > MAX_READBACK_SLOTS) {
+                fprintf(stderr, "--readback-slots must be between 1 and %d\n", MAX_READBACK_SLOTS);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--thumbnails") == 0 && i + 1 < argc) {
+            thumbnail_options.output_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--thumb-width") == 0 && i + 1 < argc) {
+            thumbnail_options.tile_width = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--thumb-columns") == 0 && i + 1 < argc) {
+            thumbnail_options.columns = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--thumb-interval") == 0 && i + 1 < argc) {
+            thumbnail_options.interval = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--thumb-threads") == 0 && i + 1 < argc) {
+            thumbnail_options.pool_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-keyframe-index") == 0) {
+            decoder_options.use_keyframe_index = false;
+        }
+        else if (strcmp(argv[i], "--no-zero-copy") == 0) {
+            decoder_options.use_frame_pool = false;
+        }
+        else if (strcmp(argv[i], "--no-catch-up") == 0) {
+            decoder_options.catch_up = false;
+        }
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            requested_playback_rate = atof(argv[++i]);
+            if (requested_playback_rate <= 0.0) {
+                fprintf(stderr, "Invalid --rate value: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+            // Clamped once here so the [ and ] steps stay within the limits too
+            double clamped = std::clamp(requested_playback_rate, MIN_PLAYBACK_RATE, MAX_PLAYBACK_RATE);
+            if (clamped != requested_playback_rate) {
+                fprintf(stderr, "--rate %s is out of range, using %gx (%g to %g)\n", argv[i], clamped, MIN_PLAYBACK_RATE, MAX_PLAYBACK_RATE);
+                requested_playback_rate = clamped;
+            }
+        }
+        else if (strcmp(argv[i], "--deinterlace") == 0 && i + 1 < argc) {
+            if (parse_deinterlace_mode(argv[++i], &post_settings.deinterlace) < 0) {
+                fprintf(stderr, "Unknown deinterlace mode: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--deinterlace-all") == 0) {
+            post_settings.deinterlace_all_frames = true;
+        }
+        else if (strcmp(argv[i], "--downscale") == 0) {
+            post_settings.downscale = true;
+        }
+        else if (strcmp(argv[i], "--sharpen") == 0 && i + 1 < argc) {
+            post_settings.sharpen = atof(argv[++i]);
+            if (post_settings.sharpen <= 0.0) {
+                fprintf(stderr, "Invalid --sharpen amount: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+            sharpen_strength = post_settings.sharpen;
+        }
+        else if (strcmp(argv[i], "--extract") == 0 && i + 1 < argc) {
+            extract_options.output_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--extract-from") == 0 && i + 1 < argc) {
+            extract_options.start = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--extract-to") == 0 && i + 1 < argc) {
+            extract_options.end = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--smart-cut") == 0) {
+            extract_options.smart_cut = true;
+        }
+        else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            if (parse_read_ahead_mode(argv[++i], &decoder_options.read_ahead) < 0) {
+                fprintf(stderr, "Unknown I/O mode: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--read-ahead-mb") == 0 && i + 1 < argc) {
+            decoder_options.read_ahead_mb = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--net-preset") == 0 && i + 1 < argc) {
+            if (parse_net_preset(argv[++i], &net_preset) < 0) {
+                fprintf(stderr, "Unknown network preset: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--net-buffer-ms") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%lf:%lf", &net_min_buffer_ms, &net_max_buffer_ms) < 1 || net_min_buffer_ms < 0.0) {
+                fprintf(stderr, "Invalid --net-buffer-ms value: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--net-reconnect") == 0 && i + 1 < argc) {
+            net_reconnect = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--net-impair") == 0 && i + 1 < argc) {
+            if (parse_net_impairment(argv[++i], &decoder_options.network) < 0) {
+                fprintf(stderr, "Invalid --net-impair value: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_enable(argv[++i]);
+            trace_set_thread_name("render");
+        }
+        else if (strcmp(argv[i], "--frame-pool-slabs") == 0 && i + 1 < argc) {
+            frame_pool_slabs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fast-start") == 0) {
+            fast_start = true;
+            decoder_options.fast_start = true;
+        }
+        else if (strcmp(argv[i], "--playlist") == 0 && i + 1 < argc) {
+            if (!loadPlaylistFile(argv[++i], &inputs)) {
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        }
+        else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return -1;
+        }
+        else {
+            input_file = argv[i];
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    if (!extract_options.output_path.empty()) {
+        // Batch job like the thumbnails: no window, no GL, no decode
+        extract_options.read_ahead = decoder_options.read_ahead;
+        extract_options.read_ahead_mb = decoder_options.read_ahead_mb;
+        int extract_ret = run_clip_extract(inputs.empty() ? input_file : inputs[0].c_str(), extract_options);
+        trace_shutdown();
+        return extract_ret;
+    }
+
+    if (!thumbnail_options.output_dir.empty()) {
+        // Batch job: no window, no GL
+        if (inputs.empty()) {
+            inputs.push_back(input_file);
+        }
+        int thumbnail_ret = run_thumbnails(inputs, thumbnail_options);
+        trace_shutdown();
+        return thumbnail_ret;
+    }
+
+    if (wall_mode) {
+        // Every input (repeated --wall-copies times, for load testing) becomes a tile
+        std::vector<std::string> wall_inputs;
+        if (inputs.empty()) {
+            inputs.push_back(input_file);
+        }
+        for (int copy = 0; copy < (wall_copies > 1 ? wall_copies : 1); copy++) {
+            wall_inputs.insert(wall_inputs.end(), inputs.begin(), inputs.end());
+        }
+        int wall_ret = runVideoWall(wall_inputs, queue_depth, wall_threads, refresh_rate);
+        trace_shutdown();
+        return wall_ret;
+    }
+
+    //Createing a video frame placeholder (holds the frame currently on screen)
+    AVFrame* video_frame = nullptr;
+    // frame_delay is now only for logging the estimated FPS, not for timing
+    double estimated_frame_delay = 0.0;
+
+    // Network input: the preset, then the options that override parts of it
+    net_input_apply_preset(&decoder_options.network, net_preset);
+    if (net_min_buffer_ms >= 0.0) {
+        decoder_options.network.min_buffer_seconds = net_min_buffer_ms / 1000.0;
+    }
+    if (net_max_buffer_ms >= 0.0) {
+        decoder_options.network.max_buffer_seconds = net_max_buffer_ms / 1000.0;
+    }
+    if (decoder_options.network.max_buffer_seconds < decoder_options.network.min_buffer_seconds) {
+        decoder_options.network.max_buffer_seconds = decoder_options.network.min_buffer_seconds;
+    }
+    if (net_reconnect >= -1) {
+        decoder_options.network.reconnect_attempts = net_reconnect;
+    }
+
+    // Offscreen runs are benchmarks / golden tests: no audio, nothing paced by a clock
+    if (offscreen_output || (cpu_render_output && !isFramebufferOutput(cpu_render_output))) {
+        decoder_options.audio_sink = AUDIO_SINK_NONE;
+    }
+
+    // The first input opens now; any others play after it as a gapless playlist
+    if (!inputs.empty()) {
+        input_file = inputs[0].c_str();
+        set_playlist(std::vector<std::string>(inputs.begin() + 1, inputs.end()));
+    }
+
+    if (cpu_render_output) {
+        // No window, no GL: the decoder thread feeds the CPU renderer on this thread
+        set_decoder_options(decoder_options);
+        int cpu_ret = init_ffmpeg(input_file, &v_frame_width, &v_frame_height, &estimated_frame_delay, &video_frame);
+        if (cpu_ret >= 0) {
+            cpu_ret = start_decode_thread(queue_depth);
+        }
+        if (cpu_ret >= 0) {
+            CpuRenderer* renderer = cpu_renderer_create(cpu_threads, cpu_kernel);
+            cpu_ret = runCpuRender(cpu_render_output, renderer, video_frame, offscreen_frames, estimated_frame_delay);
+            cpu_renderer_destroy(renderer);
+        }
+        else {
+            fprintf(stderr, "Failed to Init ffmpeg\n");
+        }
+        stop_decode_thread();
+        av_frame_free(&video_frame);
+        cleanup_ffmpeg();
+        trace_shutdown();
+        return cpu_ret < 0 ? cpu_ret : 0;
+    }
+
+    // Init FFmpeg and get frame resolution. With --fast-start this runs on its own thread while
+    // the window, GL context and shaders are set up, and the decoder thread starts as soon as
+    // the codec is open: frames decode into libavcodec's buffers until the frame pool is attached.
+    set_decoder_options(decoder_options);
+    int ret = 0;
+    bool decoder_started = false;
+    auto openInput = [&]() {
+        ret = init_ffmpeg(input_file, &v_frame_width, &v_frame_height, &estimated_frame_delay, &video_frame);
+        if (ret >= 0 && fast_start) {
+            ret = start_decode_thread(queue_depth);
+            decoder_started = ret >= 0;
+        }
+    };
+    std::thread opener;
+    if (fast_start) {
+        opener = std::thread([&]() {
+            trace_set_thread_name("open");
+            openInput();
+        });
+    }
+    else {
+        openInput();
+        //Error handling
+        if (ret < 0) {
+            fprintf(stderr, "Failed to Init ffmpeg\n");
+            return ret;
+        }
+        fprintf(stdout, "FFmpeg inited successfully\n");
+    }
+
+    //Crateing a window and initing GLFW 
+    GLFWwindow* window = offscreen_output ? createHeadlessContext(offscreen_context) : createPlayerWindow("Test", &refresh_rate);
+
+    //Createing a shader to render the frame using
+    if (window) {
+        STARTUP_SCOPE("compile shaders");
+        // The common 8-bit 4:2:0 variant; others compile with the first texture set of their format
+        shader_program = yuvShaderProgram(yuv_format_layout(AV_PIX_FMT_YUV420P));
+        if (shader_program == 0) {
+            fprintf(stderr, "Couldent create a program");
+        }
+    }
+
+    if (opener.joinable()) {
+        {
+            STARTUP_SCOPE("wait for input open");
+            opener.join();
+        }
+        if (ret < 0) {
+            fprintf(stderr, "Failed to Init ffmpeg\n");
+            stop_decode_thread();
+            glfwTerminate();
+            return ret;
+        }
+        fprintf(stdout, "FFmpeg inited successfully\n");
+    }
+    if (!window || shader_program == 0) {
+        stop_decode_thread();
+        glfwTerminate();
+        return window ? -1 : -2;
+    }
+
+    {
+        STARTUP_SCOPE("GL setup");
+        setupYUVTextures();
+        setupQuad();
+        post_process_init(VAO, createShaderProgram, drawYUVFrame);
+
+        if (decoder_options.use_frame_pool) {
+            setupFramePool(frame_pool_slabs > 0 ? frame_pool_slabs : queue_depth + FRAME_POOL_EXTRA_SLABS);
+        }
+        setupGpuTrace();
+    }
+    if (post_process_active(&post_settings, &post_frame) || post_settings.deinterlace != DEINTERLACE_OFF) {
+        post_process_print_settings(&post_settings);
+    }
+
+    // Demux and decode now run on their own thread; this loop only presents.
+    // An idle render loop sleeps in glfwWaitEvents*; the first frame after an underrun wakes it.
+    if (!offscreen_output) {
+        set_frame_ready_callback(glfwPostEmptyEvent);
+    }
+    if (!decoder_started && start_decode_thread(queue_depth) < 0) {
+        fprintf(stderr, "Failed to start the decoder thread\n");
+        goto cleanup_and_exit;
+    }
+
+    if (offscreen_output) {
+        int width = offscreen_target_width > 0 ? offscreen_target_width : v_frame_width;
+        int height = offscreen_target_height > 0 ? offscreen_target_height : v_frame_height;
+        FrameWriter* writer = frame_writer_open(offscreen_output, width, height);
+        if (!writer || !setupOffscreenTarget(width, height)) {
+            ret = -1;
+        }
+        else {
+            if (offscreen_compare_cpu) {
+                cpu_compare_renderer = cpu_renderer_create(cpu_threads, cpu_kernel);
+                if (post_settings.deinterlace != DEINTERLACE_OFF || post_settings.downscale || post_settings.sharpen > 0.0) {
+                    // The CPU backend only converts; compare the plain conversion
+                    fprintf(stderr, "Warning: --offscreen-compare-cpu turns GPU post-processing off\n");
+                    post_settings.deinterlace = DEINTERLACE_OFF;
+                    post_settings.downscale = false;
+                    post_settings.sharpen = 0.0;
+                }
+            }
+            ret = runOffscreen(writer, video_frame, offscreen_frames);
+            if (ret >= 0 && offscreen_expect) {
+                ret = frame_writer_check_golden(writer, offscreen_expect);
+            }
+            printCpuComparison();
+            cpu_renderer_destroy(cpu_compare_renderer);
+            cpu_compare_renderer = nullptr;
+        }
+        frame_writer_close(writer);
+        cleanup_offscreen_target();
+        goto cleanup_and_exit;
+    }
+
+    {
+        // Master Clock: Stores the time when the video started playing relative to its first frame's PTS
+        double video_start_time = -1.0;
+
+        // Picks frames by target vblank; see present_scheduler.h
+        PresentScheduler scheduler;
+        present_scheduler_init(&scheduler, refresh_rate, estimated_frame_delay, false);
+
+        // How often to check on a GOP decode when stepping back (nothing signals its completion)
+        const double UNDERRUN_POLL_INTERVAL = 0.002;
+
+        // Longest wait for the decoder when the queue is empty. A frame landing in the queue wakes
+        // the loop sooner; the timeout only bounds how late end of stream or errors are noticed.
+        const double FRAME_WAIT_TIMEOUT = 0.1;
+
+        // PTS of the frame on screen, and the seek serial frames must carry to be shown
+        double displayed_pts = 0.0;
+        uint64_t displayed_source_ns = 0;   // Network input: when the frame on screen was sent/received
+        int displayed_item = 0;
+        int playback_serial = current_seek_serial();
+
+        // After showing cached frames the decoder is re-synced with a seek; queued frames up to
+        // (and including) the one already on screen are then skipped.
+        double resync_skip_until = -1.0;
+        bool showing_cached_frames = false;
+
+        // Reverse playback runs on its own clock: pts = anchor_pts - (now - anchor_time) * rate
+        bool reverse_playback = false;
+        double reverse_anchor_pts = 0.0;
+        double reverse_anchor_time = 0.0;
+
+        // Field-rate deinterlacing: when the later field of the frame on screen is due (-1: none)
+        double second_field_due = -1.0;
+
+        // Largest PTS gap still considered "the adjacent frame" in cache lookups
+        double max_frame_gap = estimated_frame_delay * 2.5;
+        FrameCache* frame_cache = decoder_frame_cache();
+
+        // Audio only plays during normal forward playback
+        bool audio_paused = false;
+
+        PlaybackState state = playbackState(reverse_playback);
+        double loop_time = glfwGetTime();
+        long long loop_renders = frames_rendered_total;
+        long long loop_uploads = frames_uploaded_total;
+
+        while (!glfwWindowShouldClose(window)) {
+            recordLoopActivity(state, glfwGetTime(), &loop_time, &loop_renders, &loop_uploads);
+
+            // Hand back zero-copy slabs the GPU has finished reading
+            retireCompletedUploads(0);
+            prewarmTextureSets();
+            collectGpuTrace();
+            if (trace_dump_requested) {
+                trace_dump_requested = false;
+                trace_dump();
+            }
+            if (post_settings_changed) {
+                post_settings_changed = false;
+                post_process_print_settings(&post_settings);
+            }
+
+            // Arrow keys: seek relative to the frame on screen; the clock restarts at the landed frame
+            if (pending_seek_offset != 0.0) {
+                set_forward_decoding(true);
+                playback_serial = request_seek(displayed_pts + pending_seek_offset);
+                pending_seek_offset = 0.0;
+                video_start_time = -1.0;
+                reverse_playback = false;
+                showing_cached_frames = false;
+                resync_skip_until = -1.0;
+                present_scheduler_resync(&scheduler);
+            }
+
+            // 'R': toggle reverse playback (needs the frame cache)
+            if (reverse_toggle_requested) {
+                reverse_toggle_requested = false;
+                if (!frame_cache) {
+                    fprintf(stderr, "Reverse playback needs the frame cache (--frame-cache-mb)\n");
+                }
+                else if (!reverse_playback) {
+                    reverse_playback = true;
+                    paused = false;
+                    set_forward_decoding(false);
+                    showing_cached_frames = true;
+                    reverse_anchor_pts = displayed_pts;
+                    reverse_anchor_time = glfwGetTime();
+                }
+                else {
+                    reverse_playback = false;
+                }
+            }
+
+            // '[' / ']' / Backslash: the clocks restart at the frame on screen
+            if (requested_playback_rate != playback_rate) {
+                double previous_rate = playback_rate;
+                playback_rate = requested_playback_rate;
+                set_playback_rate(playback_rate, scheduler.refresh_period);
+                fprintf(stdout, "Playback rate: %gx\n", playback_rate);
+                trace_instant("playback rate", (int64_t)(playback_rate * 100.0));
+                video_start_time = -1.0;
+                reverse_anchor_pts = displayed_pts;
+                reverse_anchor_time = glfwGetTime();
+                // Slowing down, the queued frames were picked for the faster rate and are too sparse;
+                // back at 1x, audio has to pick up again. Re-sync the decoder at the frame on screen.
+                if ((playback_rate < previous_rate || playback_rate == 1.0) && !showing_cached_frames && video_frame->buf[0]) {
+                    playback_serial = request_seek(displayed_pts);
+                    resync_skip_until = displayed_pts;
+                }
+                present_scheduler_resync(&scheduler);
+            }
+
+            // Going back to forward playback after cached frames: re-sync the decoder at the frame on screen
+            if (showing_cached_frames && !reverse_playback && (!paused || pending_frame_steps > 0)) {
+                set_forward_decoding(true);
+                playback_serial = request_seek(displayed_pts);
+                resync_skip_until = displayed_pts;
+                video_start_time = -1.0;
+                showing_cached_frames = false;
+            }
+
+            PlaybackState new_state = playbackState(reverse_playback);
+            if (new_state != state) {
+                trace_instant(PLAYBACK_STATE_NAMES[new_state]);
+                state = new_state;
+            }
+
+            // No time-stretching: audio is muted at any rate but 1x
+            bool audio_should_pause = paused || reverse_playback || showing_cached_frames || playback_rate != 1.0;
+            if (audio_should_pause != audio_paused) {
+                audio_set_paused(audio_should_pause);
+                audio_paused = audio_should_pause;
+            }
+
+            // --- Reverse playback: frames come from the GOP cache, decoded a GOP ahead ---
+            if (state == PLAYBACK_REVERSE) {
+                double target = reverse_anchor_pts - (glfwGetTime() - reverse_anchor_time) * playback_rate;
+                if (target < 0.0) {
+                    // Reached the start: stay paused on the first frame
+                    reverse_playback = false;
+                    paused = true;
+                    continue;
+                }
+
+                double cached_pts;
+                // Frames and GOPs are those of the item on screen, which the decoder may have left
+                if (frame_cache_lookup(frame_cache, displayed_item, target, max_frame_gap, video_frame, &cached_pts)) {
+                    if (cached_pts != displayed_pts || redraw_requested) {
+                        displayed_pts = cached_pts;
+                        presentFrame(window, video_frame);
+                    }
+                }
+                else if (!request_gop_decode(target, displayed_item)) {
+                    fprintf(stdout, "Reverse playback stopped: playlist item %d is no longer open\n", displayed_item + 1);
+                    reverse_playback = false;
+                    paused = true;
+                    continue;
+                }
+
+                // Prefetch: the previous GOP is decoded while this one plays backwards
+                double gop_start = gop_start_time(displayed_pts, displayed_item);
+                request_gop_decode(gop_start >= 0.0 ? gop_start - estimated_frame_delay * 0.5 : displayed_pts - 1.0, displayed_item);
+
+                present_scheduler_resync(&scheduler);
+                glfwWaitEventsTimeout(estimated_frame_delay * 0.25);
+                continue;
+            }
+
+            // --- Paused: only frame steps change what is on screen ---
+            if (state == PLAYBACK_STEPPING && pending_frame_steps < 0) {
+                double cached_pts;
+                if (frame_cache && frame_cache_lookup_before(frame_cache, displayed_item, displayed_pts, max_frame_gap, video_frame, &cached_pts)) {
+                    displayed_pts = cached_pts;
+                    presentFrame(window, video_frame);
+                    pending_frame_steps++;
+                }
+                else if (frame_cache) {
+                    // Decode the GOP holding the previous frame; the step completes once it is cached
+                    set_forward_decoding(false);
+                    if (!request_gop_decode(displayed_pts - estimated_frame_delay * 0.5, displayed_item)) {
+                        fprintf(stderr, "Can't step back: playlist item %d is no longer open\n", displayed_item + 1);
+                        pending_frame_steps = 0;
+                    }
+                }
+                else {
+                    fprintf(stderr, "Stepping back needs the frame cache (--frame-cache-mb)\n");
+                    pending_frame_steps = 0;
+                }
+                showing_cached_frames = showing_cached_frames || frame_cache != nullptr;
+                present_scheduler_resync(&scheduler);
+                glfwWaitEventsTimeout(pending_frame_steps < 0 ? UNDERRUN_POLL_INTERVAL : FRAME_WAIT_TIMEOUT);
+                continue;
+            }
+            if (state == PLAYBACK_PAUSED) {
+                if (redraw_requested && video_frame->buf[0]) {
+                    render();
+                    glfwSwapBuffers(window);
+                }
+                video_start_time = -1.0; // Restart the clock from the next frame on resume
+                second_field_due = -1.0;
+                present_scheduler_resync(&scheduler);
+                // Nothing changes until a key or window event arrives
+                glfwWaitEvents();
+                continue;
+            }
+
+            // --- 1. Frame Selection ---
+            // Frames are picked for the vblank the next swap lands on. Decoding already happened
+            // on the decoder thread, so dropping a superseded frame costs nothing but the upload we skip.
+            double sleep_time = present_scheduler_sleep_time(&scheduler, glfwGetTime());
+            if (sleep_time > 0.0) {
+                // Driver ignores the swap interval: pace to the predicted vblank ourselves
+                TRACE_SCOPE("vsync sleep");
+                std::this_thread::sleep_for(std::chrono::duration<double>(sleep_time));
+            }
+            double master_clock = glfwGetTime();
+            double target_vsync = present_scheduler_next_vsync(&scheduler, master_clock);
+
+            DecodedFrame* next = peek_decoded_frame();
+
+            // Field-rate deinterlacing: the later field of the frame on screen, unless the next frame is due as well
+            if (second_field_due >= 0.0 && present_scheduler_frame_due(&scheduler, second_field_due, target_vsync)) {
+                second_field_due = -1.0;
+                bool next_due = next && next->serial == playback_serial &&
+                    present_scheduler_frame_due(&scheduler, next->pts / playback_rate + video_start_time, target_vsync);
+                if (!next_due && post_field_rate_active(&post_settings, &post_frame)) {
+                    post_frame.field = 1;
+                    render();
+                    {
+                        TRACE_SCOPE("swap");
+                        glfwSwapBuffers(window);
+                    }
+                    present_scheduler_on_swap(&scheduler, glfwGetTime(), false);
+                    glfwPollEvents();
+                    continue;
+                }
+            }
+
+            if (!next) {
+                int status = decode_thread_status();
+                if (status < 0) {
+                    if (status != AVERROR_EOF) {
+                        fprintf(stderr, "Critical error during decoding. Stopping playback.\n");
+                        ret = status;
+                    }
+                    break;
+                }
+                if (video_frame->buf[0]) {
+                    // Decoder hasn't caught up: the frame on screen stays, redrawn only if the window needs it
+                    trace_instant("underrun");
+                    if (decoder_input_rebuffering()) {
+                        // Network jitter buffer refilling: carry on from the next frame instead of
+                        // dropping everything that arrives late for the old clock
+                        video_start_time = -1.0;
+                    }
+                    if (redraw_requested) {
+                        render();
+                        glfwSwapBuffers(window);
+                        present_scheduler_on_swap(&scheduler, glfwGetTime(), false);
+                    }
+                    present_scheduler_note_idle(&scheduler);
+                }
+                // Woken by the decoder as soon as a frame is queued
+                double wait = FRAME_WAIT_TIMEOUT;
+                if (second_field_due >= 0.0 && second_field_due - glfwGetTime() < wait) {
+                    wait = second_field_due - glfwGetTime();
+                }
+                if (wait > 0.0) {
+                    glfwWaitEventsTimeout(wait);
+                }
+                continue;
+            }
+
+            // Frames queued before the last seek are stale, and so are frames already shown before a re-sync
+            if (next->serial != playback_serial || next->pts <= resync_skip_until) {
+                av_frame_free(&next->frame);
+                pop_decoded_frame();
+                continue;
+            }
+
+            // Initialize the video start time on the very first frame
+            if (video_start_time < 0.0) {
+                // video_start_time = SystemTime (master_clock) - FramePTS / rate
+                // This establishes a sync point: when the first frame (at its PTS) *should* be shown.
+                // A frame is due at video_start_time + pts / rate.
+                video_start_time = master_clock - next->pts / playback_rate;
+            }
+
+            // Audio master: while audio plays, re-anchor the system clock on the audio clock so
+            // video follows it. When there is none (seeking, track ended) the last anchor carries on.
+            double audio_clock;
+            if (playback_rate == 1.0 && audio_get_clock(&audio_clock)) {
+                video_start_time = master_clock - audio_clock;
+            }
+
+            // Stepping forward while paused shows the next frame regardless of the clock
+            bool stepping = paused && pending_frame_steps > 0;
+
+            // A newer frame is also due by the target vblank: this one would never be seen, drop it.
+            DecodedFrame* after = peek_next_decoded_frame();
+            if (!stepping && after && after->serial == playback_serial &&
+                present_scheduler_frame_due(&scheduler, after->pts / playback_rate + video_start_time, target_vsync)) {
+                trace_instant("frame dropped", (int64_t)(next->pts * 1000.0));
+                av_frame_free(&next->frame);
+                pop_decoded_frame();
+                present_scheduler_note_drop(&scheduler);
+                continue;
+            }
+
+            // --- 2. Present on the target vblank: the next frame if it is due ---
+            bool new_frame = stepping || present_scheduler_frame_due(&scheduler, next->pts / playback_rate + video_start_time, target_vsync);
+            if (!new_frame && !redraw_requested) {
+                // Nothing changed on screen: no upload, no draw, no swap. Sleep until half a refresh
+                // before the vblank the next frame (or second field) is due on, or until an event.
+                double half_period = 0.5 * scheduler.refresh_period;
+                double next_due_time = next->pts / playback_rate + video_start_time;
+                if (second_field_due >= 0.0 && second_field_due < next_due_time) {
+                    next_due_time = second_field_due;
+                }
+                double due_vsync = present_scheduler_next_vsync(&scheduler, next_due_time - half_period + 1e-6);
+                double wait = due_vsync - half_period - glfwGetTime();
+                present_scheduler_note_idle(&scheduler);
+                if (wait > 0.0) {
+                    TRACE_SCOPE("idle wait");
+                    glfwWaitEventsTimeout(wait);
+                }
+                continue;
+            }
+            gpuTraceMark(0);
+            if (new_frame) {
+                if (stepping) {
+                    pending_frame_steps--;
+                    present_scheduler_resync(&scheduler);
+                }
+                else {
+                    // Lag feeds the decoder's catch-up controller
+                    report_presentation_lateness(target_vsync - (next->pts / playback_rate + video_start_time));
+                }
+
+                // Take ownership of the frame: video_frame now holds what is on screen.
+                av_frame_unref(video_frame);
+                av_frame_move_ref(video_frame, next->frame);
+                displayed_pts = next->pts;
+                displayed_source_ns = next->source_ns;
+                if (next->playlist_item != displayed_item) {
+                    // Gapless playlist: the first frame of the next item, presented on its vblank like any other
+                    displayed_item = next->playlist_item;
+                    trace_instant("playlist item", displayed_item);
+                    fprintf(stdout, "Now playing (%d/%zu): %s at %.3fs\n", displayed_item + 1, inputs.size(),
+                        inputs[displayed_item].c_str(), displayed_pts);
+                }
+                av_frame_free(&next->frame);
+                pop_decoded_frame();
+
+                updateYUVTexturesFromAVFrame(video_frame);
+                // Field-rate deinterlacing shows the later field half a frame after this one
+                second_field_due = !stepping && post_field_rate_active(&post_settings, &post_frame) ?
+                    displayed_pts / playback_rate + video_start_time + 0.5 * estimated_frame_delay / playback_rate : -1.0;
+            }
+
+            // --- 3. Render (a new frame, or the same one for a damaged window) ---
+            // With a swap interval of 1 the swap waits for the vblank, which paces this loop.
+            gpuTraceMark(1);
+            render();
+            gpuTraceMark(2);
+            {
+                TRACE_SCOPE("swap");
+                glfwSwapBuffers(window);
+            }
+            present_scheduler_on_swap(&scheduler, glfwGetTime(), new_frame);
+            if (new_frame) {
+                startup_first_frame("first frame on screen");
+                audio_record_drift(displayed_pts);
+                report_frame_latency(displayed_source_ns);
+            }
+            glfwPollEvents();
+        }
+
+        recordLoopActivity(state, glfwGetTime(), &loop_time, &loop_renders, &loop_uploads);
+        present_scheduler_print_stats(&scheduler);
+        printLoopActivity();
+    }
+
 cleanup_and_exit:
     // Cleanup
-	cleanup_pbo();
+    stop_decode_thread();
+    cleanup_upload_ring();
+    cleanup_texture_pool();
+    cleanup_shader_variants();
     av_frame_free(&video_frame);
     cleanup_ffmpeg();
+    cleanup_frame_pool();
+    cleanup_gpu_trace();
+    post_process_print_timings();
+    post_process_cleanup();
     glfwTerminate();
-    return 0;
-}
\ No newline at end of file
+    trace_shutdown();
+    return ret < 0 ? ret : 0;
+}
@@ -0,0 +1,808 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include "net_input.h"
+#include "decode_video.h"
+#include "trace.h"
+
+// Target = JITTER_MULTIPLIER x RFC 3550 jitter, or the transit spread if larger, plus the safety margin
+static const double JITTER_MULTIPLIER = 4.0;
+
+// AVIOInterruptCB: blocking network I/O returns at once when the owning input is closed, and the
+// receive thread's read returns when a seek is waiting for the demuxer.
+// `opaque` is the NetInput, set once it exists (nullptr while the input is being opened).
+static int net_interrupt_callback(void* opaque) {
+    const NetInput* net = (const NetInput*)opaque;
+    if (!net) {
+        return 0;
+    }
+    return net->abort_requested.load(std::memory_order_relaxed) ||
+        (net->reading.load(std::memory_order_relaxed) && net->seek_requested.load(std::memory_order_relaxed)) ? 1 : 0;
+}
+
+NetInputOptions default_net_input_options() {
+    NetInputOptions options;
+    memset(&options, 0, sizeof(options));
+    net_input_apply_preset(&options, NET_PRESET_BALANCED);
+    return options;
+}
+
+void net_input_apply_preset(NetInputOptions* options, NetPreset preset) {
+    options->preset = preset;
+    switch (preset) {
+    case NET_PRESET_LOW_LATENCY:
+        options->min_buffer_seconds = 0.04;
+        options->max_buffer_seconds = 0.5;
+        options->safety_seconds = 0.02;
+        options->jitter_window_seconds = 3.0;
+        options->reconnect_attempts = 3;
+        options->reconnect_delay_seconds = 0.25;
+        options->timeout_ms = 2000;
+        break;
+    case NET_PRESET_ROBUST:
+        options->min_buffer_seconds = 1.0;
+        options->max_buffer_seconds = 10.0;
+        options->safety_seconds = 0.5;
+        options->jitter_window_seconds = 30.0;
+        options->reconnect_attempts = -1;
+        options->reconnect_delay_seconds = 1.0;
+        options->timeout_ms = 10000;
+        break;
+    default:
+        options->min_buffer_seconds = 0.2;
+        options->max_buffer_seconds = 3.0;
+        options->safety_seconds = 0.1;
+        options->jitter_window_seconds = 10.0;
+        options->reconnect_attempts = 5;
+        options->reconnect_delay_seconds = 0.5;
+        options->timeout_ms = 5000;
+        break;
+    }
+}
+
+int parse_net_preset(const char* name, NetPreset* out) {
+    if (strcmp(name, "balanced") == 0) {
+        *out = NET_PRESET_BALANCED;
+    }
+    else if (strcmp(name, "low-latency") == 0) {
+        *out = NET_PRESET_LOW_LATENCY;
+    }
+    else if (strcmp(name, "robust") == 0) {
+        *out = NET_PRESET_ROBUST;
+    }
+    else {
+        return -1;
+    }
+    return 0;
+}
+
+int parse_net_impairment(const char* arg, NetInputOptions* options) {
+    double delay_ms = 0.0, jitter_ms = 0.0, loss_percent = 0.0;
+    if (sscanf(arg, "%lf:%lf:%lf", &delay_ms, &jitter_ms, &loss_percent) < 1 ||
+        delay_ms < 0.0 || jitter_ms < 0.0 || loss_percent < 0.0 || loss_percent >= 100.0) {
+        return -1;
+    }
+    options->impair_delay_seconds = delay_ms / 1000.0;
+    options->impair_jitter_seconds = jitter_ms / 1000.0;
+    options->impair_loss = loss_percent / 100.0;
+    return 0;
+}
+
+bool net_input_is_url(const char* path) {
+    return strstr(path, "://") && strncmp(path, "file:", 5) != 0;
+}
+
+bool net_input_impaired(const NetInputOptions* options) {
+    return options->impair_delay_seconds > 0.0 || options->impair_jitter_seconds > 0.0 || options->impair_loss > 0.0;
+}
+
+AVFormatContext* net_input_alloc_context(const NetInputOptions* options) {
+    AVFormatContext* ctx = avformat_alloc_context();
+    if (!ctx) {
+        return nullptr;
+    }
+    ctx->interrupt_callback.callback = net_interrupt_callback;
+    ctx->interrupt_callback.opaque = nullptr;   // net_input_open() points it at the NetInput
+    if (options->preset == NET_PRESET_LOW_LATENCY) {
+        ctx->flags |= AVFMT_FLAG_NOBUFFER; // Don't hold packets back while probing
+    }
+    return ctx;
+}
+
+void net_input_open_options(const char* url, const NetInputOptions* options, AVDictionary** format_opts) {
+    int64_t timeout_us = (int64_t)options->timeout_ms * 1000;
+    av_dict_set_int(format_opts, "rw_timeout", timeout_us, 0);
+    if (strncmp(url, "rtsp://", 7) == 0) {
+        av_dict_set_int(format_opts, "timeout", timeout_us, 0);
+        if (options->preset == NET_PRESET_ROBUST) {
+            av_dict_set(format_opts, "rtsp_transport", "tcp", 0); // No UDP loss, at the cost of latency
+        }
+    }
+}
+
+static double ns_to_seconds(uint64_t ns) {
+    return ns / 1e9;
+}
+
+// Video seconds buffered: from the oldest buffered video packet to the end of the newest
+static double buffered_seconds(const NetInput* net) {
+    const NetPacket* first = nullptr;
+    const NetPacket* last = nullptr;
+    for (const NetPacket& p : net->buffer) {
+        if (!isnan(p.media_seconds)) {
+            first = &p;
+            break;
+        }
+    }
+    for (auto it = net->buffer.rbegin(); first && it != net->buffer.rend(); ++it) {
+        if (!isnan(it->media_seconds)) {
+            last = &*it;
+            break;
+        }
+    }
+    if (!first) {
+        return 0.0;
+    }
+    double duration = last->pkt->duration * av_q2d(net->input->streams[net->video_stream]->time_base);
+    return last->media_seconds - first->media_seconds + duration;
+}
+
+static void free_packets(std::deque<NetPacket>* packets) {
+    for (NetPacket& p : *packets) {
+        av_packet_free(&p.pkt);
+    }
+    packets->clear();
+}
+
+// Forgets the arrival history: the transit times that follow are not comparable (seek,
+// reconnect, or arrivals paced by a full buffer rather than by the network)
+static void reset_arrival_history(NetInput* net) {
+    net->have_transit = false;
+    net->transit_window.clear();
+}
+
+// A video packet arrived: updates the jitter estimate and the buffer target. Under net->mutex.
+static void update_target(NetInput* net, double media_seconds, uint64_t arrival_ns) {
+    double arrival = ns_to_seconds(arrival_ns - net->origin_ns);
+    double transit = arrival - media_seconds;
+    if (net->have_transit) {
+        net->jitter += (fabs(transit - net->last_transit) - net->jitter) / 16.0;
+    }
+    net->have_transit = true;
+    net->last_transit = transit;
+
+    net->transit_window.push_back(std::make_pair(arrival, transit));
+    while (net->transit_window.front().first < arrival - net->options.jitter_window_seconds) {
+        net->transit_window.pop_front();
+    }
+    double min_transit = transit;
+    double max_transit = transit;
+    for (const std::pair<double, double>& sample : net->transit_window) {
+        min_transit = std::min(min_transit, sample.second);
+        max_transit = std::max(max_transit, sample.second);
+    }
+
+    double target = std::max(JITTER_MULTIPLIER * net->jitter, max_transit - min_transit) + net->options.safety_seconds;
+    target = std::min(std::max(target, net->options.min_buffer_seconds), net->options.max_buffer_seconds);
+    net->target_seconds = target;
+    net->target_min = std::min(net->target_min, target);
+    net->target_max = std::max(net->target_max, target);
+}
+
+// Leaves the buffering state once the target is buffered (or nothing more will come). Under net->mutex.
+static void check_buffered(NetInput* net) {
+    if (net->state != NET_BUFFERING) {
+        return;
+    }
+    double depth = buffered_seconds(net);
+    if (depth < net->target_seconds && !(net->eof && net->in_flight.empty())) {
+        return;
+    }
+    net->state = NET_PLAYING;
+    double seconds = ns_to_seconds(trace_now_ns() - net->buffering_start_ns);
+    if (net->rebuffering) {
+        net->rebuffer_seconds += seconds;
+        net->rebuffering = false;
+    }
+    trace_instant("network buffered", (int64_t)(depth * 1000.0));
+    fprintf(stdout, "Network: buffered %.0f ms of video in %.0f ms (target %.0f ms)\n",
+        1000.0 * depth, 1000.0 * seconds, 1000.0 * net->target_seconds);
+}
+
+// A packet reached the buffer. Under net->mutex.
+static void arrive(NetInput* net, const NetPacket& entry, uint64_t arrival_ns) {
+    if (!isnan(entry.media_seconds)) {
+        update_target(net, entry.media_seconds, arrival_ns);
+        NetArrival& slot = net->arrivals[net->arrival_next++ % NET_ARRIVAL_RING];
+        slot.pts = entry.pkt->pts;
+        slot.source_ns = entry.source_ns;
+    }
+    net->buffer.push_back(entry);
+    check_buffered(net);
+    net->data_ready.notify_all();
+}
+
+// Impairment: packets whose simulated arrival time has come. Under net->mutex.
+static void deliver_due(NetInput* net, uint64_t now_ns) {
+    while (!net->in_flight.empty() && net->in_flight.front().deliver_ns <= now_ns) {
+        NetPacket entry = net->in_flight.front();
+        net->in_flight.pop_front();
+        arrive(net, entry, entry.deliver_ns);
+    }
+    if (net->eof && net->in_flight.empty()) {
+        check_buffered(net);
+        net->data_ready.notify_all();
+    }
+}
+
+// Reconnected session: moves the packet onto the input's stream and timeline. Returns false to
+// drop it (stream the input doesn't have, video before the first keyframe of a live session, or a
+// packet of a file that was already received before the connection dropped).
+static bool remap_packet(NetInput* net, AVPacket* pkt) {
+    int target = pkt->stream_index < (int)net->stream_map.size() ? net->stream_map[pkt->stream_index] : -1;
+    if (target < 0) {
+        return false;
+    }
+    if (net->awaiting_keyframe) {
+        // The decoder can only pick the stream up at a keyframe; earlier audio is dropped with it
+        if (target != net->video_stream || !(pkt->flags & AV_PKT_FLAG_KEY)) {
+            return false;
+        }
+        net->awaiting_keyframe = false;
+    }
+
+    AVRational time_base = net->input->streams[target]->time_base;
+    av_packet_rescale_ts(pkt, net->session->streams[pkt->stream_index]->time_base, time_base);
+    pkt->stream_index = target;
+
+    if (!net->live) {
+        // Same file, same timeline: skip up to the last packet received, then carry on
+        int64_t& resume = net->resume_dts[target];
+        if (resume != AV_NOPTS_VALUE) {
+            int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+            if (ts == AV_NOPTS_VALUE || ts <= resume) {
+                return false;
+            }
+            resume = AV_NOPTS_VALUE;
+        }
+        return true;
+    }
+
+    if (net->offset_pending) {
+        // The first packet of the session continues where the last one ended
+        int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        if (ts == AV_NOPTS_VALUE) {
+            return false;
+        }
+        double resume = 0.0;
+        for (double end : net->stream_end_seconds) {
+            if (!isnan(end)) {
+                resume = std::max(resume, end);
+            }
+        }
+        net->session_offset_seconds = resume - ts * av_q2d(time_base);
+        net->offset_pending = false;
+    }
+    int64_t offset = llround(net->session_offset_seconds / av_q2d(time_base));
+    if (pkt->pts != AV_NOPTS_VALUE) {
+        pkt->pts += offset;
+    }
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        pkt->dts += offset;
+    }
+    return true;
+}
+
+// Receive thread: queues a packet just read, through the simulated network when impaired.
+// Takes ownership of the packet's data.
+static void receive_packet(NetInput* net, AVPacket* pkt) {
+    if (net->session != net->input && !remap_packet(net, pkt)) {
+        av_packet_unref(pkt);
+        return;
+    }
+
+    AVStream* stream = net->input->streams[pkt->stream_index];
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    double media = ts != AV_NOPTS_VALUE ? ts * av_q2d(stream->time_base) : NAN;
+    if (ts != AV_NOPTS_VALUE) {
+        net->stream_end_seconds[pkt->stream_index] = media + pkt->duration * av_q2d(stream->time_base);
+        net->last_dts[pkt->stream_index] = ts;
+    }
+
+    NetPacket entry;
+    entry.pkt = av_packet_alloc();
+    if (!entry.pkt) {
+        av_packet_unref(pkt);
+        return;
+    }
+    av_packet_move_ref(entry.pkt, pkt);
+    entry.media_seconds = entry.pkt->stream_index == net->video_stream ? media : NAN;
+    uint64_t now = trace_now_ns();
+    entry.source_ns = now;
+    entry.deliver_ns = now;
+
+    std::lock_guard<std::mutex> lock(net->mutex);
+    net->packets++;
+    net->bytes += entry.pkt->size;
+    if (!net_input_impaired(&net->options)) {
+        arrive(net, entry, now);
+        return;
+    }
+
+    // Simulated network: the source sends in real time (media time), the network delays,
+    // jitters and drops, and arrivals stay in order as over a TCP connection
+    uint64_t send_ns = std::max(now, net->last_send_ns);
+    if (ts != AV_NOPTS_VALUE) {
+        int64_t media_ns = llround(media * 1e9);
+        if (!net->pacing) {
+            net->pacing = true;
+            net->pace_origin_ns = (int64_t)now - media_ns;
+        }
+        send_ns = std::max(send_ns, (uint64_t)std::max(net->pace_origin_ns + media_ns, (int64_t)0));
+    }
+    net->last_send_ns = send_ns;
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    if (uniform(net->rng) < net->options.impair_loss) {
+        net->lost++;
+        av_packet_free(&entry.pkt);
+        return;
+    }
+    double delay = net->options.impair_delay_seconds + uniform(net->rng) * net->options.impair_jitter_seconds;
+    entry.source_ns = send_ns;
+    entry.deliver_ns = std::max(send_ns + (uint64_t)(delay * 1e9), net->last_deliver_ns);
+    net->last_deliver_ns = entry.deliver_ns;
+    net->in_flight.push_back(entry);
+}
+
+// Maps the streams of a new session onto the input's: the n-th stream of each type to the n-th
+// of the same type and codec. Fails if the video stream has no counterpart.
+static int map_session(NetInput* net, AVFormatContext* session, std::vector<int>* map) {
+    map->assign(session->nb_streams, -1);
+    bool have_video = false;
+    for (unsigned int i = 0; i < session->nb_streams; i++) {
+        const AVCodecParameters* par = session->streams[i]->codecpar;
+        int nth = 0;
+        for (unsigned int j = 0; j < i; j++) {
+            nth += session->streams[j]->codecpar->codec_type == par->codec_type;
+        }
+        for (unsigned int j = 0; j < net->input->nb_streams; j++) {
+            const AVCodecParameters* known = net->input->streams[j]->codecpar;
+            if (known->codec_type == par->codec_type && nth-- == 0) {
+                if (known->codec_id == par->codec_id) {
+                    (*map)[i] = (int)j;
+                    have_video |= (int)j == net->video_stream;
+                }
+                break;
+            }
+        }
+    }
+    if (!have_video) {
+        fprintf(stderr, "Network: the reconnected stream has no matching video stream\n");
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+    return 0;
+}
+
+// Receive thread: waits `seconds` unless stopped. Returns false if stopped.
+static bool wait_unless_stopped(NetInput* net, double seconds) {
+    std::unique_lock<std::mutex> lock(net->mutex);
+    net->room_ready.wait_for(lock, std::chrono::duration<double>(seconds), [net] { return net->stop_requested; });
+    return !net->stop_requested;
+}
+
+// Receive thread: reading failed with `error`. Opens a new session with backoff between attempts.
+// Returns 0 once reconnected, or `error` when the attempts ran out (or the input is closing).
+static int reconnect(NetInput* net, int error) {
+    char reason[AV_ERROR_MAX_STRING_SIZE];
+    if (error == AVERROR_EOF) {
+        snprintf(reason, sizeof(reason), "live stream ended");
+    }
+    else {
+        av_strerror(error, reason, sizeof(reason));
+    }
+
+    double delay = net->options.reconnect_delay_seconds;
+    for (int attempt = 1; net->options.reconnect_attempts < 0 || attempt <= net->options.reconnect_attempts; attempt++) {
+        fprintf(stderr, "Network: %s; reconnecting in %.2f s (attempt %d)\n", reason, delay, attempt);
+        trace_instant("network reconnect", attempt);
+        if (!wait_unless_stopped(net, delay)) {
+            return AVERROR_EXIT;
+        }
+        delay = std::min(delay * 2.0, NET_MAX_RECONNECT_DELAY);
+
+        AVFormatContext* session = net_input_alloc_context(&net->options);
+        if (session) {
+            session->interrupt_callback.opaque = net;
+        }
+        AVDictionary* format_opts = nullptr;
+        net_input_open_options(net->url.c_str(), &net->options, &format_opts);
+        int ret = session ? avformat_open_input(&session, net->url.c_str(), nullptr, &format_opts) : AVERROR(ENOMEM);
+        av_dict_free(&format_opts);
+        if (ret >= 0) {
+            ret = avformat_find_stream_info(session, nullptr);
+        }
+        std::vector<int> map;
+        if (ret >= 0) {
+            ret = map_session(net, session, &map);
+        }
+        if (ret >= 0 && !net->live) {
+            // A file starts over at the beginning: go back to the last video packet received
+            int64_t resume;
+            {
+                std::lock_guard<std::mutex> demux_lock(net->demux_mutex); // vs. net_input_seek()
+                resume = net->last_dts[net->video_stream];
+            }
+            int session_video = (int)(std::find(map.begin(), map.end(), net->video_stream) - map.begin());
+            if (resume != AV_NOPTS_VALUE) {
+                AVRational time_base = net->input->streams[net->video_stream]->time_base;
+                int seek_ret = av_seek_frame(session, session_video,
+                    av_rescale_q(resume, time_base, session->streams[session_video]->time_base), AVSEEK_FLAG_BACKWARD);
+                if (seek_ret < 0) {
+                    // Still correct, only slower: everything up to the resume point is read and skipped
+                    fprintf(stderr, "Network: can't seek the reconnected file, reading up to the resume point\n");
+                }
+            }
+        }
+        if (ret < 0) {
+            if (session) {
+                avformat_close_input(&session);
+            }
+            av_strerror(ret, reason, sizeof(reason));
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> demux_lock(net->demux_mutex);
+            if (net->session != net->input) {
+                avformat_close_input(&net->session);
+            }
+            net->session = session;
+            net->stream_map = map;
+            // Live: a new timeline, continued from where the old one ended, from a keyframe.
+            // File: the same timeline; the packets already received are skipped.
+            net->offset_pending = net->live;
+            net->awaiting_keyframe = net->live;
+            net->resume_dts = net->last_dts;
+        }
+        {
+            std::lock_guard<std::mutex> lock(net->mutex);
+            reset_arrival_history(net);
+            net->pacing = false;
+        }
+        net->reconnects++;
+        fprintf(stdout, "Network: reconnected to %s after %d attempt(s)\n", net->url.c_str(), attempt);
+        return 0;
+    }
+    return error;
+}
+
+static void receive_thread_main(NetInput* net) {
+    trace_set_thread_name("network");
+    AVPacket* pkt = av_packet_alloc();
+
+    while (pkt) {
+        {
+            // Wait for room, for a seek after the end, or (impaired) for the next send time
+            std::unique_lock<std::mutex> lock(net->mutex);
+            bool waited_for_room = false;
+            while (!net->stop_requested) {
+                uint64_t now = trace_now_ns();
+                deliver_due(net, now);
+                uint64_t wake_ns = UINT64_MAX;
+                if (net->eof) {
+                    // Nothing to read until a seek
+                }
+                else if (buffered_seconds(net) >= net->options.max_buffer_seconds) {
+                    waited_for_room = true;
+                }
+                else if (net->pacing && net->last_send_ns > now) {
+                    wake_ns = net->last_send_ns;
+                }
+                else {
+                    break;
+                }
+                if (!net->in_flight.empty()) {
+                    wake_ns = std::min(wake_ns, net->in_flight.front().deliver_ns);
+                }
+                if (wake_ns == UINT64_MAX) {
+                    net->room_ready.wait(lock);
+                }
+                else if (wake_ns > now) {
+                    net->room_ready.wait_for(lock, std::chrono::nanoseconds(wake_ns - now));
+                }
+            }
+            if (net->stop_requested) {
+                break;
+            }
+            if (waited_for_room) {
+                reset_arrival_history(net); // The full buffer paced those arrivals, not the network
+            }
+        }
+
+        int ret = AVERROR_EXIT;
+        {
+            std::lock_guard<std::mutex> demux_lock(net->demux_mutex);
+            if (!net->seek_requested.load()) {
+                TRACE_SCOPE("network read");
+                net->reading.store(true);
+                ret = av_read_frame(net->session, pkt);
+                net->reading.store(false);
+            }
+            if (ret >= 0) {
+                receive_packet(net, pkt);
+                continue;
+            }
+        }
+        {
+            std::unique_lock<std::mutex> lock(net->mutex);
+            if (net->seek_requested.load() && !net->stop_requested) {
+                // Interrupted (or skipped) for a seek: not a network error. Read again once it is done.
+                av_packet_unref(pkt);
+                net->room_ready.wait(lock, [net] { return !net->seek_requested.load() || net->stop_requested; });
+                if (!net->stop_requested) {
+                    continue;
+                }
+            }
+            if (net->stop_requested) {
+                break;
+            }
+        }
+
+        if (ret != AVERROR_EOF || net->live) {
+            // Connection lost (or a live stream ended): the buffer keeps playing meanwhile
+            ret = net->options.reconnect_attempts != 0 ? reconnect(net, ret) : ret;
+            if (ret == 0 || ret == AVERROR_EXIT) {
+                continue;
+            }
+            fprintf(stderr, "Network: giving up on %s\n", net->url.c_str());
+        }
+        std::lock_guard<std::mutex> lock(net->mutex);
+        net->eof = true;
+        net->error = ret == AVERROR_EOF ? 0 : ret;
+        check_buffered(net);
+        net->data_ready.notify_all();
+    }
+
+    av_packet_free(&pkt);
+}
+
+NetInput* net_input_open(AVFormatContext* input, const char* url, int video_stream, const NetInputOptions* options) {
+    NetInput* net = new NetInput();
+    net->url = url;
+    net->options = *options;
+    net->input = input;
+    net->session = input;
+    net->video_stream = video_stream;
+    net->live = input->duration == AV_NOPTS_VALUE || input->duration <= 0;
+    net->session_offset_seconds = 0.0;
+    net->offset_pending = false;
+    net->awaiting_keyframe = false;
+    net->stream_end_seconds.assign(input->nb_streams, NAN);
+    net->last_dts.assign(input->nb_streams, AV_NOPTS_VALUE);
+    net->resume_dts.assign(input->nb_streams, AV_NOPTS_VALUE);
+    net->abort_requested = false;
+    net->seek_requested = false;
+    net->reading = false;
+    input->interrupt_callback.opaque = net;
+    net->stop_requested = false;
+    net->wake_pending = false;
+    net->eof = false;
+    net->error = 0;
+    net->state = NET_BUFFERING;
+    net->target_seconds = options->min_buffer_seconds;
+    net->buffering_start_ns = trace_now_ns();
+    net->rebuffering = false;
+    net->have_transit = false;
+    net->last_transit = 0.0;
+    net->jitter = 0.0;
+    net->origin_ns = net->buffering_start_ns;
+    net->rng.seed(1); // Repeatable impairment runs
+    net->pacing = false;
+    net->pace_origin_ns = 0;
+    net->last_send_ns = 0;
+    net->last_deliver_ns = 0;
+    net->arrivals.assign(NET_ARRIVAL_RING, NetArrival{ AV_NOPTS_VALUE, 0 });
+    net->arrival_next = 0;
+    net->packets = 0;
+    net->bytes = 0;
+    net->lost = 0;
+    net->reconnects = 0;
+    net->underruns = 0;
+    net->rebuffer_seconds = 0.0;
+    net->target_min = options->max_buffer_seconds;
+    net->target_max = options->min_buffer_seconds;
+    net->depth_sum = 0.0;
+    net->depth_min = HUGE_VAL;
+    net->depth_samples = 0;
+    net->latency_sum = 0.0;
+    net->latency_max = 0.0;
+    net->latency_samples = 0;
+
+    static const char* PRESET_NAMES[] = { "balanced", "low-latency", "robust" };
+    fprintf(stdout, "Network: %s%s, %s preset (buffer %.0f-%.0f ms, %s)\n", url, net->live ? " (live)" : "",
+        PRESET_NAMES[options->preset], 1000.0 * options->min_buffer_seconds, 1000.0 * options->max_buffer_seconds,
+        options->reconnect_attempts < 0 ? "reconnects forever" : options->reconnect_attempts == 0 ? "no reconnect" : "reconnects on error");
+    if (net_input_impaired(options)) {
+        fprintf(stdout, "Network: simulating %.0f ms delay, %.0f ms jitter, %.1f%% loss (paced at media time)\n",
+            1000.0 * options->impair_delay_seconds, 1000.0 * options->impair_jitter_seconds, 100.0 * options->impair_loss);
+    }
+    net->thread = std::thread(receive_thread_main, net);
+    return net;
+}
+
+// Hands the oldest buffered packet to the decoder. Under net->mutex, buffer not empty.
+static void take_front(NetInput* net, AVPacket* pkt) {
+    NetPacket entry = net->buffer.front();
+    net->buffer.pop_front();
+    av_packet_move_ref(pkt, entry.pkt);
+    av_packet_free(&entry.pkt);
+    net->room_ready.notify_one();
+}
+
+int net_input_read(NetInput* net, AVPacket* pkt) {
+    std::unique_lock<std::mutex> lock(net->mutex);
+    while (true) {
+        if (net->wake_pending) {
+            net->wake_pending = false;
+            return AVERROR(EAGAIN);
+        }
+        bool ended = net->eof && net->in_flight.empty();
+        if (net->state == NET_PLAYING || ended) {
+            if (!net->buffer.empty()) {
+                double depth = buffered_seconds(net);
+                net->depth_sum += depth;
+                net->depth_min = std::min(net->depth_min, depth);
+                net->depth_samples++;
+                take_front(net, pkt);
+                return 0;
+            }
+            if (ended) {
+                return net->error < 0 ? net->error : AVERROR_EOF;
+            }
+            // Ran dry: hold everything back until the target is buffered again
+            net->underruns++;
+            net->state = NET_BUFFERING;
+            net->rebuffering = true;
+            net->buffering_start_ns = trace_now_ns();
+            trace_instant("network underrun");
+            fprintf(stdout, "Network: buffer ran dry, rebuffering to %.0f ms\n", 1000.0 * net->target_seconds);
+        }
+        TRACE_SCOPE("network buffering");
+        net->data_ready.wait(lock);
+    }
+}
+
+int net_input_try_read(NetInput* net, AVPacket* pkt) {
+    std::lock_guard<std::mutex> lock(net->mutex);
+    bool ended = net->eof && net->in_flight.empty();
+    if (net->buffer.empty() || (!ended && (net->state != NET_PLAYING || buffered_seconds(net) <= net->target_seconds))) {
+        return AVERROR(EAGAIN);
+    }
+    take_front(net, pkt);
+    return 0;
+}
+
+void net_input_wake(NetInput* net) {
+    std::lock_guard<std::mutex> lock(net->mutex);
+    net->wake_pending = true;
+    net->data_ready.notify_all();
+}
+
+int net_input_seek(NetInput* net, int stream_index, int64_t timestamp, int flags) {
+    net->seek_requested.store(true); // A read blocked on the network gives up the demuxer
+    std::lock_guard<std::mutex> demux_lock(net->demux_mutex);
+    int ret;
+    if (net->session == net->input) {
+        ret = av_seek_frame(net->input, stream_index, timestamp, flags);
+    }
+    else {
+        // Reconnected: the same position in the session's own timestamps
+        auto it = std::find(net->stream_map.begin(), net->stream_map.end(), stream_index);
+        if (it == net->stream_map.end() || (flags & AVSEEK_FLAG_BYTE)) {
+            ret = AVERROR(ENOSYS);
+        }
+        else {
+            int session_stream = (int)(it - net->stream_map.begin());
+            AVRational time_base = net->input->streams[stream_index]->time_base;
+            int64_t ts = timestamp - llround(net->session_offset_seconds / av_q2d(time_base));
+            ret = av_seek_frame(net->session, session_stream, av_rescale_q(ts, time_base, net->session->streams[session_stream]->time_base), flags);
+        }
+    }
+
+    std::fill(net->last_dts.begin(), net->last_dts.end(), AV_NOPTS_VALUE);
+    std::fill(net->resume_dts.begin(), net->resume_dts.end(), AV_NOPTS_VALUE);
+
+    std::lock_guard<std::mutex> lock(net->mutex);
+    free_packets(&net->buffer);
+    free_packets(&net->in_flight);
+    net->wake_pending = false; // The seek request's wake-up is served by this seek
+    net->seek_requested.store(false);
+    if (ret >= 0) {
+        net->eof = false;
+        net->error = 0;
+    }
+    net->state = NET_BUFFERING;
+    net->rebuffering = false;
+    net->buffering_start_ns = trace_now_ns();
+    reset_arrival_history(net);
+    net->pacing = false;
+    net->last_send_ns = 0;
+    net->last_deliver_ns = 0;
+    net->room_ready.notify_all();
+    return ret;
+}
+
+bool net_input_rebuffering(NetInput* net) {
+    std::lock_guard<std::mutex> lock(net->mutex);
+    return net->state == NET_BUFFERING && net->rebuffering;
+}
+
+uint64_t net_input_source_ns(NetInput* net, int64_t pts) {
+    if (pts == AV_NOPTS_VALUE) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(net->mutex);
+    for (const NetArrival& arrival : net->arrivals) {
+        if (arrival.pts == pts) {
+            return arrival.source_ns;
+        }
+    }
+    return 0;
+}
+
+void net_input_record_latency(NetInput* net, uint64_t source_ns) {
+    double latency = ns_to_seconds(trace_now_ns() - source_ns);
+    std::lock_guard<std::mutex> lock(net->latency_mutex);
+    net->latency_sum += latency;
+    net->latency_max = std::max(net->latency_max, latency);
+    net->latency_samples++;
+}
+
+static void print_net_input_stats(const NetInput* net) {
+    fprintf(stdout, "Network: %lld packet(s), %.1f MB received, %lld reconnect(s)", net->packets, net->bytes / (1024.0 * 1024.0), net->reconnects);
+    if (net_input_impaired(&net->options)) {
+        fprintf(stdout, ", %lld lost (simulated)", net->lost);
+    }
+    fprintf(stdout, "\n");
+    fprintf(stdout, "Network: jitter %.1f ms, buffer target %.0f-%.0f ms, depth %.0f ms on average (min %.0f ms)\n",
+        1000.0 * net->jitter, 1000.0 * std::min(net->target_min, net->target_max), 1000.0 * net->target_max,
+        net->depth_samples > 0 ? 1000.0 * net->depth_sum / net->depth_samples : 0.0,
+        net->depth_samples > 0 ? 1000.0 * net->depth_min : 0.0);
+    fprintf(stdout, "Network: %lld underrun(s), %.2f s rebuffering", net->underruns, net->rebuffer_seconds);
+    if (net->latency_samples > 0) {
+        fprintf(stdout, "; latency %s screen %.0f ms on average, %.0f ms max",
+            net_input_impaired(&net->options) ? "source to" : "arrival to",
+            1000.0 * net->latency_sum / net->latency_samples, 1000.0 * net->latency_max);
+    }
+    fprintf(stdout, "\n");
+}
+
+void net_input_close(NetInput** net_ptr) {
+    if (!net_ptr || !*net_ptr) {
+        return;
+    }
+    NetInput* net = *net_ptr;
+    net->abort_requested.store(true);
+    {
+        std::lock_guard<std::mutex> lock(net->mutex);
+        net->stop_requested = true;
+    }
+    net->room_ready.notify_all();
+    net->data_ready.notify_all();
+    if (net->thread.joinable()) {
+        net->thread.join();
+    }
+    net->input->interrupt_callback.opaque = nullptr; // The input outlives this NetInput
+
+    print_net_input_stats(net);
+    free_packets(&net->buffer);
+    free_packets(&net->in_flight);
+    if (net->session != net->input) {
+        avformat_close_input(&net->session);
+    }
+    delete net;
+    *net_ptr = nullptr;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include<libavformat/avformat.h>
+}
+
+// Network input: a receive thread and an adaptive jitter buffer between the network and the decoder.
+//
+// The receive thread runs av_read_frame() on the input and queues the packets; the decoder thread
+// takes them from the queue instead of reading the demuxer itself, so a slow or stalled network
+// read never blocks decoding of what has already arrived.
+//
+// The buffer starts (and restarts after running dry) in the buffering state: nothing is handed
+// out until it holds `target` seconds of the video stream. The target follows the measured
+// arrival variance: interarrival jitter as in RFC 3550 (the smoothed change in transit time,
+// arrival minus media time) and the spread of transit times over the last jitter_window seconds,
+// plus a safety margin, clamped to [min_buffer, max_buffer].
+//
+// A failed read (or the end of a live stream) reconnects with an exponential backoff. A live
+// session's timestamps are rescaled onto the old streams and continue where they left off, and
+// video resumes at the next keyframe. A file (VOD) is the same content again: the new session
+// seeks back to the last packet received and skips what was already buffered.
+//
+// Impairment (--net-impair) simulates a bad network for testing: packets are paced at their media
+// time like a live source, then delayed, jittered and randomly dropped before they "arrive". End-to-end
+// latency is then measured from that send time; for real sources it is measured from arrival.
+
+// Longest wait between reconnect attempts
+const double NET_MAX_RECONNECT_DELAY = 8.0;
+// Video packets whose arrival time is remembered for the latency of their frames
+const size_t NET_ARRIVAL_RING = 256;
+
+enum NetPreset {
+    NET_PRESET_BALANCED = 0,
+    NET_PRESET_LOW_LATENCY,    // Small buffer, gives up reconnecting quickly
+    NET_PRESET_ROBUST          // Deep buffer, RTSP over TCP, reconnects forever
+};
+
+struct NetInputOptions {
+    NetPreset preset;
+    double min_buffer_seconds;
+    double max_buffer_seconds;      // Also where the receive thread stops reading ahead
+    double safety_seconds;          // Added to the measured jitter
+    double jitter_window_seconds;   // History the transit spread is taken over
+    int reconnect_attempts;         // Per outage; -1 = forever, 0 = off
+    double reconnect_delay_seconds; // First retry; doubles up to NET_MAX_RECONNECT_DELAY
+    int timeout_ms;                 // Network read/connect timeout
+
+    // Simulated network (all 0 = off)
+    double impair_delay_seconds;
+    double impair_jitter_seconds;   // Extra delay, uniform in [0, jitter]
+    double impair_loss;             // Fraction of packets dropped
+};
+
+// Balanced preset, no impairment
+NetInputOptions default_net_input_options();
+// Sets the buffer, reconnect and timeout fields; leaves the impairment alone
+void net_input_apply_preset(NetInputOptions* options, NetPreset preset);
+
+// "low-latency", "balanced" or "robust". Returns -1 if the name is unknown.
+int parse_net_preset(const char* name, NetPreset* out);
+
+// "DELAY_MS[:JITTER_MS[:LOSS_PERCENT]]". Returns -1 if invalid.
+int parse_net_impairment(const char* arg, NetInputOptions* options);
+
+// URLs other than file: go through the network input
+bool net_input_is_url(const char* path);
+bool net_input_impaired(const NetInputOptions* options);
+
+// Prepares the open of a network input: a format context with the interrupt callback (so
+// net_input_close() can abort a blocking read) and the preset's flags, and protocol options
+// (timeouts, RTSP transport) for avformat_open_input().
+AVFormatContext* net_input_alloc_context(const NetInputOptions* options);
+void net_input_open_options(const char* url, const NetInputOptions* options, AVDictionary** format_opts);
+
+enum NetBufferState {
+    NET_BUFFERING = 0,
+    NET_PLAYING
+};
+
+struct NetPacket {
+    AVPacket* pkt;
+    double media_seconds;    // dts of a video packet in seconds, NAN for other streams
+    uint64_t source_ns;      // trace_now_ns() it was sent (impairment) or arrived
+    uint64_t deliver_ns;     // Impairment: when it arrives
+};
+
+// Arrival (source) time of a video packet, for the latency of the frame decoded from it
+struct NetArrival {
+    int64_t pts;
+    uint64_t source_ns;
+};
+
+struct NetInput {
+    std::string url;
+    NetInputOptions options;
+    AVFormatContext* input;          // The opened input; its streams are what the decoder knows
+    AVFormatContext* session;        // Where packets are read from: `input` or a reconnected session
+    int video_stream;
+    bool live;                       // No duration: end of stream means the connection dropped
+
+    // Reconnected session -> `input` streams
+    std::vector<int> stream_map;                // Session stream -> input stream (-1 = dropped)
+    double session_offset_seconds;              // Added to session timestamps (live only)
+    bool offset_pending;                        // Set from the first packet of a new session
+    bool awaiting_keyframe;
+    std::vector<double> stream_end_seconds;     // Per input stream: last dts + duration
+    std::vector<int64_t> last_dts;              // Per input stream: dts of the last packet received
+    std::vector<int64_t> resume_dts;            // VOD reconnect: packets up to this dts are skipped
+
+    std::atomic<bool> abort_requested;          // Interrupts blocking I/O of `input` and sessions
+    std::atomic<bool> seek_requested;           // net_input_seek() waits for the demuxer: interrupts the read
+    std::atomic<bool> reading;                  // Receive thread is in av_read_frame() (under demux_mutex)
+
+    std::thread thread;
+    std::mutex demux_mutex;          // Held around every read and seek of `session`
+    std::mutex mutex;
+    std::condition_variable data_ready;   // Receive thread -> decoder
+    std::condition_variable room_ready;   // Decoder -> receive thread (space, seek, stop)
+    bool stop_requested;
+    bool wake_pending;               // net_input_wake(): the blocked read returns EAGAIN
+    bool eof;
+    int error;                       // Receive failed for good; reported once the buffer is empty
+
+    std::deque<NetPacket> buffer;
+    std::deque<NetPacket> in_flight; // Impairment: sent, not arrived yet
+    NetBufferState state;
+    double target_seconds;
+    uint64_t buffering_start_ns;
+    bool rebuffering;                // Buffering because it ran dry (not at start or after a seek)
+
+    // Arrival variance (video packets)
+    bool have_transit;
+    double last_transit;
+    double jitter;
+    std::deque<std::pair<double, double>> transit_window;  // (arrival, transit), oldest first
+    uint64_t origin_ns;              // Arrival clock zero
+
+    // Impairment
+    std::mt19937 rng;
+    bool pacing;
+    int64_t pace_origin_ns;          // trace_now_ns() at media time 0
+    uint64_t last_send_ns;
+    uint64_t last_deliver_ns;
+
+    std::vector<NetArrival> arrivals;   // Ring of the last NET_ARRIVAL_RING video packets
+    size_t arrival_next;
+
+    // Statistics
+    long long packets;
+    int64_t bytes;
+    long long lost;                  // Impairment drops
+    long long reconnects;
+    long long underruns;
+    double rebuffer_seconds;
+    double target_min;
+    double target_max;
+    double depth_sum;                // Depth sampled at every packet handed to the decoder
+    double depth_min;
+    long long depth_samples;
+    std::mutex latency_mutex;        // Latency is reported by the render thread
+    double latency_sum;
+    double latency_max;
+    long long latency_samples;
+};
+
+// Starts receiving from an input opened with net_input_alloc_context(). `input` stays owned
+// by the caller and must outlive the NetInput. Returns nullptr on failure.
+NetInput* net_input_open(AVFormatContext* input, const char* url, int video_stream, const NetInputOptions* options);
+
+// Decoder thread: the next packet. Blocks while buffering. Returns 0, AVERROR_EOF at the end of
+// the stream, AVERROR(EAGAIN) when woken by net_input_wake(), or the receive error.
+int net_input_read(NetInput* net, AVPacket* pkt);
+
+// Decoder thread: a packet only if the buffer holds more than its target (reading ahead for audio
+// must not eat into the jitter margin). Returns 0 or AVERROR(EAGAIN).
+int net_input_try_read(NetInput* net, AVPacket* pkt);
+
+// Makes a blocked (or the next) net_input_read() return AVERROR(EAGAIN). Any thread.
+void net_input_wake(NetInput* net);
+
+// Decoder thread: av_seek_frame() on the input (timestamps of `input`'s streams). Drops what is
+// buffered and buffers again from the new position. A read blocked on the network is interrupted
+// rather than waited for.
+int net_input_seek(NetInput* net, int stream_index, int64_t timestamp, int flags);
+
+bool net_input_rebuffering(NetInput* net);
+
+// Source time of the video packet with this pts (trace_now_ns() clock), 0 if unknown
+uint64_t net_input_source_ns(NetInput* net, int64_t pts);
+
+// Render thread: a frame with a known source time is on screen
+void net_input_record_latency(NetInput* net, uint64_t source_ns);
+
+// Stops the receive thread, prints the statistics and frees everything but `input`.
+void net_input_close(NetInput** net);
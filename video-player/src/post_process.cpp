@@ -0,0 +1,577 @@
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+
+#include "post_process.h"
+#include "trace.h"
+
+const char* DEINTERLACE_MODE_NAMES[DEINTERLACE_MODE_COUNT] = { "off", "frame", "field" };
+
+enum PostPass {
+    POST_PASS_CONVERT = 0,
+    POST_PASS_DEINTERLACE,
+    POST_PASS_DOWNSCALE,
+    POST_PASS_SHARPEN,
+    POST_PASS_OUTPUT,
+    POST_PASS_COUNT
+};
+static const char* POST_PASS_NAMES[POST_PASS_COUNT] = { "convert", "deinterlace", "downscale", "sharpen", "output" };
+
+struct PostTarget {
+    GLuint fbo;
+    GLuint texture;
+    int width;
+    int height;
+    long long used_in_chain;   // post_chain_runs of the last chain that wrote it
+};
+
+// The converted frame, the one converted before it (the deinterlacer's previous frame), and the
+// pass outputs. Passes pick a target of their size not yet written in this run, so the sizes stay
+// put from frame to frame and nothing is reallocated until the video or viewport size changes.
+static const int POST_SCRATCH_TARGETS = 4;
+static PostTarget post_current = PostTarget();
+static PostTarget post_previous = PostTarget();
+static PostTarget post_scratch[POST_SCRATCH_TARGETS];
+static long long post_converted_upload = -1;    // PostFrame::upload of the frame in post_current
+static bool post_have_previous = false;
+static long long post_chain_runs = 0;
+
+static GLuint post_deinterlace_program = 0;
+static GLuint post_downscale_program = 0;
+static GLuint post_sharpen_program = 0;
+
+// Timer queries: a begin and end timestamp per pass, in a ring of query sets
+static const int POST_TIMING_FRAMES = 8;
+static GLuint post_timing_queries[POST_TIMING_FRAMES][POST_PASS_COUNT * 2];
+static unsigned int post_timing_passes[POST_TIMING_FRAMES];   // Bit per pass recorded in the set
+static bool post_timing_pending[POST_TIMING_FRAMES];
+static int post_timing_next = 0;
+static int post_timing_current = -1;
+static bool post_timing_ready = false;
+static double post_pass_seconds[POST_PASS_COUNT];
+static double post_pass_max_seconds[POST_PASS_COUNT];
+static long long post_pass_runs[POST_PASS_COUNT];
+
+static GLuint quad_vao = 0;
+static PostCompileFunc compile_program = nullptr;
+static PostDrawFrameFunc draw_yuv_frame = nullptr;
+static bool trace_clock_set = false;
+static int64_t trace_clock_offset_ns = 0;   // trace_now_ns() - GL_TIMESTAMP
+
+// Fragment shaders work on texels (texelFetch at gl_FragCoord), so the vertex shader only places the quad
+static const char* vertex_shader_source = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;
+
+void main()
+{
+    gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0);
+}
+)";
+
+static const char* deinterlace_shader_source = R"(
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D cur_tex;
+uniform sampler2D prev_tex;
+uniform int kept_parity;    // Image rows of this parity belong to the field shown
+uniform int second_field;   // The field shown is the later one of the frame
+uniform int has_prev;       // prev_tex holds the previous frame
+
+// Luma change (0-1) under which a pixel counts as still, and over which as moving
+const float MOTION_LOW = 0.02;
+const float MOTION_HIGH = 0.08;
+
+ivec2 size;
+
+// The FBO holds the image bottom-up: image row r is texel row size.y - 1 - r
+vec3 pixel(sampler2D tex, int x, int row)
+{
+    ivec2 p = ivec2(clamp(x, 0, size.x - 1), size.y - 1 - clamp(row, 0, size.y - 1));
+    return texelFetch(tex, p, 0).rgb;
+}
+
+float luma(vec3 c)
+{
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+    size = textureSize(cur_tex, 0);
+    int x = int(gl_FragCoord.x);
+    int row = size.y - 1 - int(gl_FragCoord.y);
+    vec3 here = pixel(cur_tex, x, row);
+    if ((row & 1) == kept_parity) {
+        FragColor = vec4(here, 1.0);
+        return;
+    }
+
+    // Spatial: edge-based line average. Interpolate along the direction (vertical or one of the
+    // diagonals) in which the lines above and below agree best.
+    vec3 above = pixel(cur_tex, x, row - 1);
+    vec3 below = pixel(cur_tex, x, row + 1);
+    vec3 spatial = 0.5 * (above + below);
+    float best = abs(luma(above) - luma(below));
+    for (int d = -1; d <= 1; d += 2) {
+        vec3 a = pixel(cur_tex, x + d, row - 1);
+        vec3 b = pixel(cur_tex, x - d, row + 1);
+        float diff = abs(luma(a) - luma(b));
+        if (diff < best) {
+            best = diff;
+            spatial = 0.5 * (a + b);
+        }
+    }
+    if (has_prev == 0) {
+        FragColor = vec4(spatial, 1.0);
+        return;
+    }
+
+    // Temporal: the missing line from the other field. The earlier field of a frame sits halfway
+    // between the other field of this frame and that of the previous one; the later field is
+    // closest to the other field of this frame.
+    vec3 prev = pixel(prev_tex, x, row);
+    vec3 temporal = second_field != 0 ? here : 0.5 * (here + prev);
+
+    // Motion since the previous frame, on the missing line and on the lines around it
+    float motion = abs(luma(here) - luma(prev));
+    float around = 0.5 * (abs(luma(above) - luma(pixel(prev_tex, x, row - 1))) +
+                          abs(luma(below) - luma(pixel(prev_tex, x, row + 1))));
+    float moving = smoothstep(MOTION_LOW, MOTION_HIGH, max(motion, around));
+    FragColor = vec4(mix(temporal, spatial, moving), 1.0);
+}
+)";
+
+static const char* downscale_shader_source = R"(
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D src_tex;
+uniform int horizontal;     // 1: filter along x, 0: along y
+uniform float scale;        // Source texels per output pixel along the filtered axis (> 1)
+
+const float PI = 3.14159265;
+// Bounds the taps for extreme reductions (64 per pixel)
+const float MAX_RADIUS = 32.0;
+
+float lanczos2(float x)
+{
+    x = abs(x);
+    if (x < 1e-5) {
+        return 1.0;
+    }
+    if (x >= 2.0) {
+        return 0.0;
+    }
+    float px = PI * x;
+    return 2.0 * sin(px) * sin(0.5 * px) / (px * px);
+}
+
+void main()
+{
+    ivec2 size = textureSize(src_tex, 0);
+    ivec2 dst = ivec2(gl_FragCoord.xy);
+    int along = horizontal != 0 ? dst.x : dst.y;
+    int last_texel = (horizontal != 0 ? size.x : size.y) - 1;
+
+    // Source position of the output pixel's center; the 2-lobe kernel covers `scale` texels per lobe
+    float center = (float(along) + 0.5) * scale - 0.5;
+    float radius = min(2.0 * scale, MAX_RADIUS);
+    int first = int(ceil(center - radius));
+    int last = int(floor(center + radius));
+    vec3 sum = vec3(0.0);
+    float weight_sum = 0.0;
+    for (int i = first; i <= last; i++) {
+        float w = lanczos2(2.0 * (float(i) - center) / radius);
+        int t = clamp(i, 0, last_texel);
+        sum += w * texelFetch(src_tex, horizontal != 0 ? ivec2(t, dst.y) : ivec2(dst.x, t), 0).rgb;
+        weight_sum += w;
+    }
+    FragColor = vec4(clamp(sum / weight_sum, 0.0, 1.0), 1.0);
+}
+)";
+
+static const char* sharpen_shader_source = R"(
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D src_tex;
+uniform float amount;
+
+ivec2 size;
+
+vec3 pixel(ivec2 p)
+{
+    return texelFetch(src_tex, clamp(p, ivec2(0), size - 1), 0).rgb;
+}
+
+void main()
+{
+    size = textureSize(src_tex, 0);
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec3 c = pixel(p);
+    // Unsharp mask: the difference from a 3x3 binomial blur is added back
+    vec3 blur = 4.0 * c
+        + 2.0 * (pixel(p + ivec2(1, 0)) + pixel(p - ivec2(1, 0)) + pixel(p + ivec2(0, 1)) + pixel(p - ivec2(0, 1)))
+        + pixel(p + ivec2(1, 1)) + pixel(p - ivec2(1, 1)) + pixel(p + ivec2(1, -1)) + pixel(p - ivec2(1, -1));
+    blur /= 16.0;
+    FragColor = vec4(clamp(c + amount * (c - blur), 0.0, 1.0), 1.0);
+}
+)";
+
+static void check_gl_error(const char* func) {
+    GLenum err;
+    while ((err = glGetError()) != GL_NO_ERROR) {
+        fprintf(stderr, "OpenGL Error (after %s): %d\n", func, err);
+    }
+}
+
+void post_process_init(GLuint vao, PostCompileFunc compile, PostDrawFrameFunc draw_frame) {
+    quad_vao = vao;
+    compile_program = compile;
+    draw_yuv_frame = draw_frame;
+}
+
+void post_process_set_trace_clock(int64_t offset_ns) {
+    trace_clock_offset_ns = offset_ns;
+    trace_clock_set = true;
+}
+
+bool post_deinterlace_active(const PostSettings* settings, const PostFrame* frame) {
+    return settings->deinterlace != DEINTERLACE_OFF && (frame->interlaced || settings->deinterlace_all_frames);
+}
+
+bool post_field_rate_active(const PostSettings* settings, const PostFrame* frame) {
+    return settings->deinterlace == DEINTERLACE_FIELD && post_deinterlace_active(settings, frame);
+}
+
+bool post_process_active(const PostSettings* settings, const PostFrame* frame) {
+    return post_deinterlace_active(settings, frame) || settings->downscale || settings->sharpen > 0.0;
+}
+
+void post_process_print_settings(const PostSettings* settings) {
+    fprintf(stdout, "Post-processing: deinterlace %s%s, downscale %s, sharpen ", DEINTERLACE_MODE_NAMES[settings->deinterlace],
+        settings->deinterlace != DEINTERLACE_OFF && settings->deinterlace_all_frames ? " (all frames)" : "",
+        settings->downscale ? "on" : "off");
+    if (settings->sharpen > 0.0) {
+        fprintf(stdout, "%.2f\n", settings->sharpen);
+    }
+    else {
+        fprintf(stdout, "off\n");
+    }
+}
+
+int parse_deinterlace_mode(const char* name, DeinterlaceMode* out) {
+    for (int i = 0; i < DEINTERLACE_MODE_COUNT; i++) {
+        if (strcmp(name, DEINTERLACE_MODE_NAMES[i]) == 0) {
+            *out = (DeinterlaceMode)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Program for a pass, compiled the first time the pass runs. Returns 0 if compiling failed.
+static GLuint pass_program(GLuint* program, const char* fragment_source) {
+    if (*program == 0) {
+        TRACE_SCOPE("shader compile");
+        *program = compile_program(vertex_shader_source, fragment_source);
+        if (*program == 0) {
+            return 0;
+        }
+        glUseProgram(*program);
+        glUniform1i(glGetUniformLocation(*program, "src_tex"), 0);
+        glUniform1i(glGetUniformLocation(*program, "cur_tex"), 0);
+        glUniform1i(glGetUniformLocation(*program, "prev_tex"), 1);
+    }
+    return *program;
+}
+
+// (Re)allocates the target's texture for the size. RGB10_A2 keeps 10-bit sources intact between
+// passes at the bandwidth of RGBA8. Returns false if the FBO is incomplete.
+static bool ensure_target(PostTarget* target, int width, int height) {
+    if (target->fbo && target->width == width && target->height == height) {
+        return true;
+    }
+    if (!target->fbo) {
+        glGenFramebuffers(1, &target->fbo);
+        glGenTextures(1, &target->texture);
+    }
+    glBindTexture(GL_TEXTURE_2D, target->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, width, height, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture, 0);
+    target->width = width;
+    target->height = height;
+    check_gl_error("post_process ensure_target");
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Post-processing framebuffer %dx%d is incomplete\n", width, height);
+        return false;
+    }
+    return true;
+}
+
+static void delete_target(PostTarget* target) {
+    if (target->fbo) {
+        glDeleteFramebuffers(1, &target->fbo);
+        glDeleteTextures(1, &target->texture);
+    }
+    *target = PostTarget();
+}
+
+// Binds a target for a pass writing width x height: one of that size not written yet in this
+// run, else any target not written yet (reallocated). Never the pass's own source.
+static PostTarget* bind_target(GLuint program, const PostTarget* src, int width, int height) {
+    PostTarget* target = nullptr;
+    for (int i = 0; i < POST_SCRATCH_TARGETS; i++) {
+        PostTarget* t = &post_scratch[i];
+        if (t == src || t->used_in_chain == post_chain_runs) {
+            continue;
+        }
+        if (t->width == width && t->height == height) {
+            target = t;
+            break;
+        }
+        if (!target) {
+            target = t;
+        }
+    }
+    if (!target || !ensure_target(target, width, height)) {
+        return nullptr;
+    }
+    target->used_in_chain = post_chain_runs;
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+    glViewport(0, 0, width, height);
+    glUseProgram(program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, src->texture);
+    return target;
+}
+
+static void draw_quad() {
+    glBindVertexArray(quad_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+static void begin_pass(PostPass pass) {
+    if (post_timing_current >= 0) {
+        glQueryCounter(post_timing_queries[post_timing_current][pass * 2], GL_TIMESTAMP);
+        post_timing_passes[post_timing_current] |= 1u << pass;
+    }
+}
+
+static void end_pass(PostPass pass) {
+    if (post_timing_current >= 0) {
+        glQueryCounter(post_timing_queries[post_timing_current][pass * 2 + 1], GL_TIMESTAMP);
+    }
+}
+
+// Adds up every finished query set, oldest first, and stops at the first one still in flight.
+void post_process_collect_timings() {
+    if (!post_timing_ready) {
+        return;
+    }
+    for (int n = 0; n < POST_TIMING_FRAMES; n++) {
+        int i = (post_timing_next + n) % POST_TIMING_FRAMES;
+        if (!post_timing_pending[i]) {
+            continue;
+        }
+        // The output pass runs last in every set
+        GLint available = 0;
+        glGetQueryObjectiv(post_timing_queries[i][POST_PASS_OUTPUT * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        for (int pass = 0; pass < POST_PASS_COUNT; pass++) {
+            if (!(post_timing_passes[i] & (1u << pass))) {
+                continue;
+            }
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(post_timing_queries[i][pass * 2], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(post_timing_queries[i][pass * 2 + 1], GL_QUERY_RESULT, &end);
+            double seconds = end > begin ? (end - begin) * 1e-9 : 0.0;
+            post_pass_seconds[pass] += seconds;
+            post_pass_runs[pass]++;
+            if (seconds > post_pass_max_seconds[pass]) {
+                post_pass_max_seconds[pass] = seconds;
+            }
+            if (trace_clock_set && end > begin) {
+                trace_gpu_complete(POST_PASS_NAMES[pass], begin + trace_clock_offset_ns, end + trace_clock_offset_ns);
+            }
+        }
+        post_timing_pending[i] = false;
+    }
+}
+
+// Converts the uploaded frame if it hasn't been yet, runs the enabled passes and blits the
+// result into the viewport of the framebuffer bound on entry.
+void post_process_run(const PostSettings* settings, const PostFrame* frame) {
+    GLint draw_fbo = 0, read_fbo = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    if (!post_timing_ready) {
+        glGenQueries(POST_TIMING_FRAMES * POST_PASS_COUNT * 2, &post_timing_queries[0][0]);
+        for (int i = 0; i < POST_TIMING_FRAMES; i++) {
+            post_timing_pending[i] = false;
+        }
+        post_timing_ready = true;
+    }
+    post_process_collect_timings();
+    // A frame goes untimed when every query set is still in flight
+    post_timing_current = post_timing_pending[post_timing_next] ? -1 : post_timing_next;
+    if (post_timing_current >= 0) {
+        post_timing_passes[post_timing_current] = 0;
+    }
+    post_chain_runs++;
+
+    // 1. YUV -> RGB at video resolution, once per uploaded frame. The frame converted before
+    // it is kept for the deinterlacer.
+    bool converted = true;
+    if (post_converted_upload != frame->upload || post_current.width != frame->width || post_current.height != frame->height) {
+        std::swap(post_current, post_previous);
+        post_have_previous = post_converted_upload >= 0 && post_previous.width == frame->width && post_previous.height == frame->height;
+        converted = ensure_target(&post_current, frame->width, frame->height);
+        if (converted) {
+            begin_pass(POST_PASS_CONVERT);
+            glBindFramebuffer(GL_FRAMEBUFFER, post_current.fbo);
+            glViewport(0, 0, frame->width, frame->height);
+            draw_yuv_frame();
+            end_pass(POST_PASS_CONVERT);
+            post_converted_upload = frame->upload;
+        }
+        else {
+            post_converted_upload = -1;
+        }
+    }
+    if (!converted) {
+        // No FBO: draw the frame as it is
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        draw_yuv_frame();
+        post_timing_current = -1;
+        return;
+    }
+    const PostTarget* src = &post_current;
+
+    // 2. Deinterlace, at video resolution
+    GLuint program;
+    if (post_deinterlace_active(settings, frame) && (program = pass_program(&post_deinterlace_program, deinterlace_shader_source)) != 0) {
+        begin_pass(POST_PASS_DEINTERLACE);
+        if (PostTarget* dst = bind_target(program, src, src->width, src->height)) {
+            // Image rows 0, 2, 4... are the top field; the earlier field is the top one when top field first
+            bool top_shown = (frame->field == 0) == frame->top_field_first;
+            glUniform1i(glGetUniformLocation(program, "kept_parity"), top_shown ? 0 : 1);
+            glUniform1i(glGetUniformLocation(program, "second_field"), frame->field);
+            glUniform1i(glGetUniformLocation(program, "has_prev"), post_have_previous ? 1 : 0);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, post_have_previous ? post_previous.texture : src->texture);
+            draw_quad();
+            src = dst;
+        }
+        end_pass(POST_PASS_DEINTERLACE);
+    }
+
+    // 3. Downscale to the viewport, one axis at a time
+    int out_width = viewport[2];
+    int out_height = viewport[3];
+    if (settings->downscale && out_width > 0 && out_height > 0 && (out_width < src->width || out_height < src->height) &&
+        (program = pass_program(&post_downscale_program, downscale_shader_source)) != 0) {
+        begin_pass(POST_PASS_DOWNSCALE);
+        if (out_width < src->width) {
+            float scale = (float)src->width / out_width;
+            if (PostTarget* dst = bind_target(program, src, out_width, src->height)) {
+                glUniform1i(glGetUniformLocation(program, "horizontal"), 1);
+                glUniform1f(glGetUniformLocation(program, "scale"), scale);
+                draw_quad();
+                src = dst;
+            }
+        }
+        if (out_height < src->height) {
+            float scale = (float)src->height / out_height;
+            if (PostTarget* dst = bind_target(program, src, src->width, out_height)) {
+                glUniform1i(glGetUniformLocation(program, "horizontal"), 0);
+                glUniform1f(glGetUniformLocation(program, "scale"), scale);
+                draw_quad();
+                src = dst;
+            }
+        }
+        end_pass(POST_PASS_DOWNSCALE);
+    }
+
+    // 4. Sharpen
+    if (settings->sharpen > 0.0 && (program = pass_program(&post_sharpen_program, sharpen_shader_source)) != 0) {
+        begin_pass(POST_PASS_SHARPEN);
+        if (PostTarget* dst = bind_target(program, src, src->width, src->height)) {
+            glUniform1f(glGetUniformLocation(program, "amount"), (float)settings->sharpen);
+            draw_quad();
+            src = dst;
+        }
+        end_pass(POST_PASS_SHARPEN);
+    }
+
+    // 5. Into the viewport, stretched like the plain draw (bilinear when the size differs)
+    begin_pass(POST_PASS_OUTPUT);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, src->fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+    bool same_size = src->width == viewport[2] && src->height == viewport[3];
+    glBlitFramebuffer(0, 0, src->width, src->height, viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+        GL_COLOR_BUFFER_BIT, same_size ? GL_NEAREST : GL_LINEAR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    end_pass(POST_PASS_OUTPUT);
+    check_gl_error("post_process_run");
+
+    if (post_timing_current >= 0) {
+        post_timing_pending[post_timing_current] = true;
+        post_timing_next = (post_timing_current + 1) % POST_TIMING_FRAMES;
+        post_timing_current = -1;
+    }
+}
+
+void post_process_print_timings() {
+    bool any = false;
+    for (int i = 0; i < POST_PASS_COUNT; i++) {
+        any = any || post_pass_runs[i] > 0;
+    }
+    if (!any) {
+        return;
+    }
+    fprintf(stdout, "Post-processing (GPU): pass          runs    avg ms    max ms\n");
+    for (int i = 0; i < POST_PASS_COUNT; i++) {
+        if (post_pass_runs[i] == 0) {
+            continue;
+        }
+        fprintf(stdout, "Post-processing (GPU): %-11s %8lld  %8.3f  %8.3f\n", POST_PASS_NAMES[i], post_pass_runs[i],
+            1000.0 * post_pass_seconds[i] / post_pass_runs[i], 1000.0 * post_pass_max_seconds[i]);
+    }
+}
+
+void post_process_cleanup() {
+    delete_target(&post_current);
+    delete_target(&post_previous);
+    for (int i = 0; i < POST_SCRATCH_TARGETS; i++) {
+        delete_target(&post_scratch[i]);
+    }
+    GLuint* programs[] = { &post_deinterlace_program, &post_downscale_program, &post_sharpen_program };
+    for (GLuint* program : programs) {
+        if (*program) {
+            glDeleteProgram(*program);
+            *program = 0;
+        }
+    }
+    if (post_timing_ready) {
+        glDeleteQueries(POST_TIMING_FRAMES * POST_PASS_COUNT * 2, &post_timing_queries[0][0]);
+        post_timing_ready = false;
+    }
+    post_converted_upload = -1;
+    trace_clock_set = false;
+}
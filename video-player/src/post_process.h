@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <GL/glew.h>
+
+// GPU post-processing: deinterlace, downscale, sharpen.
+// With any pass enabled, the frame in the YUV textures is converted to RGB into an FBO at video
+// resolution instead of being drawn to the screen, the enabled passes run, each reading the
+// previous pass's output from one FBO and writing the next (ping-pong), and the result is blitted
+// into the viewport of the framebuffer that was bound (window or offscreen target):
+//   deinterlace  motion-adaptive: where the picture is still, the missing lines are woven in from
+//                the neighboring fields; where it moves, they are interpolated from the lines above
+//                and below along the best-matching edge direction. At frame rate one picture per
+//                frame, at field rate each field in turn, the second half a frame later.
+//   downscale    Lanczos-2 filter stretched over the reduction, in two separable passes; only when
+//                the viewport is smaller than the video (bilinear sampling skips texels and aliases).
+//   sharpen      unsharp mask at output resolution
+// Redraws of the same frame (expose, second field) reuse its converted RGB image. Every pass is
+// timed with GL_TIMESTAMP queries, collected a few frames later without waiting; averages are
+// printed by post_process_print_timings() and, with a trace clock set, each pass is a span on
+// the trace's GPU track.
+//
+// Everything here runs on the thread that owns the GL context.
+
+enum DeinterlaceMode {
+    DEINTERLACE_OFF = 0,
+    DEINTERLACE_FRAME,     // One output picture per frame
+    DEINTERLACE_FIELD,     // One per field: 50i plays at 50 pictures per second
+    DEINTERLACE_MODE_COUNT
+};
+extern const char* DEINTERLACE_MODE_NAMES[DEINTERLACE_MODE_COUNT];
+
+const double DEFAULT_SHARPEN_AMOUNT = 0.5;
+
+struct PostSettings {
+    DeinterlaceMode deinterlace;
+    bool deinterlace_all_frames;   // Also frames not flagged interlaced (mis-flagged captures)
+    bool downscale;
+    double sharpen;                // Unsharp mask strength, 0 = off
+};
+
+// The frame in the YUV textures
+struct PostFrame {
+    int width;
+    int height;
+    long long upload;              // Changes with every upload: a new frame to convert
+    bool interlaced;
+    bool top_field_first;
+    int field;                     // 0: the earlier field, 1: the later one (field-rate deinterlacing)
+};
+
+// Draws the YUV textures, converted to RGB, over the viewport of the bound framebuffer
+typedef void (*PostDrawFrameFunc)();
+// Compiles and links a program from vertex and fragment shader sources; 0 on failure
+typedef GLuint (*PostCompileFunc)(const char* vertex_source, const char* fragment_source);
+
+// quad_vao holds a full-viewport quad of 6 vertices (position at location 0). Pass programs are
+// compiled the first time they run, render targets allocated at the sizes they are used at.
+void post_process_init(GLuint quad_vao, PostCompileFunc compile, PostDrawFrameFunc draw_frame);
+
+bool post_deinterlace_active(const PostSettings* settings, const PostFrame* frame);
+// The second field of the frame is shown half a frame after the first
+bool post_field_rate_active(const PostSettings* settings, const PostFrame* frame);
+// Any pass enabled: draw through post_process_run()
+bool post_process_active(const PostSettings* settings, const PostFrame* frame);
+
+// Converts the frame if it hasn't been yet, runs the enabled passes and blits the result into the
+// viewport of the framebuffer bound on entry. Without FBO support the frame is drawn as it is.
+void post_process_run(const PostSettings* settings, const PostFrame* frame);
+
+// Trace clock: GPU timestamps + offset_ns = trace_now_ns(). Pass timings go on the trace's GPU
+// track once it is set; call again whenever the clocks are re-anchored.
+void post_process_set_trace_clock(int64_t offset_ns);
+
+// Adds up the timer queries that have finished (post_process_run() does this every frame).
+void post_process_collect_timings();
+
+void post_process_print_settings(const PostSettings* settings);
+void post_process_print_timings();
+
+// "off", "frame" or "field". Returns -1 if the name is unknown.
+int parse_deinterlace_mode(const char* name, DeinterlaceMode* out);
+
+void post_process_cleanup();
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "present_scheduler.h"
+
+// Phase-locked loop gains: how much of each swap's timing error moves the vblank phase and
+// the period estimate. Small enough that one late swap doesn't pull the schedule.
+static const double VSYNC_PHASE_GAIN = 0.1;
+static const double VSYNC_PERIOD_GAIN = 0.01;
+
+// A swap returning sooner than this fraction of a period after the previous one didn't wait for vblank
+static const double NON_BLOCKING_SWAP_FRACTION = 0.25;
+static const int BLOCKING_SWAP_HISTORY = 8;
+
+static const size_t MAX_CADENCE_SAMPLES = 64;
+
+void present_scheduler_init(PresentScheduler* s, double refresh_hz, double frame_duration, bool simulated) {
+    s->refresh_period = 1.0 / (refresh_hz > 0.0 ? refresh_hz : 60.0);
+    s->frame_duration = frame_duration;
+    s->simulated = simulated;
+    s->last_vsync = 0.0;
+    s->have_vsync = false;
+    s->last_swap_time = 0.0;
+    s->blocking_swaps = BLOCKING_SWAP_HISTORY;
+    s->current_frame_vsyncs = 0;
+    s->have_frame = false;
+    s->vsyncs = 0;
+    s->frames_presented = 0;
+    s->frames_dropped = 0;
+    s->repeated_vsyncs = 0;
+    s->skipped_vsyncs = 0;
+    s->idle_vsyncs = 0;
+    s->idle_before_swap = false;
+    s->jitter_ms.clear();
+    s->cadence.clear();
+}
+
+double present_scheduler_next_vsync(const PresentScheduler* s, double now) {
+    if (!s->have_vsync) {
+        return now;
+    }
+    // First vblank after `now`
+    double periods = floor((now - s->last_vsync) / s->refresh_period) + 1.0;
+    return s->last_vsync + (periods > 1.0 ? periods : 1.0) * s->refresh_period;
+}
+
+bool present_scheduler_frame_due(const PresentScheduler* s, double display_time, double vsync) {
+    // Rounded to the nearest vblank. Exact ties (24 fps on 60 Hz) go to the later one; the
+    // microsecond margin keeps rounding noise in the timestamps from breaking the 3:2 pattern.
+    return display_time < vsync + 0.5 * s->refresh_period - 1e-6;
+}
+
+double present_scheduler_sleep_time(const PresentScheduler* s, double now) {
+    if (s->simulated || s->blocking_swaps > 0 || !s->have_vsync) {
+        return 0.0;
+    }
+    // Swaps don't wait for vblank: pace the loop ourselves, waking just before the next one
+    double remaining = present_scheduler_next_vsync(s, now) - now - 0.001;
+    return remaining > 0.0 ? remaining : 0.0;
+}
+
+// A frame is replaced: check how long it stayed against its share of the cadence
+static void finish_frame(PresentScheduler* s) {
+    if (!s->have_frame) {
+        return;
+    }
+    int allowed = (int)ceil(s->frame_duration / s->refresh_period - 0.001);
+    if (allowed < 1) {
+        allowed = 1;
+    }
+    if (s->current_frame_vsyncs > allowed) {
+        s->repeated_vsyncs += s->current_frame_vsyncs - allowed;
+    }
+    if (s->cadence.size() < MAX_CADENCE_SAMPLES) {
+        s->cadence.push_back(s->current_frame_vsyncs);
+    }
+}
+
+double present_scheduler_on_swap(PresentScheduler* s, double now, bool new_frame) {
+    long long periods = 1;
+
+    if (!s->have_vsync) {
+        s->last_vsync = now;
+        s->have_vsync = true;
+    }
+    else {
+        double elapsed = now - s->last_vsync;
+        periods = llround(elapsed / s->refresh_period);
+        if (periods < 1) {
+            periods = 1;
+        }
+        double predicted = s->last_vsync + periods * s->refresh_period;
+        double jitter = now - predicted;
+
+        s->jitter_ms.push_back((float)(jitter * 1000.0));
+        if (s->idle_before_swap) {
+            s->idle_vsyncs += periods - 1;
+        }
+        else {
+            s->skipped_vsyncs += periods - 1;
+        }
+
+        // Follow the display: nudge the phase, and the period unless this swap was an outlier
+        s->last_vsync = predicted + VSYNC_PHASE_GAIN * jitter;
+        if (fabs(jitter) < 0.25 * s->refresh_period) {
+            s->refresh_period += VSYNC_PERIOD_GAIN * jitter / periods;
+        }
+    }
+
+    if (!s->simulated) {
+        bool blocked = now - s->last_swap_time >= NON_BLOCKING_SWAP_FRACTION * s->refresh_period;
+        s->blocking_swaps = blocked ? std::min(s->blocking_swaps + 1, BLOCKING_SWAP_HISTORY) : std::max(s->blocking_swaps - 1, 0);
+    }
+    s->last_swap_time = now;
+    s->idle_before_swap = false;
+    s->vsyncs += periods;
+
+    if (new_frame) {
+        // Vblanks skipped before this swap still showed the old frame
+        s->current_frame_vsyncs += (int)periods - 1;
+        finish_frame(s);
+        s->current_frame_vsyncs = 1;
+        s->have_frame = true;
+        s->frames_presented++;
+    }
+    else {
+        s->current_frame_vsyncs += (int)periods;
+    }
+    return s->last_vsync;
+}
+
+// Forget the vblank phase and the frame on screen; the next swap starts a new schedule.
+// Used after the loop stopped presenting for a while (pause, seek, reverse playback).
+void present_scheduler_resync(PresentScheduler* s) {
+    s->have_vsync = false;
+    s->have_frame = false;
+    s->current_frame_vsyncs = 0;
+    s->idle_before_swap = false;
+}
+
+void present_scheduler_note_idle(PresentScheduler* s) {
+    s->idle_before_swap = true;
+}
+
+void present_scheduler_note_drop(PresentScheduler* s) {
+    s->frames_dropped++;
+}
+
+void present_scheduler_print_stats(const PresentScheduler* s) {
+    fprintf(stdout, "Presentation: %.3f Hz display, %lld vsyncs, %lld frames presented, %lld dropped, %lld repeated vsyncs, %lld skipped vsyncs, %lld idle vsyncs\n",
+        1.0 / s->refresh_period, s->vsyncs, s->frames_presented, s->frames_dropped, s->repeated_vsyncs, s->skipped_vsyncs, s->idle_vsyncs);
+
+    if (!s->jitter_ms.empty()) {
+        std::vector<float> abs_ms(s->jitter_ms.size());
+        double sum = 0.0;
+        for (size_t i = 0; i < s->jitter_ms.size(); i++) {
+            abs_ms[i] = fabsf(s->jitter_ms[i]);
+            sum += abs_ms[i];
+        }
+        std::sort(abs_ms.begin(), abs_ms.end());
+        fprintf(stdout, "Present jitter: mean |%.2f| ms, p95 |%.2f| ms, max |%.2f| ms\n",
+            sum / abs_ms.size(), abs_ms[(size_t)(0.95 * (abs_ms.size() - 1))], abs_ms.back());
+    }
+
+    if (!s->cadence.empty()) {
+        fprintf(stdout, "Cadence (vsyncs per frame):");
+        for (size_t i = 0; i < s->cadence.size() && i < 24; i++) {
+            fprintf(stdout, " %d", s->cadence[i]);
+        }
+        fprintf(stdout, "%s\n", s->cadence.size() > 24 ? " ..." : "");
+    }
+}
+
+int present_scheduler_simulate(double content_fps, double refresh_hz, int frame_count) {
+    PresentScheduler s;
+    present_scheduler_init(&s, refresh_hz, 1.0 / content_fps, true);
+    fprintf(stdout, "Simulating %d frames at %.3f fps on a %.3f Hz display\n", frame_count, content_fps, refresh_hz);
+
+    // Same selection as the render loop, with frame i due at i / content_fps and the clock
+    // advancing exactly one refresh period per swap.
+    double now = 0.0;
+    int head = 0; // Oldest frame not yet shown
+    while (head < frame_count) {
+        double vsync = present_scheduler_next_vsync(&s, now);
+        while (head + 1 < frame_count && present_scheduler_frame_due(&s, (head + 1) / content_fps, vsync)) {
+            present_scheduler_note_drop(&s);
+            head++;
+        }
+        bool new_frame = present_scheduler_frame_due(&s, head / content_fps, vsync);
+        if (!new_frame && s.have_frame) {
+            // No swap: the loop wakes again halfway to the following vblank
+            present_scheduler_note_idle(&s);
+            now = vsync + 0.5 * s.refresh_period;
+            continue;
+        }
+        now = vsync;
+        if (new_frame) {
+            head++;
+        }
+        present_scheduler_on_swap(&s, vsync, new_frame);
+    }
+
+    present_scheduler_print_stats(&s);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+// Vsync-aware presentation scheduler.
+//
+// With a swap interval of 1 every glfwSwapBuffers() lands on a vblank, so the render loop runs
+// once per refresh. The scheduler tracks the vblank phase from swap completion times (a small
+// phase-locked loop, since reported refresh rates are rounded: 59.94 Hz shows up as 60), predicts
+// the vblank the next swap will land on, and picks frames by that target: a frame is due when its
+// display time is no later than half a refresh period after the vblank. Superseded frames are
+// dropped; when nothing new is due the render loop doesn't swap at all, and the vblanks it lets
+// pass are counted as idle.
+//
+// In simulated mode the clock advances by exactly one period per swap, which makes the cadence
+// deterministic (e.g. 3:2 for 24 fps on 60 Hz) and testable without a display.
+
+struct PresentScheduler {
+    double refresh_period;  // Seconds between vblanks (refined while running)
+    double frame_duration;  // Nominal duration of a content frame
+    bool simulated;
+
+    double last_vsync;      // Estimated time of the vblank the last swap landed on
+    bool have_vsync;
+    double last_swap_time;
+    int blocking_swaps;     // Recent swaps that actually waited for vblank; 0 means vsync is off
+
+    int current_frame_vsyncs; // Vblanks the current frame has been on screen
+    bool have_frame;
+
+    // Statistics
+    long long vsyncs;
+    long long frames_presented;
+    long long frames_dropped;
+    long long repeated_vsyncs;  // Frame held longer than its cadence share (e.g. 4 on 24p@60 instead of 2 or 3)
+    long long skipped_vsyncs;   // Vblanks that passed without a swap landing on them
+    long long idle_vsyncs;      // Vblanks deliberately left without a swap (nothing changed on screen)
+    bool idle_before_swap;      // The gap before the next swap is idle, not skipped
+    std::vector<float> jitter_ms;
+    std::vector<int> cadence;   // Vblanks per presented frame (first frames only, for the report)
+};
+
+void present_scheduler_init(PresentScheduler* s, double refresh_hz, double frame_duration, bool simulated);
+
+// Time of the vblank the next swap is expected to land on.
+double present_scheduler_next_vsync(const PresentScheduler* s, double now);
+
+// Whether a frame with this display time (system clock) should be on screen at `vsync`.
+bool present_scheduler_frame_due(const PresentScheduler* s, double display_time, double vsync);
+
+// Seconds to sleep before rendering when swaps don't block (vsync off in the driver), else 0.
+double present_scheduler_sleep_time(const PresentScheduler* s, double now);
+
+// Call right after each swap. `new_frame` is false when the previous frame was shown again.
+// Returns the time of the vblank the swap landed on.
+double present_scheduler_on_swap(PresentScheduler* s, double now, bool new_frame);
+
+// Forgets the vblank phase and the frame on screen after the loop stopped presenting for a while.
+void present_scheduler_resync(PresentScheduler* s);
+
+// The loop lets vblanks pass without swapping because the frame on screen hasn't changed.
+// The gap before the next swap is then counted as idle rather than skipped; the phase still locks.
+void present_scheduler_note_idle(PresentScheduler* s);
+
+void present_scheduler_note_drop(PresentScheduler* s);
+void present_scheduler_print_stats(const PresentScheduler* s);
+
+// Runs the scheduler on a simulated display: frame_count frames at content_fps shown on a
+// refresh_hz display, idling on vblanks without a new frame like the render loop. Prints the
+// cadence and statistics. Returns 0.
+int present_scheduler_simulate(double content_fps, double refresh_hz, int frame_count);
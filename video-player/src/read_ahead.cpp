@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include<libavutil/mem.h>
+#include<libavutil/error.h>
+}
+
+#include "read_ahead.h"
+#include "trace.h"
+
+// Buffer between our callbacks and the demuxer; reads from the ring are memcpys, so it stays small
+static const int AVIO_BUFFER_SIZE = 64 * 1024;
+
+static const intptr_t INVALID_FILE = -1;
+
+int parse_read_ahead_mode(const char* name, ReadAheadMode* out) {
+    if (strcmp(name, "default") == 0) *out = READ_AHEAD_OFF;
+    else if (strcmp(name, "readahead") == 0) *out = READ_AHEAD_THREAD;
+    else if (strcmp(name, "mmap") == 0) *out = READ_AHEAD_MMAP;
+    else return -1;
+    return 0;
+}
+
+// --- Platform file access ---
+
+static intptr_t open_file(const char* path, int64_t* size_out) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return INVALID_FILE;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return INVALID_FILE;
+    }
+    *size_out = (int64_t)size.QuadPart;
+    return (intptr_t)file;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return INVALID_FILE;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return INVALID_FILE;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    *size_out = (int64_t)st.st_size;
+    return (intptr_t)fd;
+#endif
+}
+
+static void close_file(intptr_t file) {
+#ifdef _WIN32
+    CloseHandle((HANDLE)file);
+#else
+    close((int)file);
+#endif
+}
+
+// Positioned read of up to `size` bytes. Returns the byte count (0 at end of file) or an AVERROR.
+static int64_t read_at(intptr_t file, int64_t offset, uint8_t* dst, size_t size) {
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = (DWORD)(offset & 0xffffffff);
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD got = 0;
+    if (!ReadFile((HANDLE)file, dst, (DWORD)size, &got, &overlapped) && GetLastError() != ERROR_HANDLE_EOF) {
+        return AVERROR(EIO);
+    }
+    return (int64_t)got;
+#else
+    while (true) {
+        ssize_t got = pread((int)file, dst, size, (off_t)offset);
+        if (got >= 0) return (int64_t)got;
+        if (errno != EINTR) return AVERROR(errno);
+    }
+#endif
+}
+
+static const uint8_t* map_file(intptr_t file, int64_t size) {
+    if (size <= 0) return nullptr;
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA((HANDLE)file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) return nullptr;
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // The view keeps the mapping alive
+    return (const uint8_t*)data;
+#else
+    void* data = mmap(nullptr, (size_t)size, PROT_READ, MAP_PRIVATE, (int)file, 0);
+    if (data == MAP_FAILED) return nullptr;
+    madvise(data, (size_t)size, MADV_SEQUENTIAL);
+    return (const uint8_t*)data;
+#endif
+}
+
+static void unmap_file(const uint8_t* data, int64_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, (size_t)size);
+#endif
+}
+
+// Asks the OS to start paging in [offset, offset + size) of the mapping. Windows pages in on demand.
+static void advise_will_need(const uint8_t* data, int64_t offset, int64_t size) {
+#ifdef _WIN32
+    (void)data; (void)offset; (void)size;
+#else
+    // madvise needs a page-aligned start
+    int64_t page = (int64_t)sysconf(_SC_PAGESIZE);
+    int64_t aligned = offset - offset % page;
+    madvise((void*)(data + aligned), (size_t)(size + offset - aligned), MADV_WILLNEED);
+#endif
+}
+
+// --- Prefetch thread ---
+
+static void prefetch_main(ReadAheadFile* f) {
+    trace_set_thread_name("read-ahead");
+    std::unique_lock<std::mutex> lock(f->mutex);
+
+    while (!f->stop_requested) {
+        // Next chunk: up to the next block boundary, never wrapping around the ring
+        int64_t offset = f->window_end;
+        size_t ring_offset = (size_t)(offset % (int64_t)f->ring_size);
+        int64_t size = (int64_t)READ_AHEAD_BLOCK_SIZE - offset % (int64_t)READ_AHEAD_BLOCK_SIZE;
+        if (size > f->file_size - offset) size = f->file_size - offset;
+        if (size > (int64_t)(f->ring_size - ring_offset)) size = (int64_t)(f->ring_size - ring_offset);
+
+        // Wait at end of file, after an error, or while the chunk would overwrite unread data
+        if (size <= 0 || f->io_error != 0 || offset + size - f->read_pos > (int64_t)f->ring_size) {
+            f->room_ready.wait(lock);
+            continue;
+        }
+
+        // The chunk overwrites the oldest bytes in the ring, all of them behind the demuxer
+        if (offset + size - f->window_start > (int64_t)f->ring_size) {
+            f->window_start = offset + size - (int64_t)f->ring_size;
+        }
+        uint64_t generation = f->generation;
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        int64_t got;
+        {
+            TRACE_SCOPE("storage read");
+            got = read_at(f->file, offset, f->ring + ring_offset, (size_t)size);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        f->reads++;
+        f->read_seconds += seconds;
+        if (generation != f->generation) {
+            continue; // A seek moved the window while we were reading
+        }
+        if (got < 0) {
+            f->io_error = (int)got;
+        }
+        else if (got == 0) {
+            f->file_size = offset; // The file shrank under us
+        }
+        else {
+            f->bytes_read += got;
+            f->window_end += got;
+        }
+        f->data_ready.notify_all();
+    }
+}
+
+// --- AVIOContext callbacks (demuxer thread) ---
+
+static int read_packet_thread(ReadAheadFile* f, uint8_t* buf, int buf_size) {
+    std::unique_lock<std::mutex> lock(f->mutex);
+    if (f->read_pos >= f->window_end && f->read_pos < f->file_size && f->io_error == 0) {
+        // Storage is behind the demuxer: this is the stall read-ahead exists to avoid
+        uint64_t stall_start = trace_enabled() ? trace_now_ns() : 0;
+        auto start = std::chrono::steady_clock::now();
+        f->stalls++;
+        f->data_ready.wait(lock, [f] {
+            return f->read_pos < f->window_end || f->read_pos >= f->file_size || f->io_error != 0 || f->stop_requested;
+        });
+        f->stall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (stall_start) {
+            trace_complete("io stall", stall_start, trace_now_ns());
+        }
+    }
+    if (f->read_pos >= f->window_end) {
+        if (f->read_pos >= f->file_size) return AVERROR_EOF;
+        return f->io_error != 0 ? f->io_error : AVERROR(EIO);
+    }
+
+    int64_t available = f->window_end - f->read_pos;
+    f->fill_sum += (double)available / f->ring_size;
+    f->fill_samples++;
+    size_t size = available < buf_size ? (size_t)available : (size_t)buf_size;
+    int64_t pos = f->read_pos;
+    lock.unlock();
+
+    // [read_pos, window_end) is never overwritten by the prefetch thread, so copy without the lock
+    size_t ring_offset = (size_t)(pos % (int64_t)f->ring_size);
+    size_t first = size < f->ring_size - ring_offset ? size : f->ring_size - ring_offset;
+    memcpy(buf, f->ring + ring_offset, first);
+    memcpy(buf + first, f->ring, size - first);
+
+    lock.lock();
+    f->read_pos = pos + (int64_t)size;
+    f->bytes_served += (int64_t)size;
+    f->room_ready.notify_one();
+    return (int)size;
+}
+
+static int read_packet_mmap(ReadAheadFile* f, uint8_t* buf, int buf_size) {
+    if (f->read_pos >= f->file_size) {
+        return AVERROR_EOF;
+    }
+    int64_t available = f->file_size - f->read_pos;
+    size_t size = available < buf_size ? (size_t)available : (size_t)buf_size;
+
+    // Keep the next ring_size bytes on their way into the page cache
+    if (f->read_pos + (int64_t)f->ring_size / 2 > f->advised_until) {
+        int64_t from = f->advised_until > f->read_pos ? f->advised_until : f->read_pos;
+        int64_t until = f->read_pos + (int64_t)f->ring_size;
+        if (until > f->file_size) until = f->file_size;
+        if (until > from) {
+            advise_will_need(f->mapping, from, until - from);
+        }
+        f->advised_until = until;
+    }
+
+    memcpy(buf, f->mapping + f->read_pos, size);
+    f->read_pos += (int64_t)size;
+    f->bytes_served += (int64_t)size;
+    return (int)size;
+}
+
+static int read_packet(void* opaque, uint8_t* buf, int buf_size) {
+    ReadAheadFile* f = (ReadAheadFile*)opaque;
+    return f->mode == READ_AHEAD_MMAP ? read_packet_mmap(f, buf, buf_size) : read_packet_thread(f, buf, buf_size);
+}
+
+static int64_t seek(void* opaque, int64_t offset, int whence) {
+    ReadAheadFile* f = (ReadAheadFile*)opaque;
+    if (whence & AVSEEK_SIZE) {
+        return f->file_size;
+    }
+
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = f->read_pos + offset; break;
+    case SEEK_END: pos = f->file_size + offset; break;
+    default: return AVERROR(EINVAL);
+    }
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    if (f->mode == READ_AHEAD_MMAP) {
+        f->read_pos = pos;
+        f->seeks_in_window++;
+        f->advised_until = 0;
+        return pos;
+    }
+
+    std::lock_guard<std::mutex> lock(f->mutex);
+    if (pos >= f->window_start && pos <= f->window_end) {
+        f->seeks_in_window++;
+    }
+    else {
+        // Outside the buffered window: restart prefetching at the block holding the target
+        f->seeks_refill++;
+        f->generation++;
+        f->window_start = pos - pos % (int64_t)READ_AHEAD_BLOCK_SIZE;
+        f->window_end = f->window_start;
+        f->io_error = 0;
+    }
+    f->read_pos = pos;
+    f->room_ready.notify_one();
+    return pos;
+}
+
+static void stop_prefetch_thread(ReadAheadFile* f) {
+    if (f->thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(f->mutex);
+            f->stop_requested = true;
+        }
+        f->room_ready.notify_all();
+        f->data_ready.notify_all();
+        f->thread.join();
+    }
+}
+
+static void free_read_ahead_file(ReadAheadFile* f) {
+    stop_prefetch_thread(f);
+    if (f->mapping) {
+        unmap_file(f->mapping, f->file_size);
+    }
+    close_file(f->file);
+    delete[] f->ring;
+    delete f;
+}
+
+// --- Public API ---
+
+AVIOContext* read_ahead_open(const char* path, ReadAheadMode mode, int read_ahead_mb) {
+    if (mode == READ_AHEAD_OFF || strstr(path, "://")) {
+        return nullptr;
+    }
+
+    int64_t file_size = 0;
+    intptr_t file = open_file(path, &file_size);
+    if (file == INVALID_FILE) {
+        return nullptr; // avformat_open_input() reports the problem
+    }
+
+    ReadAheadFile* f = new ReadAheadFile();
+    f->path = path;
+    f->mode = mode;
+    f->file_size = file_size;
+    f->file = file;
+    f->mapping = nullptr;
+    f->advised_until = 0;
+    f->ring = nullptr;
+    f->window_start = 0;
+    f->window_end = 0;
+    f->generation = 0;
+    f->io_error = 0;
+    f->stop_requested = false;
+    f->read_pos = 0;
+    f->bytes_read = 0;
+    f->reads = 0;
+    f->read_seconds = 0.0;
+    f->bytes_served = 0;
+    f->stalls = 0;
+    f->stall_seconds = 0.0;
+    f->seeks_in_window = 0;
+    f->seeks_refill = 0;
+    f->fill_sum = 0.0;
+    f->fill_samples = 0;
+
+    // Whole blocks, at least two so one can be read while the demuxer consumes the other
+    size_t blocks = ((size_t)(read_ahead_mb > 0 ? read_ahead_mb : 1) * 1024 * 1024) / READ_AHEAD_BLOCK_SIZE;
+    f->ring_size = (blocks < 2 ? 2 : blocks) * READ_AHEAD_BLOCK_SIZE;
+
+    if (mode == READ_AHEAD_MMAP) {
+        f->mapping = map_file(file, file_size);
+        if (!f->mapping) {
+            fprintf(stderr, "Read-ahead: could not map %s, using the prefetch thread\n", path);
+            f->mode = READ_AHEAD_THREAD;
+        }
+    }
+    if (f->mode == READ_AHEAD_THREAD) {
+        f->ring = new uint8_t[f->ring_size];
+        f->thread = std::thread(prefetch_main, f);
+    }
+
+    uint8_t* buffer = (uint8_t*)av_malloc(AVIO_BUFFER_SIZE);
+    AVIOContext* pb = buffer ? avio_alloc_context(buffer, AVIO_BUFFER_SIZE, 0, f, read_packet, nullptr, seek) : nullptr;
+    if (!pb) {
+        av_free(buffer);
+        fprintf(stderr, "Read-ahead: out of memory\n");
+        free_read_ahead_file(f);
+        return nullptr;
+    }
+
+    if (f->mode == READ_AHEAD_MMAP) {
+        fprintf(stdout, "Read-ahead: %s memory-mapped (%.1f MB), %.0f MB page-in window\n",
+            path, file_size / (1024.0 * 1024.0), f->ring_size / (1024.0 * 1024.0));
+    }
+    else {
+        fprintf(stdout, "Read-ahead: %s (%.1f MB), %.0f MB ring in %zu KB blocks\n",
+            path, file_size / (1024.0 * 1024.0), f->ring_size / (1024.0 * 1024.0), READ_AHEAD_BLOCK_SIZE / 1024);
+    }
+    return pb;
+}
+
+static void print_read_ahead_stats(const ReadAheadFile* f) {
+    const double MB = 1024.0 * 1024.0;
+    if (f->mode == READ_AHEAD_MMAP) {
+        fprintf(stdout, "Read-ahead (mmap): %.1f MB served to the demuxer, %lld seek(s)\n",
+            f->bytes_served / MB, f->seeks_in_window);
+        return;
+    }
+    fprintf(stdout, "Read-ahead: %.1f MB read in %lld block read(s), %.1f MB/s while reading; %.1f MB served to the demuxer\n",
+        f->bytes_read / MB, f->reads, f->read_seconds > 0.0 ? f->bytes_read / MB / f->read_seconds : 0.0, f->bytes_served / MB);
+    fprintf(stdout, "Read-ahead: buffer %.0f%% full on average, %lld stall(s) (%.1f ms), %lld seek(s) in the buffer, %lld refill(s)\n",
+        f->fill_samples > 0 ? 100.0 * f->fill_sum / f->fill_samples : 0.0, f->stalls, 1000.0 * f->stall_seconds,
+        f->seeks_in_window, f->seeks_refill);
+}
+
+void read_ahead_close(AVIOContext** pb) {
+    if (!pb || !*pb) {
+        return;
+    }
+    ReadAheadFile* f = (ReadAheadFile*)(*pb)->opaque;
+    stop_prefetch_thread(f); // The statistics are final once it has stopped
+    print_read_ahead_stats(f);
+    free_read_ahead_file(f);
+
+    // The demuxer may have replaced the buffer we allocated
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+}
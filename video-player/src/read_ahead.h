@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include<libavformat/avformat.h>
+}
+
+// Read-ahead I/O for the demuxer: a custom AVIOContext so av_read_frame() never waits on storage.
+//
+// READ_AHEAD_THREAD: a prefetch thread reads large block-aligned chunks into a ring buffer ahead
+// of the demuxer. The ring holds the file window [window_start, window_end); data behind the read
+// position is kept until the space is needed, so the short backward seeks demuxers do are served
+// from memory. Seeks outside the window restart prefetching at the target block.
+// READ_AHEAD_MMAP: maps the whole file and hints the kernel to page in the read-ahead window.
+// Cheapest for local disks; on network mounts a page fault still blocks, so prefer the thread there.
+//
+// Only plain files use it; URLs (anything with "://") keep FFmpeg's own protocols.
+
+enum ReadAheadMode {
+    READ_AHEAD_OFF = 0,      // FFmpeg's file protocol
+    READ_AHEAD_THREAD,
+    READ_AHEAD_MMAP
+};
+
+const int DEFAULT_READ_AHEAD_MB = 16;
+
+// Storage read size for the prefetch thread; reads start on multiples of it
+const size_t READ_AHEAD_BLOCK_SIZE = 1024 * 1024;
+
+struct ReadAheadFile {
+    std::string path;
+    ReadAheadMode mode;
+    int64_t file_size;
+    intptr_t file;               // fd, or HANDLE on Windows (prefetch thread only)
+
+    // READ_AHEAD_MMAP
+    const uint8_t* mapping;
+    int64_t advised_until;       // End of the range last passed to the read-ahead hint
+
+    // READ_AHEAD_THREAD: file byte p lives at ring[p % ring_size]
+    uint8_t* ring;
+    size_t ring_size;
+    std::mutex mutex;
+    std::condition_variable data_ready;   // Prefetch thread -> demuxer
+    std::condition_variable room_ready;   // Demuxer -> prefetch thread (data consumed or seek)
+    int64_t window_start;
+    int64_t window_end;
+    uint64_t generation;         // Bumped by seeks that leave the window; in-flight reads are discarded
+    int io_error;                // AVERROR of a failed storage read, reported by the next read
+    bool stop_requested;
+    std::thread thread;
+
+    int64_t read_pos;            // Demuxer position (demuxer thread only, published under the mutex)
+
+    // Statistics
+    int64_t bytes_read;          // From storage
+    long long reads;
+    double read_seconds;
+    int64_t bytes_served;        // To the demuxer
+    long long stalls;            // Demuxer reads that had to wait for storage
+    double stall_seconds;
+    long long seeks_in_window;
+    long long seeks_refill;
+    double fill_sum;             // Buffered-ahead fraction, sampled on every demuxer read
+    long long fill_samples;
+};
+
+// "default", "readahead" or "mmap". Returns -1 if the name is unknown.
+int parse_read_ahead_mode(const char* name, ReadAheadMode* out);
+
+// Opens `path` for the demuxer. Returns an AVIOContext for AVFormatContext::pb (set
+// AVFMT_FLAG_CUSTOM_IO), or nullptr if the mode is off, the path is a URL or the file can't be
+// opened; the caller then lets avformat_open_input() open it the usual way.
+AVIOContext* read_ahead_open(const char* path, ReadAheadMode mode, int read_ahead_mb);
+
+// Call after avformat_close_input(): stops prefetching, prints I/O statistics and frees the context.
+void read_ahead_close(AVIOContext** pb);
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "startup_timing.h"
+#include "trace.h"
+
+struct StartupRecord {
+    const char* name;      // String literals only
+    uint64_t start_ns;
+    uint64_t end_ns;       // == start_ns for milestones
+    bool milestone;
+};
+
+static std::mutex startup_mutex;
+static std::vector<StartupRecord> startup_records;
+static uint64_t startup_begin_ns = 0;
+static std::atomic<bool> startup_done(false);  // Timeline printed; nothing more is recorded
+
+void startup_timing_begin() {
+    std::lock_guard<std::mutex> lock(startup_mutex);
+    startup_begin_ns = trace_now_ns();
+    startup_records.clear();
+    startup_done = false;
+}
+
+static void add_record(const char* name, uint64_t start_ns, uint64_t end_ns, bool milestone) {
+    std::lock_guard<std::mutex> lock(startup_mutex);
+    if (startup_done || startup_begin_ns == 0) {
+        return;
+    }
+    if (milestone) {
+        for (const StartupRecord& r : startup_records) {
+            if (r.milestone && strcmp(r.name, name) == 0) {
+                return;
+            }
+        }
+    }
+    StartupRecord record;
+    record.name = name;
+    record.start_ns = start_ns;
+    record.end_ns = end_ns;
+    record.milestone = milestone;
+    startup_records.push_back(record);
+}
+
+void startup_phase(const char* name, uint64_t start_ns) {
+    uint64_t end_ns = trace_now_ns();
+    add_record(name, start_ns, end_ns, false);
+    if (trace_enabled()) {
+        trace_complete(name, start_ns, end_ns);
+    }
+}
+
+void startup_milestone(const char* name) {
+    add_record(name, trace_now_ns(), trace_now_ns(), true);
+    if (trace_enabled()) {
+        trace_instant(name);
+    }
+}
+
+void startup_first_frame(const char* what) {
+    if (startup_done.load(std::memory_order_relaxed)) {
+        return; // Called for every presented frame
+    }
+    startup_milestone(what);
+
+    std::lock_guard<std::mutex> lock(startup_mutex);
+    if (startup_done || startup_begin_ns == 0) {
+        return;
+    }
+    startup_done.store(true);
+
+    std::vector<StartupRecord> records = startup_records;
+    std::stable_sort(records.begin(), records.end(),
+        [](const StartupRecord& a, const StartupRecord& b) { return a.start_ns < b.start_ns; });
+
+    // Time spent in phases on any thread, against the wall-clock span they cover
+    double busy_ms = 0.0;
+    uint64_t last_ns = startup_begin_ns;
+    fprintf(stdout, "Startup timeline (ms since launch):\n");
+    for (const StartupRecord& r : records) {
+        double start_ms = (r.start_ns - startup_begin_ns) / 1e6;
+        double end_ms = (r.end_ns - startup_begin_ns) / 1e6;
+        if (r.milestone) {
+            fprintf(stdout, "  %8.1f            %s\n", start_ms, r.name);
+        }
+        else {
+            fprintf(stdout, "  %8.1f - %8.1f  %-28s %7.1f ms\n", start_ms, end_ms, r.name, end_ms - start_ms);
+            busy_ms += end_ms - start_ms;
+        }
+        last_ns = std::max(last_ns, r.end_ns);
+    }
+    double total_ms = (last_ns - startup_begin_ns) / 1e6;
+    fprintf(stdout, "Time to first frame: %.1f ms (%.1f ms of phases, overlapped where they ran on different threads)\n",
+        total_ms, busy_ms);
+}
+
+StartupScope::StartupScope(const char* phase_name) : name(phase_name), start_ns(trace_now_ns()) {}
+
+StartupScope::~StartupScope() {
+    startup_phase(name, start_ns);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "trace.h"
+
+// Startup instrumentation: time to first frame, split into phases.
+//
+// Phases are recorded by whichever thread runs them (with --fast-start, probing and codec open
+// run next to window and GL setup) as [start, end] on the trace_now_ns() clock, and also go to
+// the trace when --trace is on. startup_first_frame() prints them as a timeline relative to
+// startup_timing_begin(), ending with the time to first frame. Later phases (e.g. opening the
+// next playlist item) are not recorded.
+
+void startup_timing_begin();
+
+// Records a phase that started at start_ns (trace_now_ns()) and ends now.
+void startup_phase(const char* name, uint64_t start_ns);
+
+// Records a point in time (e.g. the first decoded frame). Only the first call per name counts.
+void startup_milestone(const char* name);
+
+// The first frame is visible (on screen, or rendered offscreen): records `what` and prints the timeline.
+void startup_first_frame(const char* what);
+
+// Records the enclosing scope as one startup phase.
+struct StartupScope {
+    const char* name;
+    uint64_t start_ns;
+
+    explicit StartupScope(const char* phase_name);
+    ~StartupScope();
+};
+
+#define STARTUP_SCOPE(name) StartupScope TRACE_CONCAT(startup_scope_, __LINE__)(name)
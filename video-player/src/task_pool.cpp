@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <chrono>
+
+#include "task_pool.h"
+#include "trace.h"
+
+// Index of the pool worker running on this thread, or -1 outside the pool
+static thread_local int current_worker = -1;
+static thread_local const TaskPool* current_pool = nullptr;
+
+static bool pop_own(PoolWorker* worker, PoolTask* out) {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (worker->tasks.empty()) {
+        return false;
+    }
+    *out = worker->tasks.back();
+    worker->tasks.pop_back();
+    return true;
+}
+
+static bool steal(TaskPool* pool, int thief, PoolTask* out) {
+    int count = (int)pool->workers.size();
+    for (int i = 1; i < count; i++) {
+        PoolWorker* victim = pool->workers[(thief + i) % count];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->tasks.empty()) {
+            *out = victim->tasks.front();
+            victim->tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+static void worker_main(TaskPool* pool, int index) {
+    current_worker = index;
+    current_pool = pool;
+    char thread_name[32];
+    snprintf(thread_name, sizeof(thread_name), "pool worker %d", index);
+    trace_set_thread_name(thread_name);
+    PoolWorker* self = pool->workers[index];
+
+    while (!pool->stop_requested.load(std::memory_order_relaxed)) {
+        PoolTask task;
+        bool stolen = false;
+        if (!pop_own(self, &task)) {
+            stolen = steal(pool, index, &task);
+            if (!stolen) {
+                // Nothing anywhere: sleep until a submit. The timeout covers a submit racing the check.
+                std::unique_lock<std::mutex> lock(pool->idle_mutex);
+                pool->idle_cond.wait_for(lock, std::chrono::milliseconds(5), [pool] {
+                    return pool->pending.load() > 0 || pool->stop_requested.load();
+                });
+                continue;
+            }
+        }
+
+        pool->pending.fetch_sub(1);
+        {
+            TRACE_SCOPE(stolen ? "task (stolen)" : "task");
+            task.func(task.arg);
+        }
+        self->executed++;
+        if (stolen) {
+            self->stolen++;
+        }
+    }
+}
+
+TaskPool* task_pool_create(int thread_count) {
+    if (thread_count <= 0) {
+        thread_count = (int)std::thread::hardware_concurrency();
+        if (thread_count <= 0) {
+            thread_count = 4;
+        }
+    }
+
+    TaskPool* pool = new TaskPool();
+    pool->pending = 0;
+    pool->next_external = 0;
+    pool->stop_requested = false;
+    for (int i = 0; i < thread_count; i++) {
+        PoolWorker* worker = new PoolWorker();
+        worker->executed = 0;
+        worker->stolen = 0;
+        pool->workers.push_back(worker);
+    }
+    // Start only once every worker exists: they steal from each other right away
+    for (int i = 0; i < thread_count; i++) {
+        pool->workers[i]->thread = std::thread(worker_main, pool, i);
+    }
+
+    fprintf(stdout, "Task pool: %d worker thread(s)\n", thread_count);
+    return pool;
+}
+
+void task_pool_submit(TaskPool* pool, TaskFunc func, void* arg) {
+    int index = current_pool == pool ? current_worker : -1;
+    if (index < 0) {
+        index = (int)(pool->next_external.fetch_add(1) % pool->workers.size());
+    }
+
+    PoolTask task;
+    task.func = func;
+    task.arg = arg;
+    {
+        std::lock_guard<std::mutex> lock(pool->workers[index]->mutex);
+        pool->workers[index]->tasks.push_back(task);
+    }
+    pool->pending.fetch_add(1);
+    pool->idle_cond.notify_one();
+}
+
+void task_pool_destroy(TaskPool* pool) {
+    if (!pool) {
+        return;
+    }
+    pool->stop_requested.store(true);
+    pool->idle_cond.notify_all();
+    for (PoolWorker* worker : pool->workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    for (PoolWorker* worker : pool->workers) {
+        delete worker;
+    }
+    delete pool;
+}
+
+void task_pool_print_stats(const TaskPool* pool) {
+    long long executed = 0, stolen = 0;
+    for (const PoolWorker* worker : pool->workers) {
+        executed += worker->executed;
+        stolen += worker->stolen;
+    }
+    fprintf(stdout, "Task pool: %zu worker(s), %lld task(s) run, %lld stolen (%.1f%%)\n",
+        pool->workers.size(), executed, stolen, executed > 0 ? 100.0 * stolen / executed : 0.0);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+//
+// Each worker owns a deque: tasks submitted from a worker go to its own deque and are taken
+// newest-first (the data they touch is still in cache), while idle workers steal the oldest
+// task from another worker's deque. Tasks submitted from outside the pool are spread round-robin.
+
+typedef void (*TaskFunc)(void* arg);
+
+struct PoolTask {
+    TaskFunc func;
+    void* arg;
+};
+
+struct PoolWorker {
+    std::mutex mutex;
+    std::deque<PoolTask> tasks;
+    std::thread thread;
+    long long executed;
+    long long stolen;
+};
+
+struct TaskPool {
+    std::vector<PoolWorker*> workers;
+    std::atomic<int> pending;       // Tasks queued in any deque
+    std::atomic<unsigned> next_external;
+    std::atomic<bool> stop_requested;
+
+    // Idle workers sleep here until a task is submitted
+    std::mutex idle_mutex;
+    std::condition_variable idle_cond;
+};
+
+// thread_count <= 0 uses std::thread::hardware_concurrency().
+TaskPool* task_pool_create(int thread_count);
+void task_pool_submit(TaskPool* pool, TaskFunc func, void* arg);
+// Stops the workers; tasks still queued are discarded.
+void task_pool_destroy(TaskPool* pool);
+void task_pool_print_stats(const TaskPool* pool);
@@ -0,0 +1,711 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+extern "C" {
+#include<libavcodec/avcodec.h>
+#include<libavformat/avformat.h>
+#include<libswscale/swscale.h>
+}
+
+#include "thumbnailer.h"
+#include "decode_video.h"
+#include "task_pool.h"
+#include "trace.h"
+
+// Segments per pool worker, so a segment with dense keyframes doesn't leave the other workers idle at the end
+static const int SEGMENTS_PER_WORKER = 2;
+
+// Shorter segments cost more in opening and seeking than they gain in parallelism
+static const double MIN_SEGMENT_SECONDS = 20.0;
+
+// What a directory input contributes; other files in it are ignored
+static const char* VIDEO_EXTENSIONS[] = {
+    "mp4", "m4v", "mov", "mkv", "webm", "avi", "ts", "mts", "m2ts", "flv", "mpg", "mpeg", "wmv", "y4m"
+};
+
+struct ThumbBatch;
+
+struct ThumbTile {
+    double pts;
+    uint8_t* rgb;                // RGB24, tile_stride bytes per row
+};
+
+struct ThumbFile {
+    ThumbBatch* batch;
+    std::string path;
+    std::string name;            // Output base name, unique within the batch
+    int tile_height;
+    int tile_stride;
+    int segment_count;
+    std::atomic<int> segments_left;
+    std::atomic<bool> failed;
+    std::chrono::steady_clock::time_point started;
+
+    std::mutex mutex;            // Guards tiles
+    std::vector<ThumbTile> tiles;
+};
+
+// Keyframes with pts in [start, end) belong to the segment
+struct ThumbSegment {
+    ThumbFile* file;
+    int index;
+    double start;
+    double end;
+};
+
+struct ThumbInput {
+    AVFormatContext* fmt_ctx;
+    AVCodecContext* codec_ctx;
+    int stream_index;
+    AVRational time_base;
+};
+
+struct ThumbBatch {
+    ThumbnailOptions options;
+    TaskPool* pool;
+    std::vector<ThumbFile*> files;
+    std::vector<ThumbSegment*> segments;
+    std::mutex segments_mutex;   // Probe tasks append segments concurrently
+
+    std::mutex mutex;
+    std::condition_variable files_done;
+    int files_left;
+
+    // Statistics
+    std::atomic<long long> tiles_written;
+    std::atomic<long long> keyframes_decoded;
+    std::atomic<long long> packets_skipped;  // Never sent to the decoder
+    std::atomic<int> sheets_written;
+};
+
+ThumbnailOptions default_thumbnail_options() {
+    ThumbnailOptions options;
+    options.tile_width = DEFAULT_THUMB_WIDTH;
+    options.columns = DEFAULT_THUMB_COLUMNS;
+    options.interval = 0.0;
+    options.pool_threads = 0;
+    return options;
+}
+
+// --- Inputs ---
+
+static bool has_video_extension(const std::string& name) {
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string ext = name.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+    for (const char* known : VIDEO_EXTENSIONS) {
+        if (ext == known) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_directory(const std::string& path) {
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+// Video files directly inside `dir`, sorted by name
+static void list_video_files(const std::string& dir, std::vector<std::string>* out) {
+    std::vector<std::string> found;
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &entry);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && has_video_extension(entry.cFileName)) {
+                found.push_back(dir + "\\" + entry.cFileName);
+            }
+        } while (FindNextFileA(find, &entry));
+        FindClose(find);
+    }
+#else
+    DIR* d = opendir(dir.c_str());
+    if (d) {
+        while (struct dirent* entry = readdir(d)) {
+            std::string path = dir + "/" + entry->d_name;
+            if (has_video_extension(entry->d_name) && !is_directory(path)) {
+                found.push_back(path);
+            }
+        }
+        closedir(d);
+    }
+#endif
+    std::sort(found.begin(), found.end());
+    out->insert(out->end(), found.begin(), found.end());
+}
+
+// File name without directory and extension; a numeric suffix keeps names from colliding
+static std::string output_name(const std::string& path, std::vector<std::string>* used) {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0) {
+        name = name.substr(0, dot);
+    }
+    std::string unique = name;
+    for (int n = 2; std::find(used->begin(), used->end(), unique) != used->end(); n++) {
+        unique = name + "-" + std::to_string(n);
+    }
+    used->push_back(unique);
+    return unique;
+}
+
+// Opens the best video stream for keyframe-only decoding
+static int open_thumb_input(const char* path, ThumbInput* in) {
+    in->fmt_ctx = nullptr;
+    in->codec_ctx = nullptr;
+
+    const AVCodec* codec = nullptr;
+    int ret = avformat_open_input(&in->fmt_ctx, path, nullptr, nullptr);
+    if (ret >= 0) {
+        ret = avformat_find_stream_info(in->fmt_ctx, nullptr);
+    }
+    if (ret >= 0) {
+        ret = av_find_best_stream(in->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+        in->stream_index = ret;
+    }
+    if (ret >= 0) {
+        in->codec_ctx = avcodec_alloc_context3(codec);
+        ret = in->codec_ctx ? avcodec_parameters_to_context(in->codec_ctx, in->fmt_ctx->streams[in->stream_index]->codecpar) : AVERROR(ENOMEM);
+    }
+    if (ret >= 0) {
+        // The pool runs one segment per worker; decoder threads would only add latency here
+        in->codec_ctx->thread_count = 1;
+        in->codec_ctx->skip_frame = AVDISCARD_NONKEY;
+        ret = avcodec_open2(in->codec_ctx, codec, nullptr);
+    }
+    if (ret < 0) {
+        avcodec_free_context(&in->codec_ctx);
+        avformat_close_input(&in->fmt_ctx);
+        return ret;
+    }
+
+    // Only the video stream is demuxed; demuxers that honour NONKEY don't even return the other packets
+    for (unsigned i = 0; i < in->fmt_ctx->nb_streams; i++) {
+        in->fmt_ctx->streams[i]->discard = (int)i == in->stream_index ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+    }
+    in->time_base = in->fmt_ctx->streams[in->stream_index]->time_base;
+    return 0;
+}
+
+static void close_thumb_input(ThumbInput* in) {
+    avcodec_free_context(&in->codec_ctx);
+    avformat_close_input(&in->fmt_ctx);
+}
+
+// --- Segment decoding ---
+
+// Downscales one decoded keyframe into a tile of the file's sheet
+static int add_tile(ThumbFile* f, const ThumbInput* in, const AVFrame* frame, SwsContext** sws) {
+    TRACE_SCOPE("thumb scale");
+    int tile_width = f->batch->options.tile_width;
+
+    // Area averaging avoids aliasing at 10x+ reductions; swscale runs it on its SIMD filter kernels
+    *sws = sws_getCachedContext(*sws, frame->width, frame->height, (AVPixelFormat)frame->format,
+        tile_width, f->tile_height, AV_PIX_FMT_RGB24, SWS_AREA, nullptr, nullptr, nullptr);
+    if (!*sws) {
+        return AVERROR(EINVAL);
+    }
+
+    ThumbTile tile;
+    tile.rgb = (uint8_t*)av_malloc((size_t)f->tile_stride * f->tile_height);
+    if (!tile.rgb) {
+        return AVERROR(ENOMEM);
+    }
+    uint8_t* dst[4] = { tile.rgb, nullptr, nullptr, nullptr };
+    int dst_linesize[4] = { f->tile_stride, 0, 0, 0 };
+    sws_scale(*sws, frame->data, frame->linesize, 0, frame->height, dst, dst_linesize);
+
+    int64_t ts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+    tile.pts = ts != AV_NOPTS_VALUE ? ts * av_q2d(in->time_base) : 0.0;
+
+    std::lock_guard<std::mutex> lock(f->mutex);
+    f->tiles.push_back(tile);
+    return 0;
+}
+
+static int64_t seconds_to_ts(double seconds, AVRational time_base) {
+    return (int64_t)(seconds / av_q2d(time_base));
+}
+
+// Demuxes the segment and decodes the keyframes it keeps (receive-before-read, as in decode_video.cpp)
+static int decode_segment(ThumbSegment* seg, ThumbInput* in) {
+    TRACE_SCOPE("thumb segment");
+    ThumbFile* f = seg->file;
+    ThumbBatch* batch = f->batch;
+    double interval = batch->options.interval;
+
+    if (seg->index > 0) {
+        int ret = av_seek_frame(in->fmt_ctx, in->stream_index, seconds_to_ts(seg->start, in->time_base), AVSEEK_FLAG_BACKWARD);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    SwsContext* sws = nullptr;
+    if (!packet || !frame) {
+        av_packet_free(&packet);
+        av_frame_free(&frame);
+        return AVERROR(ENOMEM);
+    }
+
+    int64_t last_bucket = INT64_MIN;
+    long long skipped = 0;
+    bool draining = false;
+    int ret = 0;
+    while (ret >= 0) {
+        ret = avcodec_receive_frame(in->codec_ctx, frame);
+        if (ret == 0) {
+            batch->keyframes_decoded.fetch_add(1);
+            ret = add_tile(f, in, frame, &sws);
+            av_frame_unref(frame);
+            continue;
+        }
+        if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        }
+        if (ret != AVERROR(EAGAIN) || draining) {
+            break;
+        }
+
+        ret = av_read_frame(in->fmt_ctx, packet);
+        if (ret == AVERROR_EOF) {
+            ret = avcodec_send_packet(in->codec_ctx, nullptr);
+            draining = true;
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+        if (packet->stream_index != in->stream_index) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        // Decide from the packet alone, so nothing that won't become a tile reaches the decoder
+        int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        double t = ts * av_q2d(in->time_base);
+        if (!(packet->flags & AV_PKT_FLAG_KEY) || ts == AV_NOPTS_VALUE || t < seg->start) {
+            skipped++;
+            av_packet_unref(packet);
+            continue;
+        }
+        if (t >= seg->end) {
+            av_packet_unref(packet);
+            ret = avcodec_send_packet(in->codec_ctx, nullptr);
+            draining = true;
+            continue;
+        }
+        if (interval > 0.0) {
+            // At most one tile per interval: the first keyframe in each bucket of the timeline
+            int64_t bucket = (int64_t)floor(t / interval);
+            if (bucket <= last_bucket) {
+                skipped++;
+                av_packet_unref(packet);
+                continue;
+            }
+            last_bucket = bucket;
+        }
+
+        TRACE_SCOPE("thumb decode");
+        int send_ret = avcodec_send_packet(in->codec_ctx, packet);
+        av_packet_unref(packet);
+        if (send_ret < 0 && send_ret != AVERROR(EAGAIN)) {
+            print_ffmpeerr(send_ret); // A corrupt keyframe costs a tile, not the file
+        }
+
+        // Jump to the first keyframe of the next bucket instead of demuxing the GOPs in between.
+        // Only keyframes are ever sent, so the decoder needs no flush; if the demuxer can't
+        // seek forward we keep reading sequentially.
+        if (interval > 0.0 && (last_bucket + 1) * interval < seg->end) {
+            int64_t target = seconds_to_ts((last_bucket + 1) * interval, in->time_base);
+            avformat_seek_file(in->fmt_ctx, in->stream_index, target, target, INT64_MAX, 0);
+        }
+    }
+
+    batch->packets_skipped.fetch_add(skipped);
+    sws_freeContext(sws);
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    return ret;
+}
+
+// --- Output ---
+
+static void write_json_string(FILE* f, const std::string& s) {
+    fputc('"', f);
+    for (char c : s) {
+        if ((unsigned char)c < 0x20) {
+            fprintf(f, "\\u%04x", (unsigned char)c);
+            continue;
+        }
+        if (c == '"' || c == '\\') {
+            fputc('\\', f);
+        }
+        fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static int write_index(ThumbFile* file, int columns, int rows) {
+    const ThumbnailOptions& options = file->batch->options;
+    std::string path = options.output_dir + "/" + file->name + ".json";
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "Thumbnails: could not write %s\n", path.c_str());
+        return -1;
+    }
+
+    fprintf(f, "{\n  \"source\": ");
+    write_json_string(f, file->path);
+    fprintf(f, ",\n  \"image\": ");
+    write_json_string(f, file->name + ".png");
+    fprintf(f, ",\n  \"tile_width\": %d,\n  \"tile_height\": %d,\n  \"columns\": %d,\n  \"rows\": %d,\n  \"tiles\": [",
+        options.tile_width, file->tile_height, columns, rows);
+    for (size_t i = 0; i < file->tiles.size(); i++) {
+        fprintf(f, "%s\n    {\"pts\": %.3f, \"column\": %d, \"row\": %d}", i > 0 ? "," : "",
+            file->tiles[i].pts, (int)(i % columns), (int)(i / columns));
+    }
+    fprintf(f, "\n  ]\n}\n");
+    bool ok = ferror(f) == 0;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+static int encode_png(const AVFrame* image, const std::string& path) {
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!codec) {
+        fprintf(stderr, "Thumbnails: this FFmpeg build has no PNG encoder\n");
+        return -1;
+    }
+    AVCodecContext* ctx = avcodec_alloc_context3(codec);
+    AVPacket* packet = av_packet_alloc();
+    int ret = ctx && packet ? 0 : AVERROR(ENOMEM);
+    if (ret >= 0) {
+        ctx->width = image->width;
+        ctx->height = image->height;
+        ctx->pix_fmt = AV_PIX_FMT_RGB24;
+        ctx->time_base = av_make_q(1, 25);
+        ret = avcodec_open2(ctx, codec, nullptr);
+    }
+    if (ret >= 0) {
+        ret = avcodec_send_frame(ctx, image);
+    }
+    if (ret >= 0) {
+        ret = avcodec_receive_packet(ctx, packet);
+    }
+    if (ret >= 0) {
+        FILE* f = fopen(path.c_str(), "wb");
+        bool ok = f && fwrite(packet->data, 1, packet->size, f) == (size_t)packet->size;
+        if (f) {
+            fclose(f);
+        }
+        if (!ok) {
+            fprintf(stderr, "Thumbnails: could not write %s\n", path.c_str());
+            ret = -1;
+        }
+    }
+    else {
+        print_ffmpeerr(ret);
+    }
+    av_packet_free(&packet);
+    avcodec_free_context(&ctx);
+    return ret;
+}
+
+// Orders the tiles, drops the duplicates segment boundaries can produce, and writes the sheet and index
+static int write_sheet(ThumbFile* file) {
+    TRACE_SCOPE("thumb sheet");
+    const ThumbnailOptions& options = file->batch->options;
+    std::vector<ThumbTile>& tiles = file->tiles;
+
+    std::sort(tiles.begin(), tiles.end(), [](const ThumbTile& a, const ThumbTile& b) { return a.pts < b.pts; });
+    size_t kept = 0;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        bool duplicate = kept > 0 && (options.interval > 0.0
+            ? floor(tiles[i].pts / options.interval) == floor(tiles[kept - 1].pts / options.interval)
+            : tiles[i].pts == tiles[kept - 1].pts);
+        if (duplicate) {
+            av_free(tiles[i].rgb);
+        }
+        else {
+            tiles[kept++] = tiles[i];
+        }
+    }
+    tiles.resize(kept);
+    if (tiles.empty()) {
+        fprintf(stderr, "Thumbnails: no keyframes decoded from %s\n", file->path.c_str());
+        return -1;
+    }
+
+    int count = (int)tiles.size();
+    int columns = std::min(options.columns, count);
+    int rows = (count + columns - 1) / columns;
+    size_t row_bytes = (size_t)options.tile_width * 3;
+
+    AVFrame* image = av_frame_alloc();
+    int ret = image ? 0 : AVERROR(ENOMEM);
+    if (ret >= 0) {
+        image->format = AV_PIX_FMT_RGB24;
+        image->width = columns * options.tile_width;
+        image->height = rows * file->tile_height;
+        ret = av_frame_get_buffer(image, 0);
+    }
+    if (ret >= 0) {
+        // Unused cells of the last row stay black
+        for (int y = 0; y < image->height; y++) {
+            memset(image->data[0] + (size_t)y * image->linesize[0], 0, (size_t)image->width * 3);
+        }
+        for (int i = 0; i < count; i++) {
+            uint8_t* cell = image->data[0] + (size_t)(i / columns) * file->tile_height * image->linesize[0] + (i % columns) * row_bytes;
+            for (int y = 0; y < file->tile_height; y++) {
+                memcpy(cell + (size_t)y * image->linesize[0], tiles[i].rgb + (size_t)y * file->tile_stride, row_bytes);
+            }
+        }
+        ret = encode_png(image, options.output_dir + "/" + file->name + ".png");
+    }
+    else {
+        print_ffmpeerr(ret);
+    }
+    av_frame_free(&image);
+
+    if (ret >= 0) {
+        ret = write_index(file, columns, rows);
+    }
+    return ret;
+}
+
+static void free_tiles(ThumbFile* file) {
+    for (ThumbTile& tile : file->tiles) {
+        av_free(tile.rgb);
+    }
+    file->tiles.clear();
+}
+
+// --- Tasks ---
+
+static void finish_file(ThumbFile* file) {
+    ThumbBatch* batch = file->batch;
+    if (!file->failed.load()) {
+        if (write_sheet(file) >= 0) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - file->started).count();
+            fprintf(stdout, "Thumbnails: %s: %d tile(s) from %d segment(s) in %.2f s -> %s.png\n",
+                file->path.c_str(), (int)file->tiles.size(), file->segment_count, seconds, file->name.c_str());
+            batch->tiles_written.fetch_add((long long)file->tiles.size());
+            batch->sheets_written.fetch_add(1);
+        }
+    }
+    free_tiles(file);
+
+    std::lock_guard<std::mutex> lock(batch->mutex);
+    batch->files_left--;
+    batch->files_done.notify_all();
+}
+
+// Decodes the segment and closes its input
+static void run_segment(ThumbSegment* seg, ThumbInput* in) {
+    ThumbFile* file = seg->file;
+    int ret = decode_segment(seg, in);
+    close_thumb_input(in);
+    if (ret < 0) {
+        fprintf(stderr, "Thumbnails: %s segment %d failed: ", file->path.c_str(), seg->index);
+        print_ffmpeerr(ret);
+        file->failed.store(true);
+    }
+    // The last segment to finish writes the file's outputs
+    if (file->segments_left.fetch_sub(1) == 1) {
+        finish_file(file);
+    }
+}
+
+static void segment_task(void* arg) {
+    ThumbSegment* seg = (ThumbSegment*)arg;
+    ThumbInput in;
+    int ret = open_thumb_input(seg->file->path.c_str(), &in);
+    if (ret < 0) {
+        fprintf(stderr, "Thumbnails: could not reopen %s: ", seg->file->path.c_str());
+        print_ffmpeerr(ret);
+        seg->file->failed.store(true);
+        if (seg->file->segments_left.fetch_sub(1) == 1) {
+            finish_file(seg->file);
+        }
+        return;
+    }
+    run_segment(seg, &in);
+}
+
+// Opens a file, splits it into segments, queues all but the first and decodes the first itself
+static void probe_task(void* arg) {
+    ThumbFile* file = (ThumbFile*)arg;
+    ThumbBatch* batch = file->batch;
+    file->started = std::chrono::steady_clock::now();
+
+    ThumbInput in;
+    int ret = open_thumb_input(file->path.c_str(), &in);
+    if (ret < 0) {
+        fprintf(stderr, "Thumbnails: could not open %s: ", file->path.c_str());
+        print_ffmpeerr(ret);
+        file->failed.store(true);
+        finish_file(file);
+        return;
+    }
+
+    if (in.codec_ctx->width <= 0 || in.codec_ctx->height <= 0) {
+        // Stream parameters weren't probed: no size to scale the tiles from
+        fprintf(stderr, "Thumbnails: %s has no video frame size\n", file->path.c_str());
+        close_thumb_input(&in);
+        file->failed.store(true);
+        finish_file(file);
+        return;
+    }
+
+    AVStream* stream = in.fmt_ctx->streams[in.stream_index];
+    int tile_width = batch->options.tile_width;
+    AVRational sar = av_guess_sample_aspect_ratio(in.fmt_ctx, stream, nullptr);
+    double aspect = (double)in.codec_ctx->width / in.codec_ctx->height;
+    if (sar.num > 0 && sar.den > 0) {
+        aspect *= av_q2d(sar);
+    }
+    file->tile_height = std::max(2, (int)(tile_width / aspect + 0.5) & ~1);
+    file->tile_stride = (tile_width * 3 + 31) & ~31;
+
+    // Stream timeline covered by the file
+    double start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time * av_q2d(in.time_base) : 0.0;
+    double duration = stream->duration != AV_NOPTS_VALUE ? stream->duration * av_q2d(in.time_base)
+        : in.fmt_ctx->duration != AV_NOPTS_VALUE ? (double)in.fmt_ctx->duration / AV_TIME_BASE : 0.0;
+
+    int workers = (int)batch->pool->workers.size();
+    int segments = std::max(1, workers * SEGMENTS_PER_WORKER / (int)batch->files.size());
+    segments = std::min(segments, std::max(1, (int)(duration / MIN_SEGMENT_SECONDS)));
+
+    std::vector<ThumbSegment*> created;
+    for (int i = 0; i < segments; i++) {
+        ThumbSegment* seg = new ThumbSegment();
+        seg->file = file;
+        seg->index = i;
+        seg->start = i == 0 ? -INFINITY : start + duration * i / segments;
+        seg->end = i == segments - 1 ? INFINITY : start + duration * (i + 1) / segments;
+        created.push_back(seg);
+    }
+    {
+        std::lock_guard<std::mutex> lock(batch->segments_mutex);
+        batch->segments.insert(batch->segments.end(), created.begin(), created.end());
+    }
+    file->segment_count = segments;
+    file->segments_left = segments;
+
+    // Submitted from a worker, so they land on this worker's deque and idle workers steal them
+    for (int i = 1; i < segments; i++) {
+        task_pool_submit(batch->pool, segment_task, created[i]);
+    }
+    run_segment(created[0], &in);
+}
+
+int run_thumbnails(const std::vector<std::string>& inputs, const ThumbnailOptions& options) {
+    if (options.tile_width < 2 || options.columns < 1 || options.interval < 0.0) {
+        fprintf(stderr, "Thumbnails: invalid tile width, column count or interval\n");
+        return -1;
+    }
+    if (!is_directory(options.output_dir)) {
+        fprintf(stderr, "Thumbnails: output directory %s does not exist\n", options.output_dir.c_str());
+        return -1;
+    }
+
+    std::vector<std::string> paths;
+    for (const std::string& input : inputs) {
+        if (is_directory(input)) {
+            list_video_files(input, &paths);
+        }
+        else {
+            paths.push_back(input);
+        }
+    }
+    if (paths.empty()) {
+        fprintf(stderr, "Thumbnails: no video files in the inputs\n");
+        return -1;
+    }
+
+    ThumbBatch* batch = new ThumbBatch();
+    batch->options = options;
+    batch->files_left = (int)paths.size();
+    batch->tiles_written = 0;
+    batch->keyframes_decoded = 0;
+    batch->packets_skipped = 0;
+    batch->sheets_written = 0;
+
+    std::vector<std::string> used_names;
+    for (const std::string& path : paths) {
+        ThumbFile* file = new ThumbFile();
+        file->batch = batch;
+        file->path = path;
+        file->name = output_name(path, &used_names);
+        file->tile_height = 0;
+        file->tile_stride = 0;
+        file->segment_count = 0;
+        file->segments_left = 0;
+        file->failed = false;
+        batch->files.push_back(file);
+    }
+
+    batch->pool = task_pool_create(options.pool_threads);
+    fprintf(stdout, "Thumbnails: %d file(s) on %d worker(s), %dpx tiles, %s\n", (int)paths.size(),
+        (int)batch->pool->workers.size(), options.tile_width, options.interval > 0.0 ? "interval-limited" : "every keyframe");
+
+    auto start = std::chrono::steady_clock::now();
+    for (ThumbFile* file : batch->files) {
+        task_pool_submit(batch->pool, probe_task, file);
+    }
+    {
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->files_done.wait(lock, [batch] { return batch->files_left == 0; });
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long long tiles = batch->tiles_written.load();
+    long long keyframes = batch->keyframes_decoded.load();
+    int sheets = batch->sheets_written.load();
+    fprintf(stdout, "Thumbnails: %d of %d file(s), %lld tile(s) in %.2f s = %.1f thumbnails/s "
+        "(%lld keyframes decoded = %.1f/s, %lld packets skipped before decode, %d segment(s))\n",
+        sheets, (int)paths.size(), tiles, seconds, seconds > 0.0 ? tiles / seconds : 0.0,
+        keyframes, seconds > 0.0 ? keyframes / seconds : 0.0, batch->packets_skipped.load(), (int)batch->segments.size());
+    task_pool_print_stats(batch->pool);
+
+    task_pool_destroy(batch->pool);
+    for (ThumbSegment* seg : batch->segments) {
+        delete seg;
+    }
+    for (ThumbFile* file : batch->files) {
+        delete file;
+    }
+    delete batch;
+    return sheets > 0 ? 0 : -1;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Batch thumbnail / contact-sheet generation: no window, no GL, no playback.
+//
+// Only keyframes are decoded. Non-key packets are dropped before they reach the decoder and
+// skip_frame = AVDISCARD_NONKEY covers whatever a demuxer mislabels. Every input is split into
+// time segments that are decoded in parallel on the work-stealing pool (a single long file uses
+// every core; a directory of short files runs one file per worker), each kept keyframe is
+// downscaled to one tile with libswscale's SIMD filters, and a file's tiles are written as:
+//   <out>/<name>.png   contact sheet / scrub strip, `columns` tiles per row in pts order
+//   <out>/<name>.json  tile size, grid and the pts of every tile (pts -> tile lookup)
+
+const int DEFAULT_THUMB_WIDTH = 160;
+const int DEFAULT_THUMB_COLUMNS = 10;
+
+struct ThumbnailOptions {
+    std::string output_dir;  // Must exist
+    int tile_width;          // Tile height follows the display aspect ratio
+    int columns;             // Tiles per row; use a large value for a single-row strip
+    double interval;         // At most one tile per `interval` seconds of video (0 = every keyframe)
+    int pool_threads;        // <= 0 sizes the pool to the machine
+};
+
+ThumbnailOptions default_thumbnail_options();
+
+// Inputs are files or directories (their video files, not recursive). Prints per-file results
+// and the overall thumbnails/sec. Returns 0, or a negative error if no input produced a sheet.
+int run_thumbnails(const std::vector<std::string>& inputs, const ThumbnailOptions& options);
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "trace.h"
+
+std::atomic<bool> trace_active(false);
+
+// One ring per traced thread. Only the owning thread writes; `written` counts every event
+// ever recorded, so the slot of event i is i % TRACE_RING_EVENTS.
+struct TraceRing {
+    int tid;
+    char thread_name[32];
+    TraceEvent* events;
+    std::atomic<uint64_t> written;
+};
+
+static std::mutex trace_registry_mutex;
+static std::vector<TraceRing*> trace_rings;
+static char trace_path[260];
+static uint64_t trace_epoch_ns = 0;
+static thread_local TraceRing* thread_ring = nullptr;
+
+uint64_t trace_now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_enable(const char* path) {
+    snprintf(trace_path, sizeof(trace_path), "%s", path);
+    trace_epoch_ns = trace_now_ns();
+    trace_active.store(true);
+    fprintf(stdout, "Tracing to %s\n", trace_path);
+}
+
+// The calling thread's ring, created on its first event (the only time the registry lock is taken)
+static TraceRing* get_thread_ring() {
+    if (thread_ring) {
+        return thread_ring;
+    }
+    TraceRing* ring = new TraceRing();
+    ring->events = new TraceEvent[TRACE_RING_EVENTS];
+    ring->written = 0;
+    ring->thread_name[0] = '\0';
+
+    std::lock_guard<std::mutex> lock(trace_registry_mutex);
+    ring->tid = (int)trace_rings.size() + 1;
+    trace_rings.push_back(ring);
+    thread_ring = ring;
+    return ring;
+}
+
+static void record(const char* name, uint64_t start_ns, uint64_t duration_ns, int64_t arg, int tid, bool instant) {
+    TraceRing* ring = get_thread_ring();
+    uint64_t index = ring->written.load(std::memory_order_relaxed);
+    TraceEvent& e = ring->events[index % TRACE_RING_EVENTS];
+    e.name = name;
+    e.start_ns = start_ns;
+    e.duration_ns = duration_ns;
+    e.arg = arg;
+    e.tid = tid;
+    e.instant = instant;
+    ring->written.store(index + 1, std::memory_order_release);
+}
+
+void trace_set_thread_name(const char* name) {
+    if (!trace_enabled()) {
+        return;
+    }
+    TraceRing* ring = get_thread_ring();
+    std::lock_guard<std::mutex> lock(trace_registry_mutex);
+    snprintf(ring->thread_name, sizeof(ring->thread_name), "%s", name);
+}
+
+void trace_complete(const char* name, uint64_t start_ns, uint64_t end_ns, int64_t arg) {
+    if (!trace_enabled()) {
+        return;
+    }
+    record(name, start_ns, end_ns > start_ns ? end_ns - start_ns : 0, arg, 0, false);
+}
+
+void trace_instant(const char* name, int64_t arg) {
+    if (!trace_enabled()) {
+        return;
+    }
+    record(name, trace_now_ns(), 0, arg, 0, true);
+}
+
+void trace_gpu_complete(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    if (!trace_enabled()) {
+        return;
+    }
+    record(name, start_ns, end_ns > start_ns ? end_ns - start_ns : 0, TRACE_NO_ARG, TRACE_GPU_TID, false);
+}
+
+// Copies the events still in the ring. The owner keeps writing meanwhile, so events it may have
+// overwritten during the copy (older than `written` - ring size after the copy) are discarded.
+static void snapshot_ring(TraceRing* ring, std::vector<TraceEvent>* out) {
+    uint64_t end = ring->written.load(std::memory_order_acquire);
+    uint64_t begin = end > (uint64_t)TRACE_RING_EVENTS ? end - TRACE_RING_EVENTS : 0;
+    size_t first = out->size();
+    for (uint64_t i = begin; i < end; i++) {
+        out->push_back(ring->events[i % TRACE_RING_EVENTS]);
+    }
+
+    uint64_t now_written = ring->written.load(std::memory_order_acquire);
+    uint64_t valid_from = now_written > (uint64_t)TRACE_RING_EVENTS ? now_written - TRACE_RING_EVENTS : 0;
+    if (valid_from > begin) {
+        size_t torn = (size_t)(valid_from - begin < end - begin ? valid_from - begin : end - begin);
+        out->erase(out->begin() + first, out->begin() + first + torn);
+    }
+}
+
+static void write_thread_name(FILE* f, int tid, const char* name, bool* first) {
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+        *first ? "" : ",", tid, name);
+    *first = false;
+}
+
+int trace_dump() {
+    if (trace_path[0] == '\0') {
+        return 0;
+    }
+
+    // Snapshot under the registry lock (threads only take it once, when they first trace)
+    std::vector<TraceEvent> events;
+    std::vector<TraceRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(trace_registry_mutex);
+        rings = trace_rings;
+        for (TraceRing* ring : rings) {
+            size_t first = events.size();
+            snapshot_ring(ring, &events);
+            for (size_t i = first; i < events.size(); i++) {
+                if (events[i].tid == 0) {
+                    events[i].tid = ring->tid;
+                }
+            }
+        }
+    }
+
+    FILE* f = fopen(trace_path, "w");
+    if (!f) {
+        fprintf(stderr, "Could not write the trace to %s\n", trace_path);
+        return -1;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    write_thread_name(f, TRACE_GPU_TID, "GPU", &first);
+    for (TraceRing* ring : rings) {
+        char fallback[32];
+        snprintf(fallback, sizeof(fallback), "thread %d", ring->tid);
+        write_thread_name(f, ring->tid, ring->thread_name[0] ? ring->thread_name : fallback, &first);
+    }
+
+    for (const TraceEvent& e : events) {
+        // Chrome traces are in microseconds
+        double ts = (double)((int64_t)(e.start_ns - trace_epoch_ns)) / 1000.0;
+        if (e.instant) {
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", e.name, e.tid, ts);
+        }
+        else {
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                e.name, e.tid, ts, e.duration_ns / 1000.0);
+        }
+        if (e.arg != TRACE_NO_ARG) {
+            fprintf(f, ",\"args\":{\"value\":%lld}", (long long)e.arg);
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    fprintf(stdout, "Trace: %zu event(s) from %zu thread(s) written to %s\n", events.size(), rings.size(), trace_path);
+    return 0;
+}
+
+void trace_shutdown() {
+    if (!trace_enabled()) {
+        return;
+    }
+    trace_dump();
+    trace_active.store(false);
+
+    std::lock_guard<std::mutex> lock(trace_registry_mutex);
+    for (TraceRing* ring : trace_rings) {
+        delete[] ring->events;
+        delete ring;
+    }
+    trace_rings.clear();
+    thread_ring = nullptr; // Only the calling thread's pointer; the others have exited
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Pipeline tracing exported as Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+//
+// Every thread records events into its own fixed-size ring: one writer, no locks on the hot
+// path, the oldest events are overwritten. The rings are only walked when the trace is dumped,
+// so a dump holds the last TRACE_RING_EVENTS events of each thread. With tracing off a
+// TRACE_SCOPE costs one relaxed atomic load.
+
+const int TRACE_RING_EVENTS = 1 << 16;
+
+// Pseudo thread that GPU timer query results are shown on
+const int TRACE_GPU_TID = 1000;
+
+// No argument attached to the event
+const int64_t TRACE_NO_ARG = INT64_MIN;
+
+struct TraceEvent {
+    const char* name;      // Stored by pointer: string literals only
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    int64_t arg;
+    int tid;
+    bool instant;
+};
+
+extern std::atomic<bool> trace_active;
+
+inline bool trace_enabled() {
+    return trace_active.load(std::memory_order_relaxed);
+}
+
+// Starts recording; the trace is written to `path` by trace_dump() and trace_shutdown().
+void trace_enable(const char* path);
+
+// steady_clock nanoseconds, the time base of every event
+uint64_t trace_now_ns();
+
+// Names the calling thread in the trace. Call at thread start, after trace_enable().
+void trace_set_thread_name(const char* name);
+
+void trace_complete(const char* name, uint64_t start_ns, uint64_t end_ns, int64_t arg = TRACE_NO_ARG);
+void trace_instant(const char* name, int64_t arg = TRACE_NO_ARG);
+
+// GPU work, already converted to trace_now_ns() time; shown on the TRACE_GPU_TID track.
+void trace_gpu_complete(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+// Writes everything currently in the rings. Safe while other threads keep recording.
+// Returns <0 if the file could not be written.
+int trace_dump();
+
+// Final dump and cleanup. Every traced thread must have stopped.
+void trace_shutdown();
+
+// Records the enclosing scope as one complete event.
+struct TraceScope {
+    const char* name;
+    uint64_t start_ns;
+
+    explicit TraceScope(const char* event_name) : name(event_name), start_ns(trace_enabled() ? trace_now_ns() : 0) {}
+    ~TraceScope() {
+        if (start_ns) {
+            trace_complete(name, start_ns, trace_now_ns());
+        }
+    }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
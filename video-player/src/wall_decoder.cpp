@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+#include "wall_decoder.h"
+
+// Frames a decode task produces before handing the worker back to the pool, so one stream
+// can't monopolise a worker while others wait
+static const int WALL_FRAMES_PER_TASK = 2;
+
+// How long video_wall_close() waits for running decode tasks to notice the stop request
+static const double WALL_STOP_TIMEOUT = 2.0;
+
+static void wall_decode_task(void* arg);
+
+static WallStream* open_wall_stream(VideoWall* wall, int index, const std::string& path, int queue_depth, int decode_threads) {
+    WallStream* s = new WallStream();
+    s->wall = wall;
+    s->index = index;
+    s->path = path;
+    s->fmt_ctx = nullptr;
+    s->codec_ctx = nullptr;
+    s->packet = nullptr;
+    s->scratch = nullptr;
+    s->sws_ctx = nullptr;
+    s->queue = nullptr;
+
+    const AVCodec* codec = nullptr;
+    int ret = avformat_open_input(&s->fmt_ctx, path.c_str(), nullptr, nullptr);
+    if (ret >= 0) {
+        ret = avformat_find_stream_info(s->fmt_ctx, nullptr);
+    }
+    if (ret >= 0) {
+        ret = av_find_best_stream(s->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+        s->video_stream_index = ret;
+    }
+    if (ret >= 0) {
+        s->codec_ctx = avcodec_alloc_context3(codec);
+        ret = s->codec_ctx ? avcodec_parameters_to_context(s->codec_ctx, s->fmt_ctx->streams[s->video_stream_index]->codecpar) : AVERROR(ENOMEM);
+    }
+    if (ret >= 0) {
+        // The pool provides the parallelism across streams; decoder threads only use what is left over
+        s->codec_ctx->thread_count = decode_threads;
+        s->codec_ctx->thread_type = decode_threads > 1 ? FF_THREAD_FRAME | FF_THREAD_SLICE : 0;
+        ret = avcodec_open2(s->codec_ctx, codec, nullptr);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Wall: could not open %s\n", path.c_str());
+        print_ffmpeerr(ret);
+        avcodec_free_context(&s->codec_ctx);
+        avformat_close_input(&s->fmt_ctx);
+        delete s;
+        return nullptr;
+    }
+
+    AVStream* stream = s->fmt_ctx->streams[s->video_stream_index];
+    AVRational frame_rate = av_guess_frame_rate(s->fmt_ctx, stream, nullptr);
+    s->time_base = stream->time_base;
+    s->frame_delay = frame_rate.num > 0 && frame_rate.den > 0 ? 1.0 / av_q2d(frame_rate) : 1.0 / 30.0;
+    s->width = s->codec_ctx->width;
+    s->height = s->codec_ctx->height;
+    s->loop_offset = 0.0;
+    s->first_pts = 0.0;
+    s->have_first_pts = false;
+    s->last_pts = -1.0;
+
+    s->packet = av_packet_alloc();
+    s->scratch = av_frame_alloc();
+    s->queue = new SpscRing<DecodedFrame>(queue_depth);
+    s->scheduled = false;
+    s->failed = false;
+    s->frames_decoded = 0;
+    s->decode_seconds = 0.0;
+    s->decode_max_seconds = 0.0;
+    s->loops = 0;
+    s->start_time = -1.0;
+    s->frames_presented = 0;
+    s->frames_dropped = 0;
+    s->underruns = 0;
+
+    fprintf(stdout, "Wall stream %d: %s, %s %dx%d @ %.2f fps\n", index, path.c_str(), codec->name,
+        s->width, s->height, 1.0 / s->frame_delay);
+    return s;
+}
+
+static void close_wall_stream(WallStream* s) {
+    while (DecodedFrame* item = s->queue->front()) {
+        av_frame_free(&item->frame);
+        s->queue->pop();
+    }
+    delete s->queue;
+    sws_freeContext(s->sws_ctx);
+    av_frame_free(&s->scratch);
+    av_packet_free(&s->packet);
+    avcodec_free_context(&s->codec_ctx);
+    avformat_close_input(&s->fmt_ctx);
+    delete s;
+}
+
+// Rewinds a stream at end of file. Timestamps continue from the last frame so the render
+// thread's clock for the stream never goes backwards.
+static int loop_wall_stream(WallStream* s) {
+    int ret = av_seek_frame(s->fmt_ctx, s->video_stream_index, 0, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        return ret;
+    }
+    avcodec_flush_buffers(s->codec_ctx);
+    s->loop_offset = s->last_pts + s->frame_delay - s->first_pts;
+    s->loops++;
+    return 0;
+}
+
+// Demuxes and decodes until one frame comes out (same receive-before-read order as decode_video.cpp).
+static int wall_decode_frame(WallStream* s) {
+    bool looped = false;
+    while (true) {
+        int ret = avcodec_receive_frame(s->codec_ctx, s->scratch);
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret == AVERROR_EOF) {
+            // Nothing decodable in the file (or since the last rewind): don't spin
+            if (looped || s->frames_decoded.load() == 0) {
+                return AVERROR_EOF;
+            }
+            ret = loop_wall_stream(s);
+            if (ret < 0) {
+                return ret;
+            }
+            looped = true;
+            continue;
+        }
+        if (ret != AVERROR(EAGAIN)) {
+            return ret;
+        }
+
+        ret = av_read_frame(s->fmt_ctx, s->packet);
+        if (ret == AVERROR_EOF) {
+            avcodec_send_packet(s->codec_ctx, nullptr); // Drain, then loop
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        if (s->packet->stream_index == s->video_stream_index) {
+            ret = avcodec_send_packet(s->codec_ctx, s->packet);
+            if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+                print_ffmpeerr(ret); // A corrupt packet in a feed costs a frame, not the stream
+            }
+        }
+        av_packet_unref(s->packet);
+    }
+}
+
+// Hands the scratch frame over as a queue item, converted to YUV420P if the wall can't show it directly.
+static int make_wall_item(WallStream* s, DecodedFrame* item) {
+    item->frame = av_frame_alloc();
+    if (!item->frame) {
+        return AVERROR(ENOMEM);
+    }
+
+    int64_t ts = s->scratch->pts != AV_NOPTS_VALUE ? s->scratch->pts : s->scratch->best_effort_timestamp;
+    double pts = ts != AV_NOPTS_VALUE ? ts * av_q2d(s->time_base) : s->last_pts + s->frame_delay - s->loop_offset;
+    if (!s->have_first_pts) {
+        s->first_pts = pts;
+        s->have_first_pts = true;
+    }
+    item->pts = pts + s->loop_offset;
+    item->serial = 0;
+    item->playlist_item = 0;
+    item->source_ns = 0;
+    s->last_pts = item->pts;
+
+    AVPixelFormat format = (AVPixelFormat)s->scratch->format;
+    if (format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P) {
+        av_frame_move_ref(item->frame, s->scratch);
+        return 0;
+    }
+
+    s->sws_ctx = sws_getCachedContext(s->sws_ctx, s->scratch->width, s->scratch->height, format,
+        s->scratch->width, s->scratch->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    item->frame->format = AV_PIX_FMT_YUV420P;
+    item->frame->width = s->scratch->width;
+    item->frame->height = s->scratch->height;
+    int ret = s->sws_ctx ? av_frame_get_buffer(item->frame, 32) : AVERROR(EINVAL);
+    if (ret >= 0) {
+        sws_scale(s->sws_ctx, s->scratch->data, s->scratch->linesize, 0, s->scratch->height,
+            item->frame->data, item->frame->linesize);
+    }
+    av_frame_unref(s->scratch);
+    if (ret < 0) {
+        av_frame_free(&item->frame);
+    }
+    return ret;
+}
+
+static bool queue_has_room(WallStream* s) {
+    return s->queue->size() < s->queue->depth();
+}
+
+static void wall_decode_task(void* arg) {
+    WallStream* s = (WallStream*)arg;
+    VideoWall* wall = s->wall;
+
+    for (int i = 0; i < WALL_FRAMES_PER_TASK && queue_has_room(s) && !wall->stop_requested.load(); i++) {
+        auto start = std::chrono::steady_clock::now();
+        DecodedFrame item;
+        int ret = wall_decode_frame(s);
+        if (ret >= 0) {
+            ret = make_wall_item(s, &item);
+        }
+        if (ret < 0) {
+            fprintf(stderr, "Wall stream %d stopped decoding: ", s->index);
+            print_ffmpeerr(ret);
+            s->failed.store(true);
+            s->scheduled.store(false);
+            return;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        s->decode_seconds += seconds;
+        if (seconds > s->decode_max_seconds) {
+            s->decode_max_seconds = seconds;
+        }
+        s->frames_decoded.fetch_add(1);
+        s->queue->push(item); // Only this task produces, and there was room
+    }
+
+    // Keep going while there is room; otherwise go idle until the render thread kicks the stream
+    if (!wall->stop_requested.load() && queue_has_room(s)) {
+        task_pool_submit(wall->pool, wall_decode_task, s);
+        return;
+    }
+    s->scheduled.store(false);
+    if (queue_has_room(s)) {
+        video_wall_kick(wall, s); // Room was made between the check and the store
+    }
+}
+
+VideoWall* video_wall_open(const std::vector<std::string>& paths, int queue_depth, int pool_threads) {
+    VideoWall* wall = new VideoWall();
+    wall->stop_requested = false;
+    wall->pool = task_pool_create(pool_threads);
+
+    int workers = (int)wall->pool->workers.size();
+    int streams = (int)paths.size();
+    int decode_threads = streams >= workers ? 1 : workers / streams;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        WallStream* s = open_wall_stream(wall, (int)wall->streams.size(), paths[i], queue_depth, decode_threads);
+        if (s) {
+            wall->streams.push_back(s);
+        }
+    }
+    if (wall->streams.empty()) {
+        fprintf(stderr, "Wall: no input could be opened\n");
+        task_pool_destroy(wall->pool);
+        delete wall;
+        return nullptr;
+    }
+    return wall;
+}
+
+void video_wall_start(VideoWall* wall) {
+    for (WallStream* s : wall->streams) {
+        video_wall_kick(wall, s);
+    }
+}
+
+void video_wall_kick(VideoWall* wall, WallStream* stream) {
+    bool expected = false;
+    if (wall->stop_requested.load() || stream->failed.load() || !stream->scheduled.compare_exchange_strong(expected, true)) {
+        return;
+    }
+    task_pool_submit(wall->pool, wall_decode_task, stream);
+}
+
+static void print_wall_stats(const VideoWall* wall) {
+    fprintf(stdout, "Stream  decoded  avg ms  max ms  presented  dropped  underruns  loops  input\n");
+    for (const WallStream* s : wall->streams) {
+        long long decoded = s->frames_decoded.load();
+        fprintf(stdout, "%6d  %7lld  %6.2f  %6.2f  %9lld  %7lld  %9lld  %5d  %s\n", s->index, decoded,
+            decoded > 0 ? 1000.0 * s->decode_seconds / decoded : 0.0, 1000.0 * s->decode_max_seconds,
+            s->frames_presented, s->frames_dropped, s->underruns, s->loops, s->path.c_str());
+    }
+    task_pool_print_stats(wall->pool);
+}
+
+void video_wall_close(VideoWall* wall) {
+    if (!wall) {
+        return;
+    }
+
+    // Decode tasks finish their current frame and don't resubmit
+    wall->stop_requested.store(true);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(WALL_STOP_TIMEOUT);
+    for (WallStream* s : wall->streams) {
+        while (s->scheduled.load() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    print_wall_stats(wall);
+    task_pool_destroy(wall->pool);
+    for (WallStream* s : wall->streams) {
+        close_wall_stream(s);
+    }
+    delete wall;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include<libavcodec/avcodec.h>
+#include<libavformat/avformat.h>
+#include<libswscale/swscale.h>
+}
+
+#include "decode_video.h"
+#include "frame_queue.h"
+#include "task_pool.h"
+
+// Decoding for the multi-stream video wall.
+//
+// Every input gets its own demuxer/decoder context (the single-stream player keeps its state in
+// globals in decode_video.cpp), and all of them are decoded on one shared work-stealing pool
+// instead of one thread per stream. A stream is decoded by at most one task at a time: the task
+// decodes a few frames into the stream's queue and resubmits itself until the queue is full; the
+// render thread kicks it again after taking frames out. Files loop, so the wall runs until closed.
+
+struct VideoWall;
+
+struct WallStream {
+    VideoWall* wall;
+    int index;
+    std::string path;
+
+    AVFormatContext* fmt_ctx;
+    AVCodecContext* codec_ctx;
+    AVPacket* packet;
+    AVFrame* scratch;
+    SwsContext* sws_ctx;         // Only for inputs that don't decode to YUV420P
+    int video_stream_index;
+    AVRational time_base;
+    double frame_delay;
+    int width;
+    int height;
+
+    // Continuous timeline across loops: pts + loop_offset
+    double loop_offset;
+    double first_pts;             // Of the first decoded frame; negative start times are valid
+    bool have_first_pts;
+    double last_pts;
+
+    SpscRing<DecodedFrame>* queue;
+    std::atomic<bool> scheduled;  // A decode task is queued or running
+    std::atomic<bool> failed;
+
+    // Decoder-side statistics (written by whichever task runs the stream)
+    std::atomic<long long> frames_decoded;
+    double decode_seconds;
+    double decode_max_seconds;
+    int loops;
+
+    // Render-side state and statistics
+    double start_time;           // Display time of pts 0; < 0 until the first frame
+    long long frames_presented;
+    long long frames_dropped;    // Superseded before they were shown
+    long long underruns;         // Vblanks where the stream had no frame ready
+};
+
+struct VideoWall {
+    std::vector<WallStream*> streams;
+    TaskPool* pool;
+    std::atomic<bool> stop_requested;
+};
+
+// Opens every input; inputs that fail to open are skipped. Returns nullptr if none opened.
+// pool_threads <= 0 sizes the pool to the machine.
+VideoWall* video_wall_open(const std::vector<std::string>& paths, int queue_depth, int pool_threads);
+
+// Starts decoding every stream on the pool.
+void video_wall_start(VideoWall* wall);
+
+// Render thread: call after popping frames from stream->queue so its decode task runs again.
+void video_wall_kick(VideoWall* wall, WallStream* stream);
+
+// Stops decoding, prints per-stream statistics and frees everything.
+void video_wall_close(VideoWall* wall);
@@ -0,0 +1,60 @@
+#include "yuv_format.h"
+
+static const YUVFormatLayout YUV_FORMAT_LAYOUTS[] = {
+    // format                   planes shift_x shift_y bytes depth msb
+    { AV_PIX_FMT_YUV420P,       3, 1, 1, 1, 8,  false },
+    { AV_PIX_FMT_YUVJ420P,      3, 1, 1, 1, 8,  false },
+    { AV_PIX_FMT_YUV422P,       3, 1, 0, 1, 8,  false },
+    { AV_PIX_FMT_YUVJ422P,      3, 1, 0, 1, 8,  false },
+    { AV_PIX_FMT_YUV444P,       3, 0, 0, 1, 8,  false },
+    { AV_PIX_FMT_YUVJ444P,      3, 0, 0, 1, 8,  false },
+    { AV_PIX_FMT_NV12,          2, 1, 1, 1, 8,  false },
+    { AV_PIX_FMT_YUV420P10LE,   3, 1, 1, 2, 10, false },
+    { AV_PIX_FMT_YUV422P10LE,   3, 1, 0, 2, 10, false },
+    { AV_PIX_FMT_YUV444P10LE,   3, 0, 0, 2, 10, false },
+    { AV_PIX_FMT_YUV420P12LE,   3, 1, 1, 2, 12, false },
+    { AV_PIX_FMT_YUV422P12LE,   3, 1, 0, 2, 12, false },
+    { AV_PIX_FMT_YUV444P12LE,   3, 0, 0, 2, 12, false },
+    { AV_PIX_FMT_P010LE,        2, 1, 1, 2, 10, true },
+};
+
+const YUVFormatLayout* yuv_format_layout(int format) {
+    for (const YUVFormatLayout& layout : YUV_FORMAT_LAYOUTS) {
+        if (layout.format == format) {
+            return &layout;
+        }
+    }
+    return nullptr;
+}
+
+void yuv_plane_size(const YUVFormatLayout* layout, int plane, int width, int height, int* plane_width, int* plane_height) {
+    if (plane == 0) {
+        *plane_width = width;
+        *plane_height = height;
+        return;
+    }
+    // Rounded up: odd sizes still have a chroma sample for the last column/row
+    *plane_width = (width + (1 << layout->chroma_shift_x) - 1) >> layout->chroma_shift_x;
+    *plane_height = (height + (1 << layout->chroma_shift_y) - 1) >> layout->chroma_shift_y;
+}
+
+int yuv_plane_components(const YUVFormatLayout* layout, int plane) {
+    return plane > 0 && layout->plane_count == 2 ? 2 : 1;
+}
+
+size_t yuv_frame_size(const YUVFormatLayout* layout, int width, int height) {
+    size_t size = 0;
+    for (int i = 0; i < layout->plane_count; i++) {
+        int w, h;
+        yuv_plane_size(layout, i, width, height, &w, &h);
+        size += (size_t)w * h * yuv_plane_components(layout, i) * layout->bytes_per_sample;
+    }
+    return size;
+}
+
+double yuv_sample_scale(const YUVFormatLayout* layout) {
+    if (layout->bytes_per_sample == 1 || layout->msb_aligned) {
+        return 1.0;
+    }
+    return 65535.0 / ((1 << layout->bit_depth) - 1);
+}
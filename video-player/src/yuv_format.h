@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+
+extern "C" {
+#include<libavutil/pixfmt.h>
+}
+
+// Memory layout of the decoded YUV formats the player shows without converting them.
+//
+// Planar formats have three planes (Y, U, V), semi-planar ones (NV12, P010) two: Y and
+// interleaved UV, uploaded as a two-component texture. Chroma planes are smaller by the
+// subsampling shifts (4:2:0: both, 4:2:2: horizontal only, 4:4:4: none). Formats deeper than
+// 8 bits keep each sample in 16 bits, in the low bits (yuv420p10le) or the high bits (p010le).
+
+struct YUVFormatLayout {
+    AVPixelFormat format;
+    int plane_count;        // 3 = Y, U, V; 2 = Y, interleaved UV
+    int chroma_shift_x;     // log2 of the horizontal chroma subsampling
+    int chroma_shift_y;     // log2 of the vertical chroma subsampling
+    int bytes_per_sample;   // 1, or 2 for deeper than 8 bits
+    int bit_depth;
+    bool msb_aligned;       // Samples in the high bits of their 16-bit word
+};
+
+// nullptr when the format can't be shown without conversion (RGB, hardware frames, big endian, ...)
+const YUVFormatLayout* yuv_format_layout(int format);
+
+// Size of a plane in texels, and the components per texel (2 for interleaved UV)
+void yuv_plane_size(const YUVFormatLayout* layout, int plane, int width, int height, int* plane_width, int* plane_height);
+int yuv_plane_components(const YUVFormatLayout* layout, int plane);
+
+// Bytes of a frame with every plane tightly packed
+size_t yuv_frame_size(const YUVFormatLayout* layout, int width, int height);
+
+// Factor from a normalized 16-bit texture sample to [0, 1]: 65535 / (2^depth - 1) for samples in
+// the low bits, 1 otherwise
+double yuv_sample_scale(const YUVFormatLayout* layout);